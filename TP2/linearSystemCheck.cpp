@@ -0,0 +1,54 @@
+// -------------------------------------------
+// linearSystemCheck : the product by A before
+// preprocess() (multiplyAby) applies the writes
+// of each entry as preprocess() does: = sets it,
+// the last value given wins , += adds to it.
+//   make check
+// -------------------------------------------
+
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+
+#include "src/linearSystem.h"
+
+using namespace std;
+
+
+int main () {
+    linearSystem system;
+    system.setDimensions( 2 , 2 );
+    system.A(0,0) = 1.0;
+    system.A(0,0) = 2.0;    // overwrites the 1
+    system.A(1,1) += 1.0;
+    system.A(1,0) = 5.0;
+    system.A(1,1) += 2.0;
+    system.A(1,0) += 1.0;
+    system.A(1,0) = 4.0;    // overwrites the 5 + 1
+    system.b(0) = 2.0;
+    system.b(1) = 7.0;
+
+    Eigen::VectorXd X(2) , expected(2) , AX;
+    X << 1.0 , 1.0;
+    expected << 2.0 , 7.0;
+    Eigen::VectorXd beforePreprocess = system.multiplyAby( X );
+
+    system.preprocess();
+    system.multiplyA( X , AX );
+    Eigen::VectorXd afterPreprocess = system.multiplyAby( X );
+
+    Eigen::VectorXd solution;
+    system.solve( solution );
+
+    bool ok = true;
+    if( ( beforePreprocess - expected ).norm() > 1e-12 ) { cerr << "multiplyAby before preprocess(): " << beforePreprocess.transpose() << endl; ok = false; }
+    if( ( AX - expected ).norm() > 1e-12 ) { cerr << "multiplyA after preprocess(): " << AX.transpose() << endl; ok = false; }
+    if( ( afterPreprocess - expected ).norm() > 1e-12 ) { cerr << "multiplyAby after preprocess(): " << afterPreprocess.transpose() << endl; ok = false; }
+    if( ! system.factorizationIsOk()  ||  ( solution - X ).norm() > 1e-9 ) { cerr << "solve: " << solution.transpose() << endl; ok = false; }
+    if( ! ok ) {
+        cerr << "linearSystemCheck: failed" << endl;
+        return EXIT_FAILURE;
+    }
+    cout << "linearSystemCheck: ok" << endl;
+    return EXIT_SUCCESS;
+}
@@ -8,11 +8,14 @@
 #include <cstdlib>
 
 #include <algorithm>
+#include <thread>
+#include <chrono>
 #include <GL/glut.h>
 #include "src/Vec3.h"
 #include "src/Camera.h"
 #include "src/Mesh.h"
 #include "src/Skeleton.h"
+#include "src/RenderScheduler.h"
 
 
 
@@ -48,6 +51,11 @@ int displayMode = 0;
 // 1 : show procedural anim
 // 2 : show current manipulation for Inverse Kinematics
 
+// frames are drawn when something changed, and continuously during the procedural anim only
+// (key 'p': frame pacing , 'h': draw and solve times , the solves being the procedural anim and the IK updates)
+RenderScheduler renderScheduler;
+std::string frameTimesFileName = "frame_times.csv";
+
 
 void printUsage () {
     cerr << endl
@@ -57,6 +65,8 @@ void printUsage () {
          << " ?: Print help" << endl
          << " w: Toggle Wireframe Mode" << endl
          << " f: Toggle full screen mode" << endl
+         << " p: Cycle frame pacing (none / 60 Hz / 30 Hz)" << endl
+         << " h: Print the draw and solve time percentiles and write them to frame_times.csv" << endl
          << " <drag>+<left button>: rotate model" << endl
          << " <drag>+<right button>: move model" << endl
          << " <drag>+<middle button>: zoom" << endl << endl;
@@ -123,29 +133,50 @@ void draw () {
 
 
 void display () {
+    Timer frameTimer;
+    renderScheduler.beginFrame();
     glLoadIdentity ();
     glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     camera.apply ();
     draw ();
     glFlush ();
+    renderScheduler.addDrawMs( frameTimer.elapsedMs() );   // without the wait for the buffer swap
     glutSwapBuffers ();
 }
 
 void moveTargetArticulationBy( Vec3 translation ) {
     if( targetArticulation > -1  &&  targetArticulation < skeleton.articulations.size() ) {
         Vec3 newPos = skeletonTransfoIK.articulations_transformed_position[ targetArticulation ] + translation;
+        Timer solveTimer;
         skeleton.updateIKChain( skeletonTransfoIK, targetArticulation , newPos );
+        renderScheduler.addSolveMs( solveTimer.elapsedMs() );
     }
 }
 
 void updateProceduralAnim(){
     float currentTime = glutGet ((GLenum)GLUT_ELAPSED_TIME);
+    Timer solveTimer;
     skeleton.computeProceduralAnim( 0.001 * currentTime , skeletonTransfo );
+    renderScheduler.addSolveMs( solveTimer.elapsedMs() );
 }
 
 void idle () {
-    updateProceduralAnim();
-    glutPostRedisplay ();
+    renderScheduler.setAnimating( displayMode == 1 );
+    if( renderScheduler.frameIsDue() ) {
+        if( renderScheduler.isAnimating() ) updateProceduralAnim();
+        glutPostRedisplay ();
+    }
+    else if( renderScheduler.hasPendingFrame() )
+        // waiting for the pacing: poll every millisecond at most
+        std::this_thread::sleep_for( std::chrono::microseconds( (long long)( 1000.0 * std::min( renderScheduler.msUntilNextFrame() , 1.0 ) ) + 100 ) );
+    else
+        glutIdleFunc (0);   // nothing to do before the next event
+}
+
+// from the input callbacks: something to draw
+void requestRedraw () {
+    renderScheduler.requestRedraw();
+    glutIdleFunc (idle);
 }
 
 void key (unsigned char keyPressed, int x, int y) {
@@ -183,10 +214,23 @@ void key (unsigned char keyPressed, int x, int y) {
     case 'm':
         displayMode = (displayMode + 1) % 3;
         if( displayMode == 2 ) {
+            updateProceduralAnim();   // the anim is only computed while it is shown
             skeletonTransfoIK = skeletonTransfo;
         }
         break;
 
+    case 'p':
+        renderScheduler.setMinimumFrameMs( renderScheduler.minimumFrameMs() == 0.0 ? 1000.0 / 60.0 : renderScheduler.minimumFrameMs() < 20.0 ? 1000.0 / 30.0 : 0.0 );
+        if( renderScheduler.minimumFrameMs() == 0.0 ) cout << "Frame pacing: none" << endl;
+        else cout << "Frame pacing: " << renderScheduler.minimumFrameMs() << " ms between frames" << endl;
+        break;
+
+    case 'h':
+        renderScheduler.print( cout );
+        if( renderScheduler.writeCsv( frameTimesFileName ) ) cout << "Frame times written to " << frameTimesFileName << endl;
+        else cerr << "main: cannot write " << frameTimesFileName << endl;
+        break;
+
     case 'w':
         GLint polygonMode[2];
         glGetIntegerv(GL_POLYGON_MODE, polygonMode);
@@ -200,7 +244,7 @@ void key (unsigned char keyPressed, int x, int y) {
         printUsage ();
         break;
     }
-    idle ();
+    requestRedraw ();
 }
 void specialKey(int key, int x, int y)
 {
@@ -227,7 +271,7 @@ void specialKey(int key, int x, int y)
         }
         break;
     }
-    idle ();
+    requestRedraw ();
 }
 
 void mouse (int button, int state, int x, int y) {
@@ -256,7 +300,7 @@ void mouse (int button, int state, int x, int y) {
             }
         }
     }
-    idle ();
+    requestRedraw ();
 }
 
 void motion (int x, int y) {
@@ -272,11 +316,13 @@ void motion (int x, int y) {
         camera.zoom ( 10.f * (float)(y-lastZoom)/SCREENHEIGHT);
         lastZoom = y;
     }
+    requestRedraw ();
 }
 
 
 void reshape(int w, int h) {
     camera.resize (w, h);
+    requestRedraw ();
 }
 
 
@@ -0,0 +1,135 @@
+#ifndef ThreadPool_H
+#define ThreadPool_H
+
+// Same code as arap/src/ThreadPool.h (TP2 is built on its own).
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+
+
+//-------------------------------------------------------------------------------------//
+//
+// Persistent pool of worker threads, used to run loops whose iterations are independent.
+//   The calling thread takes part in the work, so a pool of N threads runs N-1 workers.
+//   parallelFor() does not allocate: the functor is passed by address to the workers.
+//
+//-------------------------------------------------------------------------------------//
+class ThreadPool {
+    typedef void (*ChunkFunction)( void * data , unsigned int begin , unsigned int end , unsigned int threadIndex );
+
+    std::vector< std::thread > _workers;
+    std::mutex _mutex;
+    std::condition_variable _wakeUp , _finished;
+    unsigned int _generation;
+    unsigned int _busyWorkers;
+    bool _stop;
+
+    ChunkFunction _function;
+    void * _data;
+    unsigned int _end , _chunkSize;
+    std::atomic< unsigned int > _nextChunkBegin;
+
+    template< class F >
+    static void callChunk( void * data , unsigned int begin , unsigned int end , unsigned int threadIndex ) {
+        (*static_cast< F * >(data))( begin , end , threadIndex );
+    }
+
+    void runChunks( unsigned int threadIndex ) {
+        for( ;; ) {
+            unsigned int begin = _nextChunkBegin.fetch_add( _chunkSize );
+            if( begin >= _end ) return;
+            _function( _data , begin , std::min( begin + _chunkSize , _end ) , threadIndex );
+        }
+    }
+
+    // seenGeneration : the generation when the worker was created, a worker that starts late must still
+    // take part in the loops launched since then (the caller waits for all the workers)
+    void workerLoop( unsigned int threadIndex , unsigned int seenGeneration ) {
+        for( ;; ) {
+            {
+                std::unique_lock< std::mutex > lock(_mutex);
+                _wakeUp.wait( lock , [&]{ return _stop || _generation != seenGeneration; } );
+                if( _stop ) return;
+                seenGeneration = _generation;
+            }
+            runChunks( threadIndex );
+            {
+                std::lock_guard< std::mutex > lock(_mutex);
+                if( --_busyWorkers == 0 ) _finished.notify_one();
+            }
+        }
+    }
+
+    void stopWorkers() {
+        {
+            std::lock_guard< std::mutex > lock(_mutex);
+            _stop = true;
+        }
+        _wakeUp.notify_all();
+        for( unsigned int t = 0 ; t < _workers.size() ; ++t ) _workers[t].join();
+        _workers.clear();
+        _stop = false;
+    }
+
+public:
+    ThreadPool( unsigned int numberOfThreads = 0 ) : _generation(0) , _busyWorkers(0) , _stop(false) , _function(0) , _data(0) , _end(0) , _chunkSize(1) {
+        setNumberOfThreads( numberOfThreads );
+    }
+    ~ThreadPool() {
+        stopWorkers();
+    }
+
+    static unsigned int defaultNumberOfThreads() {
+        return std::max( 1u , std::thread::hardware_concurrency() );
+    }
+
+    // 0 means one thread per hardware core
+    void setNumberOfThreads( unsigned int numberOfThreads ) {
+        if( numberOfThreads == 0 ) numberOfThreads = defaultNumberOfThreads();
+        stopWorkers();
+        for( unsigned int t = 1 ; t < numberOfThreads ; ++t )
+            _workers.push_back( std::thread( &ThreadPool::workerLoop , this , t , _generation ) );
+    }
+
+    unsigned int numberOfThreads() const {
+        return _workers.size() + 1;
+    }
+
+    // f( chunkBegin , chunkEnd , threadIndex ) , threadIndex in [0 , numberOfThreads()[
+    template< class F >
+    void parallelForChunks( unsigned int begin , unsigned int end , F const & f , unsigned int chunkSize = 0 ) {
+        if( end <= begin ) return;
+        if( _workers.empty() ) { f( begin , end , 0 ); return; }
+        if( chunkSize == 0 ) chunkSize = std::max( 1u , ( end - begin ) / ( 8 * numberOfThreads() ) );
+
+        {
+            std::lock_guard< std::mutex > lock(_mutex);
+            _function = &ThreadPool::callChunk< F const >;
+            _data = const_cast< void * >( static_cast< void const * >( &f ) );
+            _end = end;
+            _chunkSize = chunkSize;
+            _nextChunkBegin = begin;
+            _busyWorkers = _workers.size();
+            ++_generation;
+        }
+        _wakeUp.notify_all();
+        runChunks( 0 );
+
+        std::unique_lock< std::mutex > lock(_mutex);
+        _finished.wait( lock , [&]{ return _busyWorkers == 0; } );
+    }
+
+    // f( i ) for i in [begin , end[
+    template< class F >
+    void parallelFor( unsigned int begin , unsigned int end , F const & f , unsigned int chunkSize = 0 ) {
+        parallelForChunks( begin , end , [&f]( unsigned int b , unsigned int e , unsigned int ) {
+            for( unsigned int i = b ; i < e ; ++i ) f(i);
+        } , chunkSize );
+    }
+};
+
+#endif // ThreadPool_H
@@ -0,0 +1,23 @@
+#ifndef Timer_H
+#define Timer_H
+
+// Same code as arap/src/Timer.h (TP2 is built on its own).
+
+#include <chrono>
+
+// Wall-clock stopwatch, in milliseconds.
+struct Timer {
+    std::chrono::steady_clock::time_point start;
+
+    Timer() { restart(); }
+
+    void restart() {
+        start = std::chrono::steady_clock::now();
+    }
+
+    double elapsedMs() const {
+        return std::chrono::duration< double , std::milli >( std::chrono::steady_clock::now() - start ).count();
+    }
+};
+
+#endif // Timer_H
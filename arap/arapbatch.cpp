@@ -0,0 +1,135 @@
+// -------------------------------------------
+// arapbatch : offline ARAP deformations.
+//
+// Runs jobs (mesh , handle script , output mesh)
+// without display, several at the same time:
+// each job loads its mesh, runs the script (see
+// src/ArapScript.h) and writes the deformed mesh.
+// -------------------------------------------
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#include <dirent.h>
+
+#include "src/ArapJob.h"
+#include "src/ThreadPool.h"
+#include "src/Timer.h"
+
+using namespace std;
+
+
+void printUsage() {
+    cerr << "Usage : ./arapbatch <file.off> <handles script> <output.off> [options]" << endl
+         << "        ./arapbatch --directory <input directory> <handles script> <output directory> [options]" << endl
+         << "        ./arapbatch --jobs-file <file> [options]      one job per line: <file.off> <handles script> <output.off>" << endl
+         << "  options: --jobs N                jobs run at the same time (one per core by default)" << endl
+         << "           --threads-per-job N     threads of the solver of each job (1 by default)" << endl
+         << "           --memory-budget MB      jobs whose estimated memory is larger fail without solving" << endl
+         << "           --cache directory       reads (or writes) the weights and factorizations of the meshes there" << endl;
+}
+
+bool hasOffExtension( std::string const & fileName ) {
+    return fileName.size() > 4  &&  fileName.compare( fileName.size() - 4 , 4 , ".off" ) == 0;
+}
+
+// every .off file of inputDirectory , written with the same name in outputDirectory
+bool addDirectoryJobs( std::string const & inputDirectory , std::string const & scriptFile , std::string const & outputDirectory ,
+                       std::vector< ArapJob > & jobs ) {
+    DIR * directory = opendir( inputDirectory.c_str() );
+    if( !directory ) return false;
+    std::vector< std::string > names;
+    while( dirent * entry = readdir( directory ) )
+        if( hasOffExtension( entry->d_name ) ) names.push_back( entry->d_name );
+    closedir( directory );
+    std::sort( names.begin() , names.end() );
+    for( unsigned int i = 0 ; i < names.size() ; ++i )
+        jobs.push_back( ArapJob( inputDirectory + "/" + names[i] , scriptFile , outputDirectory + "/" + names[i] ) );
+    return true;
+}
+
+bool addJobsOfFile( std::string const & jobsFile , std::vector< ArapJob > & jobs ) {
+    std::ifstream in( jobsFile.c_str() );
+    if( !in ) return false;
+    std::string line;
+    while( std::getline( in , line ) ) {
+        line = line.substr( 0 , line.find('#') );
+        std::istringstream fields( line );
+        ArapJob job;
+        if( fields >> job.meshFile >> job.scriptFile >> job.outputFile ) jobs.push_back( job );
+    }
+    return true;
+}
+
+int main( int argc , char ** argv ) {
+    std::vector< ArapJob > jobs;
+    unsigned int numberOfConcurrentJobs = 0;
+    ArapJobSettings settings;
+    std::vector< std::string > positional;
+    bool jobsAreListed = false;
+    for( int a = 1 ; a < argc ; ++a ) {
+        std::string option = argv[a];
+        if( option == "--jobs"  &&  a + 1 < argc ) numberOfConcurrentJobs = std::atoi( argv[++a] );
+        else if( option == "--threads-per-job"  &&  a + 1 < argc ) settings.numberOfThreads = std::max( std::atoi( argv[++a] ) , 1 );
+        else if( option == "--memory-budget"  &&  a + 1 < argc ) settings.memoryBudgetBytes = (unsigned long long)( std::atof( argv[++a] ) * 1024.0 * 1024.0 );
+        else if( option == "--cache"  &&  a + 1 < argc ) settings.cacheDirectory = argv[++a];
+        else if( option == "--directory"  &&  a + 3 < argc ) {
+            if( ! addDirectoryJobs( argv[a+1] , argv[a+2] , argv[a+3] , jobs ) ) {
+                cerr << "arapbatch: cannot open the directory " << argv[a+1] << endl;
+                return EXIT_FAILURE;
+            }
+            jobsAreListed = true;
+            a += 3;
+        }
+        else if( option == "--jobs-file"  &&  a + 1 < argc ) {
+            if( ! addJobsOfFile( argv[++a] , jobs ) ) {
+                cerr << "arapbatch: cannot open " << argv[a] << endl;
+                return EXIT_FAILURE;
+            }
+            jobsAreListed = true;
+        }
+        else if( option.compare( 0 , 2 , "--" ) != 0 ) positional.push_back( option );
+        else {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+    }
+    if( positional.size() == 3 ) jobs.push_back( ArapJob( positional[0] , positional[1] , positional[2] ) );
+    else if( ! positional.empty()  ||  ! jobsAreListed ) {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+
+    // the jobs are independent: one job per task , the solver of each job has its own threads
+    if( numberOfConcurrentJobs == 0 )
+        numberOfConcurrentJobs = std::max( 1u , ThreadPool::defaultNumberOfThreads() / settings.numberOfThreads );
+    ThreadPool jobPool( std::min< unsigned int >( numberOfConcurrentJobs , std::max< unsigned int >( jobs.size() , 1 ) ) );
+    std::mutex outputMutex;
+    unsigned int failedJobs = 0;
+    Timer timer;
+    jobPool.parallelFor( 0 , jobs.size() , [&]( unsigned int j ) {
+        ArapJobResult result = runArapJob( jobs[j] , settings );
+        std::lock_guard< std::mutex > lock( outputMutex );
+        if( result.ok ) {
+            cout << jobs[j].outputFile << ": " << result.numberOfVertices << " vertices , " << result.frames << " frames , "
+                 << result.iterations << " iterations , energy " << result.energy << " , " << result.totalMs << " ms , estimated "
+                 << ( result.estimatedBytes >> 10 ) << " KB" << endl;
+        }
+        else {
+            cerr << "arapbatch: " << jobs[j].meshFile << ": " << result.error << endl;
+            ++failedJobs;
+        }
+    } , 1 );
+    double totalMs = timer.elapsedMs();
+
+    cout << jobs.size() - failedJobs << " / " << jobs.size() << " jobs in " << totalMs << " ms ("
+         << jobPool.numberOfThreads() << " at a time , " << settings.numberOfThreads << " threads per job)" << endl;
+    return failedJobs == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
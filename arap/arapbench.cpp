@@ -0,0 +1,463 @@
+// -------------------------------------------
+// arapbench : headless ARAP benchmark.
+//
+// Loads a mesh, builds handles and moves them as
+// described by a script, runs the ARAP iterations
+// after each move (as gmini does) and reports the
+// time spent in each phase as JSON.
+// -------------------------------------------
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+
+#include "src/Vec3.h"
+#include "src/Mesh.h"
+#include "src/ArapSolver.h"
+#include "src/MultiresolutionArapSolver.h"
+#include "src/RegionOfInterestArapSolver.h"
+#include "src/BatchArapSolver.h"
+#include "src/ArapScript.h"
+#include "src/AllocationCounter.h"
+#include "src/Timer.h"
+
+using namespace std;
+
+
+// Handle script: see ArapScript.h and models/arma.handles
+struct ArapBenchmark {
+    Mesh mesh;
+    ArapSolver solver;
+    MultiresolutionArapSolver multiresolutionSolver;
+    bool multiresolution;
+    RegionOfInterestArapSolver regionOfInterestSolver;
+    bool regionOfInterest;
+    std::vector< int > verticesHandles;
+    ArapSolver::StoppingCriteria stoppingCriteria;
+    std::vector< double > lastFrameEnergies;
+
+    RotationClustering rotationClustering;
+    double rotationClustersMs;
+
+    // --batch-poses: poses interpolated between the rest and the final positions of the handles
+    BatchArapSolver batchSolver;
+    unsigned int batchPoses , batchSequentialPoses;
+    double batchSequentialMs , batchMaxDifference;
+
+    // --compare-solvers: each linear solver on the normal equations of the last frame
+    struct LinearSolverComparison {
+        LinearSolver solver;
+        LinearSolverOrdering ordering;
+        bool ok;
+        double factorizationMs , solveMs , residual;
+        unsigned int iterations;
+        unsigned long long memoryBytes;
+    };
+    std::vector< LinearSolverComparison > linearSolverComparisons;
+
+    unsigned int frames;
+    ArapSolver::Timings timings;
+    double totalMs;
+
+    ArapBenchmark() : multiresolution(false) , regionOfInterest(false) , rotationClustering(RotationClustering_KMeans) , rotationClustersMs(0.0) ,
+        batchPoses(0) , batchSequentialPoses(0) , batchSequentialMs(0.0) , batchMaxDifference(0.0) , frames(0) , totalMs(0.0) {}
+
+    void runFrame( bool handlesWereChanged ) {
+        Timer timer;
+        if( handlesWereChanged ) {
+            solver.setHandles( verticesHandles );
+            if( multiresolution ) multiresolutionSolver.setHandles( verticesHandles );
+            if( regionOfInterest ) regionOfInterestSolver.setHandles( verticesHandles );
+        }
+        if( regionOfInterest ) {
+            regionOfInterestSolver.setStoppingCriteria( stoppingCriteria );
+            regionOfInterestSolver.solve();
+            totalMs += timer.elapsedMs();
+            lastFrameEnergies = regionOfInterestSolver.energies();
+            timings += regionOfInterestSolver.timings();
+        }
+        else if( multiresolution ) {
+            multiresolutionSolver.setStoppingCriteria( stoppingCriteria );
+            multiresolutionSolver.solve();
+            totalMs += timer.elapsedMs();
+            lastFrameEnergies = multiresolutionSolver.energies();
+            timings += multiresolutionSolver.timings();
+        }
+        else {
+            solver.setStoppingCriteria( stoppingCriteria );
+            solver.solve();
+            totalMs += timer.elapsedMs();
+            lastFrameEnergies = solver.energies();
+            timings += solver.timings();
+        }
+        ++frames;
+    }
+
+    bool runScript( std::istream & script ) {
+        ArapScript arapScript( mesh , verticesHandles , stoppingCriteria );
+        std::string error;
+        bool ok = arapScript.run( script , [this , &arapScript]() {
+            runFrame( arapScript.handlesWereChanged() );
+            arapScript.handlesWereApplied();
+        } , error );
+        if( !ok ) cerr << "arapbench: " << error << endl;
+        return ok;
+    }
+
+    // numberOfPoses poses with the handles of the script, pose p at (p+1)/numberOfPoses of their final displacement,
+    // with BatchArapSolver, then the last sequentialPoses ones with one ArapSolver::solve() each (on a copy of the mesh).
+    bool runBatchPoses( unsigned int numberOfPoses , unsigned int sequentialPoses ) {
+        batchPoses = numberOfPoses;
+        Mesh poseMesh = mesh;   // at rest, the starting positions of the poses (the weights are those of pInit)
+        for( unsigned int v = 0 ; v < poseMesh.V.size() ; ++v )
+            poseMesh.V[v].p = poseMesh.V[v].pInit;
+        batchSolver.threadPool().setNumberOfThreads( solver.threadPool().numberOfThreads() );
+        batchSolver.setIterations( stoppingCriteria.maxIterations );
+        batchSolver.setMesh( poseMesh );
+        batchSolver.setHandles( verticesHandles );
+        std::vector< unsigned int > const & handleVertices = batchSolver.handleVertices();
+        std::vector< std::vector< Vec3 > > handlePositions( numberOfPoses , std::vector< Vec3 >( handleVertices.size() ) ) , positions;
+        for( unsigned int p = 0 ; p < numberOfPoses ; ++p )
+            for( unsigned int i = 0 ; i < handleVertices.size() ; ++i ) {
+                MeshVertex const & vertex = mesh.V[ handleVertices[i] ];
+                handlePositions[p][i] = vertex.pInit + ( double( p + 1 ) / numberOfPoses ) * ( vertex.p - vertex.pInit );
+            }
+        if( !batchSolver.solvePoses( handlePositions , positions ) ) return false;
+
+        ArapSolver poseSolver;
+        poseSolver.threadPool().setNumberOfThreads( solver.threadPool().numberOfThreads() );
+        poseSolver.setMesh( poseMesh );
+        poseSolver.setHandles( verticesHandles );
+        poseSolver.setStoppingCriteria( ArapSolver::StoppingCriteria( stoppingCriteria.maxIterations ) );
+        poseSolver.updateSystem();
+        batchSequentialPoses = std::min( sequentialPoses , numberOfPoses );
+        batchMaxDifference = 0.0;
+        Timer timer;
+        for( unsigned int p = numberOfPoses - batchSequentialPoses ; p < numberOfPoses ; ++p ) {
+            for( unsigned int v = 0 ; v < poseMesh.V.size() ; ++v )
+                poseMesh.V[v].p = poseMesh.V[v].pInit;
+            for( unsigned int i = 0 ; i < handleVertices.size() ; ++i )
+                poseMesh.V[ handleVertices[i] ].p = handlePositions[p][i];
+            poseSolver.setRotations( std::vector< Eigen::Matrix3d >( poseMesh.V.size() , Eigen::Matrix3d::Identity() ) );
+            poseSolver.solve();
+            for( unsigned int v = 0 ; v < poseMesh.V.size() ; ++v )
+                batchMaxDifference = std::max( batchMaxDifference , ( poseMesh.V[v].p - positions[p][v] ).length() );
+        }
+        batchSequentialMs = timer.elapsedMs();
+        return true;
+    }
+
+    // Solves the normal equations of the last frame (right-hand side of the last iteration) again with each linear
+    // solver and each ordering of the direct ones, from scratch: factorization and solve times, memory and residual.
+    bool compareLinearSolvers() {
+        linearSystem const & reference = solver.normalEquationsSystem();
+        Eigen::SparseMatrix< double > const & A = reference.matrix();
+        if( A.rows() == 0 ) return false;
+        for( int s = 0 ; s < NumberOfLinearSolvers ; ++s ) {
+            LinearSolver linearSolver = LinearSolver( s );
+            int numberOfOrderings = linearSolverIsIterative( linearSolver ) ? 1 : NumberOfLinearSolverOrderings;
+            for( int o = 0 ; o < numberOfOrderings ; ++o ) {
+                linearSystem system( A.rows() , A.cols() );
+                for( int c = 0 ; c < A.outerSize() ; ++c )
+                    for( Eigen::SparseMatrix< double >::InnerIterator it( A , c ) ; it ; ++it )
+                        system.A( it.row() , it.col() ) = it.value();
+                for( int r = 0 ; r < A.rows() ; ++r )
+                    system.b(r) = reference.rhs()[r];
+                system.setSolver( linearSolver , LinearSolverOrdering( o ) );
+                system.preprocess();
+                Eigen::VectorXd X;
+                system.solve( X );
+
+                LinearSolverComparison comparison;
+                comparison.solver = linearSolver;
+                comparison.ordering = LinearSolverOrdering( o );
+                comparison.ok = system.factorizationIsOk();
+                comparison.factorizationMs = system.lastFactorizationMs();
+                comparison.solveMs = system.lastSolveMs();
+                comparison.residual = system.relativeResidual( X );
+                comparison.iterations = system.lastIterations();
+                comparison.memoryBytes = system.solverMemoryBytes();
+                linearSolverComparisons.push_back( comparison );
+            }
+        }
+        return true;
+    }
+
+    double checksum() const {
+        double sum = 0.0;
+        for( unsigned int v = 0 ; v < mesh.V.size() ; ++v )
+            sum += mesh.V[v].p[0] + 2.0 * mesh.V[v].p[1] + 3.0 * mesh.V[v].p[2];
+        return sum;
+    }
+
+    void printJSON( std::ostream & out , std::string const & meshFile ) const {
+        ArapSolver::Timings const & meshTimings = solver.meshTimings();
+        double allocationsPerIteration = timings.iterations > 0 ? double( timings.allocations ) / timings.iterations : 0.0;
+        char checksumString[64];
+        std::snprintf( checksumString , sizeof(checksumString) , "%.6f" , checksum() );
+
+        out << "{" << endl
+            << "  \"mesh\": \"" << meshFile << "\"," << endl
+            << "  \"vertices\": " << mesh.V.size() << "," << endl
+            << "  \"triangles\": " << mesh.T.size() << "," << endl
+            << "  \"threads\": " << solver.threadPool().numberOfThreads() << "," << endl
+            << "  \"globalStep\": \"" << ( solver.globalStepMode() == ArapSolver::GlobalStep_Laplacian ? "laplacian" :
+                                         solver.globalStepMode() == ArapSolver::GlobalStep_Subspace ? "subspace" : "normalEquations" ) << "\"," << endl
+            << "  \"maxIterationsPerFrame\": " << stoppingCriteria.maxIterations << "," << endl
+            << "  \"relativeEnergyTolerance\": " << stoppingCriteria.relativeEnergyTolerance << "," << endl
+            << "  \"andersonWindow\": " << stoppingCriteria.andersonWindow << "," << endl
+            << "  \"linearSolver\": \"" << linearSolverName( solver.normalEquationsSystem().solverType() ) << "\"," << endl
+            << "  \"ordering\": \"" << linearSolverOrderingName( solver.normalEquationsSystem().ordering() ) << "\"," << endl
+            << "  \"frames\": " << frames << "," << endl
+            << "  \"multiresolution\": ";
+        if( multiresolution )
+            out << "{ \"coarseVertices\": " << multiresolutionSolver.coarseMesh().V.size()
+                << ", \"coarseTriangles\": " << multiresolutionSolver.coarseMesh().T.size()
+                << ", \"buildMs\": " << multiresolutionSolver.buildMs()
+                << ", \"fineIterations\": " << multiresolutionSolver.fineIterations() << " }";
+        else out << "null";
+        out << "," << endl
+            << "  \"regionOfInterest\": ";
+        if( regionOfInterest )
+            out << "{ \"growth\": \"" << ( regionOfInterestSolver.regionSettings().growth == RegionOfInterestArapSolver::Growth_KRing ? "kRings" : "geodesic" ) << "\""
+                << ", \"extent\": " << regionOfInterestSolver.regionExtent()
+                << ", \"vertices\": " << regionOfInterestSolver.numberOfRegionVertices()
+                << ", \"interiorVertices\": " << regionOfInterestSolver.numberOfInteriorVertices()
+                << ", \"rebuilds\": " << regionOfInterestSolver.numberOfRebuilds() << " }";
+        else out << "null";
+        out << "," << endl
+            << "  \"rotationClusters\": ";
+        if( solver.numberOfRotationClusters() > 0 )
+            out << "{ \"clusters\": " << solver.numberOfRotationClusters()
+                << ", \"clustering\": \"" << ( rotationClustering == RotationClustering_KMeans ? "kMeans" : "farthestPoints" ) << "\""
+                << ", \"buildMs\": " << rotationClustersMs << " }";
+        else out << "null";
+        out << "," << endl
+            << "  \"subspace\": ";
+        if( solver.globalStepMode() == ArapSolver::GlobalStep_Subspace )
+            out << "{ \"dimension\": " << solver.subspaceBasis().dimension()
+                << ", \"largestEigenvalue\": " << solver.subspaceBasis().eigenvalues()[ solver.subspaceBasis().dimension() - 1 ]
+                << ", \"subspaceIterations\": " << solver.subspaceBasis().iterations()
+                << ", \"loadedFromCache\": " << ( solver.subspaceBasis().loadedFromCache() ? "true" : "false" )
+                << ", \"buildMs\": " << solver.subspaceBasis().buildMs() << " }";
+        else out << "null";
+        out << "," << endl
+            << "  \"batchPoses\": ";
+        if( batchPoses > 0 ) {
+            BatchArapSolver::Timings const & batchTimings = batchSolver.timings();
+            out << "{ \"poses\": " << batchTimings.poses
+                << ", \"iterationsPerPose\": " << stoppingCriteria.maxIterations
+                << ", \"iterations\": " << batchTimings.iterations
+                << ", \"factorizationMs\": " << batchTimings.factorizationMs
+                << ", \"rhsMs\": " << batchTimings.rhsMs
+                << ", \"solveMs\": " << batchTimings.solveMs
+                << ", \"localStepMs\": " << batchTimings.localStepMs
+                << ", \"totalMs\": " << batchTimings.totalMs
+                << ", \"posesPerSecond\": " << batchTimings.posesPerSecond()
+                << ", \"sequentialPosesPerSecond\": " << ( batchSequentialMs > 0.0 ? 1000.0 * batchSequentialPoses / batchSequentialMs : 0.0 )
+                << ", \"maxDifferenceToSequential\": " << batchMaxDifference << " }";
+        }
+        else out << "null";
+        out << "," << endl
+            << "  \"linearSolvers\": ";
+        if( ! linearSolverComparisons.empty() ) {
+            out << "[" << endl;
+            for( unsigned int i = 0 ; i < linearSolverComparisons.size() ; ++i ) {
+                LinearSolverComparison const & comparison = linearSolverComparisons[i];
+                out << "    { \"solver\": \"" << linearSolverName( comparison.solver ) << "\""
+                    << ", \"ordering\": ";
+                if( linearSolverIsIterative( comparison.solver ) ) out << "null";
+                else out << "\"" << linearSolverOrderingName( comparison.ordering ) << "\"";
+                out << ", \"ok\": " << ( comparison.ok ? "true" : "false" )
+                    << ", \"factorizationMs\": " << comparison.factorizationMs
+                    << ", \"solveMs\": " << comparison.solveMs
+                    << ", \"iterations\": " << comparison.iterations
+                    << ", \"memoryBytes\": " << comparison.memoryBytes
+                    << ", \"relativeResidual\": " << comparison.residual << " }"
+                    << ( i + 1 < linearSolverComparisons.size() ? "," : "" ) << endl;
+            }
+            out << "  ]";
+        }
+        else out << "null";
+        out << "," << endl
+            << "  \"iterations\": " << timings.iterations << "," << endl
+            << "  \"rejectedAccelerations\": " << timings.rejectedAccelerations << "," << endl
+            << "  \"lastFrameEnergies\": [";
+        for( unsigned int i = 0 ; i < lastFrameEnergies.size() ; ++i )
+            out << ( i > 0 ? ", " : "" ) << lastFrameEnergies[i];
+        out << "]," << endl
+            << "  \"timingsMs\": {" << endl
+            << "    \"weights\": " << meshTimings.weightsMs << "," << endl
+            << "    \"assembly\": " << meshTimings.assemblyMs + timings.assemblyMs << "," << endl
+            << "    \"factorization\": " << meshTimings.factorizationMs + timings.factorizationMs << "," << endl
+            << "    \"rhs\": " << timings.rhsMs << "," << endl
+            << "    \"solve\": " << timings.solveMs << "," << endl
+            << "    \"localStep\": " << timings.localStepMs << "," << endl
+            << "    \"transfer\": " << timings.transferMs << "," << endl
+            << "    \"frames\": " << totalMs << endl
+            << "  }," << endl
+            << "  \"systemUpdates\": " << timings.systemUpdates << "," << endl
+            << "  \"incrementalSystemUpdates\": " << timings.incrementalSystemUpdates << "," << endl
+            << "  \"cachedSystemUpdates\": " << timings.cachedSystemUpdates << "," << endl
+            << "  \"allocationsPerIteration\": ";
+        if( AllocationCounter::isAvailable() ) out << allocationsPerIteration;
+        else out << "null";
+        out << "," << endl
+            << "  \"compiler\": \"" << __VERSION__ << "\"," << endl
+            << "  \"checksum\": " << checksumString << endl
+            << "}" << endl;
+    }
+};
+
+
+void printUsage() {
+    cerr << "Usage : ./arapbench <file.off> <handles script> [--threads N] [--normal-equations]" << endl
+         << "                   [--multiresolution coarseVertices [--fine-iterations N]]" << endl
+         << "                   [--region-of-interest extent [--k-rings]]" << endl
+         << "                   [--rotation-clusters k [--farthest-points]]" << endl
+         << "                   [--subspace dimension [--basis-cache directory]]" << endl
+         << "                   [--linear-solver llt|ldlt|supernodalLU|cg|lscg [--ordering amd|colamd|natural]] [--compare-solvers]" << endl
+         << "                     (these two with --normal-equations only)" << endl
+         << "                   [--factorization-cache directory] [--batch-poses N] [--output file.json]" << endl
+         << "  see models/arma.handles for the script commands" << endl;
+}
+
+bool parseLinearSolver( std::string const & name , LinearSolver & solver ) {
+    for( int s = 0 ; s < NumberOfLinearSolvers ; ++s )
+        if( name == linearSolverName( LinearSolver( s ) ) ) {
+            solver = LinearSolver( s );
+            return true;
+        }
+    return false;
+}
+
+bool parseLinearSolverOrdering( std::string const & name , LinearSolverOrdering & ordering ) {
+    for( int o = 0 ; o < NumberOfLinearSolverOrderings ; ++o )
+        if( name == linearSolverOrderingName( LinearSolverOrdering( o ) ) ) {
+            ordering = LinearSolverOrdering( o );
+            return true;
+        }
+    return false;
+}
+
+int main( int argc , char ** argv ) {
+    if( argc < 3 ) {
+        printUsage();
+        return EXIT_FAILURE;
+    }
+    std::string meshFile = argv[1] , scriptFile = argv[2] , outputFile;
+    unsigned int numberOfThreads = 0;
+    bool normalEquations = false;
+    unsigned int coarseVertices = 0 , fineIterations = 0;
+    double regionExtent = 0.0;
+    bool kRings = false;
+    unsigned int rotationClusters = 0;
+    bool farthestPoints = false;
+    unsigned int subspaceDimension = 0;
+    std::string basisCacheDirectory , factorizationCacheDirectory;
+    unsigned int batchPoses = 0;
+    LinearSolver linearSolver = LinearSolver_SimplicialLDLT;
+    LinearSolverOrdering ordering = LinearSolverOrdering_AMD;
+    bool linearSolverIsSet = false , compareSolvers = false;
+    for( int a = 3 ; a < argc ; ++a ) {
+        std::string option = argv[a];
+        if( option == "--threads"  &&  a + 1 < argc ) numberOfThreads = std::atoi( argv[++a] );
+        else if( option == "--normal-equations" ) normalEquations = true;
+        else if( option == "--multiresolution"  &&  a + 1 < argc ) coarseVertices = std::atoi( argv[++a] );
+        else if( option == "--fine-iterations"  &&  a + 1 < argc ) fineIterations = std::atoi( argv[++a] );
+        else if( option == "--region-of-interest"  &&  a + 1 < argc ) regionExtent = std::atof( argv[++a] );
+        else if( option == "--k-rings" ) kRings = true;
+        else if( option == "--rotation-clusters"  &&  a + 1 < argc ) rotationClusters = std::atoi( argv[++a] );
+        else if( option == "--farthest-points" ) farthestPoints = true;
+        else if( option == "--subspace"  &&  a + 1 < argc ) subspaceDimension = std::atoi( argv[++a] );
+        else if( option == "--basis-cache"  &&  a + 1 < argc ) basisCacheDirectory = argv[++a];
+        else if( option == "--factorization-cache"  &&  a + 1 < argc ) factorizationCacheDirectory = argv[++a];
+        else if( option == "--batch-poses"  &&  a + 1 < argc ) batchPoses = std::atoi( argv[++a] );
+        else if( option == "--linear-solver"  &&  a + 1 < argc  &&  parseLinearSolver( argv[++a] , linearSolver ) ) linearSolverIsSet = true;
+        else if( option == "--ordering"  &&  a + 1 < argc  &&  parseLinearSolverOrdering( argv[++a] , ordering ) ) {}
+        else if( option == "--compare-solvers" ) compareSolvers = true;
+        else if( option == "--output"  &&  a + 1 < argc ) outputFile = argv[++a];
+        else {
+            printUsage();
+            return EXIT_FAILURE;
+        }
+    }
+    // the linear solver is that of the normal equations: the Laplacian global step has its own factorization
+    if( ( linearSolverIsSet || compareSolvers )  &&  ! normalEquations ) {
+        cerr << "arapbench: --linear-solver and --compare-solvers need --normal-equations" << endl;
+        return EXIT_FAILURE;
+    }
+
+    std::ifstream script( scriptFile.c_str() );
+    if( !script ) {
+        cerr << "arapbench: cannot open " << scriptFile << endl;
+        return EXIT_FAILURE;
+    }
+
+    ArapBenchmark benchmark;
+    if( numberOfThreads > 0 ) benchmark.solver.threadPool().setNumberOfThreads( numberOfThreads );
+    if( normalEquations ) benchmark.solver.setGlobalStepMode( ArapSolver::GlobalStep_NormalEquations );
+    benchmark.solver.setLinearSolver( linearSolver , ordering );
+
+    if( ! benchmark.mesh.loadOFF( meshFile ) ) {
+        cerr << "arapbench: cannot read " << meshFile << endl;
+        return EXIT_FAILURE;
+    }
+    benchmark.verticesHandles.assign( benchmark.mesh.V.size() , -1 );
+    benchmark.solver.setFactorizationCacheDirectory( factorizationCacheDirectory );
+    benchmark.solver.setMesh( benchmark.mesh );
+    if( subspaceDimension > 0 ) {
+        benchmark.solver.computeSubspaceBasis( subspaceDimension , basisCacheDirectory );
+        benchmark.solver.setGlobalStepMode( ArapSolver::GlobalStep_Subspace );
+    }
+    if( rotationClusters > 0 ) {
+        Timer timer;
+        benchmark.rotationClustering = farthestPoints ? RotationClustering_FarthestPoints : RotationClustering_KMeans;
+        benchmark.solver.setRotationClusters( rotationClusters , benchmark.rotationClustering );
+        benchmark.rotationClustersMs = timer.elapsedMs();
+    }
+    if( coarseVertices > 0 ) {
+        benchmark.multiresolution = true;
+        benchmark.multiresolutionSolver.threadPool().setNumberOfThreads( benchmark.solver.threadPool().numberOfThreads() );
+        if( ! benchmark.multiresolutionSolver.setMesh( benchmark.mesh , coarseVertices ) ) {
+            cerr << "arapbench: --multiresolution needs a mesh with triangles" << endl;
+            return EXIT_FAILURE;
+        }
+        benchmark.multiresolutionSolver.setFineLevel( &benchmark.solver , fineIterations );
+    }
+    if( regionExtent > 0.0 ) {
+        benchmark.regionOfInterest = true;
+        benchmark.regionOfInterestSolver.threadPool().setNumberOfThreads( benchmark.solver.threadPool().numberOfThreads() );
+        benchmark.regionOfInterestSolver.setGlobalStepMode( benchmark.solver.globalStepMode() );
+        benchmark.regionOfInterestSolver.setRegionSettings( RegionOfInterestArapSolver::RegionSettings(
+            kRings ? RegionOfInterestArapSolver::Growth_KRing : RegionOfInterestArapSolver::Growth_Geodesic , regionExtent ) );
+        benchmark.regionOfInterestSolver.setMesh( benchmark.mesh );
+    }
+
+    if( !benchmark.runScript( script ) ) return EXIT_FAILURE;
+    if( batchPoses > 0  &&  ! benchmark.runBatchPoses( batchPoses , 16 ) ) {
+        cerr << "arapbench: --batch-poses needs handles and a factorized Laplacian of the free vertices" << endl;
+        return EXIT_FAILURE;
+    }
+    if( compareSolvers  &&  ! benchmark.compareLinearSolvers() ) {
+        cerr << "arapbench: --compare-solvers needs the normal equations global step of the full mesh" << endl;
+        return EXIT_FAILURE;
+    }
+
+    if( outputFile.empty() ) {
+        benchmark.printJSON( cout , meshFile );
+    }
+    else {
+        std::ofstream out( outputFile.c_str() );
+        if( !out ) {
+            cerr << "arapbench: cannot write " << outputFile << endl;
+            return EXIT_FAILURE;
+        }
+        benchmark.printJSON( out , meshFile );
+    }
+    return EXIT_SUCCESS;
+}
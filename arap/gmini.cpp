@@ -22,14 +22,17 @@
 #include <cstdlib>
 
 #include <algorithm>
+#include <thread>
+#include <chrono>
 #include <GL/glut.h>
 #include "src/Vec3.h"
 #include "src/Camera.h"
 #include "src/Mesh.h"
 #include "src/linearSystem.h"
-#include "src/LaplacianWeights.h"
-#include "extern/eigen3/Eigen/SVD"
-#include "extern/eigen3/Eigen/Geometry"
+#include "src/ArapSolver.h"
+#include "src/MultiresolutionArapSolver.h"
+#include "src/RegionOfInterestArapSolver.h"
+#include "src/ArapSolverThread.h"
 
 
 using namespace std;
@@ -51,6 +54,11 @@ static int lastX=0, lastY=0, lastZoom=0;
 static unsigned int FPS = 0;
 static bool fullScreen = false;
 
+// frames are drawn when something changed, not at every idle call (key 'p': frame pacing , 'h': frame times)
+#include "src/RenderScheduler.h"
+RenderScheduler renderScheduler;
+std::string frameTimesFileName = "frame_times.csv";
+
 enum ViewerState {
     ViewerState_NORMAL ,
     ViewerState_EDITINGHANDLE ,
@@ -68,20 +76,44 @@ SelectionToolState selectionToolState;
 
 #include "src/RectangleSelectionTool.h"
 RectangleSelectionTool rectangleSelectionTool;
+VertexBitset verticesInRectangle;
+ThreadPool selectionThreadPool;   // not the one of arapSolver , which the solver thread uses
+
+// triangle ids and depths of the pixels, rendered again at the next selection once the camera or the mesh changed:
+// the selection tools only take the visible vertices (key 'v': also the hidden ones, rectangle and sphere)
+#include "src/PickingBuffer.h"
+PickingBuffer pickingBuffer;
+bool selectHiddenVertices = false;
+
+// ray casting for the point under the mouse (sphere center, click selection): built once, refit when the mesh moved
+#include "src/TriangleBVH.h"
+TriangleBVH pickingBVH;
+bool pickingBVHIsUpToDate = false;
 
 #include "src/SphereSelectionTool.h"
 SphereSelectionTool sphereSelectionTool;
 float selectionRadius = 0.1f;
 
+// sphere brush: the marks are applied while the sphere is active, and updated on the shell between the old and
+// the new radius when it changes (scroll)
+#include "src/SpatialGrid.h"
+SpatialGrid sphereSelectionGrid;                  // over mesh.V , rebuilt at the next stroke once the mesh moved
+bool sphereSelectionGridIsUpToDate = false;
+std::vector< bool > marksBeforeSphereStroke;      // restored on the vertices left by a shrinking sphere
+double appliedSphereRadius = -1.0;                // radius of the marks applied by the current stroke , < 0 : none
+
 
 // -------------------------------------------
 // ARAP variables
 // -------------------------------------------
 
 Mesh mesh;
-LaplacianWeights edgeAndVertexWeights;
-linearSystem arapLinearSystem;
-std::vector< Eigen::MatrixXd > vertexRotationMatrices;
+Mesh arapMesh;           // copy of mesh deformed by the solver thread, see fetchPositions() in idle()
+ArapSolver arapSolver;   // one thread per core by default, see keys '+' and '-'
+
+// mesh.draw() with its vertices and triangles kept in buffers on the GPU, the vertices that moved are sent again
+#include "src/MeshRenderer.h"
+MeshRenderer meshRenderer;
 
 int numberOfHandles = 0;
 int activeHandle = 0;
@@ -90,6 +122,42 @@ std::vector< bool > verticesAreMarkedForCurrentHandle;
 std::vector< int > verticesHandles;
 double spheresSize = 0.01;
 
+// spheres on the marked and handle vertices, in one draw call , see updateHandleMarkers()
+#include "src/HandleMarkers.h"
+HandleMarkers handleMarkers;
+bool handleMarkersAreUpToDate = false;   // false once verticesHandles or verticesAreMarkedForCurrentHandle changed
+
+bool printArapTimings = false;
+// stops when an iteration decreases the ARAP energy by less than 0.1%, see key 'a' for the acceleration
+ArapSolver::StoppingCriteria arapStoppingCriteria( 50 , 1e-3 , 0 );
+
+// key 'm': ARAP on a coarse proxy of the mesh (built the first time), then optionally a few iterations on the mesh
+enum ArapMultiresolutionMode {
+    ArapMultiresolution_Off ,
+    ArapMultiresolution_Proxy ,
+    ArapMultiresolution_ProxyAndFineIterations
+};
+ArapMultiresolutionMode arapMultiresolutionMode = ArapMultiresolution_Off;
+MultiresolutionArapSolver arapMultiresolutionSolver;
+unsigned int arapMaxCoarseVertices = 2000;
+unsigned int arapFineIterations = 2;
+
+// key 'l', third mode: global step in a subspace of Laplacian eigenvectors
+unsigned int arapSubspaceDimension = 25;
+// --cache directory: weights, factorizations and eigenvectors read from (and written to) there, none by default
+std::string arapCacheDirectory;
+
+// key 'k': one ARAP rotation per cluster of vertices (k-means on the rest positions) instead of one per vertex
+unsigned int arapRotationClusters = 0;
+
+// key 'o': ARAP only on a region around the handles (geodesic, grown when they move far), takes precedence over 'm'
+bool arapRegionOfInterest = false;
+RegionOfInterestArapSolver arapRegionOfInterestSolver;
+
+// the solves run on this thread, the display loop only posts the handle positions (key 'b': time budget of a slice)
+ArapSolverThread arapSolverThread;
+double arapBudgetMs = 0.0;
+
 
 
 
@@ -133,17 +201,6 @@ void testlinearSystem() {
 
 
 
-Eigen::MatrixXd getClosestRotation( Eigen::MatrixXd const & m ) {
-    Eigen::JacobiSVD< Eigen::MatrixXd > svdStruct = m.jacobiSvd( Eigen::ComputeFullU | Eigen::ComputeFullV );
-    return svdStruct.matrixU() * svdStruct.matrixV().transpose();
-}
-
-
-
-
-
-
-
 //nicolas.luciani@umontpellier.fr
 
 //-----------------------------------------------------------------------------------//
@@ -153,160 +210,24 @@ Eigen::MatrixXd getClosestRotation( Eigen::MatrixXd const & m ) {
 //-----------------------------------------------------------------------------------//
 //-----------------------------------------------------------------------------------//
 //-----------------------------------------------------------------------------------//
-void updateSystem() {
-    if(! handlesWereChanged) return;
-
-    // TODO:
-    // set the right values for the number or rows and number of columns
-    // remember: number of colums = nb of variables
-    // remember: number of rows = nb of equations
-
-    unsigned int ncolumns = 3*mesh.V.size();
-
-    unsigned int nrows = 0;
-
-    for( unsigned int v = 0 ; v < mesh.V.size() ; ++v ) {
-        unsigned int numberOfNeighbors = edgeAndVertexWeights.get_n_adjacent_edges(v);
-        nrows += numberOfNeighbors*3;   // WHAT TO PUT HERE ??????? How to update the number of rows ?
-    }
-    for( unsigned int v = 0 ; v < mesh.V.size() ; ++v ) {
-        if(verticesHandles[v] != -1) {
-            nrows += 3;  // WHAT TO PUT HERE ??????? How to update the number of rows ?
-        }
-    }
-
-    // Once the number of rows and columns have been found, we can allocate the matrices:
-    arapLinearSystem.setDimensions( nrows , ncolumns );
-
-    // TODO:
-    // set the right values for the matrix A in the linear system
-
-    unsigned int equationIndex = 0;
-    for( unsigned int v = 0 ; v < mesh.V.size() ; ++v ) {
-        for( std::map< unsigned int , double >::const_iterator it = edgeAndVertexWeights.get_weight_of_adjacent_edges_it_begin(v) ;
-             it != edgeAndVertexWeights.get_weight_of_adjacent_edges_it_end(v) ; ++it) {
-
-            unsigned int vNeighbor = it->first;
-
-            // WHAT TO PUT HERE ??????? How to update the entries of A ?
-            
-            arapLinearSystem.A(equationIndex,3*v)=-1.0f;
-            arapLinearSystem.A(equationIndex,3*vNeighbor)=1.0f;
-            equationIndex++;
-
-            arapLinearSystem.A(equationIndex,1+3*v)=-1.0f;
-            arapLinearSystem.A(equationIndex,1+3*vNeighbor)=1.0f;
-            equationIndex++;
-
-            arapLinearSystem.A(equationIndex,2+3*v)=-1.0f;
-            arapLinearSystem.A(equationIndex,2+3*vNeighbor)=1.0f;
-            equationIndex++;
-
-            
-        }
-    }
-    for( unsigned int v = 0 ; v < mesh.V.size() ; ++v ) {
-        if(verticesHandles[v] != -1) {
-
-            // WHAT TO PUT HERE ??????? How to update the entries of A ?
-            arapLinearSystem.A(equationIndex,3*v)=1.0f;
-            arapLinearSystem.A(equationIndex+1,1+3*v)=1.0f;
-            arapLinearSystem.A(equationIndex+2,2+3*v)=1.0f;
-            equationIndex+=3;
-
-        }
-    }
-
-    arapLinearSystem.preprocess();
-    handlesWereChanged = false;
+// the structures built on the positions of mesh are updated before their next use
+void meshPositionsWereChanged() {
+    sphereSelectionGridIsUpToDate = false;
+    pickingBVHIsUpToDate = false;
+    pickingBuffer.meshWasChanged();
+    handleMarkers.positionsWereChanged();
+    meshRenderer.positionsWereChanged();
 }
 
-
-
 void updateMeshVertexPositionsFromARAPSolver() {
-    // return; // TODO : COMMENT THIS LINE WHEN YOU START THE EXERCISE  (setup of the matrix A for the linear system A.X=B)
-    updateSystem();
-
-    unsigned int maxIterationsForArap = 5;
-
-
-    // return; // TODO : COMMENT THIS LINE WHEN YOU CONTINUE THE EXERCISE  (setup of the vector B for the linear system A.X=B)
-    // set the right values for the vector b in the linear system, solve the linear system and update the positions using the solution.
-
-
-    for( unsigned int arapIteration = 0 ; arapIteration < maxIterationsForArap ; ++arapIteration ) {
-        // 1 FIRST : SOLVE THE LINEAR SYSTEM TO UPDATE THE POSITIONS, GIVEN THE EXISTING ROTATION MATRICES
-        unsigned int equationIndex = 0;
-        for( unsigned int v = 0 ; v < mesh.V.size() ; ++v ) {
-            for( std::map< unsigned int , double >::const_iterator it = edgeAndVertexWeights.get_weight_of_adjacent_edges_it_begin(v) ;
-                 it != edgeAndVertexWeights.get_weight_of_adjacent_edges_it_end(v) ; ++it) {
-                unsigned int vNeighbor = it->first;
-                Eigen::VectorXd rotatedEdge(3);
-                for( unsigned int coord = 0 ; coord < 3 ; ++coord )
-                    rotatedEdge[coord] = mesh.V[vNeighbor].pInit[coord]  -  mesh.V[v].pInit[coord];
-                rotatedEdge = vertexRotationMatrices[v] * rotatedEdge;
-
-                // WHAT TO PUT HERE ??????? How to update the entries of b ?
-                arapLinearSystem.b(equationIndex)=rotatedEdge[0];
-                equationIndex++;
-                arapLinearSystem.b(equationIndex)=rotatedEdge[1];
-                equationIndex++;
-                arapLinearSystem.b(equationIndex)=rotatedEdge[2];
-                equationIndex++;
-
-            }
-        }
-        for( unsigned int v = 0 ; v < mesh.V.size() ; ++v ) {
-            if(verticesHandles[v] != -1) {
-
-                // WHAT TO PUT HERE ??????? How to update the entries of b ?
-                arapLinearSystem.b(equationIndex)=mesh.V[v].p[0];
-                equationIndex++;
-                arapLinearSystem.b(equationIndex)=mesh.V[v].p[1];
-                equationIndex++;
-                arapLinearSystem.b(equationIndex)=mesh.V[v].p[2];
-                equationIndex++;
-
-            }
-        }
-
-        // Once the matrix A and the vector B are correctly set, we obtain the position of the vertices by solving for A.X = B
-        Eigen::VectorXd X_newPositions;
-        arapLinearSystem.solve(X_newPositions);
-        for( unsigned int v = 0 ; v < mesh.V.size() ; ++v ) {
-            if(verticesHandles[v] == -1) {
-                for( unsigned int coord = 0 ; coord < 3 ; ++coord )
-                    mesh.V[v].p[coord] = X_newPositions[3*v + coord];
-            }
-        }
-
-
-
-        // return; // TODO : COMMENT THIS LINE WHEN YOU CONTINUE THE EXERCISE (update of the rotation matrices -- auxiliary variables)
-
-
-
-        // 2 SECOND : UPDATE THE ROTATION MATRICES
-        for( unsigned int v = 0 ; v < mesh.V.size() ; ++v ) {
-            Eigen::MatrixXd tensorMatrix = Eigen::MatrixXd::Zero(3,3);
-            for( std::map< unsigned int , double >::const_iterator it = edgeAndVertexWeights.get_weight_of_adjacent_edges_it_begin(v) ;
-                 it != edgeAndVertexWeights.get_weight_of_adjacent_edges_it_end(v) ; ++it) {
-                unsigned int vNeighbor = it->first;
-                Eigen::VectorXd initialEdge(3);
-                Eigen::VectorXd rotatedEdge(3);
-                for( unsigned int coord = 0 ; coord < 3 ; ++coord ) {
-                    initialEdge[coord] = mesh.V[vNeighbor].pInit[coord]  -  mesh.V[v].pInit[coord];
-                    rotatedEdge[coord] = mesh.V[vNeighbor].p[coord]  -  mesh.V[v].p[coord];
-                }
-
-                // WHAT TO PUT HERE ??????? How to update the entries of the tensor   ?
-                // 1 build
-                tensorMatrix += it->second * (rotatedEdge * initialEdge.transpose());
-            }
-            // 2 SVD 3 solution
-            vertexRotationMatrices[v] = getClosestRotation( tensorMatrix );
-        }
+    // The ARAP iterations themselves (system setup, global and local steps) are in src/ArapSolver.cpp ,
+    // they run on arapSolverThread: the new positions come back in idle()
+    if( handlesWereChanged ) {
+        arapSolverThread.setHandles( verticesHandles );
+        handlesWereChanged = false;
     }
+    meshPositionsWereChanged();   // the handles moved
+    arapSolverThread.requestSolve( mesh );
 }
 //-----------------------------------------------------------------------------------//
 //-----------------------------------------------------------------------------------//
@@ -319,64 +240,133 @@ void updateMeshVertexPositionsFromARAPSolver() {
 
 
 void translateActiveHandle( Vec3 const & translationVector ) {
-    for( unsigned int v = 0 ; v < mesh.V.size() ; ++v ) {
-        if( verticesHandles[v] == activeHandle ) {
-            mesh.V[v].p += translationVector;
-        }
-    }
+    ArapSolver::translateHandle( mesh , verticesHandles , activeHandle , translationVector );
 
     updateMeshVertexPositionsFromARAPSolver();
 }
 
 void rotateActiveHandle( Vec3 const & rotationAxis , double angle ) {
-    Eigen::Vector3d centerOfRotation(0,0,0);
-    double sumWeights = 0.0;
-    for( unsigned int v = 0 ; v < mesh.V.size() ; ++v ) {
-        if( verticesHandles[v] == activeHandle ) {
-            centerOfRotation += Eigen::Vector3d(mesh.V[v].p[0] , mesh.V[v].p[1] , mesh.V[v].p[2]);
-            sumWeights += 1.0;
-        }
-    }
-    centerOfRotation /= sumWeights;
+    ArapSolver::rotateHandle( mesh , verticesHandles , activeHandle , rotationAxis , angle );
 
-    Eigen::Vector3d axisEigenType( rotationAxis[0] , rotationAxis[1] , rotationAxis[2] );
-    Eigen::Matrix3d rotation;
-    rotation = Eigen::AngleAxisd(angle, axisEigenType);
+    updateMeshVertexPositionsFromARAPSolver();
+}
 
-    // Apply rotation and translation, such that the center of mass is preserved: R * c + t = c    =>    t = c - R * c;
-    Eigen::Vector3d translation = centerOfRotation - rotation * centerOfRotation;
+//// ------------------------------- BONUS -----------------------------------------/////
 
-    for( unsigned int v = 0 ; v < mesh.V.size() ; ++v ) {
-        if( verticesHandles[v] == activeHandle ) {
-            Eigen::Vector3d newPos = rotation * Eigen::Vector3d(mesh.V[v].p[0] , mesh.V[v].p[1] , mesh.V[v].p[2])  +  translation;
-            mesh.V[v].p = Vec3(newPos[0] , newPos[1] , newPos[2]);
-        }
+void updatePickingBVH()
+{
+    if( pickingBVH.isEmpty()  ||  pickingBVH.numberOfTriangles() != mesh.T.size() ) {
+        pickingBVH.build( mesh , &selectionThreadPool );
+        cout << "Picking BVH: " << pickingBVH.numberOfNodes() << " nodes built in " << pickingBVH.lastBuildMs() << " ms" << endl;
     }
+    else if( ! pickingBVHIsUpToDate ) pickingBVH.refit( mesh , &selectionThreadPool );
+    pickingBVHIsUpToDate = true;
+}
 
-    updateMeshVertexPositionsFromARAPSolver();
+// ray through the pixel ( x , y ) , from the near plane to the far plane
+void getMouseRay( int x , int y , Vec3 & origin , Vec3 & direction )
+{
+    GLdouble modelview[16];  glGetDoublev(GL_MODELVIEW_MATRIX , modelview);
+    GLdouble projection[16]; glGetDoublev(GL_PROJECTION_MATRIX , projection);
+    GLint viewport[4];       glGetIntegerv(GL_VIEWPORT , viewport);
+    GLdouble windowX = x + 0.5 , windowY = viewport[3] - 1 - y + 0.5;
+    GLdouble nearX , nearY , nearZ , farX , farY , farZ;
+    gluUnProject( windowX , windowY , 0.0 , modelview , projection , viewport , &nearX , &nearY , &nearZ );
+    gluUnProject( windowX , windowY , 1.0 , modelview , projection , viewport , &farX , &farY , &farZ );
+    origin = Vec3( nearX , nearY , nearZ );
+    direction = Vec3( farX , farY , farZ ) - origin;
 }
 
-//// ------------------------------- BONUS -----------------------------------------/////
+// nearest hit of the ray through the mouse with the mesh
+TriangleBVH::Hit castMouseRay( int x , int y , Vec3 & origin , Vec3 & direction )
+{
+    updatePickingBVH();
+    getMouseRay( x , y , origin , direction );
+    return pickingBVH.intersect( mesh , origin , direction , 1.0 );
+}
 
+// point of the mesh under the mouse, or at the depth of the center of the scene on the background
 void get3DPosFromMouseInput(int x, int y, float &posX, float &posY, float &posZ)
 {
+    Vec3 origin , direction;
+    TriangleBVH::Hit hit = castMouseRay( x , y , origin , direction );
+    double t = hit.triangle >= 0 ? hit.t : Vec3::dot( Vec3( 0.0 , 0.0 , 0.0 ) - origin , direction ) / direction.squareLength();
+    Vec3 position = origin + t * direction;
+    posX = position[0];
+    posY = position[1];
+    posZ = position[2];
+}
+
+bool vertexIsSelectable( unsigned int v )
+{
+    return selectHiddenVertices  ||  pickingBuffer.visibleVertices().test( v );
+}
+
+// marks of the vertices between appliedSphereRadius and newRadius
+void applySphereRadius( double newRadius )
+{
+    handleMarkersAreUpToDate = false;
+    Vec3 const & center = sphereSelectionTool.center;
+    if( newRadius > appliedSphereRadius ) {
+        bool tagToSet = sphereSelectionTool.isAdding;
+        sphereSelectionGrid.forEachVertexInShell( center , appliedSphereRadius , newRadius ,
+                                                  [tagToSet]( unsigned int v ) { if( vertexIsSelectable( v ) ) verticesAreMarkedForCurrentHandle[ v ] = tagToSet; } );
+    }
+    else {
+        // the marks of the hidden vertices were not changed
+        sphereSelectionGrid.forEachVertexInShell( center , newRadius , appliedSphereRadius ,
+                                                  []( unsigned int v ) { verticesAreMarkedForCurrentHandle[ v ] = marksBeforeSphereStroke[ v ]; } );
+    }
+    appliedSphereRadius = newRadius;
+}
+
+void updateSphereSelectionGrid()
+{
+    if( sphereSelectionGridIsUpToDate ) return;
+    sphereSelectionGrid.build( mesh.V );
+    sphereSelectionGridIsUpToDate = true;
+}
+
+// called once the sphere is initialized and active
+void beginSphereStroke()
+{
+    updateSphereSelectionGrid();
+    pickingBuffer.update( mesh , meshRenderer );
+    marksBeforeSphereStroke = verticesAreMarkedForCurrentHandle;
+    appliedSphereRadius = -1.0;
+    applySphereRadius( sphereSelectionTool.radius );
 }
 
 void setTagForVerticesInSphere(bool tagToSet)
 {
-    // check if vertices are inside the sphere
+    handleMarkersAreUpToDate = false;
+    // check if vertices are inside the sphere: already done during the stroke, see applySphereRadius()
+    if( appliedSphereRadius < 0.0 ) {
+        updateSphereSelectionGrid();
+        pickingBuffer.update( mesh , meshRenderer );
+        sphereSelectionGrid.forEachVertexInBall( sphereSelectionTool.center , sphereSelectionTool.radius ,
+                                                 [tagToSet]( unsigned int v ) { if( vertexIsSelectable( v ) ) verticesAreMarkedForCurrentHandle[ v ] = tagToSet; } );
+    }
+    appliedSphereRadius = -1.0;
+    sphereSelectionTool.isActive = false;
 }
 
 void updateSphereRadiusWithScroll(int button)
 {
     if(button == 3) //scroll up
     {
+        selectionRadius *= 1.1f;
     }
     else if(button == 4) //scroll down
     {
-        
+        selectionRadius /= 1.1f;
     }
+    else return;
 
+    if( sphereSelectionTool.isActive ) {
+        sphereSelectionTool.updateSphere( selectionRadius );
+        if( appliedSphereRadius >= 0.0 ) applySphereRadius( sphereSelectionTool.radius );
+    }
 }
 
 
@@ -421,28 +411,32 @@ Vec3 getViewVector() {
 
 
 void setTagForVerticesInRectangle( bool tagToSet ) {
+    handleMarkersAreUpToDate = false;
+    int xStart = rectangleSelectionTool.xStart , yStart = rectangleSelectionTool.yStart;
+    int xEnd = rectangleSelectionTool.xEnd , yEnd = rectangleSelectionTool.yEnd;
+    if( ! selectHiddenVertices ) {
+        pickingBuffer.update( mesh , meshRenderer );
+        if( abs( xEnd - xStart ) < 3  &&  abs( yEnd - yStart ) < 3 ) {   // a click: the nearest corner of the triangle under the mouse
+            Vec3 origin , direction;
+            TriangleBVH::Hit hit = castMouseRay( xEnd , yEnd , origin , direction );
+            if( hit.triangle >= 0 ) {
+                double weights[3] = { 1.0 - hit.u - hit.v , hit.u , hit.v };
+                unsigned int corner = std::max_element( weights , weights + 3 ) - weights;
+                verticesAreMarkedForCurrentHandle[ mesh.T[ hit.triangle ][ corner ] ] = tagToSet;
+            }
+        }
+        else pickingBuffer.forEachVisibleVertexInRectangle( mesh , xStart , yStart , xEnd , yEnd ,
+                                                          [tagToSet]( unsigned int v ) { verticesAreMarkedForCurrentHandle[ v ] = tagToSet; } );
+        return;
+    }
+
     float modelview[16];  glGetFloatv(GL_MODELVIEW_MATRIX , modelview);
     float projection[16]; glGetFloatv(GL_PROJECTION_MATRIX , projection);
+    float viewport[4];    glGetFloatv(GL_VIEWPORT , viewport);
 
-    for( unsigned int v = 0 ; v < mesh.V.size() ; ++v ) {
-        Vec3 const & p = mesh.V[ v ].p;
-
-        float x = modelview[0] * p[0] + modelview[4] * p[1] + modelview[8] * p[2] + modelview[12];
-        float y = modelview[1] * p[0] + modelview[5] * p[1] + modelview[9] * p[2] + modelview[13];
-        float z = modelview[2] * p[0] + modelview[6] * p[1] + modelview[10] * p[2] + modelview[14];
-        float w = modelview[3] * p[0] + modelview[7] * p[1] + modelview[11] * p[2] + modelview[15];
-        x /= w; y /= w; z /= w; w = 1.f;
-
-        float xx = projection[0] * x + projection[4] * y + projection[8] * z + projection[12] * w;
-        float yy = projection[1] * x + projection[5] * y + projection[9] * z + projection[13] * w;
-        float ww = projection[3] * x + projection[7] * y + projection[11] * z + projection[15] * w;
-        xx /= ww; yy /= ww;
-
-        xx = ( xx + 1.f ) / 2.f;
-        yy = ( yy + 1.f ) / 2.f;
-
-        if( rectangleSelectionTool.contains( xx , yy ) ) verticesAreMarkedForCurrentHandle[ v ] = tagToSet;
-    }
+    selectVerticesInRectangle( mesh.V , modelview , projection , rectangleSelectionTool.getBounds( viewport ) ,
+                               verticesInRectangle , &selectionThreadPool );
+    verticesInRectangle.forEachSetBit( [tagToSet]( unsigned int v ) { verticesAreMarkedForCurrentHandle[ v ] = tagToSet; } );
 }
 
 void addVerticesToCurrentHandle() {
@@ -464,16 +458,30 @@ void finalizeEditingOfCurrentHandle() {
     }
 
     handlesWereChanged = true;
+    handleMarkersAreUpToDate = false;
 }
 
 void printUsage () {
     cerr << endl
-         << "Usage : ./gmini [<file.off>]" << endl
+         << "Usage : ./gmini [--cache directory] [<file.off>]" << endl
+         << "  --cache: ARAP weights, factorizations and eigenvectors cached in directory (at most "
+         << ( DefaultCacheSizeLimit >> 20 ) << " MB)" << endl
          << "Keyboard commands" << endl
          << "------------------" << endl
          << " ?: Print help" << endl
          << " w: Toggle Wireframe Mode" << endl
          << " f: Toggle full screen mode" << endl
+         << " l: Cycle ARAP global step (Laplacian / normal equations / subspace of Laplacian eigenvectors)" << endl
+         << " t: Toggle printing of ARAP timings" << endl
+         << " a: Toggle Anderson acceleration of the ARAP iterations" << endl
+         << " b: Cycle the time budget of the ARAP solver thread (none / 8 ms / 16 ms)" << endl
+         << " m: Cycle multiresolution ARAP (off / coarse proxy / proxy and fine iterations)" << endl
+         << " k: Cycle ARAP rotation clusters (one rotation per vertex / V/10 clusters / V/50 clusters)" << endl
+         << " o: Toggle ARAP on a region around the handles only" << endl
+         << " v: Toggle selection of the hidden vertices (rectangle and sphere)" << endl
+         << " p: Cycle frame pacing (none / 60 Hz / 30 Hz)" << endl
+         << " h: Print the draw and solve time percentiles and write them to frame_times.csv" << endl
+         << " +/-: Change the number of ARAP threads" << endl
          << " <drag>+<left button>: rotate model" << endl
          << " <drag>+<right button>: move model" << endl
          << " <drag>+<middle button>: zoom" << endl << endl;
@@ -554,110 +562,38 @@ void calc_RGB( float val , float val_min , float val_max , float & r , float & g
         }
     }
 }
-void drawSphere(float x,float y,float z,float radius,int slices,int stacks)
-{
-    if(stacks < 2){stacks = 2;}
-    if(stacks > 30){stacks = 30;}
-    if(slices < 3){slices = 3;}
-    if(slices > 30){slices = 30;}
-    //Pas essentiel ...
-
-    int Nb = slices*stacks +2;
-    std::vector< Vec3 > points(Nb);
-
-    Vec3 centre(x,y,z);
-
-    float sinP , cosP , sinT , cosT , Phi , Theta;
-    points[0] = Vec3(0,0,1);
-    points[Nb-1] = Vec3(0,0,-1);
-
-    for(int i=1; i<=stacks; i++)
-    {
-        Phi = 90 - (float)(i*180)/(float)(stacks+1);
-        sinP = sinf(Phi*3.14159265/180);
-        cosP = cosf(Phi*3.14159265/180);
+// markers of the vertices: the colors only change with the marks, the handles, or the active handle
+void updateHandleMarkers() {
+    static int markedActiveHandle = -1 , markedNumberOfHandles = -1;
+    if( handleMarkersAreUpToDate  &&  markedActiveHandle == activeHandle  &&  markedNumberOfHandles == numberOfHandles ) return;
 
-        for(int j=1; j<=slices; j++)
-        {
-            Theta = (float)(j*360)/(float)(slices);
-            sinT = sinf(Theta*3.14159265/180);
-            cosT = cosf(Theta*3.14159265/180);
-
-            points[ j + (i-1)*slices ] = Vec3(cosT*cosP,sinT*cosP,sinP);
+    std::vector< unsigned int > vertices;
+    std::vector< float > colors;
+    for( unsigned int v = 0 ; v < mesh.V.size() ; ++v ) {
+        float r , g , b;
+        if(verticesAreMarkedForCurrentHandle[ v ]) {
+            r = g = b = 0.2f;
         }
-    }
-
-    int k1,k2;
-    glBegin(GL_TRIANGLES);
-    for(int i=1; i<=slices; i++)
-    {
-        k1 = i;
-        k2 = (i%slices+1);
-        glNormal(points[0]);
-        glVertex((centre + radius*points[0]));
-        glNormal(points[k1]);
-        glVertex((centre + radius*points[k1]));
-        glNormal(points[k2]);
-        glVertex((centre + radius*points[k2]));
-
-        k1 = (stacks-1)*slices+i;
-        k2 = (stacks-1)*slices+(i%slices+1);
-        glNormal(points[k1]);
-        glVertex((centre + radius*points[k1]));
-        glNormal(points[Nb-1]);
-        glVertex((centre + radius*points[Nb-1]));
-        glNormal(points[k2]);
-        glVertex((centre + radius*points[k2]));
-    }
-    glEnd();
-
-    glBegin(GL_QUADS);
-    for(int j=1; j<stacks; j++)
-    {
-        for(int i=1; i<=slices; i++)
-        {
-            k1 = i + (j-1)*slices;
-            k2 = (i%slices+1) + (j-1)*slices;
-            glNormal(points[k2]);
-            glVertex((centre + radius*points[k2]));
-            glNormal(points[k1]);
-            glVertex((centre + radius*points[k1]));
-
-            k1 = i + (j)*slices;
-            k2 = (i%slices+1) + (j)*slices;
-            glNormal(points[k1]);
-            glVertex((centre + radius*points[k1]));
-            glNormal(points[k2]);
-            glVertex((centre + radius*points[k2]));
+        else {
+            int handleIdx = verticesHandles[v];
+            if( handleIdx < 0 ) continue;
+            calc_RGB( handleIdx , 0 , numberOfHandles , r , g  , b );
+            if(handleIdx != activeHandle) {
+                r *= 0.5;  g *= 0.5;  b *= 0.5;
+            }
         }
+        vertices.push_back( v );
+        colors.push_back( r );  colors.push_back( g );  colors.push_back( b );
     }
-    glEnd();
+    handleMarkers.setMarkers( vertices , colors );
+    handleMarkersAreUpToDate = true;
+    markedActiveHandle = activeHandle;
+    markedNumberOfHandles = numberOfHandles;
 }
 
 void drawHandles() {
-    glEnable(GL_LIGHTING);
-    glColor3f(0.2,0.2,0.2);
-    for( unsigned int v = 0 ; v < mesh.V.size() ; ++v ) {
-        Vec3 const & p = mesh.V[ v ].p;
-        if(verticesAreMarkedForCurrentHandle[ v ])
-            drawSphere( p[0] , p[1] , p[2] , spheresSize , 10 , 10 );
-    }
-
-    for( unsigned int v = 0 ; v < mesh.V.size() ; ++v ) {
-        Vec3 const & p = mesh.V[ v ].p;
-        if(! verticesAreMarkedForCurrentHandle[ v ]) {
-            int handleIdx = verticesHandles[v];
-            if( handleIdx >= 0 ) {
-                float r , g , b;
-                calc_RGB( handleIdx , 0 , numberOfHandles , r , g  , b );
-                if(handleIdx != activeHandle) {
-                    r *= 0.5;  g *= 0.5;  b *= 0.5;
-                }
-                glColor3f(r,g,b);
-                drawSphere( p[0] , p[1] , p[2] , spheresSize , 10 , 10 );
-            }
-        }
-    }
+    updateHandleMarkers();
+    handleMarkers.draw( mesh , spheresSize );
 }
 
 
@@ -667,21 +603,23 @@ void draw () {
     glEnable(GL_LIGHTING);
     glDisable(GL_BLEND);
     glColor3f(0.4,0.4,0.8);
-    mesh.draw();
+    meshRenderer.draw( mesh );
     drawHandles();
     rectangleSelectionTool.draw();
+    sphereSelectionTool.draw();
 }
 
 void display () {
+    Timer frameTimer;
+    renderScheduler.beginFrame();
     glLoadIdentity ();
     glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     camera.apply ();
     draw ();
     glFlush ();
+    renderScheduler.addDrawMs( frameTimer.elapsedMs() );   // without the wait for the buffer swap
     glutSwapBuffers ();
-}
 
-void idle () {
     static float lastTime = glutGet ((GLenum)GLUT_ELAPSED_TIME);
     static unsigned int counter = 0;
     counter++;
@@ -694,7 +632,31 @@ void idle () {
         glutSetWindowTitle (winTitle);
         lastTime = currentTime;
     }
-    glutPostRedisplay ();
+}
+
+void idle () {
+    if( arapSolverThread.fetchPositions( mesh ) ) {
+        meshPositionsWereChanged();
+        renderScheduler.requestRedraw();
+    }
+    static std::vector< double > solveMs;
+    arapSolverThread.takeSolveMs( solveMs );
+    for( unsigned int i = 0 ; i < solveMs.size() ; ++i ) renderScheduler.addSolveMs( solveMs[i] );
+    solveMs.clear();
+
+    if( renderScheduler.frameIsDue() )
+        glutPostRedisplay ();
+    else if( renderScheduler.hasPendingFrame()  ||  arapSolverThread.isBusy() )
+        // waiting for the pacing or for the solver thread, which cannot wake up GLUT: poll every millisecond at most
+        std::this_thread::sleep_for( std::chrono::microseconds( (long long)( 1000.0 * std::min( renderScheduler.msUntilNextFrame() , 1.0 ) ) + 100 ) );
+    else
+        glutIdleFunc (0);   // nothing to do before the next event
+}
+
+// from the input callbacks: something to draw , and maybe a solve to wait for
+void requestRedraw () {
+    renderScheduler.requestRedraw();
+    glutIdleFunc (idle);
 }
 
 
@@ -763,6 +725,7 @@ void SpecialInput(int key, int x, int y)
         }
         break;
     }
+    requestRedraw ();
 }
 
 
@@ -828,6 +791,139 @@ void key (unsigned char keyPressed, int x, int y) {
         }
         break;
 
+    case 'l':
+        if( viewerState == ViewerState_NORMAL ) {
+            arapSolverThread.postCommand( []{
+                ArapSolver::GlobalStepMode mode = arapSolver.globalStepMode();
+                if( mode == ArapSolver::GlobalStep_Laplacian ) {
+                    mode = ArapSolver::GlobalStep_NormalEquations;
+                    cout << "ARAP global step: normal equations (3E x 3V)" << endl;
+                }
+                else if( mode == ArapSolver::GlobalStep_NormalEquations ) {
+                    mode = ArapSolver::GlobalStep_Subspace;
+                    if( arapSolver.subspaceBasis().dimension() == 0 ) {
+                        arapSolver.computeSubspaceBasis( arapSubspaceDimension , arapCacheDirectory );
+                        cout << "ARAP subspace basis: " << arapSolver.subspaceBasis().dimension() << " Laplacian eigenvectors "
+                             << ( arapSolver.subspaceBasis().loadedFromCache() ? "read from " + arapCacheDirectory :
+                                  arapCacheDirectory.empty() ? std::string( "computed" ) : "computed and written to " + arapCacheDirectory )
+                             << " (" << arapSolver.subspaceBasis().buildMs() << " ms)" << endl;
+                    }
+                    cout << "ARAP global step: subspace of " << arapSolver.subspaceBasis().dimension() << " eigenvectors" << endl;
+                }
+                else {
+                    mode = ArapSolver::GlobalStep_Laplacian;
+                    cout << "ARAP global step: cotangent Laplacian (V x V, 3 columns)" << endl;
+                }
+                arapSolver.setGlobalStepMode( mode );
+                // the region has its own mesh, the subspace is only for the whole mesh
+                arapRegionOfInterestSolver.setGlobalStepMode( mode == ArapSolver::GlobalStep_Subspace ? ArapSolver::GlobalStep_Laplacian : mode );
+            } );
+        }
+        break;
+
+    case 't':
+        printArapTimings = ! printArapTimings;
+        arapSolverThread.setPrintTimings( printArapTimings );
+        break;
+
+    case 'a':
+        arapStoppingCriteria.andersonWindow = ( arapStoppingCriteria.andersonWindow == 0 ) ? 5 : 0;
+        arapSolverThread.setStoppingCriteria( arapStoppingCriteria );
+        cout << "ARAP Anderson acceleration: " << ( arapStoppingCriteria.andersonWindow == 0 ? "off" : "on" ) << endl;
+        break;
+
+    case 'b':
+        arapBudgetMs = ( arapBudgetMs == 0.0 ) ? 8.0 : ( arapBudgetMs == 8.0 ) ? 16.0 : 0.0;
+        arapSolverThread.setBudgetMs( arapBudgetMs );
+        if( arapBudgetMs == 0.0 ) cout << "ARAP time budget: none" << endl;
+        else cout << "ARAP time budget: " << arapBudgetMs << " ms per slice" << endl;
+        break;
+
+    case 'm':
+        if( viewerState == ViewerState_NORMAL ) {
+            arapMultiresolutionMode = ArapMultiresolutionMode( ( arapMultiresolutionMode + 1 ) % 3 );
+            // the proxy is built on the solver thread: the solver is chosen there as well
+            ArapMultiresolutionMode mode = arapMultiresolutionMode;
+            arapSolverThread.postCommand( [mode]{
+                if( mode != ArapMultiresolution_Off  &&  arapMultiresolutionSolver.coarseMesh().V.empty() ) {
+                    arapMultiresolutionSolver.threadPool().setNumberOfThreads( arapSolver.threadPool().numberOfThreads() );
+                    if( arapMultiresolutionSolver.setMesh( arapMesh , std::min< unsigned int >( arapMaxCoarseVertices , arapMesh.V.size() / 4 ) ) )
+                        cout << "ARAP coarse proxy: " << arapMultiresolutionSolver.coarseMesh().V.size() << " vertices , "
+                             << arapMultiresolutionSolver.coarseMesh().T.size() << " triangles (" << arapMultiresolutionSolver.buildMs() << " ms)" << endl;
+                    else {
+                        cout << "ARAP coarse proxy: no triangle in the mesh, the full resolution solver is kept" << endl;
+                        arapSolverThread.setMultiresolutionSolver( 0 );
+                        return;
+                    }
+                }
+                arapMultiresolutionSolver.setFineLevel( &arapSolver , mode == ArapMultiresolution_ProxyAndFineIterations ? arapFineIterations : 0 );
+                arapSolverThread.setMultiresolutionSolver( mode == ArapMultiresolution_Off ? 0 : &arapMultiresolutionSolver );
+                if( mode == ArapMultiresolution_Off ) cout << "ARAP multiresolution: off" << endl;
+                else if( mode == ArapMultiresolution_Proxy ) cout << "ARAP multiresolution: coarse proxy" << endl;
+                else cout << "ARAP multiresolution: coarse proxy and " << arapFineIterations << " iterations on the mesh" << endl;
+            } );
+            handlesWereChanged = true;
+        }
+        break;
+
+    case 'k':
+        if( viewerState == ViewerState_NORMAL ) {
+            arapSolverThread.postCommand( []{
+                unsigned int numberOfVertices = arapMesh.V.size();
+                arapRotationClusters = ( arapRotationClusters == 0 ) ? numberOfVertices / 10 : ( arapRotationClusters > numberOfVertices / 50 ) ? numberOfVertices / 50 : 0;
+                arapSolver.setRotationClusters( arapRotationClusters );
+                if( arapSolver.numberOfRotationClusters() == 0 ) cout << "ARAP rotations: one per vertex" << endl;
+                else cout << "ARAP rotations: " << arapSolver.numberOfRotationClusters() << " clusters" << endl;
+            } );
+        }
+        break;
+
+    case 'o':
+        if( viewerState == ViewerState_NORMAL ) {
+            arapRegionOfInterest = ! arapRegionOfInterest;
+            if( arapRegionOfInterest ) {
+                arapSolverThread.postCommand( []{
+                    arapRegionOfInterestSolver.threadPool().setNumberOfThreads( arapSolver.threadPool().numberOfThreads() );
+                    arapRegionOfInterestSolver.setGlobalStepMode( arapSolver.globalStepMode() );
+                    arapRegionOfInterestSolver.setMesh( arapMesh );
+                } );
+            }
+            arapSolverThread.setRegionOfInterestSolver( arapRegionOfInterest ? &arapRegionOfInterestSolver : 0 );
+            cout << "ARAP region of interest: " << ( arapRegionOfInterest ? "on" : "off" ) << endl;
+            handlesWereChanged = true;
+        }
+        break;
+
+    case '+':
+    case '-':
+        arapSolverThread.postCommand( [keyPressed]{
+            unsigned int numberOfThreads = arapSolver.threadPool().numberOfThreads();
+            if( keyPressed == '+' ) ++numberOfThreads;
+            else if( numberOfThreads > 1 ) --numberOfThreads;
+            arapSolver.threadPool().setNumberOfThreads( numberOfThreads );
+            arapMultiresolutionSolver.threadPool().setNumberOfThreads( numberOfThreads );
+            arapRegionOfInterestSolver.threadPool().setNumberOfThreads( numberOfThreads );
+            cout << "ARAP threads: " << numberOfThreads << endl;
+        } );
+        break;
+
+    case 'v':
+        selectHiddenVertices = ! selectHiddenVertices;
+        cout << "Selection of the hidden vertices: " << ( selectHiddenVertices ? "on" : "off" ) << endl;
+        break;
+
+    case 'p':
+        renderScheduler.setMinimumFrameMs( renderScheduler.minimumFrameMs() == 0.0 ? 1000.0 / 60.0 : renderScheduler.minimumFrameMs() < 20.0 ? 1000.0 / 30.0 : 0.0 );
+        if( renderScheduler.minimumFrameMs() == 0.0 ) cout << "Frame pacing: none" << endl;
+        else cout << "Frame pacing: " << renderScheduler.minimumFrameMs() << " ms between frames" << endl;
+        break;
+
+    case 'h':
+        renderScheduler.print( cout );
+        if( renderScheduler.writeCsv( frameTimesFileName ) ) cout << "Frame times written to " << frameTimesFileName << endl;
+        else cerr << "gmini: cannot write " << frameTimesFileName << endl;
+        break;
+
     case 's':
         if(selectionToolState == SelectionTool_Rectangle)
         {
@@ -843,7 +939,7 @@ void key (unsigned char keyPressed, int x, int y) {
         printUsage ();
         break;
     }
-    idle ();
+    requestRedraw ();
 }
 
 
@@ -870,6 +966,7 @@ void mouse (int button, int state, int x, int y) {
                         sphereSelectionTool.initSphere(pos, selectionRadius);
                         sphereSelectionTool.isAdding = true;
                         sphereSelectionTool.isActive = true;
+                        beginSphereStroke();
                     }
                 } else if (button == GLUT_RIGHT_BUTTON) {
                     if(selectionToolState == SelectionTool_Rectangle)
@@ -886,6 +983,7 @@ void mouse (int button, int state, int x, int y) {
                         sphereSelectionTool.initSphere(pos, selectionRadius);
                         sphereSelectionTool.isAdding = false;
                         sphereSelectionTool.isActive = true;
+                        beginSphereStroke();
                     }
                 }
             }
@@ -920,7 +1018,7 @@ void mouse (int button, int state, int x, int y) {
             updateSphereRadiusWithScroll(button);
         }
     }
-    idle ();
+    requestRedraw ();
 }
 
 void motion (int x, int y) {
@@ -942,18 +1040,26 @@ void motion (int x, int y) {
             lastZoom = y;
         }
     }
+    requestRedraw ();
 }
 
 
 void reshape(int w, int h) {
     camera.resize (w, h);
+    requestRedraw ();
 }
 
 
 int main (int argc, char ** argv) {
-    if (argc > 2) {
-        printUsage ();
-        exit (EXIT_FAILURE);
+    std::string meshFileName = "models/arma.off";
+    for( int a = 1 ; a < argc ; ++a ) {
+        std::string argument = argv[a];
+        if( argument == "--cache"  &&  a + 1 < argc ) arapCacheDirectory = argv[++a];
+        else if( a == argc - 1  &&  argument.compare( 0 , 2 , "--" ) != 0 ) meshFileName = argument;
+        else {
+            printUsage ();
+            exit (EXIT_FAILURE);
+        }
     }
     glutInit (&argc, argv);
     glutInitDisplayMode (GLUT_RGBA | GLUT_DEPTH | GLUT_DOUBLE);
@@ -970,13 +1076,17 @@ int main (int argc, char ** argv) {
     glutSpecialFunc(SpecialInput);
     key ('?', 0, 0);
 
-    mesh.loadOFF(argc == 2 ? argv[1] : "models/arma.off");
+    if( ! mesh.loadOFF( meshFileName ) ) {
+        cerr << "gmini: cannot read " << meshFileName << endl;
+        exit (EXIT_FAILURE);
+    }
     verticesAreMarkedForCurrentHandle.resize( mesh.V.size() , false );
     verticesHandles.resize( mesh.V.size() , -1 );
-    edgeAndVertexWeights.buildCotangentWeightsOfTriangleMesh( mesh);
-    Eigen::MatrixXd idMatrix(3,3);
-    idMatrix(0,0) = 1.0;   idMatrix(1,1) = 1.0;   idMatrix(2,2) = 1.0;
-    vertexRotationMatrices.resize( mesh.V.size() , idMatrix );
+    arapMesh = mesh;
+    arapSolver.setFactorizationCacheDirectory( arapCacheDirectory );
+    arapSolver.setMesh( arapMesh );
+    arapSolverThread.setStoppingCriteria( arapStoppingCriteria );
+    arapSolverThread.start( arapMesh , arapSolver );
 
     glutMainLoop ();
     return EXIT_SUCCESS;
@@ -0,0 +1,22 @@
+#include "AllocationCounter.h"
+#include <atomic>
+
+// Both are constant initialized: the hooks may count allocations done before the dynamic initialization.
+static std::atomic< unsigned long long > allocationCount( 0 );
+static bool hooksAreLinked = false;
+
+bool AllocationCounter::isAvailable() {
+    return hooksAreLinked;
+}
+
+unsigned long long AllocationCounter::numberOfAllocations() {
+    return allocationCount.load( std::memory_order_relaxed );
+}
+
+void AllocationCounter::setAvailable() {
+    hooksAreLinked = true;
+}
+
+void AllocationCounter::countAllocation() {
+    allocationCount.fetch_add( 1 , std::memory_order_relaxed );
+}
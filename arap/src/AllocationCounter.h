@@ -0,0 +1,16 @@
+#ifndef AllocationCounter_H
+#define AllocationCounter_H
+
+// Number of heap allocations (malloc, calloc, realloc, aligned allocations, hence also operator new)
+// done by the program since it started. Only the programs linked with AllocationHooks.cpp count them
+// (arapbench and arapbatch, on glibc systems): elsewhere isAvailable() is false and the count stays 0.
+namespace AllocationCounter {
+    bool isAvailable();
+    unsigned long long numberOfAllocations();
+
+    // called by AllocationHooks.cpp
+    void setAvailable();
+    void countAllocation();
+}
+
+#endif // AllocationCounter_H
@@ -0,0 +1,64 @@
+#include "AllocationCounter.h"
+#include <cstddef>
+#include <cerrno>
+
+//-------------------------------------------------------------------------------------//
+//
+// The C allocation functions are redefined here, counted, and forwarded to the glibc
+// implementation. Eigen allocates with std::malloc and operator new ends up in malloc too,
+// so that every heap allocation of the program goes through the counter.
+//   This replaces the allocator of the whole process: only the benchmarks link this file
+// (see the Makefile), gmini keeps the allocator of the system.
+//
+//-------------------------------------------------------------------------------------//
+
+#ifdef __GLIBC__
+
+extern "C" {
+void * __libc_malloc( size_t size );
+void * __libc_calloc( size_t number , size_t size );
+void * __libc_realloc( void * pointer , size_t size );
+void * __libc_memalign( size_t alignment , size_t size );
+void __libc_free( void * pointer );
+
+void * malloc( size_t size ) {
+    AllocationCounter::countAllocation();
+    return __libc_malloc( size );
+}
+
+void * calloc( size_t number , size_t size ) {
+    AllocationCounter::countAllocation();
+    return __libc_calloc( number , size );
+}
+
+void * realloc( void * pointer , size_t size ) {
+    AllocationCounter::countAllocation();
+    return __libc_realloc( pointer , size );
+}
+
+void * memalign( size_t alignment , size_t size ) {
+    AllocationCounter::countAllocation();
+    return __libc_memalign( alignment , size );
+}
+
+void * aligned_alloc( size_t alignment , size_t size ) {
+    return memalign( alignment , size );
+}
+
+int posix_memalign( void ** pointer , size_t alignment , size_t size ) {
+    // a power of two multiple of sizeof(void*), as POSIX requires
+    if( alignment == 0  ||  alignment % sizeof( void * ) != 0  ||  ( alignment & ( alignment - 1 ) ) != 0 ) return EINVAL;
+    void * result = memalign( alignment , size );
+    if( result == 0 && size != 0 ) return ENOMEM;
+    *pointer = result;
+    return 0;
+}
+
+void free( void * pointer ) {
+    __libc_free( pointer );
+}
+}
+
+static bool hooksAreRegistered = ( AllocationCounter::setAvailable() , true );
+
+#endif
@@ -0,0 +1,112 @@
+#include "ArapJob.h"
+#include "ArapSolver.h"
+#include "ArapScript.h"
+#include "Timer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+
+unsigned long long estimateArapMemoryBytes( Mesh const & mesh , unsigned int andersonWindow ) {
+    unsigned long long nV = mesh.V.size() , nT = mesh.T.size();
+    unsigned long long nE = 3 * nT;                               // directed edges (each edge is seen by its two triangles)
+    unsigned long long laplacianNonZeros = nE + nV;
+    unsigned long long factorNonZeros = (unsigned long long)( 2.0 * nV * std::log2( double( std::max( nV , 2ULL ) ) ) );
+    unsigned long long entry = sizeof( double ) + sizeof( int );   // value and index of a sparse entry
+
+    unsigned long long bytes = nV * sizeof( MeshVertex ) + nT * sizeof( MeshTriangle );
+    bytes += nE * ( sizeof( unsigned int ) + sizeof( double ) );                       // weights
+    bytes += nE * ( 3 * sizeof( double ) + sizeof( unsigned int ) + sizeof( double ) ); // rest edges
+    bytes += 3 * laplacianNonZeros * entry;                                           // right-hand side operator K (V x 3V)
+    bytes += 2 * laplacianNonZeros * entry + laplacianNonZeros * ( 2 * sizeof( int ) + sizeof( double ) );   // L , L_ff and their triplets
+    bytes += factorNonZeros * entry;
+    bytes += nV * ( 9 + 8 * 3 + 4 * 3 ) * sizeof( double );                           // rotations , positions and dense buffers
+    bytes += 2ULL * andersonWindow * 3 * nV * sizeof( double );                       // Anderson history
+    return bytes;
+}
+
+
+// false with result.error set when the job fails
+static bool runJob( ArapJob const & job , ArapJobSettings const & settings , ArapJobResult & result ) {
+    if( job.outputFile == job.meshFile ) {
+        result.error = "the output would overwrite the input";
+        return false;
+    }
+    std::ifstream script( job.scriptFile.c_str() );
+    if( !script ) {
+        result.error = "cannot open " + job.scriptFile;
+        return false;
+    }
+    Mesh mesh;
+    if( ! mesh.loadOFF( job.meshFile ) ) {
+        result.error = "cannot read " + job.meshFile;
+        return false;
+    }
+    result.numberOfVertices = mesh.V.size();
+    result.numberOfTriangles = mesh.T.size();
+
+    // the Anderson window is only known while the script runs: checked again at each frame
+    bool overBudget = false;
+    auto checkBudget = [&]( unsigned int andersonWindow ) {
+        result.estimatedBytes = std::max( result.estimatedBytes , estimateArapMemoryBytes( mesh , andersonWindow ) );
+        overBudget = ( settings.memoryBudgetBytes > 0  &&  result.estimatedBytes > settings.memoryBudgetBytes );
+        if( overBudget ) {
+            std::ostringstream message;
+            message << "estimated memory " << ( result.estimatedBytes >> 20 ) << " MB exceeds the budget of "
+                    << ( settings.memoryBudgetBytes >> 20 ) << " MB";
+            result.error = message.str();
+        }
+        return ! overBudget;
+    };
+    if( ! checkBudget( 0 ) ) return false;
+
+    ArapSolver solver;
+    solver.threadPool().setNumberOfThreads( std::max( settings.numberOfThreads , 1u ) );
+    solver.setFactorizationCacheDirectory( settings.cacheDirectory );
+    solver.setMesh( mesh );
+    std::vector< int > verticesHandles( mesh.V.size() , -1 );
+    ArapSolver::StoppingCriteria stoppingCriteria;
+    ArapScript arapScript( mesh , verticesHandles , stoppingCriteria );
+
+    std::string error;
+    bool solveFailed = false;
+    bool ok = arapScript.run( script , [&]() {
+        if( overBudget  ||  solveFailed  ||  ! checkBudget( stoppingCriteria.andersonWindow ) ) return;
+        if( arapScript.handlesWereChanged() ) {
+            solver.setHandles( verticesHandles );
+            arapScript.handlesWereApplied();
+        }
+        solver.setStoppingCriteria( stoppingCriteria );
+        if( ! solver.solve() ) {
+            std::ostringstream message;
+            message << "the solve of frame " << result.frames + 1 << " failed (no handle vertex?)";
+            result.error = message.str();
+            solveFailed = true;
+            return;
+        }
+        ++result.frames;
+        result.iterations += solver.timings().iterations;
+        if( ! solver.energies().empty() ) result.energy = solver.energies().back();
+    } , error );
+    if( overBudget  ||  solveFailed ) return false;
+    if( !ok ) {
+        result.error = job.scriptFile + ": " + error;
+        return false;
+    }
+
+    if( ! mesh.saveOFF( job.outputFile ) ) {
+        result.error = "cannot write " + job.outputFile;
+        return false;
+    }
+    return true;
+}
+
+ArapJobResult runArapJob( ArapJob const & job , ArapJobSettings const & settings ) {
+    Timer timer;
+    ArapJobResult result;
+    result.ok = runJob( job , settings , result );
+    result.totalMs = timer.elapsedMs();
+    return result;
+}
@@ -0,0 +1,53 @@
+#ifndef ArapJob_H
+#define ArapJob_H
+
+#include <string>
+
+#include "Mesh.h"
+
+
+//-------------------------------------------------------------------------------------//
+//
+// One offline deformation: loads an OFF mesh, runs a handle script on it (see ArapScript.h,
+// one ARAP solve per frame) and writes the deformed mesh, in the frame of the input file.
+//   runArapJob() only uses its own mesh and solver (no global state), so that several jobs can
+//   run at the same time on different threads (see arapbatch).
+//
+//-------------------------------------------------------------------------------------//
+struct ArapJob {
+    std::string meshFile , scriptFile , outputFile;
+
+    ArapJob() {}
+    ArapJob( std::string const & meshFile_ , std::string const & scriptFile_ , std::string const & outputFile_ ) :
+        meshFile(meshFile_) , scriptFile(scriptFile_) , outputFile(outputFile_) {}
+};
+
+struct ArapJobSettings {
+    unsigned int numberOfThreads;              // of the solver of the job
+    unsigned long long memoryBudgetBytes;      // a job whose estimated memory is larger fails before solving , 0 : no budget
+    std::string cacheDirectory;                // of the weights and factorizations (see ArapSolver::setFactorizationCacheDirectory()) , empty : none
+
+    ArapJobSettings( unsigned int numberOfThreads_ = 1 , unsigned long long memoryBudgetBytes_ = 0 ) :
+        numberOfThreads(numberOfThreads_) , memoryBudgetBytes(memoryBudgetBytes_) {}
+};
+
+struct ArapJobResult {
+    bool ok;
+    std::string error;
+    unsigned int numberOfVertices , numberOfTriangles , frames , iterations;
+    double energy;                              // at the end of the last frame
+    unsigned long long estimatedBytes;
+    double totalMs;
+
+    ArapJobResult() : ok(false) , numberOfVertices(0) , numberOfTriangles(0) , frames(0) , iterations(0) ,
+        energy(0.0) , estimatedBytes(0) , totalMs(0.0) {}
+};
+
+// Upper estimate of the memory of an ARAP solve of mesh with the Laplacian global step (the default of
+// ArapSolver): mesh, weights, right-hand side operator, Laplacian and its factor, per-vertex buffers.
+// The fill of the factor is estimated as 2 V log2(V) (about V log2(V) on the models).
+unsigned long long estimateArapMemoryBytes( Mesh const & mesh , unsigned int andersonWindow );
+
+ArapJobResult runArapJob( ArapJob const & job , ArapJobSettings const & settings );
+
+#endif // ArapJob_H
@@ -0,0 +1,134 @@
+#ifndef ArapRhsOperator_H
+#define ArapRhsOperator_H
+
+#include "../extern/eigen3/Eigen/Core"
+#include "../extern/eigen3/Eigen/SparseCore"
+
+#include <vector>
+
+#include "Mesh.h"
+#include "LaplacianWeights.h"
+
+
+//-------------------------------------------------------------------------------------//
+//
+// Everything the ARAP iterations need from the rest state, laid out in contiguous arrays:
+//   the edges (v , neighbor) of each vertex v are the range [ edgesBegin(v) , edgesEnd(v) [,
+//   in the order of the neighbors in LaplacianWeights, with their weight and their rest vector
+//   restEdge = pInit_neighbor - pInit_v.
+//
+// The right-hand side of the Laplacian global step is linear in the rotations:
+//   b_v = sum_j w_vj/2 (R_v + R_j) (pInit_v - pInit_j)  =  sum_u sum_k K( v , 3u+k ) R_u.col(k)
+// K (V x 3V, row major) is precomputed with the rest state, for all the vertices, so that it does not
+// depend on the handles, and an iteration only reads K and the rotations, without any allocation.
+//
+// With rotation clusters (R_u = C_c(u) , see RotationClusters.h) , b = K P C where P (3V x 3C) sums the
+// columns of the vertices of each cluster: K P is precomputed as well, and has much fewer non zeros per
+// row than K , since the neighbors of a vertex are mostly in its cluster.
+//
+//-------------------------------------------------------------------------------------//
+class ArapRhsOperator {
+    std::vector< unsigned int > _edgesBegin;          // V+1 entries
+    std::vector< unsigned int > _edgeNeighbor;
+    std::vector< double > _edgeWeight;
+    std::vector< Eigen::Vector3d > _restEdge;
+
+    Eigen::SparseMatrix< double , Eigen::RowMajor > _K;   // V x 3V
+    Eigen::SparseMatrix< double , Eigen::RowMajor > _clusterK;   // V x 3C , K P
+
+    static void applyRow( Eigen::SparseMatrix< double , Eigen::RowMajor > const & K , unsigned int v ,
+                          std::vector< Eigen::Matrix3d > const & rotations , Eigen::Vector3d & b ) {
+        b.setZero();
+        for( Eigen::SparseMatrix< double , Eigen::RowMajor >::InnerIterator it( K , v ) ; it ; ++it ) {
+            unsigned int column = it.index();
+            b += it.value() * rotations[ column / 3 ].col( column % 3 );
+        }
+    }
+
+public:
+    ArapRhsOperator() {}
+    ~ArapRhsOperator() {}
+
+    // To be called when the mesh (or its rest state) changes.
+    void setRestState( Mesh const & mesh , LaplacianWeights const & weights ) {
+        unsigned int nV = mesh.V.size();
+        unsigned int nE = weights.get_n_edges();
+        _edgesBegin.resize( nV + 1 );
+        _edgeNeighbor.resize( nE );
+        _edgeWeight.resize( nE );
+        _restEdge.resize( nE );
+        for( unsigned int v = 0 ; v < nV ; ++v )
+            _edgesBegin[v] = weights.get_adjacent_edges_begin(v);
+        _edgesBegin[nV] = nE;
+        std::vector< Eigen::Triplet< double > > triplets;
+        triplets.reserve( 6 * nE );
+        for( unsigned int v = 0 ; v < nV ; ++v ) {
+            for( unsigned int e = edgesBegin(v) ; e < edgesEnd(v) ; ++e ) {
+                unsigned int vNeighbor = weights.get_edge_vertex(e);
+                _edgeNeighbor[e] = vNeighbor;
+                _edgeWeight[e] = weights.get_edge_weight_of_index(e);
+                for( unsigned int coord = 0 ; coord < 3 ; ++coord )
+                    _restEdge[e][coord] = mesh.V[vNeighbor].pInit[coord] - mesh.V[v].pInit[coord];
+                for( unsigned int k = 0 ; k < 3 ; ++k ) {
+                    double coefficient = - 0.5 * _edgeWeight[e] * _restEdge[e][k];
+                    triplets.push_back( Eigen::Triplet< double >( v , 3*v + k , coefficient ) );
+                    triplets.push_back( Eigen::Triplet< double >( v , 3*vNeighbor + k , coefficient ) );
+                }
+            }
+        }
+        _K.resize( nV , 3 * nV );
+        _K.setFromTriplets( triplets.begin() , triplets.end() );
+        _K.makeCompressed();
+        _clusterK.resize( 0 , 0 );
+    }
+
+    // K P for the clusters of the vertices ( clusterOfVertex[v] < numberOfClusters ).
+    void setRotationClusters( std::vector< unsigned int > const & clusterOfVertex , unsigned int numberOfClusters ) {
+        std::vector< Eigen::Triplet< double > > triplets;
+        triplets.reserve( _K.nonZeros() );
+        for( int v = 0 ; v < _K.outerSize() ; ++v )
+            for( Eigen::SparseMatrix< double , Eigen::RowMajor >::InnerIterator it( _K , v ) ; it ; ++it )
+                triplets.push_back( Eigen::Triplet< double >( v , 3 * clusterOfVertex[ it.index() / 3 ] + it.index() % 3 , it.value() ) );
+        _clusterK.resize( _K.rows() , 3 * numberOfClusters );
+        _clusterK.setFromTriplets( triplets.begin() , triplets.end() );   // sums the duplicates
+        _clusterK.makeCompressed();
+    }
+
+    unsigned int numberOfVertices() const { return _edgesBegin.empty() ? 0 : _edgesBegin.size() - 1; }
+    unsigned int edgesBegin( unsigned int v ) const { return _edgesBegin[v]; }
+    unsigned int edgesEnd( unsigned int v ) const { return _edgesBegin[v+1]; }
+    unsigned int edgeNeighbor( unsigned int e ) const { return _edgeNeighbor[e]; }
+    double edgeWeight( unsigned int e ) const { return _edgeWeight[e]; }
+    Eigen::Vector3d const & restEdge( unsigned int e ) const { return _restEdge[e]; }
+
+    // S_v = sum_j w_vj e_vj restEdge_vj^T and sum_j w_vj ( |e_vj|^2 + |restEdge_vj|^2 ) , with e_vj = position(j) - position(v)
+    // ( position(u)[coord] gives the current coordinates of u ).
+    template< class Positions >
+    void vertexTensor( unsigned int v , Positions const & position , Eigen::Matrix3d & tensor , double & squaredLengths ) const {
+        tensor.setZero();
+        squaredLengths = 0.0;
+        for( unsigned int e = edgesBegin(v) ; e < edgesEnd(v) ; ++e ) {
+            unsigned int vNeighbor = _edgeNeighbor[e];
+            Eigen::Vector3d rotatedEdge;
+            for( unsigned int coord = 0 ; coord < 3 ; ++coord )
+                rotatedEdge[coord] = position(vNeighbor)[coord]  -  position(v)[coord];
+            tensor.noalias() += _edgeWeight[e] * (rotatedEdge * _restEdge[e].transpose());
+            squaredLengths += _edgeWeight[e] * ( rotatedEdge.squaredNorm() + _restEdge[e].squaredNorm() );
+        }
+    }
+
+    unsigned int numberOfRows() const { return _K.rows(); }
+    unsigned int nonZeros() const { return _K.nonZeros(); }
+    unsigned int clusterNonZeros() const { return _clusterK.nonZeros(); }
+
+    // b_v = row v of K . (stacked rotations)
+    void applyRow( unsigned int v , std::vector< Eigen::Matrix3d > const & rotations , Eigen::Vector3d & b ) const {
+        applyRow( _K , v , rotations , b );
+    }
+    // b_v = row v of K P . (stacked rotations of the clusters)
+    void applyClusterRow( unsigned int v , std::vector< Eigen::Matrix3d > const & clusterRotations , Eigen::Vector3d & b ) const {
+        applyRow( _clusterK , v , clusterRotations , b );
+    }
+};
+
+#endif // ArapRhsOperator_H
@@ -0,0 +1,93 @@
+#include "ArapScript.h"
+
+#include <sstream>
+
+
+ArapScript::ArapScript( Mesh & mesh , std::vector< int > & verticesHandles , ArapSolver::StoppingCriteria & stoppingCriteria ) :
+    _mesh(mesh) , _verticesHandles(verticesHandles) , _stoppingCriteria(stoppingCriteria) , _activeHandle(0) , _handlesWereChanged(false) {
+}
+
+bool ArapScript::addVertexToActiveHandle( unsigned int v ) {
+    if( v >= _mesh.V.size() ) return false;
+    _verticesHandles[v] = _activeHandle;
+    _handlesWereChanged = true;
+    return true;
+}
+
+bool ArapScript::run( std::istream & script , std::function< void() > const & runFrame , std::string & error ) {
+    std::string line;
+    unsigned int lineNumber = 0;
+    while( std::getline( script , line ) ) {
+        ++lineNumber;
+        line = line.substr( 0 , line.find('#') );
+        std::istringstream in( line );
+        std::string command;
+        if( !( in >> command ) ) continue;
+
+        bool ok = true;
+        std::ostringstream problem;   // why the line is rejected, when it could be read
+        if( command == "iterations" ) {
+            ok = bool( in >> _stoppingCriteria.maxIterations )  &&  _stoppingCriteria.maxIterations > 0;
+            _stoppingCriteria.relativeEnergyTolerance = 0.0;
+        }
+        else if( command == "converge" ) {
+            ok = bool( in >> _stoppingCriteria.relativeEnergyTolerance >> _stoppingCriteria.maxIterations )  &&  _stoppingCriteria.maxIterations > 0;
+        }
+        else if( command == "anderson" ) {
+            ok = bool( in >> _stoppingCriteria.andersonWindow )  &&  _stoppingCriteria.andersonWindow <= ArapSolver::MaxAndersonWindow;
+        }
+        else if( command == "handle" ) {
+            ok = bool( in >> _activeHandle )  &&  _activeHandle >= 0;
+        }
+        else if( command == "vertices" ) {
+            unsigned int v;
+            while( ok  &&  in >> v ) {
+                ok = addVertexToActiveHandle( v );
+                if( !ok ) problem << "vertex " << v << " is out of the mesh (" << _mesh.V.size() << " vertices)";
+            }
+            ok = ok  &&  in.eof();
+        }
+        else if( command == "ball" ) {
+            Vec3 center;  double radius;
+            ok = bool( in >> center[0] >> center[1] >> center[2] >> radius );
+            for( unsigned int v = 0 ; ok  &&  v < _mesh.V.size() ; ++v )
+                if( ( _mesh.V[v].pInit - center ).length() <= radius ) addVertexToActiveHandle( v );
+        }
+        else if( command == "slab" ) {
+            unsigned int axis;  double minValue , maxValue;
+            ok = bool( in >> axis >> minValue >> maxValue )  &&  axis < 3;
+            for( unsigned int v = 0 ; ok  &&  v < _mesh.V.size() ; ++v )
+                if( _mesh.V[v].pInit[axis] >= minValue  &&  _mesh.V[v].pInit[axis] <= maxValue ) addVertexToActiveHandle( v );
+        }
+        else if( command == "translate" ) {
+            Vec3 translation;  unsigned int numberOfFrames = 1;
+            ok = bool( in >> translation[0] >> translation[1] >> translation[2] );
+            in >> numberOfFrames;
+            for( unsigned int f = 0 ; ok  &&  f < numberOfFrames ; ++f ) {
+                ArapSolver::translateHandle( _mesh , _verticesHandles , _activeHandle , translation );
+                runFrame();
+            }
+        }
+        else if( command == "rotate" ) {
+            Vec3 axis;  double angle;  unsigned int numberOfFrames = 1;
+            ok = bool( in >> axis[0] >> axis[1] >> axis[2] >> angle )  &&  axis.length() > 0.0;
+            in >> numberOfFrames;
+            if( ok ) axis.normalize();
+            for( unsigned int f = 0 ; ok  &&  f < numberOfFrames ; ++f ) {
+                ArapSolver::rotateHandle( _mesh , _verticesHandles , _activeHandle , axis , angle );
+                runFrame();
+            }
+        }
+        else ok = false;
+
+        if( !ok ) {
+            std::ostringstream message;
+            message << "script line " << lineNumber << ": ";
+            if( problem.str().empty() ) message << "cannot read \"" << line << "\"";
+            else message << problem.str();
+            error = message.str();
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,52 @@
+#ifndef ArapScript_H
+#define ArapScript_H
+
+#include <vector>
+#include <string>
+#include <istream>
+#include <functional>
+
+#include "Mesh.h"
+#include "ArapSolver.h"
+
+
+//-------------------------------------------------------------------------------------//
+//
+// Handle script, one command per line ('#' starts a comment):
+//   iterations N                     exactly N ARAP iterations per frame (5 by default)
+//   converge tolerance N             iterates until the energy decreases by less than tolerance (relative), at most N times
+//   anderson M                       Anderson acceleration with a window of M iterates (0 disables it)
+//   handle H                         following commands apply to handle H
+//   vertices i j k ...               adds the given vertices to the handle (an index out of the mesh is an error)
+//   ball x y z r                     adds the vertices whose rest position is within r of (x,y,z)
+//   slab axis min max                adds the vertices whose rest coordinate axis (0,1,2) is in [min,max]
+//   translate dx dy dz [frames]      translates the handle by (dx,dy,dz) at each frame (1 frame by default)
+//   rotate ax ay az angle [frames]   rotates the handle around its center, by angle (radians) at each frame
+// Positions are those of the mesh once centered and scaled to the unit box (see Mesh::loadOFF).
+//
+// The script edits the handles and moves the handle vertices of the mesh, the caller solves:
+// run() calls runFrame() after each frame of translate / rotate.
+//
+//-------------------------------------------------------------------------------------//
+class ArapScript {
+    Mesh & _mesh;
+    std::vector< int > & _verticesHandles;
+    ArapSolver::StoppingCriteria & _stoppingCriteria;
+    int _activeHandle;
+    bool _handlesWereChanged;
+
+    bool addVertexToActiveHandle( unsigned int v );   // false if v is not a vertex of the mesh
+
+public:
+    // verticesHandles has one entry per vertex of mesh (-1 : not a handle vertex)
+    ArapScript( Mesh & mesh , std::vector< int > & verticesHandles , ArapSolver::StoppingCriteria & stoppingCriteria );
+
+    // false at the first line that cannot be read or names a vertex out of the mesh, error tells which one
+    bool run( std::istream & script , std::function< void() > const & runFrame , std::string & error );
+
+    // Handle vertices added since the last call to handlesWereApplied(), to give them to the solver before solving
+    bool handlesWereChanged() const { return _handlesWereChanged; }
+    void handlesWereApplied() { _handlesWereChanged = false; }
+};
+
+#endif // ArapScript_H
@@ -0,0 +1,780 @@
+#include "ArapSolver.h"
+#include "ClosestRotation.h"
+#include "AllocationCounter.h"
+#include "MeshHash.h"
+#include "CacheDirectory.h"
+#include "Timer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+
+#include "../extern/eigen3/Eigen/Cholesky"
+#include "../extern/eigen3/Eigen/Geometry"
+
+
+ArapSolver::Timings & ArapSolver::Timings::operator += ( Timings const & t ) {
+    weightsMs += t.weightsMs;
+    assemblyMs += t.assemblyMs;
+    factorizationMs += t.factorizationMs;
+    rhsMs += t.rhsMs;
+    solveMs += t.solveMs;
+    localStepMs += t.localStepMs;
+    transferMs += t.transferMs;
+    iterations += t.iterations;
+    rejectedAccelerations += t.rejectedAccelerations;
+    systemUpdates += t.systemUpdates;
+    incrementalSystemUpdates += t.incrementalSystemUpdates;
+    cachedSystemUpdates += t.cachedSystemUpdates;
+    allocations += t.allocations;
+    return *this;
+}
+
+void ArapSolver::Timings::print( std::ostream & out , unsigned int numberOfThreads ) const {
+    if( systemUpdates > 0 )
+        out << "ARAP handles changed: " << ( incrementalSystemUpdates > 0 ? "update of the existing factorization" :
+                                             cachedSystemUpdates > 0 ? "factorization read from the cache" : "new factorization" )
+            << " (assembly " << assemblyMs << " ms , factorization " << factorizationMs << " ms)" << std::endl;
+    out << "ARAP (" << iterations << " iterations, ";
+    if( rejectedAccelerations > 0 ) out << rejectedAccelerations << " rejected accelerations, ";
+    out << numberOfThreads << " threads) :"
+        << "  rhs " << rhsMs << " ms"
+        << "  solve " << solveMs << " ms"
+        << "  local step " << localStepMs << " ms";
+    if( transferMs > 0.0 )
+        out << "  transfer " << transferMs << " ms";
+    if( AllocationCounter::isAvailable() )
+        out << "  allocations " << allocations;
+    out << std::endl;
+}
+
+
+// weight of the handles in the subspace global step, relative to the mean diagonal of the Laplacian
+static const double SubspaceRelativeHandleWeight = 1e3;
+
+// cache files: magic , mesh hash , hash of the constrained vertices (0 for the weights) , V , then the content
+static const char WeightsCacheMagic[8] = { 'A' , 'R' , 'A' , 'P' , 'W' , 'G' , 'T' , '1' };
+static const char FactorizationCacheMagic[8] = { 'A' , 'R' , 'A' , 'P' , 'F' , 'A' , 'C' , '1' };
+
+static bool readCacheHeader( std::istream & in , char const * magic , unsigned long long meshHash , unsigned long long constrainedHash ,
+                             unsigned int numberOfVertices ) {
+    char fileMagic[8];
+    unsigned long long fileMeshHash , fileConstrainedHash;
+    unsigned int fileNumberOfVertices;
+    in.read( fileMagic , 8 );
+    in.read( reinterpret_cast< char * >( &fileMeshHash ) , sizeof( fileMeshHash ) );
+    in.read( reinterpret_cast< char * >( &fileConstrainedHash ) , sizeof( fileConstrainedHash ) );
+    in.read( reinterpret_cast< char * >( &fileNumberOfVertices ) , sizeof( fileNumberOfVertices ) );
+    return in  &&  std::equal( fileMagic , fileMagic + 8 , magic )  &&  fileMeshHash == meshHash  &&
+           fileConstrainedHash == constrainedHash  &&  fileNumberOfVertices == numberOfVertices;
+}
+
+static void writeCacheFile( std::string const & fileName , char const * magic , unsigned long long meshHash , unsigned long long constrainedHash ,
+                            unsigned int numberOfVertices , std::function< bool( std::ostream & ) > const & writeContent ) {
+    bool ok = writeFileAtomically( fileName , [&]( std::ostream & out ) {
+        out.write( magic , 8 );
+        out.write( reinterpret_cast< char const * >( &meshHash ) , sizeof( meshHash ) );
+        out.write( reinterpret_cast< char const * >( &constrainedHash ) , sizeof( constrainedHash ) );
+        out.write( reinterpret_cast< char const * >( &numberOfVertices ) , sizeof( numberOfVertices ) );
+        return out  &&  writeContent( out );
+    } );
+    if( !ok ) std::cerr << "ArapSolver: cannot write " << fileName << std::endl;
+}
+
+
+ArapSolver::ArapSolver() : _mesh(0) , _systemIsUpToDate(false) , _globalStepMode(GlobalStep_Laplacian) , _factorizationCacheSizeLimit(DefaultCacheSizeLimit) ,
+    _meshHash(0) , _stoppedOnBudget(false) ,
+    _andersonHistorySize(0) , _andersonNextColumn(0) , _andersonHasPrevious(false) {
+    _energies.reserve( _stoppingCriteria.maxIterations );
+    _normalEquationsSystem.setThreadPool( &_threadPool );
+}
+
+void ArapSolver::setMesh( Mesh & mesh ) {
+    _mesh = &mesh;
+    _meshTimings.clear();
+
+    Timer timer;
+    std::string weightsFileName;
+    if( ! _factorizationCacheDirectory.empty() ) {
+        _meshHash = hashRestMesh( mesh );
+        weightsFileName = _factorizationCacheDirectory + "/" + meshHashString( _meshHash ) + ".weights";
+    }
+    if( weightsFileName.empty()  ||  ! readCachedWeights( weightsFileName ) ) {
+        _weights.buildCotangentWeightsOfTriangleMesh( mesh , &_threadPool );
+        if( ! weightsFileName.empty() ) writeCachedWeights( weightsFileName );
+    }
+    _meshTimings.weightsMs = timer.elapsedMs();
+
+    timer.restart();
+    _rhsOperator.setRestState( mesh , _weights );
+    _meshTimings.assemblyMs = timer.elapsedMs();
+    _laplacianSystem.setConstrainedVertices( std::vector< bool >( mesh.V.size() , false ) );
+    _laplacianSystem.preprocess( _weights );   // Laplacian only, no handle yet
+    _meshTimings.assemblyMs += _laplacianSystem.lastAssemblyMs();
+    _meshTimings.factorizationMs = _laplacianSystem.lastFactorizationMs();
+
+    _rotations.assign( mesh.V.size() , Eigen::Matrix3d::Identity() );
+    _vertexEnergies.assign( mesh.V.size() , 0.0 );
+    _energies.clear();
+    _verticesHandles.assign( mesh.V.size() , -1 );
+    _normalEquationsConstrainedVertices.clear();   // other edges: the pattern of the normal equations changes
+    _systemIsUpToDate = false;
+    _timings.clear();
+    setRotationClusters( 0 );
+    _subspaceBasis.clear();
+    _subspaceMatrix.resize( 0 , 0 );
+    if( _globalStepMode == GlobalStep_Subspace ) _globalStepMode = GlobalStep_Laplacian;
+}
+
+void ArapSolver::computeSubspaceBasis( unsigned int dimension , std::string const & cacheDirectory , unsigned long long cacheSizeLimit ) {
+    Mesh const & mesh = *_mesh;
+    _subspaceBasis.build( mesh , _laplacianSystem.laplacian() , dimension , cacheDirectory , &_threadPool , cacheSizeLimit );
+    Eigen::MatrixXd const & U = _subspaceBasis.basis();
+    _subspaceMatrix.resize( mesh.V.size() , 4 * U.cols() );
+    for( unsigned int i = 0 ; i < U.cols() ; ++i )
+        for( unsigned int v = 0 ; v < mesh.V.size() ; ++v ) {
+            for( unsigned int coord = 0 ; coord < 3 ; ++coord )
+                _subspaceMatrix(v,4*i+coord) = U(v,i) * mesh.V[v].pInit[coord];
+            _subspaceMatrix(v,4*i+3) = U(v,i);
+        }
+    if( _globalStepMode == GlobalStep_Subspace ) _systemIsUpToDate = false;
+    if( _subspaceBasis.dimension() == 0  &&  _globalStepMode == GlobalStep_Subspace ) _globalStepMode = GlobalStep_Laplacian;
+}
+
+void ArapSolver::setRotationClusters( unsigned int numberOfClusters , RotationClustering clustering ) {
+    Mesh const & mesh = *_mesh;
+    _rotations.assign( mesh.V.size() , Eigen::Matrix3d::Identity() );
+    if( numberOfClusters == 0  ||  numberOfClusters >= mesh.V.size() ) {
+        _clusterOfVertex.clear();
+        _clusterRotations.clear();
+        _vertexTensors.clear();
+        _clusterTensors.clear();
+        _clusterSquaredLengths.clear();
+        _clusterEnergies.clear();
+        return;
+    }
+    numberOfClusters = clusterVerticesForRotations( mesh , numberOfClusters , clustering , _clusterOfVertex );
+    _clusterRotations.assign( numberOfClusters , Eigen::Matrix3d::Identity() );
+    _vertexTensors.resize( 9 * mesh.V.size() );
+    _clusterTensors.resize( 9 * numberOfClusters );
+    _clusterSquaredLengths.resize( numberOfClusters );
+    _clusterEnergies.resize( numberOfClusters );
+    _rhsOperator.setRotationClusters( _clusterOfVertex , numberOfClusters );
+}
+
+void ArapSolver::setRotations( std::vector< Eigen::Matrix3d > const & rotations ) {
+    _rotations = rotations;
+    // with clusters, the last vertex of each cluster gives its rotation
+    for( unsigned int v = 0 ; v < _clusterOfVertex.size()  &&  v < rotations.size() ; ++v )
+        _clusterRotations[ _clusterOfVertex[v] ] = rotations[v];
+}
+
+void ArapSolver::setHandles( std::vector< int > const & verticesHandles ) {
+    _verticesHandles = verticesHandles;
+    _systemIsUpToDate = false;
+}
+
+void ArapSolver::setStoppingCriteria( StoppingCriteria const & criteria ) {
+    _stoppingCriteria = criteria;
+    _stoppingCriteria.maxIterations = std::max( _stoppingCriteria.maxIterations , 1u );
+    _stoppingCriteria.andersonWindow = std::min( _stoppingCriteria.andersonWindow , MaxAndersonWindow );
+    _energies.reserve( _stoppingCriteria.maxIterations );   // so that solve() does not allocate
+}
+
+void ArapSolver::setGlobalStepMode( GlobalStepMode mode ) {
+    if( mode == _globalStepMode ) return;
+    if( mode == GlobalStep_Subspace  &&  _subspaceBasis.dimension() == 0 ) return;
+    _globalStepMode = mode;
+    _systemIsUpToDate = false;
+}
+
+void ArapSolver::setLinearSolver( LinearSolver solver , LinearSolverOrdering ordering ) {
+    if( solver == _normalEquationsSystem.solverType()  &&  ordering == _normalEquationsSystem.ordering() ) return;
+    _normalEquationsSystem.setSolver( solver , ordering );
+    if( _globalStepMode == GlobalStep_NormalEquations ) _systemIsUpToDate = false;
+}
+
+
+//-----------------------------------------------------------------------------------//
+//-----------------------------------------------------------------------------------//
+//-----------------------------------------------------------------------------------//
+//---------------------------------  CODE TO CHANGE  --------------------------------//
+//-----------------------------------------------------------------------------------//
+//-----------------------------------------------------------------------------------//
+//-----------------------------------------------------------------------------------//
+void ArapSolver::updateNormalEquationsSystem() {
+    Mesh & mesh = *_mesh;
+    Timer timer;
+
+    // TODO:
+    // set the right values for the number or rows and number of columns
+    // remember: number of colums = nb of variables
+    // remember: number of rows = nb of equations
+
+    unsigned int ncolumns = 3*mesh.V.size();
+
+    unsigned int nrows = 0;
+
+    for( unsigned int v = 0 ; v < mesh.V.size() ; ++v ) {
+        unsigned int numberOfNeighbors = _weights.get_n_adjacent_edges(v);
+        nrows += numberOfNeighbors*3;   // WHAT TO PUT HERE ??????? How to update the number of rows ?
+    }
+    for( unsigned int v = 0 ; v < mesh.V.size() ; ++v ) {
+        if(_verticesHandles[v] != -1) {
+            nrows += 3;  // WHAT TO PUT HERE ??????? How to update the number of rows ?
+        }
+    }
+
+    // Once the number of rows and columns have been found, we can allocate the matrices:
+    // (the same handle vertices give the same pattern: the entries are then written in place)
+    std::vector< bool > vertexIsConstrained( mesh.V.size() );
+    for( unsigned int v = 0 ; v < mesh.V.size() ; ++v )
+        vertexIsConstrained[v] = ( _verticesHandles[v] != -1 );
+    if( nrows == _normalEquationsSystem.rows()  &&  ncolumns == _normalEquationsSystem.columns()  &&
+        vertexIsConstrained == _normalEquationsConstrainedVertices )
+        _normalEquationsSystem.resetValues();
+    else
+        _normalEquationsSystem.setDimensions( nrows , ncolumns );
+    _normalEquationsConstrainedVertices.swap( vertexIsConstrained );
+    _normalEquationsSolution.resize( ncolumns );
+
+    // TODO:
+    // set the right values for the matrix A in the linear system
+
+    unsigned int equationIndex = 0;
+    for( unsigned int v = 0 ; v < mesh.V.size() ; ++v ) {
+        ConstArraySpan< unsigned int > neighbors = _weights.get_adjacent_vertices(v);
+        for( unsigned int k = 0 ; k < neighbors.size() ; ++k ) {
+
+            unsigned int vNeighbor = neighbors[k];
+
+            // WHAT TO PUT HERE ??????? How to update the entries of A ?
+
+            _normalEquationsSystem.A(equationIndex,3*v)=-1.0f;
+            _normalEquationsSystem.A(equationIndex,3*vNeighbor)=1.0f;
+            equationIndex++;
+
+            _normalEquationsSystem.A(equationIndex,1+3*v)=-1.0f;
+            _normalEquationsSystem.A(equationIndex,1+3*vNeighbor)=1.0f;
+            equationIndex++;
+
+            _normalEquationsSystem.A(equationIndex,2+3*v)=-1.0f;
+            _normalEquationsSystem.A(equationIndex,2+3*vNeighbor)=1.0f;
+            equationIndex++;
+
+
+        }
+    }
+    for( unsigned int v = 0 ; v < mesh.V.size() ; ++v ) {
+        if(_verticesHandles[v] != -1) {
+
+            // WHAT TO PUT HERE ??????? How to update the entries of A ?
+            _normalEquationsSystem.A(equationIndex,3*v)=1.0f;
+            _normalEquationsSystem.A(equationIndex+1,1+3*v)=1.0f;
+            _normalEquationsSystem.A(equationIndex+2,2+3*v)=1.0f;
+            equationIndex+=3;
+
+        }
+    }
+    _timings.assemblyMs += timer.elapsedMs();
+    timer.restart();
+
+    _normalEquationsSystem.preprocess();
+    _timings.factorizationMs += timer.elapsedMs();
+}
+
+void ArapSolver::updateLaplacianSystem() {
+    std::vector< bool > vertexIsConstrained( _mesh->V.size() );
+    for( unsigned int v = 0 ; v < _mesh->V.size() ; ++v )
+        vertexIsConstrained[v] = ( _verticesHandles[v] != -1 );
+
+    // the cache only replaces new factorizations: an update of the border is cheaper than reading one
+    std::string cacheFileName;
+    if( ! _factorizationCacheDirectory.empty()  &&  ! _laplacianSystem.updateWouldBeIncremental( vertexIsConstrained , _threadPool.numberOfThreads() ) )
+        cacheFileName = _factorizationCacheDirectory + "/" + meshHashString( _meshHash ) + "_" +
+                        meshHashString( hashConstrainedVertices( vertexIsConstrained ) ) + ".factorization";
+    if( ! cacheFileName.empty()  &&  readCachedFactorization( cacheFileName , vertexIsConstrained ) )
+        ++_timings.cachedSystemUpdates;
+    else {
+        _laplacianSystem.updateConstrainedVertices( vertexIsConstrained , &_threadPool );
+        if( ! cacheFileName.empty() ) writeCachedFactorization( cacheFileName , vertexIsConstrained );
+    }
+    _timings.assemblyMs += _laplacianSystem.lastAssemblyMs();
+    _timings.factorizationMs += _laplacianSystem.lastFactorizationMs();
+    if( _laplacianSystem.lastUpdateWasIncremental() ) ++_timings.incrementalSystemUpdates;
+    _laplacianSolution.resize( _laplacianSystem.numberOfUnknowns() , 3 );   // so that the first iteration does not allocate
+}
+
+bool ArapSolver::readCachedFactorization( std::string const & fileName , std::vector< bool > const & vertexIsConstrained ) {
+    std::ifstream in( fileName.c_str() , std::ios::binary );
+    if( !in  ||  ! readCacheHeader( in , FactorizationCacheMagic , _meshHash , hashConstrainedVertices( vertexIsConstrained ) , _mesh->V.size() ) )
+        return false;
+    _laplacianSystem.setConstrainedVertices( vertexIsConstrained );
+    if( ! _laplacianSystem.readBaseFactorization( in ) ) return false;
+    markCacheFileUsed( fileName );
+    return true;
+}
+
+void ArapSolver::writeCachedFactorization( std::string const & fileName , std::vector< bool > const & vertexIsConstrained ) const {
+    if( ! _laplacianSystem.isValid()  ||  _laplacianSystem.borderSize() > 0 ) return;   // no factorization of this partition
+    writeCacheFile( fileName , FactorizationCacheMagic , _meshHash , hashConstrainedVertices( vertexIsConstrained ) , _mesh->V.size() ,
+                    [this]( std::ostream & out ) { return _laplacianSystem.writeBaseFactorization( out ); } );
+    evictCacheFiles( _factorizationCacheDirectory , _factorizationCacheSizeLimit );
+}
+
+bool ArapSolver::readCachedWeights( std::string const & fileName ) {
+    std::ifstream in( fileName.c_str() , std::ios::binary );
+    if( !in  ||  ! readCacheHeader( in , WeightsCacheMagic , _meshHash , 0 , _mesh->V.size() )  ||  ! _weights.read( in , _mesh->V.size() ) )
+        return false;
+    markCacheFileUsed( fileName );
+    return true;
+}
+
+void ArapSolver::writeCachedWeights( std::string const & fileName ) const {
+    writeCacheFile( fileName , WeightsCacheMagic , _meshHash , 0 , _mesh->V.size() ,
+                    [this]( std::ostream & out ) { return _weights.write( out ); } );
+    evictCacheFiles( _factorizationCacheDirectory , _factorizationCacheSizeLimit );
+}
+
+// A = B^T L B + w sum_h B_h^T B_h , 4k x 4k , dense
+void ArapSolver::updateSubspaceSystem() {
+    Mesh const & mesh = *_mesh;
+    Timer timer;
+    Eigen::MatrixXd const & B = _subspaceMatrix;
+    Eigen::SparseMatrix< double > const & L = _laplacianSystem.laplacian();
+    unsigned int nV = mesh.V.size() , k = B.cols();
+    Eigen::MatrixXd LB = L * B;
+    Eigen::MatrixXd A = B.transpose() * LB;
+    Eigen::MatrixXd restPositions( nV , 3 );
+    for( unsigned int v = 0 ; v < nV ; ++v )
+        for( unsigned int coord = 0 ; coord < 3 ; ++coord )
+            restPositions(v,coord) = mesh.V[v].pInit[coord];
+    _subspaceRestRhs.noalias() = LB.transpose() * restPositions;
+
+    double handleWeight = SubspaceRelativeHandleWeight * L.diagonal().mean();
+    _subspaceHandleVertices.clear();
+    for( unsigned int v = 0 ; v < nV ; ++v )
+        if( _verticesHandles[v] != -1 ) _subspaceHandleVertices.push_back( v );
+    _subspaceHandleBasis.resize( k , _subspaceHandleVertices.size() );
+    for( unsigned int i = 0 ; i < _subspaceHandleVertices.size() ; ++i )
+        _subspaceHandleBasis.col(i) = handleWeight * B.row( _subspaceHandleVertices[i] ).transpose();
+    A.noalias() += _subspaceHandleBasis * _subspaceHandleBasis.transpose() / handleWeight;
+    // the products of the eigenvectors with the coordinates are not quite independent
+    A.diagonal().array() += 1e-10 * A.diagonal().mean();
+
+    _subspaceRhs.resize( nV , 3 );
+    _subspaceHandleDisplacements.resize( _subspaceHandleVertices.size() , 3 );
+    _reducedRhs.resize( k , 3 );
+    _reducedSolution.resize( k , 3 );
+    _subspaceDisplacements.resize( nV , 3 );
+    _subspacePreviousPositions.resize( 3 * nV );
+    _timings.assemblyMs += timer.elapsedMs();
+    timer.restart();
+
+    _subspaceSystem.compute( A );
+    _timings.factorizationMs += timer.elapsedMs();
+}
+
+void ArapSolver::updateSystem() {
+    if( _systemIsUpToDate ) return;
+
+    if( _globalStepMode == GlobalStep_Laplacian )
+        updateLaplacianSystem();
+    else if( _globalStepMode == GlobalStep_Subspace )
+        updateSubspaceSystem();
+    else
+        updateNormalEquationsSystem();
+    ++_timings.systemUpdates;
+
+    _systemIsUpToDate = true;
+}
+
+
+
+void ArapSolver::solveNormalEquationsGlobalStep() {
+    Mesh & mesh = *_mesh;
+    Timer timer;
+    unsigned int equationIndex = 0;
+    for( unsigned int v = 0 ; v < mesh.V.size() ; ++v ) {
+        for( unsigned int e = _rhsOperator.edgesBegin(v) ; e < _rhsOperator.edgesEnd(v) ; ++e ) {
+            Eigen::Vector3d rotatedEdge = _rotations[v] * _rhsOperator.restEdge(e);
+
+            // WHAT TO PUT HERE ??????? How to update the entries of b ?
+            _normalEquationsSystem.b(equationIndex)=rotatedEdge[0];
+            equationIndex++;
+            _normalEquationsSystem.b(equationIndex)=rotatedEdge[1];
+            equationIndex++;
+            _normalEquationsSystem.b(equationIndex)=rotatedEdge[2];
+            equationIndex++;
+
+        }
+    }
+    for( unsigned int v = 0 ; v < mesh.V.size() ; ++v ) {
+        if(_verticesHandles[v] != -1) {
+
+            // WHAT TO PUT HERE ??????? How to update the entries of b ?
+            _normalEquationsSystem.b(equationIndex)=mesh.V[v].p[0];
+            equationIndex++;
+            _normalEquationsSystem.b(equationIndex)=mesh.V[v].p[1];
+            equationIndex++;
+            _normalEquationsSystem.b(equationIndex)=mesh.V[v].p[2];
+            equationIndex++;
+
+        }
+    }
+
+    _timings.rhsMs += timer.elapsedMs();
+    timer.restart();
+
+    // Once the matrix A and the vector B are correctly set, we obtain the position of the vertices by solving for A.X = B
+    _normalEquationsSystem.solve(_normalEquationsSolution);
+    for( unsigned int v = 0 ; v < mesh.V.size() ; ++v ) {
+        if(_verticesHandles[v] == -1) {
+            for( unsigned int coord = 0 ; coord < 3 ; ++coord )
+                mesh.V[v].p[coord] = _normalEquationsSolution[3*v + coord];
+        }
+    }
+    _timings.solveMs += timer.elapsedMs();
+}
+
+// b_v = sum_j w_vj/2 (R_v + R_j) (pInit_v - pInit_j) , precomputed in _rhsOperator (per cluster with rotation clusters)
+void ArapSolver::solveLaplacianGlobalStep() {
+    Timer timer;
+    bool clusters = ! _clusterRotations.empty();
+    _threadPool.parallelFor( 0 , _laplacianSystem.numberOfUnknowns() , [this , clusters]( unsigned int r ) {
+        Eigen::Vector3d b;
+        if( clusters ) _rhsOperator.applyClusterRow( _laplacianSystem.vertexOfUnknown(r) , _clusterRotations , b );
+        else _rhsOperator.applyRow( _laplacianSystem.vertexOfUnknown(r) , _rotations , b );
+        for( unsigned int coord = 0 ; coord < 3 ; ++coord )
+            _laplacianSystem.b(r,coord) = b[coord];
+    } );
+    _timings.rhsMs += timer.elapsedMs();
+    timer.restart();
+
+    _laplacianSystem.solve(_laplacianSolution);
+    for( unsigned int r = 0 ; r < _laplacianSystem.numberOfUnknowns() ; ++r ) {
+        Vec3 & p = _mesh->V[ _laplacianSystem.vertexOfUnknown(r) ].p;
+        p = Vec3( _laplacianSolution(r,0) , _laplacianSolution(r,1) , _laplacianSolution(r,2) );
+    }
+    _timings.solveMs += timer.elapsedMs();
+}
+
+// S_v = sum_j w_vj e_vj eInit_vj^T , and sum_j w_vj ( |e_vj|^2 + |eInit_vj|^2 ) , for the current positions
+inline void ArapSolver::vertexTensor( unsigned int v , Eigen::Matrix3d & tensorMatrix , double & squaredLengths ) const {
+    Mesh const & mesh = *_mesh;
+    _rhsOperator.vertexTensor( v , [&mesh]( unsigned int u ) -> Vec3 const & { return mesh.V[u].p; } , tensorMatrix , squaredLengths );
+}
+
+// b = K R for all the vertices , then Q = A^-1 ( B^T ( b - L pInit ) + w sum_h B_h^T ( p_h - pInit_h ) ) : the solve
+// is O(k^2) , the projection and the displacements B Q are O(V k). The handle vertices keep their positions.
+void ArapSolver::solveSubspaceGlobalStep() {
+    Mesh & mesh = *_mesh;
+    Timer timer;
+    bool clusters = ! _clusterRotations.empty();
+    _threadPool.parallelFor( 0 , mesh.V.size() , [this , clusters]( unsigned int v ) {
+        Eigen::Vector3d b;
+        if( clusters ) _rhsOperator.applyClusterRow( v , _clusterRotations , b );
+        else _rhsOperator.applyRow( v , _rotations , b );
+        _subspaceRhs.row(v) = b.transpose();
+    } );
+    for( unsigned int i = 0 ; i < _subspaceHandleVertices.size() ; ++i ) {
+        MeshVertex const & vertex = mesh.V[ _subspaceHandleVertices[i] ];
+        for( unsigned int coord = 0 ; coord < 3 ; ++coord )
+            _subspaceHandleDisplacements(i,coord) = vertex.p[coord] - vertex.pInit[coord];
+    }
+    // one column at a time: the matrix-matrix products and solves allocate their blocking buffers
+    for( unsigned int coord = 0 ; coord < 3 ; ++coord ) {
+        _reducedRhs.col(coord).noalias() = _subspaceMatrix.transpose() * _subspaceRhs.col(coord);
+        _reducedRhs.col(coord) -= _subspaceRestRhs.col(coord);
+        _reducedRhs.col(coord).noalias() += _subspaceHandleBasis * _subspaceHandleDisplacements.col(coord);
+    }
+    _timings.rhsMs += timer.elapsedMs();
+    timer.restart();
+
+    _reducedSolution = _reducedRhs;
+    for( unsigned int coord = 0 ; coord < 3 ; ++coord ) {
+        _subspaceSystem.matrixL().solveInPlace( _reducedSolution.col(coord) );
+        _subspaceSystem.matrixU().solveInPlace( _reducedSolution.col(coord) );
+        _subspaceDisplacements.col(coord).noalias() = _subspaceMatrix * _reducedSolution.col(coord);
+    }
+    for( unsigned int v = 0 ; v < mesh.V.size() ; ++v )
+        if( _verticesHandles[v] == -1 )
+            mesh.V[v].p = mesh.V[v].pInit + Vec3( _subspaceDisplacements(v,0) , _subspaceDisplacements(v,1) , _subspaceDisplacements(v,2) );
+    _timings.solveMs += timer.elapsedMs();
+}
+
+// Each vertex fits its own rotation, independently of the others: the loop runs on all the threads of _threadPool.
+// The tensors are gathered by batches of ClosestRotationBatchSize vertices, whose rotations are computed together.
+// With S_v = sum_j w_vj e_vj eInit_vj^T , the energy of v is sum_j w_vj ( |e_vj|^2 + |eInit_vj|^2 ) - 2 trace( R_v^T S_v ).
+double ArapSolver::updateRotationsLocalStep() {
+    if( ! _clusterRotations.empty() ) return updateClusterRotationsLocalStep();
+    Mesh const & mesh = *_mesh;
+    Timer timer;
+    unsigned int numberOfBatches = ( mesh.V.size() + ClosestRotationBatchSize - 1 ) / ClosestRotationBatchSize;
+    _threadPool.parallelFor( 0 , numberOfBatches , [this , &mesh]( unsigned int batch ) {
+        double tensors[9][ClosestRotationBatchSize] , rotations[9][ClosestRotationBatchSize];
+        double squaredLengths[ClosestRotationBatchSize];
+        unsigned int vBegin = batch * ClosestRotationBatchSize;
+        for( unsigned int l = 0 ; l < ClosestRotationBatchSize ; ++l ) {
+            unsigned int v = vBegin + l;
+            Eigen::Matrix3d tensorMatrix = Eigen::Matrix3d::Identity();   // padding of the last batch
+            squaredLengths[l] = 0.0;
+            if( v < mesh.V.size() )
+                vertexTensor( v , tensorMatrix , squaredLengths[l] );   // 1 build
+            for( unsigned int i = 0 ; i < 3 ; ++i )
+                for( unsigned int j = 0 ; j < 3 ; ++j )
+                    tensors[3*i+j][l] = tensorMatrix(i,j);
+        }
+
+        // 2 polar decomposition 3 solution
+        computeClosestRotationsBatch< ClosestRotationBatchSize >( tensors , rotations );
+
+        for( unsigned int l = 0 ; l < ClosestRotationBatchSize  &&  vBegin + l < mesh.V.size() ; ++l ) {
+            double trace = 0.0;
+            for( unsigned int i = 0 ; i < 3 ; ++i )
+                for( unsigned int j = 0 ; j < 3 ; ++j ) {
+                    _rotations[vBegin + l](i,j) = rotations[3*i+j][l];
+                    trace += rotations[3*i+j][l] * tensors[3*i+j][l];
+                }
+            _vertexEnergies[vBegin + l] = squaredLengths[l] - 2.0 * trace;
+        }
+    } );
+    double energy = 0.0;
+    for( unsigned int v = 0 ; v < mesh.V.size() ; ++v )
+        energy += _vertexEnergies[v];
+    _timings.localStepMs += timer.elapsedMs();
+    return energy;
+}
+
+// Same, with one rotation per cluster: the tensors (and squared lengths) of the vertices of a cluster are summed,
+// in order, then each cluster fits its rotation, and its vertices take it.
+double ArapSolver::updateClusterRotationsLocalStep() {
+    unsigned int nV = _mesh->V.size() , nC = _clusterRotations.size();
+    Timer timer;
+    _threadPool.parallelFor( 0 , nV , [this]( unsigned int v ) {
+        Eigen::Matrix3d tensorMatrix;
+        vertexTensor( v , tensorMatrix , _vertexEnergies[v] );
+        for( unsigned int i = 0 ; i < 3 ; ++i )
+            for( unsigned int j = 0 ; j < 3 ; ++j )
+                _vertexTensors[9*v + 3*i+j] = tensorMatrix(i,j);
+    } );
+    std::fill( _clusterTensors.begin() , _clusterTensors.end() , 0.0 );
+    std::fill( _clusterSquaredLengths.begin() , _clusterSquaredLengths.end() , 0.0 );
+    for( unsigned int v = 0 ; v < nV ; ++v ) {
+        unsigned int c = _clusterOfVertex[v];
+        for( unsigned int i = 0 ; i < 9 ; ++i )
+            _clusterTensors[9*c + i] += _vertexTensors[9*v + i];
+        _clusterSquaredLengths[c] += _vertexEnergies[v];
+    }
+
+    unsigned int numberOfBatches = ( nC + ClosestRotationBatchSize - 1 ) / ClosestRotationBatchSize;
+    _threadPool.parallelFor( 0 , numberOfBatches , [this , nC]( unsigned int batch ) {
+        double tensors[9][ClosestRotationBatchSize] , rotations[9][ClosestRotationBatchSize];
+        unsigned int cBegin = batch * ClosestRotationBatchSize;
+        for( unsigned int l = 0 ; l < ClosestRotationBatchSize ; ++l )
+            for( unsigned int i = 0 ; i < 9 ; ++i )
+                tensors[i][l] = ( cBegin + l < nC ) ? _clusterTensors[9*(cBegin + l) + i] : ( i % 4 == 0 ? 1.0 : 0.0 );
+        computeClosestRotationsBatch< ClosestRotationBatchSize >( tensors , rotations );
+        for( unsigned int l = 0 ; l < ClosestRotationBatchSize  &&  cBegin + l < nC ; ++l ) {
+            double trace = 0.0;
+            for( unsigned int i = 0 ; i < 3 ; ++i )
+                for( unsigned int j = 0 ; j < 3 ; ++j ) {
+                    _clusterRotations[cBegin + l](i,j) = rotations[3*i+j][l];
+                    trace += rotations[3*i+j][l] * tensors[3*i+j][l];
+                }
+            _clusterEnergies[cBegin + l] = _clusterSquaredLengths[cBegin + l] - 2.0 * trace;
+        }
+    } );
+    _threadPool.parallelFor( 0 , nV , [this]( unsigned int v ) {
+        _rotations[v] = _clusterRotations[ _clusterOfVertex[v] ];
+    } );
+
+    double energy = 0.0;
+    for( unsigned int c = 0 ; c < nC ; ++c )
+        energy += _clusterEnergies[c];
+    _timings.localStepMs += timer.elapsedMs();
+    return energy;
+}
+
+
+void ArapSolver::getPositions( Eigen::VectorXd & x ) const {
+    for( unsigned int v = 0 ; v < _mesh->V.size() ; ++v )
+        for( unsigned int coord = 0 ; coord < 3 ; ++coord )
+            x[3*v + coord] = _mesh->V[v].p[coord];
+}
+
+void ArapSolver::setPositions( Eigen::VectorXd const & x ) {
+    for( unsigned int v = 0 ; v < _mesh->V.size() ; ++v )
+        for( unsigned int coord = 0 ; coord < 3 ; ++coord )
+            _mesh->V[v].p[coord] = x[3*v + coord];
+}
+
+void ArapSolver::resetAnderson() {
+    unsigned int n = 3 * _mesh->V.size() , window = _stoppingCriteria.andersonWindow;
+    if( _andersonX.size() != n )  { _andersonX.resize(n); _andersonG.resize(n); _andersonPreviousF.resize(n); _andersonPreviousG.resize(n); }
+    if( _andersonDF.rows() != n  ||  _andersonDF.cols() != window ) { _andersonDF.resize( n , window ); _andersonDG.resize( n , window ); }
+    _andersonHistorySize = _andersonNextColumn = 0;
+    _andersonHasPrevious = false;
+}
+
+// Anderson acceleration (type II) of the fixed point x = G(x) , G = global step o local step:
+//   with f_k = G(x_k) - x_k , theta = argmin | f_k - DF theta | over the last differences DF of f and DG of G ,
+//   x_k+1 = G(x_k) - DG theta.
+// The first call only records f and G. Everything is in preallocated buffers, nothing is allocated.
+bool ArapSolver::andersonStep() {
+    typedef Eigen::Matrix< double , Eigen::Dynamic , Eigen::Dynamic , 0 , MaxAndersonWindow , MaxAndersonWindow > SmallMatrix;
+    typedef Eigen::Matrix< double , Eigen::Dynamic , 1 , 0 , MaxAndersonWindow , 1 > SmallVector;
+    unsigned int window = _stoppingCriteria.andersonWindow;
+
+    _andersonX = _andersonG - _andersonX;   // f_k
+    if( _andersonHasPrevious ) {
+        _andersonDF.col( _andersonNextColumn ) = _andersonX - _andersonPreviousF;
+        _andersonDG.col( _andersonNextColumn ) = _andersonG - _andersonPreviousG;
+        _andersonNextColumn = ( _andersonNextColumn + 1 ) % window;
+        _andersonHistorySize = std::min( _andersonHistorySize + 1 , window );
+    }
+    _andersonPreviousF = _andersonX;
+    _andersonPreviousG = _andersonG;
+    _andersonHasPrevious = true;
+    if( _andersonHistorySize == 0 ) return false;
+
+    unsigned int m = _andersonHistorySize;
+    SmallMatrix gram( m , m );
+    SmallVector rhs( m );
+    for( unsigned int i = 0 ; i < m ; ++i ) {
+        rhs(i) = _andersonDF.col(i).dot( _andersonX );
+        for( unsigned int j = 0 ; j <= i ; ++j )
+            gram(i,j) = gram(j,i) = _andersonDF.col(i).dot( _andersonDF.col(j) );
+    }
+    double trace = gram.trace();
+    if( !( trace > 0.0 ) ) return false;
+    // the differences become nearly collinear close to convergence
+    gram.diagonal().array() += 1e-10 * trace / m;
+    SmallVector theta = gram.ldlt().solve( rhs );
+
+    _andersonX = _andersonG;
+    for( unsigned int i = 0 ; i < m ; ++i )
+        _andersonX -= theta(i) * _andersonDG.col(i);
+    return true;
+}
+
+
+
+bool ArapSolver::solve( bool continuePreviousSolve ) {
+    Timer budgetTimer;
+    // the energy criterion compares the first iteration with the last one of the interrupted solve
+    bool continuing = continuePreviousSolve  &&  _stoppedOnBudget  &&  ! _energies.empty();
+    double previousEnergy = continuing ? _energies.back() : 0.0;   // of the last accepted iterate
+    _timings.clear();
+    _energies.clear();
+    _stoppedOnBudget = false;
+    updateSystem();
+
+    bool hasHandles = false;
+    for( unsigned int v = 0 ; v < _verticesHandles.size()  &&  ! hasHandles ; ++v )
+        hasHandles = ( _verticesHandles[v] != -1 );
+    if( ! hasHandles ) return false; // nothing holds the mesh in place
+
+    if( _globalStepMode == GlobalStep_Laplacian )
+        _laplacianSystem.setConstrainedPositions( _mesh->V );
+
+    // the handles moved: the fixed point changed, the history of the previous solve() does not apply any more
+    bool accelerate = ( _stoppingCriteria.andersonWindow > 0 );
+    if( accelerate ) resetAnderson();
+
+    unsigned long long allocationsBefore = AllocationCounter::numberOfAllocations();
+    // the first iteration starts from the positions of the previous handles, its energy is not comparable
+    bool mayRise = ( _globalStepMode == GlobalStep_Subspace );
+    for( unsigned int arapIteration = 0 ; arapIteration < _stoppingCriteria.maxIterations ; ++arapIteration ) {
+        if( accelerate ) getPositions( _andersonX );
+        if( mayRise ) getPositions( _subspacePreviousPositions );
+
+        // 1 FIRST : SOLVE THE LINEAR SYSTEM TO UPDATE THE POSITIONS, GIVEN THE EXISTING ROTATION MATRICES
+        if( _globalStepMode == GlobalStep_Laplacian )
+            solveLaplacianGlobalStep();
+        else if( _globalStepMode == GlobalStep_Subspace )
+            solveSubspaceGlobalStep();
+        else
+            solveNormalEquationsGlobalStep();
+
+        // the rotations of the first iteration are those of the positions before the handles moved,
+        // it is not an evaluation of the same G
+        bool accelerated = false;
+        if( accelerate  &&  arapIteration > 0 ) {
+            getPositions( _andersonG );
+            accelerated = andersonStep();
+            if( accelerated ) setPositions( _andersonX );
+        }
+
+        // 2 SECOND : UPDATE THE ROTATION MATRICES
+        double energy = updateRotationsLocalStep();
+        if( accelerated  &&  energy > previousEnergy ) {
+            // back to the plain local/global step, whose energy cannot be larger
+            setPositions( _andersonG );
+            _andersonHistorySize = _andersonNextColumn = 0;
+            energy = updateRotationsLocalStep();
+            ++_timings.rejectedAccelerations;
+        }
+        if( mayRise  &&  ( arapIteration > 0  ||  continuing )  &&  energy > previousEnergy ) {
+            // see _subspacePreviousPositions: back to the previous iterate and its rotations
+            setPositions( _subspacePreviousPositions );
+            updateRotationsLocalStep();
+            break;
+        }
+        _energies.push_back( energy );
+        ++_timings.iterations;
+
+        if( _stoppingCriteria.relativeEnergyTolerance > 0.0  &&  ( arapIteration > 0  ||  continuing )  &&
+            previousEnergy - energy <= _stoppingCriteria.relativeEnergyTolerance * previousEnergy )
+            break;
+        previousEnergy = energy;
+        if( _stoppingCriteria.maxMilliseconds > 0.0  &&  arapIteration + 1 < _stoppingCriteria.maxIterations  &&
+            budgetTimer.elapsedMs() >= _stoppingCriteria.maxMilliseconds ) {
+            _stoppedOnBudget = true;
+            break;
+        }
+    }
+    _timings.allocations = AllocationCounter::numberOfAllocations() - allocationsBefore;
+    return true;
+}
+//-----------------------------------------------------------------------------------//
+//-----------------------------------------------------------------------------------//
+//-----------------------------------------------------------------------------------//
+
+
+void ArapSolver::translateHandle( Mesh & mesh , std::vector< int > const & verticesHandles , int handle , Vec3 const & translationVector ) {
+    for( unsigned int v = 0 ; v < mesh.V.size() ; ++v ) {
+        if( verticesHandles[v] == handle ) {
+            mesh.V[v].p += translationVector;
+        }
+    }
+}
+
+void ArapSolver::rotateHandle( Mesh & mesh , std::vector< int > const & verticesHandles , int handle , Vec3 const & rotationAxis , double angle ) {
+    Eigen::Vector3d centerOfRotation(0,0,0);
+    double sumWeights = 0.0;
+    for( unsigned int v = 0 ; v < mesh.V.size() ; ++v ) {
+        if( verticesHandles[v] == handle ) {
+            centerOfRotation += Eigen::Vector3d(mesh.V[v].p[0] , mesh.V[v].p[1] , mesh.V[v].p[2]);
+            sumWeights += 1.0;
+        }
+    }
+    if( sumWeights == 0.0 ) return;
+    centerOfRotation /= sumWeights;
+
+    Eigen::Vector3d axisEigenType( rotationAxis[0] , rotationAxis[1] , rotationAxis[2] );
+    Eigen::Matrix3d rotation;
+    rotation = Eigen::AngleAxisd(angle, axisEigenType);
+
+    // Apply rotation and translation, such that the center of mass is preserved: R * c + t = c    =>    t = c - R * c;
+    Eigen::Vector3d translation = centerOfRotation - rotation * centerOfRotation;
+
+    for( unsigned int v = 0 ; v < mesh.V.size() ; ++v ) {
+        if( verticesHandles[v] == handle ) {
+            Eigen::Vector3d newPos = rotation * Eigen::Vector3d(mesh.V[v].p[0] , mesh.V[v].p[1] , mesh.V[v].p[2])  +  translation;
+            mesh.V[v].p = Vec3(newPos[0] , newPos[1] , newPos[2]);
+        }
+    }
+}
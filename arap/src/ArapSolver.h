@@ -0,0 +1,219 @@
+#ifndef ArapSolver_H
+#define ArapSolver_H
+
+#include <vector>
+#include <string>
+#include <ostream>
+
+#include "../extern/eigen3/Eigen/Core"
+#include "../extern/eigen3/Eigen/Cholesky"
+
+#include "Vec3.h"
+#include "Mesh.h"
+#include "LaplacianWeights.h"
+#include "linearSystem.h"
+#include "laplacianSystem.h"
+#include "ArapRhsOperator.h"
+#include "RotationClusters.h"
+#include "LaplacianEigenbasis.h"
+#include "CacheDirectory.h"
+#include "ThreadPool.h"
+
+
+//-------------------------------------------------------------------------------------//
+//
+// As-rigid-as-possible deformation of a mesh: alternates a global step (positions, given the
+// rotations) and a local step (one rotation per vertex, given the positions).
+//   The mesh is not copied: solve() writes the new positions in mesh.V[v].p , and the positions
+//   of the handle vertices (moved by the caller) are the constraints.
+//
+// Used by the viewer (gmini) and by the headless benchmark (arapbench).
+//
+//-------------------------------------------------------------------------------------//
+class ArapSolver {
+public:
+    enum GlobalStepMode {
+        GlobalStep_NormalEquations , // rectangular 3E x 3V system, solved through A^T A
+        GlobalStep_Laplacian ,       // V x V cotangent Laplacian, handles eliminated, x/y/z solved together
+        GlobalStep_Subspace          // displacements in the span of the lowest Laplacian eigenvectors times the affine functions of
+                                     // the rest positions (see computeSubspaceBasis()), handles as soft constraints:
+                                     // 4 dimension x 4 dimension dense system
+    };
+
+    // Time spent in each phase, in milliseconds: see meshTimings() for setMesh() , timings() for the last solve().
+    struct Timings {
+        double weightsMs , assemblyMs , factorizationMs , rhsMs , solveMs , localStepMs;
+        double transferMs;   // multiresolution only: handles to the coarse level and deformation back to the mesh
+        unsigned int iterations;
+        unsigned int rejectedAccelerations;   // Anderson steps that increased the energy, replaced by the plain step
+        unsigned int systemUpdates , incrementalSystemUpdates , cachedSystemUpdates;   // cached : factorization read from the cache
+        unsigned long long allocations;   // heap allocations during the iterations (not counting the system update)
+
+        Timings() { clear(); }
+        void clear() {
+            weightsMs = assemblyMs = factorizationMs = rhsMs = solveMs = localStepMs = transferMs = 0.0;
+            iterations = rejectedAccelerations = systemUpdates = incrementalSystemUpdates = cachedSystemUpdates = 0;
+            allocations = 0;
+        }
+        Timings & operator += ( Timings const & t );
+        void print( std::ostream & out , unsigned int numberOfThreads ) const;
+    };
+
+    // When solve() stops. relativeEnergyTolerance = 0 runs exactly maxIterations iterations.
+    //   maxMilliseconds > 0 also stops after the first iteration that ends past this time budget (see stoppedOnBudget()).
+    //   andersonWindow > 0 enables Anderson acceleration of the positions (Peng et al. 2018), with the given
+    //   number of previous iterates; an accelerated step that increases the energy is replaced by the plain one.
+    struct StoppingCriteria {
+        unsigned int maxIterations;
+        double relativeEnergyTolerance;   // stops when ( E_previous - E ) <= relativeEnergyTolerance * E_previous
+        unsigned int andersonWindow;
+        double maxMilliseconds;
+
+        StoppingCriteria( unsigned int maxIterations_ = 5 , double relativeEnergyTolerance_ = 0.0 , unsigned int andersonWindow_ = 0 , double maxMilliseconds_ = 0.0 ) :
+            maxIterations(maxIterations_) , relativeEnergyTolerance(relativeEnergyTolerance_) , andersonWindow(andersonWindow_) , maxMilliseconds(maxMilliseconds_) {}
+    };
+    static const unsigned int MaxAndersonWindow = 8;
+
+private:
+    Mesh * _mesh;
+    LaplacianWeights _weights;
+    linearSystem _normalEquationsSystem;
+    std::vector< bool > _normalEquationsConstrainedVertices;   // of the last assembly of the normal equations
+    Eigen::VectorXd _normalEquationsSolution;  // kept between iterations, as _laplacianSolution
+    laplacianSystem _laplacianSystem;
+    ArapRhsOperator _rhsOperator;              // rest edges and right-hand side operator of the Laplacian global step
+    Eigen::MatrixXd _laplacianSolution;        // kept between iterations, so that solving does not allocate
+    std::vector< Eigen::Matrix3d > _rotations;
+
+    std::vector< int > _verticesHandles;       // -1 for free vertices
+    bool _systemIsUpToDate;
+    GlobalStepMode _globalStepMode;
+
+    ThreadPool _threadPool;
+    Timings _timings , _meshTimings;
+
+    // cache of the weights (per mesh) and of the factorizations of the Laplacian global step (per mesh and constrained vertices)
+    std::string _factorizationCacheDirectory;
+    unsigned long long _factorizationCacheSizeLimit;
+    unsigned long long _meshHash;
+
+    StoppingCriteria _stoppingCriteria;
+    std::vector< double > _energies;           // of the last solve(), one per iteration
+    bool _stoppedOnBudget;
+    std::vector< double > _vertexEnergies;     // written by the local step, summed in order (same result with any number of threads)
+
+    // subspace global step: positions pInit + B Q , Q minimizes the ARAP energy plus w sum_handles | pInit_h + B_h Q - p_h |^2.
+    // With the eigenvectors u_i , row v of B is ( u_i(v) pInit_v^T , u_i(v) )_i : each eigenvector modulates an affine map,
+    // so that a rigid motion of a detailed part stays in the subspace (the eigenvectors alone are too smooth for it).
+    LaplacianEigenbasis _subspaceBasis;
+    Eigen::MatrixXd _subspaceMatrix;                    // B , V x 4k
+    Eigen::LLT< Eigen::MatrixXd > _subspaceSystem;      // B^T L B + w sum_handles B_h^T B_h
+    std::vector< unsigned int > _subspaceHandleVertices;
+    Eigen::MatrixXd _subspaceHandleBasis;               // w B_h^T , 4k x handle vertices
+    Eigen::MatrixXd _subspaceRestRhs;                   // B^T L pInit , 4k x 3
+    Eigen::MatrixXd _subspaceRhs , _subspaceHandleDisplacements , _reducedRhs , _reducedSolution , _subspaceDisplacements;
+    // The handles are a penalty in Q, and are put back on their targets after the step: the ARAP energy alone may rise
+    // from one iteration to the next. solve() then stops and restores the positions of the previous iteration.
+    Eigen::VectorXd _subspacePreviousPositions;         // 3V
+
+    // rotation clusters (see setRotationClusters()), empty when each vertex has its own rotation
+    std::vector< unsigned int > _clusterOfVertex;
+    std::vector< Eigen::Matrix3d > _clusterRotations;
+    std::vector< double > _vertexTensors;      // 9 per vertex , row major
+    std::vector< double > _clusterTensors , _clusterSquaredLengths , _clusterEnergies;
+
+    // Anderson acceleration, on the 3V stacked positions
+    Eigen::VectorXd _andersonX , _andersonG , _andersonPreviousF , _andersonPreviousG;
+    Eigen::MatrixXd _andersonDF , _andersonDG;   // 3V x window, circular
+    unsigned int _andersonHistorySize , _andersonNextColumn;
+    bool _andersonHasPrevious;                   // _andersonPreviousF and _andersonPreviousG are set
+
+    void updateNormalEquationsSystem();
+    void updateLaplacianSystem();
+    bool readCachedFactorization( std::string const & fileName , std::vector< bool > const & vertexIsConstrained );
+    void writeCachedFactorization( std::string const & fileName , std::vector< bool > const & vertexIsConstrained ) const;
+    bool readCachedWeights( std::string const & fileName );
+    void writeCachedWeights( std::string const & fileName ) const;
+    void updateSubspaceSystem();
+    void solveNormalEquationsGlobalStep();
+    void solveLaplacianGlobalStep();
+    void solveSubspaceGlobalStep();
+    double updateRotationsLocalStep();   // returns the ARAP energy of the current positions, with the new rotations
+    double updateClusterRotationsLocalStep();
+    void vertexTensor( unsigned int v , Eigen::Matrix3d & tensor , double & squaredLengths ) const;
+
+    void getPositions( Eigen::VectorXd & x ) const;
+    void setPositions( Eigen::VectorXd const & x );
+    void resetAnderson();
+    bool andersonStep();   // x_k in _andersonX , G(x_k) in _andersonG ; returns false if there is no history yet
+
+public:
+    ArapSolver();
+
+    // Builds the cotangent weights and the rest state of mesh , which must outlive the solver.
+    void setMesh( Mesh & mesh );
+
+    // Directory of the cache files (empty : no cache, the default), to be set before setMesh(). The cotangent weights
+    // are read from <mesh hash>.weights , and each new factorization of the Laplacian global step from
+    // <mesh hash>_<constrained vertices hash>.factorization (see MeshHash.h: the rest positions, from which the
+    // weights are computed too); they are computed and written there when there is no such file, or when the file
+    // read is not consistent. The cache files of the directory are kept under sizeLimit bytes (see CacheDirectory.h).
+    void setFactorizationCacheDirectory( std::string const & directory , unsigned long long sizeLimit = DefaultCacheSizeLimit ) {
+        _factorizationCacheDirectory = directory;
+        _factorizationCacheSizeLimit = sizeLimit;
+    }
+    std::string const & factorizationCacheDirectory() const { return _factorizationCacheDirectory; }
+    // verticesHandles[v] is the handle of v , -1 if v is free
+    void setHandles( std::vector< int > const & verticesHandles );
+
+    GlobalStepMode globalStepMode() const { return _globalStepMode; }
+    // GlobalStep_Subspace is ignored until computeSubspaceBasis() was called.
+    void setGlobalStepMode( GlobalStepMode mode );
+
+    // Solver of the normal equations global step (see linearSystem.h): SimplicialLDLT with the AMD ordering by default.
+    void setLinearSolver( LinearSolver solver , LinearSolverOrdering ordering = LinearSolverOrdering_AMD );
+    linearSystem const & normalEquationsSystem() const { return _normalEquationsSystem; }
+
+    // Basis of the subspace global step: the dimension lowest eigenvectors of the Laplacian of the mesh, read from
+    // (or written to) cacheDirectory when it is not empty, kept under cacheSizeLimit bytes. Does not change the global step mode.
+    void computeSubspaceBasis( unsigned int dimension , std::string const & cacheDirectory = std::string() ,
+                               unsigned long long cacheSizeLimit = DefaultCacheSizeLimit );
+    LaplacianEigenbasis const & subspaceBasis() const { return _subspaceBasis; }
+
+    ThreadPool & threadPool() { return _threadPool; }
+    ThreadPool const & threadPool() const { return _threadPool; }
+    LaplacianWeights const & weights() const { return _weights; }
+    std::vector< Eigen::Matrix3d > const & rotations() const { return _rotations; }
+    void setRotations( std::vector< Eigen::Matrix3d > const & rotations );   // warm start of the next solve()
+    Timings const & timings() const { return _timings; }
+    Timings const & meshTimings() const { return _meshTimings; }   // weights and Laplacian of the last setMesh()
+
+    // Groups the vertices in numberOfClusters clusters that share one rotation (0 : one rotation per vertex, the default).
+    // The local step then fits one rotation per cluster, to the summed tensors of its vertices: numberOfClusters
+    // closest rotations instead of V. Resets the rotations to the identity.
+    void setRotationClusters( unsigned int numberOfClusters , RotationClustering clustering = RotationClustering_KMeans );
+    unsigned int numberOfRotationClusters() const { return _clusterRotations.size(); }
+    std::vector< unsigned int > const & clusterOfVertex() const { return _clusterOfVertex; }
+
+    // Updates (or refactors) the system if the handles changed.
+    void updateSystem();
+
+    StoppingCriteria const & stoppingCriteria() const { return _stoppingCriteria; }
+    void setStoppingCriteria( StoppingCriteria const & criteria );
+
+    // Runs ARAP iterations from the current positions and rotations, until the stopping criteria are met.
+    // continuePreviousSolve : the handles did not move since the last solve(), cut by the time budget.
+    // Returns false (and does nothing) when no vertex is constrained.
+    bool solve( bool continuePreviousSolve = false );
+
+    // ARAP energy sum_v sum_j w_vj | (p_j - p_v) - R_v (pInit_j - pInit_v) |^2 after each iteration of the last solve()
+    std::vector< double > const & energies() const { return _energies; }
+    // true if the last solve() ran out of time before meeting the other criteria: calling solve() again continues
+    bool stoppedOnBudget() const { return _stoppedOnBudget; }
+
+    // Rigid motions of the vertices of one handle, to be followed by solve().
+    static void translateHandle( Mesh & mesh , std::vector< int > const & verticesHandles , int handle , Vec3 const & translationVector );
+    static void rotateHandle( Mesh & mesh , std::vector< int > const & verticesHandles , int handle , Vec3 const & rotationAxis , double angle );
+};
+
+#endif // ArapSolver_H
@@ -0,0 +1,217 @@
+#include "ArapSolverThread.h"
+#include "Timer.h"
+
+#include <iostream>
+
+
+namespace {
+// solve() of any of the solvers, which share the same interface for it
+template< class Solver >
+bool solveWith( Solver & solver , ArapSolver::StoppingCriteria const & criteria , bool continuePreviousSolve , bool & stoppedOnBudget ,
+                ArapSolver::Timings const * & timings , std::vector< double > const * & energies ) {
+    solver.setStoppingCriteria( criteria );
+    bool solved = solver.solve( continuePreviousSolve );
+    stoppedOnBudget = solver.stoppedOnBudget();
+    timings = &solver.timings();
+    energies = &solver.energies();
+    return solved;
+}
+}
+
+ArapSolverThread::ArapSolverThread() : _mesh(0) , _solver(0) , _multiresolutionSolver(0) , _regionOfInterestSolver(0) , _budgetMs(0.0) , _printTimings(false) ,
+    _stop(false) , _hasRequest(false) , _requestHandlesChanged(false) , _isSolving(false) , _postedRequests(0) , _droppedRequests(0) ,
+    _hasNewPositions(false) {
+}
+
+ArapSolverThread::~ArapSolverThread() {
+    stop();
+}
+
+void ArapSolverThread::start( Mesh & mesh , ArapSolver & solver ) {
+    stop();
+    _mesh = &mesh;
+    _solver = &solver;
+    _displayVerticesHandles.assign( mesh.V.size() , -1 );
+    _handleVerticesOfDisplay.clear();
+    _thread = std::thread( &ArapSolverThread::solverLoop , this );
+}
+
+void ArapSolverThread::stop() {
+    if( ! _thread.joinable() ) return;
+    {
+        std::lock_guard< std::mutex > lock(_requestMutex);
+        _stop = true;
+    }
+    _requestCondition.notify_one();
+    _thread.join();
+    _stop = false;
+}
+
+
+void ArapSolverThread::postCommand( std::function< void() > const & command ) {
+    if( std::this_thread::get_id() == _thread.get_id() ) {   // from a command
+        command();
+        return;
+    }
+    {
+        std::lock_guard< std::mutex > lock(_requestMutex);
+        _commands.push_back( command );
+    }
+    _requestCondition.notify_one();
+}
+
+void ArapSolverThread::setHandles( std::vector< int > const & verticesHandles ) {
+    _displayVerticesHandles = verticesHandles;
+    _handleVerticesOfDisplay.clear();
+    for( unsigned int v = 0 ; v < verticesHandles.size() ; ++v )
+        if( verticesHandles[v] != -1 ) _handleVerticesOfDisplay.push_back( v );
+
+    std::lock_guard< std::mutex > lock(_requestMutex);
+    _requestVerticesHandles = verticesHandles;
+    _requestHandlesChanged = true;
+}
+
+void ArapSolverThread::requestSolve( Mesh const & displayedMesh ) {
+    {
+        std::lock_guard< std::mutex > lock(_requestMutex);
+        if( _hasRequest ) ++_droppedRequests;   // superseded before the solver took it
+        _requestHandleVertices = _handleVerticesOfDisplay;
+        _requestHandlePositions.resize( _handleVerticesOfDisplay.size() );
+        for( unsigned int i = 0 ; i < _handleVerticesOfDisplay.size() ; ++i )
+            _requestHandlePositions[i] = displayedMesh.V[ _handleVerticesOfDisplay[i] ].p;
+        _hasRequest = true;
+        ++_postedRequests;
+    }
+    _requestCondition.notify_one();
+}
+
+bool ArapSolverThread::fetchPositions( Mesh & displayedMesh ) {
+    {
+        std::lock_guard< std::mutex > lock(_positionsMutex);
+        if( ! _hasNewPositions ) return false;
+        _frontPositions.swap( _fetchedPositions );
+        _hasNewPositions = false;
+    }
+    // the handle vertices keep the positions given by the user, which may be more recent than the solve
+    if( _fetchedPositions.size() != displayedMesh.V.size() ) return false;
+    for( unsigned int v = 0 ; v < displayedMesh.V.size() ; ++v )
+        if( _displayVerticesHandles[v] == -1 )
+            displayedMesh.V[v].p = _fetchedPositions[v];
+    return true;
+}
+
+void ArapSolverThread::takeSolveMs( std::vector< double > & solveMs ) {
+    std::lock_guard< std::mutex > lock(_positionsMutex);
+    solveMs.insert( solveMs.end() , _solveMs.begin() , _solveMs.end() );
+    _solveMs.clear();
+}
+
+bool ArapSolverThread::isBusy() {
+    // in this order: the solver publishes before it is done with a request
+    {
+        std::lock_guard< std::mutex > lock(_requestMutex);
+        if( _hasRequest || _isSolving ) return true;
+    }
+    std::lock_guard< std::mutex > lock(_positionsMutex);
+    return _hasNewPositions;
+}
+
+
+void ArapSolverThread::publishPositions( double solveMs ) {
+    _backPositions.resize( _mesh->V.size() );
+    for( unsigned int v = 0 ; v < _mesh->V.size() ; ++v )
+        _backPositions[v] = _mesh->V[v].p;
+
+    std::lock_guard< std::mutex > lock(_positionsMutex);
+    _backPositions.swap( _frontPositions );
+    _hasNewPositions = true;
+    _solveMs.push_back( solveMs );
+}
+
+// One call to solve() of the active solver, at most maxIterations iterations and _budgetMs milliseconds.
+// Returns true if the solve was cut by the budget and should continue.
+bool ArapSolverThread::solveSlice( bool continuePreviousSlice , unsigned int maxIterations , unsigned int & iterations ) {
+    ArapSolver::StoppingCriteria criteria = _stoppingCriteria;
+    criteria.maxIterations = maxIterations;
+    criteria.maxMilliseconds = _budgetMs;
+
+    bool solved , stoppedOnBudget;
+    ArapSolver::Timings const * timings;
+    std::vector< double > const * energies;
+    Timer timer;
+    if( _regionOfInterestSolver )
+        solved = solveWith( *_regionOfInterestSolver , criteria , continuePreviousSlice , stoppedOnBudget , timings , energies );
+    else if( _multiresolutionSolver )
+        solved = solveWith( *_multiresolutionSolver , criteria , continuePreviousSlice , stoppedOnBudget , timings , energies );
+    else
+        solved = solveWith( *_solver , criteria , continuePreviousSlice , stoppedOnBudget , timings , energies );
+    if( ! solved ) return false; // nothing holds the mesh in place
+    iterations = energies->size();
+    publishPositions( timer.elapsedMs() );
+
+    if( _printTimings ) {
+        timings->print( std::cout , _solver->threadPool().numberOfThreads() );
+        if( _regionOfInterestSolver ) std::cout << "ARAP energy (region of " << _regionOfInterestSolver->numberOfRegionVertices() << " vertices) :";
+        else std::cout << ( _multiresolutionSolver ? "ARAP energy (coarse) :" : "ARAP energy :" );
+        for( unsigned int i = 0 ; i < energies->size() ; ++i )
+            std::cout << " " << (*energies)[i];
+        if( stoppedOnBudget ) std::cout << " (out of time, continuing)";
+        std::cout << std::endl;
+    }
+    return stoppedOnBudget;
+}
+
+void ArapSolverThread::solverLoop() {
+    unsigned int remainingIterations = 0;   // of the current request, when it is solved in slices
+    for( ;; ) {
+        bool stop , newRequest = false , handlesChanged = false;
+        {
+            std::unique_lock< std::mutex > lock(_requestMutex);
+            _requestCondition.wait( lock , [&]{ return _stop || _hasRequest || ! _commands.empty() || remainingIterations > 0; } );
+            stop = _stop;
+            _runningCommands.swap( _commands );
+            if( ! stop  &&  _hasRequest ) {
+                if( _requestHandlesChanged ) {
+                    _verticesHandles.swap( _requestVerticesHandles );
+                    _requestHandlesChanged = false;
+                    handlesChanged = true;
+                }
+                _handleVertices.swap( _requestHandleVertices );
+                _handlePositions.swap( _requestHandlePositions );
+                _hasRequest = false;
+                newRequest = true;
+            }
+            _isSolving = ! stop  &&  ( newRequest  ||  remainingIterations > 0 );
+        }
+
+        // the settings posted since the last slice, also those of the last moment before stop()
+        bool settingsChanged = ! _runningCommands.empty();
+        for( unsigned int i = 0 ; i < _runningCommands.size() ; ++i )
+            _runningCommands[i]();
+        _runningCommands.clear();
+        if( stop ) return;
+        if( ! newRequest  &&  remainingIterations == 0 ) continue;
+
+        if( newRequest ) {
+            if( handlesChanged ) {
+                _solver->setHandles( _verticesHandles );
+                if( _multiresolutionSolver ) _multiresolutionSolver->setHandles( _verticesHandles );
+                if( _regionOfInterestSolver ) _regionOfInterestSolver->setHandles( _verticesHandles );
+            }
+            for( unsigned int i = 0 ; i < _handleVertices.size() ; ++i )
+                _mesh->V[ _handleVertices[i] ].p = _handlePositions[i];
+            remainingIterations = _stoppingCriteria.maxIterations;
+        }
+
+        unsigned int iterations = 0;
+        // the energy of the previous slice may not be comparable after new settings
+        if( solveSlice( ! newRequest  &&  ! settingsChanged , remainingIterations , iterations )  &&  iterations < remainingIterations )
+            remainingIterations -= iterations;
+        else
+            remainingIterations = 0;
+        if( remainingIterations == 0 ) {
+            std::lock_guard< std::mutex > lock(_requestMutex);
+            _isSolving = false;
+        }
+    }
+}
@@ -0,0 +1,113 @@
+#ifndef ArapSolverThread_H
+#define ArapSolverThread_H
+
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "Vec3.h"
+#include "Mesh.h"
+#include "ArapSolver.h"
+#include "MultiresolutionArapSolver.h"
+#include "RegionOfInterestArapSolver.h"
+
+
+//-------------------------------------------------------------------------------------//
+//
+// Runs the ARAP solves on a background thread, so that the display loop never waits for them.
+//
+//   - the solvers work on their own copy of the mesh (the one given to their setMesh()), never on the
+//     displayed one;
+//   - the display thread posts the current positions of the handle vertices with requestSolve().
+//     Only the latest request is kept: a request that arrives while the solver is busy replaces the
+//     previous pending one, which is dropped;
+//   - with a time budget, a solve is cut in slices of about budget milliseconds, and the positions are
+//     published after each slice, until the stopping criteria are met or a new request arrives;
+//   - published positions go to a back buffer, swapped with the front buffer under a short lock.
+//     fetchPositions() takes the front buffer (another swap) and copies the free vertices to the
+//     displayed mesh.
+//
+// The solvers must not be used directly while the thread runs: postCommand() changes their settings from
+// the solver thread, between two slices, without making the display thread wait for the current one.
+//
+//-------------------------------------------------------------------------------------//
+class ArapSolverThread {
+    Mesh * _mesh;                                         // copy of the mesh used by the solvers
+    ArapSolver * _solver;
+    MultiresolutionArapSolver * _multiresolutionSolver;   // used instead of _solver when set
+    RegionOfInterestArapSolver * _regionOfInterestSolver; // used instead of both when set
+    ArapSolver::StoppingCriteria _stoppingCriteria;
+    double _budgetMs;
+    bool _printTimings;
+
+    std::thread _thread;
+
+    // pending request, protected by _requestMutex
+    std::mutex _requestMutex;
+    std::condition_variable _requestCondition;
+    bool _stop , _hasRequest , _requestHandlesChanged , _isSolving;
+    std::vector< int > _requestVerticesHandles;
+    std::vector< unsigned int > _requestHandleVertices;
+    std::vector< Vec3 > _requestHandlePositions;
+    std::vector< std::function< void() > > _commands;   // run by the solver thread, in this order
+    unsigned long long _postedRequests , _droppedRequests;
+
+    // display thread only: the handles of the last setHandles()
+    std::vector< int > _displayVerticesHandles;
+    std::vector< unsigned int > _handleVerticesOfDisplay;
+
+    // solver thread only, as the solvers and the settings above
+    std::vector< std::function< void() > > _runningCommands;
+    std::vector< int > _verticesHandles;
+    std::vector< unsigned int > _handleVertices;
+    std::vector< Vec3 > _handlePositions;
+
+    // published positions
+    std::mutex _positionsMutex;
+    std::vector< Vec3 > _backPositions , _frontPositions , _fetchedPositions;
+    bool _hasNewPositions;
+    std::vector< double > _solveMs;   // of the slices published since the last takeSolveMs()
+
+    void solverLoop();
+    bool solveSlice( bool continuePreviousSlice , unsigned int maxIterations , unsigned int & iterations );
+    void publishPositions( double solveMs );
+
+public:
+    ArapSolverThread();
+    ~ArapSolverThread();
+
+    // Starts the thread. solver (and the multiresolution and region of interest solvers, if any) are set up with mesh , which is not the displayed one.
+    void start( Mesh & mesh , ArapSolver & solver );
+    void stop();
+
+    // Queues command, and returns at once: the solver thread runs it before its next slice (never during one),
+    // after the commands posted before it. The settings below are commands as well. Called from a command, they
+    // take effect at once.
+    void postCommand( std::function< void() > const & command );
+
+    // budgetMs = 0 : each request is solved in one go
+    void setBudgetMs( double budgetMs ) { postCommand( [this , budgetMs]{ _budgetMs = budgetMs; } ); }
+    void setStoppingCriteria( ArapSolver::StoppingCriteria const & criteria ) { postCommand( [this , criteria]{ _stoppingCriteria = criteria; } ); }
+    void setMultiresolutionSolver( MultiresolutionArapSolver * solver ) { postCommand( [this , solver]{ _multiresolutionSolver = solver; } ); }
+    void setRegionOfInterestSolver( RegionOfInterestArapSolver * solver ) { postCommand( [this , solver]{ _regionOfInterestSolver = solver; } ); }
+    void setPrintTimings( bool printTimings ) { postCommand( [this , printTimings]{ _printTimings = printTimings; } ); }
+
+    // Display thread: new handles, then the positions of their vertices in displayedMesh.
+    void setHandles( std::vector< int > const & verticesHandles );
+    void requestSolve( Mesh const & displayedMesh );
+
+    // Display thread: copies the last published positions of the free vertices to displayedMesh.
+    // Returns false if nothing was published since the last call.
+    bool fetchPositions( Mesh & displayedMesh );
+    // Display thread: appends the durations of the slices published since the last call, in milliseconds.
+    void takeSolveMs( std::vector< double > & solveMs );
+    // A request is pending or being solved, or positions were published and not fetched yet.
+    bool isBusy();
+
+    unsigned long long postedRequests() { std::lock_guard< std::mutex > lock(_requestMutex); return _postedRequests; }
+    unsigned long long droppedRequests() { std::lock_guard< std::mutex > lock(_requestMutex); return _droppedRequests; }
+};
+
+#endif // ArapSolverThread_H
@@ -0,0 +1,223 @@
+#include "BatchArapSolver.h"
+#include "ClosestRotation.h"
+#include "Timer.h"
+
+#include <algorithm>
+
+
+BatchArapSolver::BatchArapSolver() : _mesh(0) , _systemIsUpToDate(false) , _iterations(5) , _posesPerBatch(64) , _sequentialSolverIsUpToDate(false) {
+    _sequentialSolver.threadPool().setNumberOfThreads( 1 );
+}
+
+void BatchArapSolver::setMesh( Mesh const & mesh ) {
+    _mesh = &mesh;
+    _weights.buildCotangentWeightsOfTriangleMesh( mesh , &_threadPool );
+    _rhsOperator.setRestState( mesh , _weights );
+    _handleVertices.clear();
+    _Lfc.resize( 0 , 0 );
+    _verticesHandles.clear();
+    _systemIsUpToDate = false;
+    _sequentialSolverIsUpToDate = false;
+}
+
+void BatchArapSolver::setHandles( std::vector< int > const & verticesHandles ) {
+    _handleVertices.clear();
+    _verticesHandles = verticesHandles;
+    _sequentialSolverIsUpToDate = false;
+    _systemIsUpToDate = false;
+    for( unsigned int v = 0 ; v < _mesh->V.size() ; ++v )
+        if( verticesHandles[v] != -1 ) _handleVertices.push_back( v );
+    _timings.clear();
+
+    // only the factorization that solvePoses() will use, with the current number of threads
+    Timer timer;
+    if( _threadPool.numberOfThreads() == 1 ) updateSequentialSolver();
+    else updateSystem();
+    _timings.factorizationMs = timer.elapsedMs();
+}
+
+// Factorizes the Laplacian of the free vertices for the wide solves, and builds L_fc
+void BatchArapSolver::updateSystem() {
+    unsigned int nV = _mesh->V.size();
+    std::vector< bool > isConstrained( nV , false );
+    std::vector< int > handleIndexOfVertex( nV , -1 );
+    for( unsigned int i = 0 ; i < _handleVertices.size() ; ++i ) {
+        isConstrained[ _handleVertices[i] ] = true;
+        handleIndexOfVertex[ _handleVertices[i] ] = i;
+    }
+    _system.setConstrainedVertices( isConstrained );
+    _system.preprocess( _weights );   // a new factorization: no border, the wide solves only go through the factor
+
+    // L_fc , to move the handles to the right-hand side: L_ff X_f = B_f - L_fc X_c
+    Eigen::SparseMatrix< double > const & L = _system.laplacian();
+    std::vector< Eigen::Triplet< double > > triplets;
+    for( unsigned int r = 0 ; r < _system.numberOfUnknowns() ; ++r )
+        for( Eigen::SparseMatrix< double >::InnerIterator it( L , _system.vertexOfUnknown(r) ) ; it ; ++it )
+            if( handleIndexOfVertex[ it.row() ] >= 0 )
+                triplets.push_back( Eigen::Triplet< double >( r , handleIndexOfVertex[ it.row() ] , it.value() ) );
+    _Lfc.resize( _system.numberOfUnknowns() , _handleVertices.size() );
+    _Lfc.setFromTriplets( triplets.begin() , triplets.end() );
+    _systemIsUpToDate = true;
+}
+
+// The ArapSolver of the single thread case , on a copy of the mesh
+void BatchArapSolver::updateSequentialSolver() {
+    _poseMesh = *_mesh;
+    _sequentialSolver.setMesh( _poseMesh );
+    _sequentialSolver.setHandles( _verticesHandles );
+    _sequentialSolver.updateSystem();
+    _sequentialSolverIsUpToDate = true;
+}
+
+
+// B (free x 3P) with the rotations of each pose, minus L_fc X_c , then X_f = L_ff^-1 B by groups of poses
+void BatchArapSolver::globalStep( std::vector< Vec3 > * positions , unsigned int numberOfPoses ) {
+    Timer timer;
+    // one task per pose: its 3 columns are contiguous
+    _threadPool.parallelFor( 0 , numberOfPoses , [this]( unsigned int p ) {
+        Eigen::Vector3d b;
+        for( unsigned int r = 0 ; r < _system.numberOfUnknowns() ; ++r ) {
+            _rhsOperator.applyRow( _system.vertexOfUnknown(r) , _rotations[p] , b );
+            for( unsigned int coord = 0 ; coord < 3 ; ++coord )
+                _rhs( r , 3*p + coord ) = b[coord];
+        }
+    } , 1 );
+    _rhs -= _Lfc * _handlePositions;   // not noalias(): with Eigen 3.2 , noalias() -= of a row major sparse product assigns
+    _timings.rhsMs += timer.elapsedMs();
+    timer.restart();
+
+    unsigned int numberOfThreads = _threadPool.numberOfThreads();
+    unsigned int posesPerThread = ( numberOfPoses + numberOfThreads - 1 ) / numberOfThreads;
+    _threadPool.parallelForChunks( 0 , numberOfPoses , [this , positions]( unsigned int pBegin , unsigned int pEnd , unsigned int thread ) {
+        Eigen::MatrixXd & columns = _solveColumns[thread];
+        columns = _rhs.middleCols( 3 * pBegin , 3 * ( pEnd - pBegin ) );
+        _system.solveFactorized( columns , _solveWork[thread] );
+        for( unsigned int p = pBegin ; p < pEnd ; ++p )
+            for( unsigned int r = 0 ; r < _system.numberOfUnknowns() ; ++r ) {
+                Vec3 & position = positions[p][ _system.vertexOfUnknown(r) ];
+                for( unsigned int coord = 0 ; coord < 3 ; ++coord )
+                    position[coord] = columns( r , 3 * ( p - pBegin ) + coord );
+            }
+    } , posesPerThread );
+    _timings.solveMs += timer.elapsedMs();
+}
+
+// The local steps of all the poses, by batches of ClosestRotationBatchSize vertices of one pose
+void BatchArapSolver::localStep( std::vector< Vec3 > * positions , unsigned int numberOfPoses ) {
+    Timer timer;
+    unsigned int nV = _mesh->V.size();
+    unsigned int batchesPerPose = ( nV + ClosestRotationBatchSize - 1 ) / ClosestRotationBatchSize;
+    _threadPool.parallelFor( 0 , numberOfPoses * batchesPerPose , [this , positions , batchesPerPose , nV]( unsigned int task ) {
+        unsigned int p = task / batchesPerPose , vBegin = ( task % batchesPerPose ) * ClosestRotationBatchSize;
+        std::vector< Vec3 > const & posePositions = positions[p];
+        double tensors[9][ClosestRotationBatchSize] , rotations[9][ClosestRotationBatchSize];
+        for( unsigned int l = 0 ; l < ClosestRotationBatchSize ; ++l ) {
+            Eigen::Matrix3d tensorMatrix = Eigen::Matrix3d::Identity();   // padding of the last batch
+            double squaredLengths;
+            if( vBegin + l < nV )
+                _rhsOperator.vertexTensor( vBegin + l , [&posePositions]( unsigned int u ) -> Vec3 const & { return posePositions[u]; } ,
+                                           tensorMatrix , squaredLengths );
+            for( unsigned int i = 0 ; i < 3 ; ++i )
+                for( unsigned int j = 0 ; j < 3 ; ++j )
+                    tensors[3*i+j][l] = tensorMatrix(i,j);
+        }
+        computeClosestRotationsBatch< ClosestRotationBatchSize >( tensors , rotations );
+        for( unsigned int l = 0 ; l < ClosestRotationBatchSize  &&  vBegin + l < nV ; ++l )
+            for( unsigned int i = 0 ; i < 3 ; ++i )
+                for( unsigned int j = 0 ; j < 3 ; ++j )
+                    _rotations[p][vBegin + l](i,j) = rotations[3*i+j][l];
+    } );
+    _timings.localStepMs += timer.elapsedMs();
+}
+
+
+// Same poses as the batch: from the rest positions and identity rotations , _iterations iterations each
+bool BatchArapSolver::solvePosesSequentially( std::vector< std::vector< Vec3 > > const & handlePositions , std::vector< std::vector< Vec3 > > & positions ) {
+    if( !_sequentialSolverIsUpToDate ) updateSequentialSolver();   // the number of threads changed since setHandles()
+    _sequentialSolver.setStoppingCriteria( ArapSolver::StoppingCriteria( _iterations ) );
+    unsigned int nV = _poseMesh.V.size() , numberOfPoses = handlePositions.size();
+    std::vector< Eigen::Matrix3d > identities( nV , Eigen::Matrix3d::Identity() );
+    positions.resize( numberOfPoses );
+    for( unsigned int p = 0 ; p < numberOfPoses ; ++p ) {
+        for( unsigned int v = 0 ; v < nV ; ++v )
+            _poseMesh.V[v].p = _poseMesh.V[v].pInit;
+        for( unsigned int i = 0 ; i < _handleVertices.size() ; ++i )
+            _poseMesh.V[ _handleVertices[i] ].p = handlePositions[p][i];
+        _sequentialSolver.setRotations( identities );
+        if( !_sequentialSolver.solve() ) {
+            positions.clear();
+            return false;
+        }
+        ArapSolver::Timings const & poseTimings = _sequentialSolver.timings();
+        _timings.rhsMs += poseTimings.rhsMs;
+        _timings.solveMs += poseTimings.solveMs;
+        _timings.localStepMs += poseTimings.localStepMs;
+        _timings.iterations += poseTimings.iterations;
+        positions[p].resize( nV );
+        for( unsigned int v = 0 ; v < nV ; ++v )
+            positions[p][v] = _poseMesh.V[v].p;
+    }
+    return true;
+}
+
+bool BatchArapSolver::solvePoses( std::vector< std::vector< Vec3 > > const & handlePositions , std::vector< std::vector< Vec3 > > & positions ) {
+    positions.clear();
+    if( _mesh == 0  ||  _handleVertices.empty() ) return false;
+    for( unsigned int p = 0 ; p < handlePositions.size() ; ++p )
+        if( handlePositions[p].size() != _handleVertices.size() ) return false;
+    bool isSequential = ( _threadPool.numberOfThreads() == 1 );
+    if( ! isSequential  &&  ! _systemIsUpToDate ) {   // the number of threads changed since setHandles()
+        Timer factorizationTimer;
+        updateSystem();
+        _timings.factorizationMs = factorizationTimer.elapsedMs();
+    }
+    if( ! isSequential  &&  ! _system.isValid() ) return false;
+
+    Mesh const & mesh = *_mesh;
+    unsigned int nV = mesh.V.size() , numberOfPoses = handlePositions.size();
+    Timer timer;
+    double factorizationMs = _timings.factorizationMs;
+    _timings.clear();
+    _timings.factorizationMs = factorizationMs;
+
+    if( isSequential ) {
+        bool solved = solvePosesSequentially( handlePositions , positions );
+        _timings.poses = positions.size();
+        _timings.totalMs = timer.elapsedMs();
+        return solved;
+    }
+
+    // rest positions , then the handles of each pose
+    positions.resize( numberOfPoses );
+    for( unsigned int p = 0 ; p < numberOfPoses ; ++p ) {
+        positions[p].resize( nV );
+        for( unsigned int v = 0 ; v < nV ; ++v )
+            positions[p][v] = mesh.V[v].pInit;
+        for( unsigned int i = 0 ; i < _handleVertices.size() ; ++i )
+            positions[p][ _handleVertices[i] ] = handlePositions[p][i];
+    }
+    _solveColumns.resize( _threadPool.numberOfThreads() );
+    _solveWork.resize( _threadPool.numberOfThreads() );
+
+    for( unsigned int firstPose = 0 ; firstPose < numberOfPoses ; firstPose += _posesPerBatch ) {
+        unsigned int batchSize = std::min( _posesPerBatch , numberOfPoses - firstPose );
+        _handlePositions.resize( _handleVertices.size() , 3 * batchSize );
+        for( unsigned int p = 0 ; p < batchSize ; ++p )
+            for( unsigned int i = 0 ; i < _handleVertices.size() ; ++i )
+                for( unsigned int coord = 0 ; coord < 3 ; ++coord )
+                    _handlePositions( i , 3*p + coord ) = handlePositions[firstPose + p][i][coord];
+        _rhs.resize( _system.numberOfUnknowns() , 3 * batchSize );
+        _rotations.resize( batchSize );
+        for( unsigned int p = 0 ; p < batchSize ; ++p )
+            _rotations[p].assign( nV , Eigen::Matrix3d::Identity() );
+
+        for( unsigned int iteration = 0 ; iteration < _iterations ; ++iteration ) {
+            globalStep( &positions[firstPose] , batchSize );
+            localStep( &positions[firstPose] , batchSize );
+        }
+        _timings.iterations += _iterations * batchSize;
+    }
+    _timings.poses = numberOfPoses;
+    _timings.totalMs = timer.elapsedMs();
+    return true;
+}
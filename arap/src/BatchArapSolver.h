@@ -0,0 +1,102 @@
+#ifndef BatchArapSolver_H
+#define BatchArapSolver_H
+
+#include <vector>
+
+#include "../extern/eigen3/Eigen/Core"
+#include "../extern/eigen3/Eigen/SparseCore"
+
+#include "Vec3.h"
+#include "Mesh.h"
+#include "LaplacianWeights.h"
+#include "laplacianSystem.h"
+#include "ArapRhsOperator.h"
+#include "ArapSolver.h"
+#include "ThreadPool.h"
+
+
+//-------------------------------------------------------------------------------------//
+//
+// ARAP for many poses of the same mesh with the same handle vertices, e.g. to generate deformed
+// variants offline. Each pose only gives other positions to the handle vertices:
+//   - the Laplacian of the free vertices is factorized once, in setHandles() (or in the first solvePoses()
+//     after a change of the number of threads);
+//   - the poses are solved by batches of posesPerBatch: the global step of all the poses of a batch is
+//     one solve with a wide right-hand side (3 columns per pose), split by groups of poses between the
+//     threads, and the local steps of the poses run in parallel;
+//   - each pose starts from the rest positions and identity rotations, and runs a fixed number of
+//     iterations (the same result as ArapSolver::solve() from the rest state, see arapbench --batch-poses).
+// With a single thread, the wide solves bring nothing (the batch is slower than one ArapSolver::solve() per
+// pose, about 88 vs 104 poses/s on the armadillo): the poses are then solved one by one with an ArapSolver,
+// whose factorization replaces that of the wide solves.
+//
+// The mesh is only read: the positions of the poses are returned in separate arrays.
+//
+//-------------------------------------------------------------------------------------//
+class BatchArapSolver {
+public:
+    struct Timings {
+        double factorizationMs , rhsMs , solveMs , localStepMs , totalMs;
+        unsigned int poses , iterations;   // iterations: summed over the poses , on both paths
+
+        Timings() { clear(); }
+        void clear() { factorizationMs = rhsMs = solveMs = localStepMs = totalMs = 0.0; poses = iterations = 0; }
+        double posesPerSecond() const { return totalMs > 0.0 ? 1000.0 * poses / totalMs : 0.0; }
+    };
+
+private:
+    Mesh const * _mesh;
+    LaplacianWeights _weights;
+    laplacianSystem _system;
+    bool _systemIsUpToDate;   // factorized for the handles of the last setHandles()
+    ArapRhsOperator _rhsOperator;
+    ThreadPool _threadPool;
+
+    std::vector< unsigned int > _handleVertices;
+    Eigen::SparseMatrix< double , Eigen::RowMajor > _Lfc;   // free x handle vertices
+    unsigned int _iterations , _posesPerBatch;
+
+    // batch buffers (the positions are those of the output), 3 columns per pose
+    Eigen::MatrixXd _handlePositions , _rhs;                 // handles x 3P , free x 3P
+    std::vector< std::vector< Eigen::Matrix3d > > _rotations;   // P x V
+    std::vector< Eigen::MatrixXd > _solveColumns , _solveWork;   // per thread
+
+    Timings _timings;
+
+    // single thread: one ArapSolver::solve() per pose, on a copy of the mesh
+    std::vector< int > _verticesHandles;
+    Mesh _poseMesh;
+    ArapSolver _sequentialSolver;
+    bool _sequentialSolverIsUpToDate;
+
+    void updateSystem();
+    void updateSequentialSolver();
+    void globalStep( std::vector< Vec3 > * positions , unsigned int numberOfPoses );
+    void localStep( std::vector< Vec3 > * positions , unsigned int numberOfPoses );
+    bool solvePosesSequentially( std::vector< std::vector< Vec3 > > const & handlePositions , std::vector< std::vector< Vec3 > > & positions );
+
+public:
+    BatchArapSolver();
+
+    // Weights and rest state of mesh (both from pInit) , which must outlive the solver.
+    void setMesh( Mesh const & mesh );
+    // Factorizes the Laplacian of the free vertices, for the current number of threads (see above).
+    // verticesHandles[v] != -1 for the handle vertices.
+    void setHandles( std::vector< int > const & verticesHandles );
+    // The handle vertices , in the order of the positions given to solvePoses()
+    std::vector< unsigned int > const & handleVertices() const { return _handleVertices; }
+
+    void setIterations( unsigned int iterations ) { _iterations = std::max( iterations , 1u ); }
+    void setPosesPerBatch( unsigned int posesPerBatch ) { _posesPerBatch = std::max( posesPerBatch , 1u ); }
+    ThreadPool & threadPool() { return _threadPool; }
+
+    // handlePositions[p][i] : position of handleVertices()[i] in pose p. positions[p] : the V positions of pose p.
+    // false (and positions empty) without handles , if the factorization failed , or if a pose does not give
+    // exactly one position per handle vertex.
+    bool solvePoses( std::vector< std::vector< Vec3 > > const & handlePositions , std::vector< std::vector< Vec3 > > & positions );
+
+    // Of the last solvePoses() (factorizationMs: of the last setHandles()).
+    Timings const & timings() const { return _timings; }
+};
+
+#endif // BatchArapSolver_H
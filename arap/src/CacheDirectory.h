@@ -0,0 +1,86 @@
+#ifndef CacheDirectory_H
+#define CacheDirectory_H
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+
+//-------------------------------------------------------------------------------------//
+//
+// Size bound of a directory of ARAP cache files (.weights , .factorization , .eigenbasis):
+// after each write, the least recently used of them are removed until their total size is
+// under the limit. A file read from the cache is marked as used (its modification time is
+// set to now), so that the eviction order is that of the last use.
+//   The other files of the directory are left alone.
+//
+//-------------------------------------------------------------------------------------//
+
+static const unsigned long long DefaultCacheSizeLimit = 256ull << 20;   // bytes
+
+namespace CacheDirectoryDetails {
+
+inline bool endsWith( std::string const & name , char const * suffix ) {
+    std::string::size_type length = std::char_traits< char >::length( suffix );
+    return name.size() > length  &&  name.compare( name.size() - length , length , suffix ) == 0;
+}
+
+inline bool isCacheFile( std::string const & name ) {
+    return endsWith( name , ".weights" )  ||  endsWith( name , ".factorization" )  ||  endsWith( name , ".eigenbasis" );
+}
+
+}
+
+// Written to a temporary file first, named after the process and the thread, then renamed: another solver reading
+// the cache at the same time (e.g. the jobs of arapbatch, or another process) sees either no file or a complete one.
+// Returns false , and leaves no file behind , if the writer or the rename fails.
+inline bool writeFileAtomically( std::string const & fileName , std::function< bool( std::ostream & ) > const & writer ) {
+    char suffix[48];
+    std::snprintf( suffix , sizeof( suffix ) , ".%ld.%zx.tmp" , (long)getpid() , std::hash< std::thread::id >()( std::this_thread::get_id() ) );
+    std::string temporaryFileName = fileName + suffix;
+    bool ok;
+    {
+        std::ofstream out( temporaryFileName.c_str() , std::ios::binary );
+        ok = out  &&  writer( out )  &&  out;
+    }
+    if( ok ) ok = ( std::rename( temporaryFileName.c_str() , fileName.c_str() ) == 0 );
+    if( !ok ) std::remove( temporaryFileName.c_str() );
+    return ok;
+}
+
+inline void markCacheFileUsed( std::string const & fileName ) {
+    utime( fileName.c_str() , 0 );
+}
+
+inline void evictCacheFiles( std::string const & directory , unsigned long long sizeLimit ) {
+    DIR * dir = opendir( directory.c_str() );
+    if( ! dir ) return;
+    std::vector< std::pair< long long , std::pair< unsigned long long , std::string > > > files;   // ( time , ( size , path ) )
+    unsigned long long totalSize = 0;
+    while( dirent * entry = readdir( dir ) ) {
+        std::string name = entry->d_name;
+        if( ! CacheDirectoryDetails::isCacheFile( name ) ) continue;
+        std::string path = directory + "/" + name;
+        struct stat status;
+        if( stat( path.c_str() , &status ) != 0  ||  ! S_ISREG( status.st_mode ) ) continue;
+        files.push_back( std::make_pair( (long long)status.st_mtime , std::make_pair( (unsigned long long)status.st_size , path ) ) );
+        totalSize += status.st_size;
+    }
+    closedir( dir );
+
+    std::sort( files.begin() , files.end() );
+    for( unsigned int i = 0 ; i < files.size()  &&  totalSize > sizeLimit ; ++i )
+        if( std::remove( files[i].second.second.c_str() ) == 0 ) totalSize -= files[i].second.first;
+}
+
+#endif // CacheDirectory_H
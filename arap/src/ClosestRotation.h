@@ -0,0 +1,175 @@
+#ifndef ClosestRotation_H
+#define ClosestRotation_H
+
+#include <cmath>
+#include <algorithm>
+#include "../extern/eigen3/Eigen/Core"
+
+
+//-------------------------------------------------------------------------------------//
+//
+// Closest rotation R to a 3x3 matrix M (the one maximizing trace(R^T M)), for batches of
+// matrices stored lane by lane ("structure of arrays"): m[i][l] is coefficient i (row major)
+// of the matrix in lane l.
+//
+// Every step is a loop over the lanes with no data-dependent branch, so that the compiler
+// vectorizes it. There is no heap allocation.
+//
+//   1. M^T M = V D V^T with a fixed number of cyclic Jacobi sweeps (V is a product of rotations, det(V) = 1)
+//   2. B = M V, columns sorted by decreasing norm (swaps come with a sign flip to keep det(V) = 1)
+//   3. U = ( b0 / |b0| , b1 orthonormalized , u0 x u1 ), so that det(U) = 1
+//   4. R = U V^T
+//
+// When det(M) < 0, the third singular value is implicitly negative, and R is still a rotation
+// (not the reflection U V^T given by a plain SVD).
+//
+//-------------------------------------------------------------------------------------//
+
+static const unsigned int ClosestRotationBatchSize = 8;
+static const unsigned int ClosestRotationJacobiSweeps = 5;
+static const double ClosestRotationTiny = 1e-300;
+
+namespace ClosestRotationDetails {
+
+// Rotation in the (p,q) plane that cancels S(p,q): tan(2 phi) = 2 S_pq / (S_pp - S_qq)
+template< unsigned int W , int p , int q , int r >
+inline void jacobiRotation( double (&S)[3][3][W] , double (&V)[3][3][W] ) {
+    for( unsigned int l = 0 ; l < W ; ++l ) {
+        double a = S[p][p][l] , b = S[p][q][l] , d = S[q][q][l];
+        double aMinusD = a - d;
+        // the denominator is null only if b is null as well, in which case t = 0
+        double denominator = std::fabs(aMinusD) + std::sqrt( aMinusD * aMinusD + 4.0 * b * b );
+        double t = std::copysign( 2.0 , aMinusD ) * b / std::max( denominator , ClosestRotationTiny );
+        double c = 1.0 / std::sqrt( 1.0 + t * t );
+        double s = t * c;
+
+        double cc = c * c , ss = s * s , cs = c * s;
+        S[p][p][l] = cc * a + 2.0 * cs * b + ss * d;
+        S[q][q][l] = ss * a - 2.0 * cs * b + cc * d;
+        S[p][q][l] = S[q][p][l] = 0.0;
+        double spr = S[p][r][l] , sqr = S[q][r][l];
+        S[p][r][l] = S[r][p][l] = c * spr + s * sqr;
+        S[q][r][l] = S[r][q][l] = c * sqr - s * spr;
+
+        double v0p = V[0][p][l] , v0q = V[0][q][l] , v1p = V[1][p][l] , v1q = V[1][q][l] , v2p = V[2][p][l] , v2q = V[2][q][l];
+        V[0][p][l] = c * v0p + s * v0q;  V[0][q][l] = c * v0q - s * v0p;
+        V[1][p][l] = c * v1p + s * v1q;  V[1][q][l] = c * v1q - s * v1p;
+        V[2][p][l] = c * v2p + s * v2q;  V[2][q][l] = c * v2q - s * v2p;
+    }
+}
+
+// swap is 0 or 1 : selecting with arithmetic rather than with a branch keeps the lane loops vectorizable
+inline void swapColumnsCoefficients( double & ci , double & cj , double swap ) {
+    double oldCi = ci , oldCj = cj;
+    ci = oldCi + swap * ( oldCj - oldCi );
+    cj = oldCj - swap * ( oldCi + oldCj );
+}
+
+// Puts the column of larger norm in i, swapping columns i and j of B and V when needed (and negating the new column j)
+template< unsigned int W , int i , int j >
+inline void sortColumns( double (&B)[3][3][W] , double (&V)[3][3][W] , double (&norm2)[3][W] ) {
+    for( unsigned int l = 0 ; l < W ; ++l ) {
+        double ni = norm2[i][l] , nj = norm2[j][l];
+        double swap = ( ni < nj ) ? 1.0 : 0.0;
+        swapColumnsCoefficients( B[0][i][l] , B[0][j][l] , swap );
+        swapColumnsCoefficients( B[1][i][l] , B[1][j][l] , swap );
+        swapColumnsCoefficients( B[2][i][l] , B[2][j][l] , swap );
+        swapColumnsCoefficients( V[0][i][l] , V[0][j][l] , swap );
+        swapColumnsCoefficients( V[1][i][l] , V[1][j][l] , swap );
+        swapColumnsCoefficients( V[2][i][l] , V[2][j][l] , swap );
+        norm2[i][l] = std::max( ni , nj );
+        norm2[j][l] = std::min( ni , nj );
+    }
+}
+
+}
+
+
+template< unsigned int W >
+void computeClosestRotationsBatch( double const (&m)[9][W] , double (&rotations)[9][W] ) {
+    using namespace ClosestRotationDetails;
+
+    double S[3][3][W] , V[3][3][W];
+    for( unsigned int i = 0 ; i < 3 ; ++i )
+        for( unsigned int j = i ; j < 3 ; ++j )
+            for( unsigned int l = 0 ; l < W ; ++l )
+                S[i][j][l] = S[j][i][l] = m[i][l] * m[j][l] + m[3+i][l] * m[3+j][l] + m[6+i][l] * m[6+j][l];
+    for( unsigned int i = 0 ; i < 3 ; ++i )
+        for( unsigned int j = 0 ; j < 3 ; ++j )
+            for( unsigned int l = 0 ; l < W ; ++l )
+                V[i][j][l] = ( i == j ) ? 1.0 : 0.0;
+
+    for( unsigned int sweep = 0 ; sweep < ClosestRotationJacobiSweeps ; ++sweep ) {
+        jacobiRotation< W , 0 , 1 , 2 >( S , V );
+        jacobiRotation< W , 1 , 2 , 0 >( S , V );
+        jacobiRotation< W , 0 , 2 , 1 >( S , V );
+    }
+
+    double B[3][3][W] , norm2[3][W];
+    for( unsigned int i = 0 ; i < 3 ; ++i )
+        for( unsigned int j = 0 ; j < 3 ; ++j )
+            for( unsigned int l = 0 ; l < W ; ++l )
+                B[i][j][l] = m[3*i][l] * V[0][j][l] + m[3*i+1][l] * V[1][j][l] + m[3*i+2][l] * V[2][j][l];
+    for( unsigned int j = 0 ; j < 3 ; ++j )
+        for( unsigned int l = 0 ; l < W ; ++l )
+            norm2[j][l] = B[0][j][l] * B[0][j][l] + B[1][j][l] * B[1][j][l] + B[2][j][l] * B[2][j][l];
+
+    sortColumns< W , 0 , 1 >( B , V , norm2 );
+    sortColumns< W , 0 , 2 >( B , V , norm2 );
+    sortColumns< W , 1 , 2 >( B , V , norm2 );
+
+    double U[3][3][W];
+    for( unsigned int l = 0 ; l < W ; ++l ) {
+        // u0 : first column of B, or x if M is null
+        double hasU0 = ( norm2[0][l] > ClosestRotationTiny ) ? 1.0 : 0.0;
+        double invNorm0 = hasU0 / std::sqrt( std::max( norm2[0][l] , ClosestRotationTiny ) );
+        double u0x = B[0][0][l] * invNorm0 + ( 1.0 - hasU0 );
+        double u0y = B[1][0][l] * invNorm0;
+        double u0z = B[2][0][l] * invNorm0;
+
+        // u1 : second column of B orthogonalized against u0,
+        //   or, if M has rank 1, the axis on which u0 is the smallest orthogonalized against u0
+        double dot = u0x * B[0][1][l] + u0y * B[1][1][l] + u0z * B[2][1][l];
+        double wx = B[0][1][l] - dot * u0x , wy = B[1][1][l] - dot * u0y , wz = B[2][1][l] - dot * u0z;
+        double wNorm2 = wx * wx + wy * wy + wz * wz;
+        double hasU1 = ( wNorm2 > std::max( 1e-30 * norm2[0][l] , ClosestRotationTiny ) ) ? 1.0 : 0.0;
+        double ax = std::fabs(u0x) , ay = std::fabs(u0y) , az = std::fabs(u0z);
+        double ex = ( ax <= std::min( ay , az ) ) ? 1.0 : 0.0;
+        double ey = ( 1.0 - ex ) * ( ( ay <= az ) ? 1.0 : 0.0 );
+        double ez = 1.0 - ex - ey;
+        double eDot = u0x * ex + u0y * ey + u0z * ez;
+        wx = hasU1 * wx + ( 1.0 - hasU1 ) * ( ex - eDot * u0x );
+        wy = hasU1 * wy + ( 1.0 - hasU1 ) * ( ey - eDot * u0y );
+        wz = hasU1 * wz + ( 1.0 - hasU1 ) * ( ez - eDot * u0z );
+        double invNorm1 = 1.0 / std::sqrt( wx * wx + wy * wy + wz * wz );
+        double u1x = wx * invNorm1 , u1y = wy * invNorm1 , u1z = wz * invNorm1;
+
+        U[0][0][l] = u0x;  U[1][0][l] = u0y;  U[2][0][l] = u0z;
+        U[0][1][l] = u1x;  U[1][1][l] = u1y;  U[2][1][l] = u1z;
+        U[0][2][l] = u0y * u1z - u0z * u1y;
+        U[1][2][l] = u0z * u1x - u0x * u1z;
+        U[2][2][l] = u0x * u1y - u0y * u1x;
+    }
+
+    for( unsigned int i = 0 ; i < 3 ; ++i )
+        for( unsigned int j = 0 ; j < 3 ; ++j )
+            for( unsigned int l = 0 ; l < W ; ++l )
+                rotations[3*i+j][l] = U[i][0][l] * V[j][0][l] + U[i][1][l] * V[j][1][l] + U[i][2][l] * V[j][2][l];
+}
+
+
+// Single matrix version (a batch of one lane).
+inline Eigen::Matrix3d computeClosestRotation( Eigen::Matrix3d const & m ) {
+    double mLanes[9][1] , rLanes[9][1];
+    for( unsigned int i = 0 ; i < 3 ; ++i )
+        for( unsigned int j = 0 ; j < 3 ; ++j )
+            mLanes[3*i+j][0] = m(i,j);
+    computeClosestRotationsBatch< 1 >( mLanes , rLanes );
+    Eigen::Matrix3d r;
+    for( unsigned int i = 0 ; i < 3 ; ++i )
+        for( unsigned int j = 0 ; j < 3 ; ++j )
+            r(i,j) = rLanes[3*i+j][0];
+    return r;
+}
+
+#endif // ClosestRotation_H
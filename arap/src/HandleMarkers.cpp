@@ -0,0 +1,203 @@
+// shaders (OpenGL 2.0) , instancing (3.3) , declared by glext.h
+#define GL_GLEXT_PROTOTYPES
+
+#include "HandleMarkers.h"
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
+
+namespace {
+
+enum Attribute { Attribute_SpherePosition = 0 , Attribute_Center = 1 , Attribute_Color = 2 };
+
+// color material: the color is the ambient and diffuse material , the specular material is black
+const char * vertexShaderSource =
+    "#version 120\n"
+    "attribute vec3 spherePosition;\n"
+    "attribute vec3 center;\n"
+    "attribute vec3 color;\n"
+    "uniform float radius;\n"
+    "void main() {\n"
+    "    gl_Position = gl_ModelViewProjectionMatrix * vec4( center + radius * spherePosition , 1.0 );\n"
+    "    vec3 normal = normalize( gl_NormalMatrix * spherePosition );\n"
+    "    float diffuse = max( dot( normal , normalize( gl_LightSource[1].position.xyz ) ) , 0.0 );\n"
+    "    vec3 light = gl_LightModel.ambient.rgb + gl_LightSource[1].ambient.rgb + diffuse * gl_LightSource[1].diffuse.rgb;\n"
+    "    gl_FrontColor = vec4( min( color * light , 1.0 ) , 1.0 );\n"
+    "}\n";
+
+const char * fragmentShaderSource =
+    "#version 120\n"
+    "void main() {\n"
+    "    gl_FragColor = gl_Color;\n"
+    "}\n";
+
+GLuint compileShader( GLenum type , char const * source ) {
+    GLuint shader = glCreateShader( type );
+    glShaderSource( shader , 1 , &source , 0 );
+    glCompileShader( shader );
+    GLint isCompiled = GL_FALSE;
+    glGetShaderiv( shader , GL_COMPILE_STATUS , &isCompiled );
+    if( ! isCompiled ) {
+        char log[1024];
+        glGetShaderInfoLog( shader , sizeof(log) , 0 , log );
+        std::cerr << "HandleMarkers: shader not compiled: " << log << std::endl;
+        glDeleteShader( shader );
+        return 0;
+    }
+    return shader;
+}
+
+// triangles of the unit sphere , counterclockwise seen from outside: slices x stacks points plus the two poles
+void sphereTriangles( int slices , int stacks , std::vector< float > & positions ) {
+    int Nb = slices * stacks + 2;
+    std::vector< Vec3 > points( Nb );
+    points[0] = Vec3( 0 , 0 , 1 );
+    points[Nb-1] = Vec3( 0 , 0 , -1 );
+    for( int i = 1 ; i <= stacks ; i++ ) {
+        float Phi = 90 - (float)(i*180) / (float)(stacks+1);
+        float sinP = sinf( Phi * 3.14159265 / 180 ) , cosP = cosf( Phi * 3.14159265 / 180 );
+        for( int j = 1 ; j <= slices ; j++ ) {
+            float Theta = (float)(j*360) / (float)(slices);
+            float sinT = sinf( Theta * 3.14159265 / 180 ) , cosT = cosf( Theta * 3.14159265 / 180 );
+            points[ j + (i-1)*slices ] = Vec3( cosT*cosP , sinT*cosP , sinP );
+        }
+    }
+    auto add = [&]( int k ) { for( unsigned int c = 0 ; c < 3 ; ++c ) positions.push_back( points[k][c] ); };
+    positions.clear();
+    for( int i = 1 ; i <= slices ; i++ ) {
+        add( 0 );  add( i );  add( i % slices + 1 );
+        add( (stacks-1)*slices + i );  add( Nb - 1 );  add( (stacks-1)*slices + ( i % slices + 1 ) );
+    }
+    // quads k2 , k1 , k3 , k4 between two stacks , as two triangles
+    for( int j = 1 ; j < stacks ; j++ )
+        for( int i = 1 ; i <= slices ; i++ ) {
+            int k1 = i + (j-1)*slices , k2 = ( i % slices + 1 ) + (j-1)*slices;
+            int k3 = i + j*slices , k4 = ( i % slices + 1 ) + j*slices;
+            add( k2 );  add( k1 );  add( k3 );
+            add( k2 );  add( k3 );  add( k4 );
+        }
+}
+
+}
+
+
+HandleMarkers::HandleMarkers() :
+    _colorsAreUploaded(false) , _centersAreUploaded(false) , _isInitialized(false) , _instancingIsSupported(false) ,
+    _program(0) , _sphereBuffer(0) , _centerBuffer(0) , _colorBuffer(0) , _numberOfSphereVertices(0) , _radiusLocation(-1) {}
+
+
+void HandleMarkers::initialize() {
+    _isInitialized = true;
+    int major = 0 , minor = 0;
+    char const * version = (char const *) glGetString( GL_VERSION );
+    if( version == 0  ||  sscanf( version , "%d.%d" , &major , &minor ) != 2  ||  major * 10 + minor < 33 ) return;
+
+    GLuint vertexShader = compileShader( GL_VERTEX_SHADER , vertexShaderSource );
+    GLuint fragmentShader = compileShader( GL_FRAGMENT_SHADER , fragmentShaderSource );
+    if( vertexShader == 0  ||  fragmentShader == 0 ) return;
+    _program = glCreateProgram();
+    glAttachShader( _program , vertexShader );
+    glAttachShader( _program , fragmentShader );
+    glBindAttribLocation( _program , Attribute_SpherePosition , "spherePosition" );
+    glBindAttribLocation( _program , Attribute_Center , "center" );
+    glBindAttribLocation( _program , Attribute_Color , "color" );
+    glLinkProgram( _program );
+    glDeleteShader( vertexShader );
+    glDeleteShader( fragmentShader );
+    GLint isLinked = GL_FALSE;
+    glGetProgramiv( _program , GL_LINK_STATUS , &isLinked );
+    if( ! isLinked ) {
+        std::cerr << "HandleMarkers: program not linked, markers drawn as points" << std::endl;
+        glDeleteProgram( _program );
+        _program = 0;
+        return;
+    }
+    _radiusLocation = glGetUniformLocation( _program , "radius" );
+
+    std::vector< float > sphere;
+    sphereTriangles( 10 , 10 , sphere );
+    _numberOfSphereVertices = sphere.size() / 3;
+    glGenBuffers( 1 , &_sphereBuffer );
+    glGenBuffers( 1 , &_centerBuffer );
+    glGenBuffers( 1 , &_colorBuffer );
+    glBindBuffer( GL_ARRAY_BUFFER , _sphereBuffer );
+    glBufferData( GL_ARRAY_BUFFER , sphere.size() * sizeof(float) , &sphere[0] , GL_STATIC_DRAW );
+    glBindBuffer( GL_ARRAY_BUFFER , 0 );
+    _instancingIsSupported = true;
+}
+
+
+void HandleMarkers::setMarkers( std::vector< unsigned int > const & vertices , std::vector< float > const & colors ) {
+    _vertices = vertices;
+    _colors = colors;
+    _centers.clear();
+    _colorsAreUploaded = false;
+}
+
+
+void HandleMarkers::draw( Mesh const & mesh , float radius ) {
+    if( ! _isInitialized ) initialize();
+    if( _vertices.empty() ) return;
+
+    if( _centers.empty() ) {
+        _centers.resize( 3 * _vertices.size() );
+        for( unsigned int m = 0 ; m < _vertices.size() ; ++m )
+            for( unsigned int c = 0 ; c < 3 ; ++c ) _centers[ 3 * m + c ] = mesh.V[ _vertices[m] ].p[c];
+        _centersAreUploaded = false;
+    }
+
+    if( ! _instancingIsSupported ) {
+        glPushAttrib( GL_ENABLE_BIT | GL_POINT_BIT );
+        glDisable( GL_LIGHTING );
+        glEnable( GL_POINT_SMOOTH );
+        glPointSize( 8.f );
+        glEnableClientState( GL_VERTEX_ARRAY );
+        glEnableClientState( GL_COLOR_ARRAY );
+        glVertexPointer( 3 , GL_FLOAT , 0 , &_centers[0] );
+        glColorPointer( 3 , GL_FLOAT , 0 , &_colors[0] );
+        glDrawArrays( GL_POINTS , 0 , _vertices.size() );
+        glDisableClientState( GL_COLOR_ARRAY );
+        glDisableClientState( GL_VERTEX_ARRAY );
+        glPopAttrib();
+        return;
+    }
+
+    if( ! _colorsAreUploaded ) {
+        glBindBuffer( GL_ARRAY_BUFFER , _colorBuffer );
+        glBufferData( GL_ARRAY_BUFFER , _colors.size() * sizeof(float) , &_colors[0] , GL_DYNAMIC_DRAW );
+        _colorsAreUploaded = true;
+    }
+    if( ! _centersAreUploaded ) {
+        glBindBuffer( GL_ARRAY_BUFFER , _centerBuffer );
+        glBufferData( GL_ARRAY_BUFFER , _centers.size() * sizeof(float) , &_centers[0] , GL_DYNAMIC_DRAW );
+        _centersAreUploaded = true;
+    }
+
+    glUseProgram( _program );
+    glUniform1f( _radiusLocation , radius );
+    glBindBuffer( GL_ARRAY_BUFFER , _sphereBuffer );
+    glVertexAttribPointer( Attribute_SpherePosition , 3 , GL_FLOAT , GL_FALSE , 0 , 0 );
+    glEnableVertexAttribArray( Attribute_SpherePosition );
+    glBindBuffer( GL_ARRAY_BUFFER , _centerBuffer );
+    glVertexAttribPointer( Attribute_Center , 3 , GL_FLOAT , GL_FALSE , 0 , 0 );
+    glVertexAttribDivisor( Attribute_Center , 1 );
+    glEnableVertexAttribArray( Attribute_Center );
+    glBindBuffer( GL_ARRAY_BUFFER , _colorBuffer );
+    glVertexAttribPointer( Attribute_Color , 3 , GL_FLOAT , GL_FALSE , 0 , 0 );
+    glVertexAttribDivisor( Attribute_Color , 1 );
+    glEnableVertexAttribArray( Attribute_Color );
+
+    glDrawArraysInstanced( GL_TRIANGLES , 0 , _numberOfSphereVertices , _vertices.size() );
+
+    glDisableVertexAttribArray( Attribute_Color );
+    glVertexAttribDivisor( Attribute_Color , 0 );
+    glDisableVertexAttribArray( Attribute_Center );
+    glVertexAttribDivisor( Attribute_Center , 0 );
+    glDisableVertexAttribArray( Attribute_SpherePosition );
+    glBindBuffer( GL_ARRAY_BUFFER , 0 );
+    glUseProgram( 0 );
+}
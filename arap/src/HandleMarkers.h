@@ -0,0 +1,47 @@
+#ifndef HandleMarkers_H
+#define HandleMarkers_H
+
+#include <vector>
+
+#include "Mesh.h"
+
+
+//-------------------------------------------------------------------------------------//
+//
+// Spheres on the vertices of the handles, in one draw call: a sphere of 10 x 10 facets is
+// stored once, and drawn once per marker (instancing, OpenGL 3.3) with the center and the color
+// of the marker as attributes that advance per instance. The shader lights the spheres as the
+// fixed pipeline does with the light of gmini (GL_LIGHT1 , color material).
+//
+// The colors are uploaded by setMarkers() , only when the markers change; the centers when the
+// mesh moved (positionsWereChanged()). Without OpenGL 3.3 the markers are drawn as round points,
+// in one draw call too.
+//
+//-------------------------------------------------------------------------------------//
+class HandleMarkers {
+    std::vector< unsigned int > _vertices;   // with a marker
+    std::vector< float > _colors;            // rgb per marker
+    std::vector< float > _centers;           // xyz per marker
+    bool _colorsAreUploaded , _centersAreUploaded;
+
+    bool _isInitialized , _instancingIsSupported;
+    unsigned int _program , _sphereBuffer , _centerBuffer , _colorBuffer;
+    unsigned int _numberOfSphereVertices;
+    int _radiusLocation;
+
+    void initialize();
+
+public:
+    HandleMarkers();
+
+    // vertices with a marker, and their colors (rgb in [0,1] , 3 per vertex)
+    void setMarkers( std::vector< unsigned int > const & vertices , std::vector< float > const & colors );
+    unsigned int numberOfMarkers() const { return _vertices.size(); }
+
+    void positionsWereChanged() { _centers.clear(); }
+
+    // needs the context , radius in the frame of the mesh
+    void draw( Mesh const & mesh , float radius );
+};
+
+#endif // HandleMarkers_H
@@ -0,0 +1,181 @@
+#include "LaplacianEigenbasis.h"
+#include "MeshHash.h"
+#include "Timer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+#include "../extern/eigen3/Eigen/SparseCholesky"
+#include "../extern/eigen3/Eigen/Eigenvalues"
+
+
+static const char LaplacianEigenbasisMagic[8] = { 'A' , 'R' , 'A' , 'P' , 'E' , 'I' , 'G' , '1' };
+static const unsigned int LaplacianEigenbasisMaxIterations = 200;
+static const double LaplacianEigenbasisTolerance = 1e-8;   // on the eigenvalues, relative to the largest requested one
+
+
+LaplacianEigenbasis::LaplacianEigenbasis() : _iterations(0) , _buildMs(0.0) , _loadedFromCache(false) {
+}
+
+void LaplacianEigenbasis::clear() {
+    _basis.resize( 0 , 0 );
+    _eigenvalues.resize( 0 );
+    _iterations = 0;
+    _buildMs = 0.0;
+    _loadedFromCache = false;
+}
+
+std::string LaplacianEigenbasis::cacheFileName( std::string const & cacheDirectory , unsigned long long meshHash , unsigned int dimension ) {
+    char suffix[32];
+    std::snprintf( suffix , sizeof( suffix ) , "_%u.eigenbasis" , dimension );
+    return cacheDirectory + "/" + meshHashString( meshHash ) + suffix;
+}
+
+void LaplacianEigenbasis::build( Mesh const & mesh , Eigen::SparseMatrix< double > const & L , unsigned int dimension ,
+                                 std::string const & cacheDirectory , ThreadPool * threadPool , unsigned long long cacheSizeLimit ) {
+    Timer timer;
+    clear();
+    dimension = std::min< unsigned int >( dimension , mesh.V.size() );
+    if( dimension == 0 ) return;
+
+    unsigned long long meshHash = 0;
+    std::string fileName;
+    if( ! cacheDirectory.empty() ) {
+        meshHash = hashRestMesh( mesh );
+        fileName = cacheFileName( cacheDirectory , meshHash , dimension );
+        _loadedFromCache = load( fileName , meshHash , mesh.V.size() , dimension );
+        if( _loadedFromCache ) markCacheFileUsed( fileName );
+    }
+    if( ! _loadedFromCache ) {
+        if( ! compute( mesh , L , dimension , threadPool ) ) {
+            clear();
+            std::cerr << "LaplacianEigenbasis: cannot factorize L + sigma M" << std::endl;
+            _buildMs = timer.elapsedMs();
+            return;
+        }
+        if( ! fileName.empty() ) {
+            if( save( fileName , meshHash ) ) evictCacheFiles( cacheDirectory , cacheSizeLimit );
+            else std::cerr << "LaplacianEigenbasis: cannot write " << fileName << std::endl;
+        }
+    }
+    _buildMs = timer.elapsedMs();
+}
+
+
+bool LaplacianEigenbasis::compute( Mesh const & mesh , Eigen::SparseMatrix< double > const & L , unsigned int dimension , ThreadPool * threadPool ) {
+    unsigned int nV = mesh.V.size();
+    unsigned int numberOfVectors = std::min( nV , std::max( 2 * dimension , dimension + 8 ) );
+
+    // lumped masses
+    Eigen::VectorXd masses = Eigen::VectorXd::Zero( nV );
+    for( unsigned int t = 0 ; t < mesh.T.size() ; ++t ) {
+        Vec3 const & p0 = mesh.V[ mesh.T[t][0] ].pInit , & p1 = mesh.V[ mesh.T[t][1] ].pInit , & p2 = mesh.V[ mesh.T[t][2] ].pInit;
+        double area = 0.5 * Vec3::cross( p1 - p0 , p2 - p0 ).length();
+        for( unsigned int k = 0 ; k < 3 ; ++k )
+            masses[ mesh.T[t][k] ] += area / 3.0;
+    }
+    double meanMass = masses.sum() / nV;
+    for( unsigned int v = 0 ; v < nV ; ++v )
+        masses[v] = std::max( masses[v] , 1e-12 * meanMass );   // isolated vertices
+
+    // L + sigma M is positive definite, sigma is small compared to the spectrum of L
+    double sigma = 1e-8 * ( L.diagonal().array() / masses.array() ).mean();
+    Eigen::SparseMatrix< double > shifted = L;
+    for( unsigned int v = 0 ; v < nV ; ++v )
+        shifted.coeffRef( v , v ) += sigma * masses[v];
+    Eigen::SimplicialLDLT< Eigen::SparseMatrix< double > > shiftedFactorization( shifted );
+    if( shiftedFactorization.info() != Eigen::Success ) return false;
+
+    // fixed seed, so that the basis is the same from one run to the next
+    Eigen::MatrixXd X( nV , numberOfVectors ) , Y( nV , numberOfVectors );
+    unsigned long long seed = 0x2545F4914F6CDD1DULL;
+    for( unsigned int c = 0 ; c < numberOfVectors ; ++c )
+        for( unsigned int v = 0 ; v < nV ; ++v ) {
+            seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+            X(v,c) = double( seed >> 11 ) / double( 1ULL << 53 ) - 0.5;
+        }
+
+    Eigen::VectorXd previousEigenvalues = Eigen::VectorXd::Zero( dimension );
+    Eigen::GeneralizedSelfAdjointEigenSolver< Eigen::MatrixXd > ritz;
+    for( _iterations = 1 ; _iterations <= LaplacianEigenbasisMaxIterations ; ++_iterations ) {
+        // Y = ( L + sigma M )^-1 M X , one column per task
+        X = masses.asDiagonal() * X;
+        if( threadPool )
+            threadPool->parallelFor( 0 , numberOfVectors , [&]( unsigned int c ) { Y.col(c) = shiftedFactorization.solve( X.col(c) ); } );
+        else
+            Y = shiftedFactorization.solve( X );
+
+        // Rayleigh-Ritz: the Ritz vectors X = Y Z are M-orthonormal , with increasing Ritz values
+        Eigen::MatrixXd LY = L * Y;
+        Eigen::MatrixXd A = Y.transpose() * LY;
+        Eigen::MatrixXd B = Y.transpose() * masses.asDiagonal() * Y;
+        A = 0.5 * ( A + A.transpose() );
+        B = 0.5 * ( B + B.transpose() );
+        ritz.compute( A , B );
+        X = Y * ritz.eigenvectors();
+
+        Eigen::VectorXd eigenvalues = ritz.eigenvalues().head( dimension );
+        double change = ( eigenvalues - previousEigenvalues ).cwiseAbs().maxCoeff();
+        previousEigenvalues = eigenvalues;
+        if( _iterations > 1  &&  change <= LaplacianEigenbasisTolerance * std::max( std::abs( eigenvalues[dimension-1] ) , 1e-300 ) )
+            break;
+    }
+    _iterations = std::min( _iterations , LaplacianEigenbasisMaxIterations );
+    _basis = X.leftCols( dimension );
+    _eigenvalues = previousEigenvalues;
+    return true;
+}
+
+
+// file: magic , mesh hash , V , dimension , iterations , eigenvalues , basis (column major)
+bool LaplacianEigenbasis::load( std::string const & fileName , unsigned long long meshHash , unsigned int numberOfVertices , unsigned int dimension ) {
+    std::ifstream in( fileName.c_str() , std::ios::binary );
+    if( !in ) return false;
+    char magic[8];
+    unsigned long long fileHash;
+    unsigned int fileNumberOfVertices , fileDimension , iterations;
+    in.read( magic , 8 );
+    in.read( reinterpret_cast< char * >( &fileHash ) , sizeof( fileHash ) );
+    in.read( reinterpret_cast< char * >( &fileNumberOfVertices ) , sizeof( fileNumberOfVertices ) );
+    in.read( reinterpret_cast< char * >( &fileDimension ) , sizeof( fileDimension ) );
+    in.read( reinterpret_cast< char * >( &iterations ) , sizeof( iterations ) );
+    if( !in  ||  ! std::equal( magic , magic + 8 , LaplacianEigenbasisMagic )  ||  fileHash != meshHash  ||
+        fileNumberOfVertices != numberOfVertices  ||  fileDimension != dimension )
+        return false;
+    // the rest of the file is exactly the eigenvalues and the basis, before anything is allocated
+    std::streampos contentBegin = in.tellg();
+    in.seekg( 0 , std::ios::end );
+    unsigned long long contentBytes = (unsigned long long)( in.tellg() - contentBegin );
+    in.seekg( contentBegin );
+    if( !in  ||  contentBytes != sizeof( double ) * dimension * ( numberOfVertices + 1ull ) ) return false;
+
+    _eigenvalues.resize( dimension );
+    _basis.resize( numberOfVertices , dimension );
+    in.read( reinterpret_cast< char * >( _eigenvalues.data() ) , sizeof( double ) * dimension );
+    in.read( reinterpret_cast< char * >( _basis.data() ) , sizeof( double ) * numberOfVertices * dimension );
+    if( !in  ||  ! _eigenvalues.allFinite()  ||  ! _basis.allFinite() ) {
+        clear();
+        return false;
+    }
+    _iterations = 0;
+    return true;
+}
+
+// Written with writeFileAtomically (see CacheDirectory.h), as the caches of ArapSolver: another process building
+// the same basis, or reading it meanwhile, never sees a partial file.
+bool LaplacianEigenbasis::save( std::string const & fileName , unsigned long long meshHash ) const {
+    return writeFileAtomically( fileName , [&]( std::ostream & out ) {
+        unsigned int numberOfVertices = _basis.rows() , dimension = _basis.cols();
+        out.write( LaplacianEigenbasisMagic , 8 );
+        out.write( reinterpret_cast< char const * >( &meshHash ) , sizeof( meshHash ) );
+        out.write( reinterpret_cast< char const * >( &numberOfVertices ) , sizeof( numberOfVertices ) );
+        out.write( reinterpret_cast< char const * >( &dimension ) , sizeof( dimension ) );
+        out.write( reinterpret_cast< char const * >( &_iterations ) , sizeof( _iterations ) );
+        out.write( reinterpret_cast< char const * >( _eigenvalues.data() ) , sizeof( double ) * dimension );
+        out.write( reinterpret_cast< char const * >( _basis.data() ) , sizeof( double ) * numberOfVertices * dimension );
+        return bool( out );
+    } );
+}
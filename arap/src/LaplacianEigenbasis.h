@@ -0,0 +1,61 @@
+#ifndef LaplacianEigenbasis_H
+#define LaplacianEigenbasis_H
+
+#include <string>
+
+#include "../extern/eigen3/Eigen/Core"
+#include "../extern/eigen3/Eigen/SparseCore"
+
+#include "Mesh.h"
+#include "ThreadPool.h"
+#include "CacheDirectory.h"
+
+
+//-------------------------------------------------------------------------------------//
+//
+// The lowest eigenvectors of the cotangent Laplacian L of a mesh, for the generalized problem
+//     L u = lambda M u
+// with the lumped mass matrix M (a third of the area of the triangles around each vertex).
+// The basis is M-orthonormal and its eigenvalues increase: the first one is the constant vector.
+//
+// Computed with a shift-invert subspace iteration on a few more vectors than requested: one sparse
+// factorization of L + sigma M , then at each iteration one solve per vector and a Rayleigh-Ritz
+// projection (a small dense generalized eigenproblem), until the requested eigenvalues are stable.
+//
+// The basis only depends on the rest state: build() reads it from a file named after the hash of the
+// mesh (see MeshHash.h) when there is one in the cache directory, and writes it there otherwise.
+//
+//-------------------------------------------------------------------------------------//
+class LaplacianEigenbasis {
+    Eigen::MatrixXd _basis;          // V x dimension
+    Eigen::VectorXd _eigenvalues;
+    unsigned int _iterations;
+    double _buildMs;
+    bool _loadedFromCache;
+
+    bool compute( Mesh const & mesh , Eigen::SparseMatrix< double > const & L , unsigned int dimension , ThreadPool * threadPool );   // false if L + sigma M cannot be factorized
+    bool load( std::string const & fileName , unsigned long long meshHash , unsigned int numberOfVertices , unsigned int dimension );
+    bool save( std::string const & fileName , unsigned long long meshHash ) const;
+
+public:
+    LaplacianEigenbasis();
+
+    // L is the V x V cotangent Laplacian of mesh (positive diagonal). cacheDirectory empty : no cache, otherwise
+    // its cache files are kept under cacheSizeLimit bytes (see CacheDirectory.h).
+    // The basis stays empty (dimension 0) if it cannot be computed.
+    void build( Mesh const & mesh , Eigen::SparseMatrix< double > const & L , unsigned int dimension ,
+                std::string const & cacheDirectory = std::string() , ThreadPool * threadPool = 0 ,
+                unsigned long long cacheSizeLimit = DefaultCacheSizeLimit );
+    void clear();
+
+    unsigned int dimension() const { return _basis.cols(); }
+    Eigen::MatrixXd const & basis() const { return _basis; }
+    Eigen::VectorXd const & eigenvalues() const { return _eigenvalues; }
+    unsigned int iterations() const { return _iterations; }   // of the subspace iteration (0 when loaded)
+    double buildMs() const { return _buildMs; }
+    bool loadedFromCache() const { return _loadedFromCache; }
+
+    static std::string cacheFileName( std::string const & cacheDirectory , unsigned long long meshHash , unsigned int dimension );
+};
+
+#endif // LaplacianEigenbasis_H
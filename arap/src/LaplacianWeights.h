@@ -2,8 +2,12 @@
 #define LAPLACIANWEIGHTS_H
 
 #include <vector>
-#include <map>
+#include <algorithm>
+#include <cmath>
+#include <istream>
+#include <ostream>
 #include "Mesh.h"
+#include "ThreadPool.h"
 
 //-------------------------------------------------------------------------------------//
 //-------------------------------------------------------------------------------------//
@@ -18,21 +22,135 @@
 //-------------------------------------------------------------------------------------//
 //-------------------------------------------------------------------------------------//
 
+// The edges are stored in compressed sparse rows: the edges of vertex v are the indices
+// [ get_adjacent_edges_begin(v) , get_adjacent_edges_end(v) [ of two contiguous arrays (neighbors, weights),
+// with the neighbors sorted by increasing index.
 // access to an edge is of complexity O( log(val) ), with val the average valence of the vertices
 
+// Contiguous range of values [first , last[, read only
+template <class T>
+struct ConstArraySpan
+{
+    const T *first;
+    const T *last;
+
+    ConstArraySpan(const T *f, const T *l) : first(f), last(l) {}
+    unsigned int size() const { return last - first; }
+    const T &operator[](unsigned int i) const { return first[i]; }
+    const T *begin() const { return first; }
+    const T *end() const { return last; }
+};
+
 //---------------------------------   YOU DO NOT NEED TO CHANGE THE FOLLOWING CODE  --------------------------------//
 class LaplacianWeights
 {
 private:
     unsigned int n_vertices;
-    std::vector<std::map<unsigned int, double>> edge_weights;
+    std::vector<unsigned int> adjacent_edges_begin; // n_vertices + 1 offsets
+    std::vector<unsigned int> adjacent_vertices;
+    std::vector<double> edge_weights;
     std::vector<double> vertex_weights;
 
+    // What a triangle adds to the weights. Edge k is the edge opposite to corner k, it exists only if hasEdge[k]
+    // (an edge that receives no contribution from any triangle is not stored).
+    struct TriangleWeights
+    {
+        double edge[3];
+        double vertex[3];
+        bool hasEdge[3];
+    };
+
+    template <class F>
+    static void forEachIndex(ThreadPool *threadPool, unsigned int n, const F &f)
+    {
+        if (threadPool)
+            threadPool->parallelFor(0, n, f);
+        else
+            for (unsigned int i = 0; i < n; ++i)
+                f(i);
+    }
+
+    // Builds the sparse rows from the contributions of each triangle.
+    // Each vertex gathers the contributions of its triangles, in the order of the triangles, so that
+    // the vertices can be processed in parallel without any race and the sums do not depend on the threads.
+    template <class triangle_t>
+    void buildFromTriangleWeights(unsigned int nVertices, const std::vector<triangle_t> &triangles,
+                                  const std::vector<TriangleWeights> &triangleWeights, ThreadPool *threadPool)
+    {
+        resize(nVertices);
+
+        // triangle corners around each vertex (3 * t + corner), sorted by triangle
+        std::vector<unsigned int> cornersBegin(nVertices + 1, 0);
+        for (unsigned int t = 0; t < triangles.size(); ++t)
+            for (unsigned int c = 0; c < 3; ++c)
+                ++cornersBegin[triangles[t][c] + 1];
+        for (unsigned int v = 0; v < nVertices; ++v)
+            cornersBegin[v + 1] += cornersBegin[v];
+        std::vector<unsigned int> corners(cornersBegin[nVertices]);
+        std::vector<unsigned int> nextCorner(cornersBegin.begin(), cornersBegin.end() - 1);
+        for (unsigned int t = 0; t < triangles.size(); ++t)
+            for (unsigned int c = 0; c < 3; ++c)
+                corners[nextCorner[triangles[t][c]]++] = 3 * t + c;
+
+        // neighbors: at most 2 per corner, sorted and made unique in place
+        std::vector<unsigned int> candidates(2 * corners.size());
+        std::vector<unsigned int> numberOfNeighbors(nVertices);
+        forEachIndex(threadPool, nVertices, [&](unsigned int v) {
+            unsigned int *first = candidates.data() + 2 * cornersBegin[v];
+            unsigned int *last = first;
+            for (unsigned int i = cornersBegin[v]; i < cornersBegin[v + 1]; ++i)
+            {
+                unsigned int t = corners[i] / 3, c = corners[i] % 3;
+                const TriangleWeights &w = triangleWeights[t];
+                if (w.hasEdge[(c + 2) % 3]) *last++ = triangles[t][(c + 1) % 3];
+                if (w.hasEdge[(c + 1) % 3]) *last++ = triangles[t][(c + 2) % 3];
+            }
+            std::sort(first, last);
+            numberOfNeighbors[v] = std::unique(first, last) - first;
+        });
+
+        for (unsigned int v = 0; v < nVertices; ++v)
+            adjacent_edges_begin[v + 1] = adjacent_edges_begin[v] + numberOfNeighbors[v];
+        adjacent_vertices.resize(adjacent_edges_begin[nVertices]);
+        edge_weights.resize(adjacent_edges_begin[nVertices], 0.0);
+
+        forEachIndex(threadPool, nVertices, [&](unsigned int v) {
+            std::copy(candidates.begin() + 2 * cornersBegin[v], candidates.begin() + 2 * cornersBegin[v] + numberOfNeighbors[v],
+                      adjacent_vertices.begin() + adjacent_edges_begin[v]);
+            for (unsigned int i = cornersBegin[v]; i < cornersBegin[v + 1]; ++i)
+            {
+                unsigned int t = corners[i] / 3, c = corners[i] % 3;
+                const TriangleWeights &w = triangleWeights[t];
+                for (unsigned int k = 1; k < 3; ++k)
+                {
+                    unsigned int edge = (c + 3 - k) % 3; // edge from v to the corner (c+k)%3 , opposite to the corner (c+3-k)%3
+                    if (!w.hasEdge[edge]) continue;
+                    unsigned int vNeighbor = triangles[t][(c + k) % 3];
+                    edge_weights[find_edge(v, vNeighbor)] += w.edge[edge];
+                }
+                vertex_weights[v] += w.vertex[c];
+            }
+        });
+    }
+
+    // index of the edge (v1,v2), or get_adjacent_edges_end(v1) if it does not exist
+    unsigned int find_edge(unsigned int v1, unsigned int v2) const
+    {
+        const unsigned int *first = adjacent_vertices.data() + adjacent_edges_begin[v1];
+        const unsigned int *last = adjacent_vertices.data() + adjacent_edges_begin[v1 + 1];
+        const unsigned int *it = std::lower_bound(first, last, v2);
+        if (it != last && *it != v2)
+            it = last;
+        return it - adjacent_vertices.data();
+    }
+
 public:
     LaplacianWeights() : n_vertices(0) {}
     void clear()
     {
         n_vertices = 0;
+        adjacent_edges_begin.clear();
+        adjacent_vertices.clear();
         edge_weights.clear();
         vertex_weights.clear();
     }
@@ -54,48 +172,56 @@ public:
         if (nVertices > 0)
         {
             n_vertices = nVertices;
-            edge_weights.resize(nVertices);
+            adjacent_edges_begin.resize(nVertices + 1, 0);
             vertex_weights.resize(nVertices, 0.0);
-
-            for (unsigned int v = 0; v < nVertices; ++v)
-            {
-                edge_weights[v].clear();
-                vertex_weights[v] = 0.0;
-            }
         }
     }
     unsigned int get_n_adjacent_edges(unsigned int vertex_index) const
     {
-        return edge_weights[vertex_index].size();
+        return adjacent_edges_begin[vertex_index + 1] - adjacent_edges_begin[vertex_index];
     }
     double get_edge_weight(unsigned int v1, unsigned int v2) const
     {
-        std::map<unsigned int, double>::const_iterator it = edge_weights[v1].find(v2);
-        if (it == edge_weights[v1].end())
+        unsigned int e = find_edge(v1, v2);
+        if (e == adjacent_edges_begin[v1 + 1])
             return 0.0;
-        return it->second;
+        return edge_weights[e];
     }
     unsigned int get_n_vertices() const
     {
         return n_vertices;
     }
+    unsigned int get_n_edges() const
+    {
+        return adjacent_vertices.size();
+    }
 
-    std::map<unsigned int, double>::iterator get_weight_of_adjacent_edges_it_begin(unsigned int v1)
+    // edges of v1 , as indices in [0 , get_n_edges()[
+    unsigned int get_adjacent_edges_begin(unsigned int v1) const
+    {
+        return adjacent_edges_begin[v1];
+    }
+    unsigned int get_adjacent_edges_end(unsigned int v1) const
+    {
+        return adjacent_edges_begin[v1 + 1];
+    }
+    unsigned int get_edge_vertex(unsigned int edge) const
     {
-        return edge_weights[v1].begin();
+        return adjacent_vertices[edge];
     }
-    std::map<unsigned int, double>::iterator get_weight_of_adjacent_edges_it_end(unsigned int v1)
+    double get_edge_weight_of_index(unsigned int edge) const
     {
-        return edge_weights[v1].end();
+        return edge_weights[edge];
     }
 
-    std::map<unsigned int, double>::const_iterator get_weight_of_adjacent_edges_it_begin(unsigned int v1) const
+    // neighbors of v1 and the weights of the corresponding edges, in the same order
+    ConstArraySpan<unsigned int> get_adjacent_vertices(unsigned int v1) const
     {
-        return edge_weights[v1].begin();
+        return ConstArraySpan<unsigned int>(adjacent_vertices.data() + adjacent_edges_begin[v1], adjacent_vertices.data() + adjacent_edges_begin[v1 + 1]);
     }
-    std::map<unsigned int, double>::const_iterator get_weight_of_adjacent_edges_it_end(unsigned int v1) const
+    ConstArraySpan<double> get_weight_of_adjacent_edges(unsigned int v1) const
     {
-        return edge_weights[v1].end();
+        return ConstArraySpan<double>(edge_weights.data() + adjacent_edges_begin[v1], edge_weights.data() + adjacent_edges_begin[v1 + 1]);
     }
 
     double get_vertex_weight(unsigned int v) const
@@ -103,6 +229,53 @@ public:
         return vertex_weights[v];
     }
 
+    // Binary copy of the weights (see ArapSolver's cache), read back by read(). read() returns false
+    // and leaves the weights empty if the stream does not hold consistent weights for nVertices vertices.
+    bool write(std::ostream &out) const
+    {
+        unsigned int n_edges = adjacent_vertices.size();
+        out.write(reinterpret_cast<const char *>(&n_vertices), sizeof(n_vertices));
+        out.write(reinterpret_cast<const char *>(&n_edges), sizeof(n_edges));
+        out.write(reinterpret_cast<const char *>(adjacent_edges_begin.data()), sizeof(unsigned int) * adjacent_edges_begin.size());
+        out.write(reinterpret_cast<const char *>(adjacent_vertices.data()), sizeof(unsigned int) * n_edges);
+        out.write(reinterpret_cast<const char *>(edge_weights.data()), sizeof(double) * n_edges);
+        out.write(reinterpret_cast<const char *>(vertex_weights.data()), sizeof(double) * vertex_weights.size());
+        return bool(out);
+    }
+    bool read(std::istream &in, unsigned int nVertices)
+    {
+        unsigned int fileVertices = 0, n_edges = 0;
+        in.read(reinterpret_cast<char *>(&fileVertices), sizeof(fileVertices));
+        in.read(reinterpret_cast<char *>(&n_edges), sizeof(n_edges));
+        if (!in || fileVertices != nVertices || nVertices == 0)
+            return false;
+        // the rest of the stream is exactly the weights, before anything is allocated
+        std::streampos contentBegin = in.tellg();
+        in.seekg(0, std::ios::end);
+        unsigned long long contentBytes = (unsigned long long)(in.tellg() - contentBegin);
+        in.seekg(contentBegin);
+        if (!in || contentBytes != sizeof(unsigned int) * (nVertices + 1ull + n_edges) + sizeof(double) * ((unsigned long long)n_edges + nVertices))
+            return false;
+        resize(nVertices);
+        adjacent_vertices.resize(n_edges);
+        edge_weights.resize(n_edges);
+        in.read(reinterpret_cast<char *>(adjacent_edges_begin.data()), sizeof(unsigned int) * (nVertices + 1));
+        in.read(reinterpret_cast<char *>(adjacent_vertices.data()), sizeof(unsigned int) * n_edges);
+        in.read(reinterpret_cast<char *>(edge_weights.data()), sizeof(double) * n_edges);
+        in.read(reinterpret_cast<char *>(vertex_weights.data()), sizeof(double) * nVertices);
+        bool isValid = in && adjacent_edges_begin[0] == 0 && adjacent_edges_begin[nVertices] == n_edges;
+        for (unsigned int v = 0; isValid && v < nVertices; ++v)
+            isValid = adjacent_edges_begin[v] <= adjacent_edges_begin[v + 1] && std::isfinite(vertex_weights[v]);
+        for (unsigned int e = 0; isValid && e < n_edges; ++e)
+            isValid = adjacent_vertices[e] < nVertices && std::isfinite(edge_weights[e]);
+        if (!isValid)
+        {
+            clear();
+            return false;
+        }
+        return true;
+    }
+
     //-----------------------------------------------------------------------------------//
     //-----------------------------------------------------------------------------------//
     //-----------------------------------------------------------------------------------//
@@ -115,21 +288,25 @@ public:
     // Weight of edge eij : i<->j is the sum of cotangent of opposite angles divided by 2
     // wij = 1/2 * (cot(alpha_ij) + cot(beta_ij)) alpha_ij and beta_ij being the two opposite angles of the edge ij
 
-    void buildCotangentWeightsOfTriangleMesh(const Mesh &mesh)
+    // The weights are those of the rest positions (pInit), whatever the current positions: ARAP measures the
+    // deformation from the rest state.
+    // The triangles are processed in parallel on threadPool (sequentially when it is null).
+    void buildCotangentWeightsOfTriangleMesh(const Mesh &mesh, ThreadPool *threadPool = 0)
     {
-        resize(mesh.V.size());
+        std::vector<TriangleWeights> triangleWeights(mesh.T.size());
 
         // pour chaque triangle
-        for (unsigned int t = 0; t < mesh.T.size(); ++t)
-        {
+        forEachIndex(threadPool, mesh.T.size(), [&](unsigned int t) {
+            TriangleWeights &w = triangleWeights[t];
+
             unsigned int v0 = mesh.T[t][0];
             unsigned int v1 = mesh.T[t][1];
             unsigned int v2 = mesh.T[t][2];
 
             // nos points du triangle
-            Vec3 p0 = mesh.V[v0].p;
-            Vec3 p1 = mesh.V[v1].p;
-            Vec3 p2 = mesh.V[v2].p;
+            Vec3 p0 = mesh.V[v0].pInit;
+            Vec3 p1 = mesh.V[v1].pInit;
+            Vec3 p2 = mesh.V[v2].pInit;
 
             double arrete_01 = (p1 - p0).sqrnorm();
             double arrete_12 = (p2 - p1).sqrnorm();
@@ -150,18 +327,16 @@ public:
                 double edge02Weight = sqrt(((p0 + p2) / 2.0 - milieu).sqrnorm() / arrete_02);
                 double edge01Weight = sqrt(((p0 + p1) / 2.0 - milieu).sqrnorm() / arrete_01);
 
-                edge_weights[v0][v2] += edge02Weight;
-                edge_weights[v2][v0] += edge02Weight;
-
-                edge_weights[v0][v1] += edge01Weight;
-                edge_weights[v1][v0] += edge01Weight;
+                w.hasEdge[0] = false;
+                w.hasEdge[1] = true;   w.edge[1] = edge02Weight;
+                w.hasEdge[2] = true;   w.edge[2] = edge01Weight;
 
                 // on calcule l'aire du triangle
                 double t_area = Vec3::cross(p1 - p0, p2 - p0).norm() / 2.0;
 
-                vertex_weights[v0] += t_area / 2.0;
-                vertex_weights[v1] += t_area / 4.0;
-                vertex_weights[v2] += t_area / 4.0;
+                w.vertex[0] = t_area / 2.0;
+                w.vertex[1] = t_area / 4.0;
+                w.vertex[2] = t_area / 4.0;
             }
             else if (dot_1 < 0.0)
             {
@@ -171,17 +346,15 @@ public:
                 double edge12Weight = sqrt(((p2 + p1) / 2.0 - milieu).sqrnorm() / arrete_12);
                 double edge01Weight = sqrt(((p0 + p1) / 2.0 - milieu).sqrnorm() / arrete_01);
 
-                edge_weights[v1][v2] += edge12Weight;
-                edge_weights[v2][v1] += edge12Weight;
-
-                edge_weights[v0][v1] += edge01Weight;
-                edge_weights[v1][v0] += edge01Weight;
+                w.hasEdge[0] = true;   w.edge[0] = edge12Weight;
+                w.hasEdge[1] = false;
+                w.hasEdge[2] = true;   w.edge[2] = edge01Weight;
 
                 double t_area = Vec3::cross(p1 - p0, p2 - p0).norm() / 2.0;
 
-                vertex_weights[v0] += t_area / 4.0;
-                vertex_weights[v1] += t_area / 2.0;
-                vertex_weights[v2] += t_area / 4.0;
+                w.vertex[0] = t_area / 4.0;
+                w.vertex[1] = t_area / 2.0;
+                w.vertex[2] = t_area / 4.0;
             }
             else if (dot_2 < 0.0)
             {
@@ -191,17 +364,15 @@ public:
                 double edge12Weight = sqrt(((p2 + p1) / 2.0 - milieu).sqrnorm() / arrete_12);
                 double edge02Weight = sqrt(((p0 + p2) / 2.0 - milieu).sqrnorm() / arrete_02);
 
-                edge_weights[v1][v2] += edge12Weight;
-                edge_weights[v2][v1] += edge12Weight;
-
-                edge_weights[v0][v2] += edge02Weight;
-                edge_weights[v2][v0] += edge02Weight;
+                w.hasEdge[0] = true;   w.edge[0] = edge12Weight;
+                w.hasEdge[1] = true;   w.edge[1] = edge02Weight;
+                w.hasEdge[2] = false;
 
                 double t_area = Vec3::cross(p1 - p0, p2 - p0).norm() / 2.0;
 
-                vertex_weights[v0] += t_area / 4.0;
-                vertex_weights[v1] += t_area / 4.0;
-                vertex_weights[v2] += t_area / 2.0;
+                w.vertex[0] = t_area / 4.0;
+                w.vertex[1] = t_area / 4.0;
+                w.vertex[2] = t_area / 2.0;
             }
             else
             {
@@ -210,26 +381,18 @@ public:
                 double cotW2_by_2 = dot_2 / (2.0 * sqrt(arrete_12 * arrete_02 - dot_2 * dot_2));
 
                 // Cotangent weights:
-                edge_weights[v1][v2] += cotW0_by_2;
-                edge_weights[v2][v1] += cotW0_by_2;
-
-                edge_weights[v0][v2] += cotW1_by_2;
-                edge_weights[v2][v0] += cotW1_by_2;
-
-                edge_weights[v1][v0] += cotW2_by_2;
-                edge_weights[v0][v1] += cotW2_by_2;
+                w.hasEdge[0] = true;   w.edge[0] = cotW0_by_2;
+                w.hasEdge[1] = true;   w.edge[1] = cotW1_by_2;
+                w.hasEdge[2] = true;   w.edge[2] = cotW2_by_2;
 
                 // Voronoi areas:
-                vertex_weights[v1] += cotW0_by_2 * arrete_12 / 2.0;
-                vertex_weights[v2] += cotW0_by_2 * arrete_12 / 2.0;
-
-                vertex_weights[v0] += cotW1_by_2 * arrete_02 / 2.0;
-                vertex_weights[v2] += cotW1_by_2 * arrete_02 / 2.0;
-
-                vertex_weights[v0] += cotW2_by_2 * arrete_01 / 2.0;
-                vertex_weights[v1] += cotW2_by_2 * arrete_01 / 2.0;
+                w.vertex[0] = cotW1_by_2 * arrete_02 / 2.0 + cotW2_by_2 * arrete_01 / 2.0;
+                w.vertex[1] = cotW0_by_2 * arrete_12 / 2.0 + cotW2_by_2 * arrete_01 / 2.0;
+                w.vertex[2] = cotW0_by_2 * arrete_12 / 2.0 + cotW1_by_2 * arrete_02 / 2.0;
             }
-        }
+        });
+
+        buildFromTriangleWeights(mesh.V.size(), mesh.T, triangleWeights, threadPool);
     }
 
     //---------------------------------   YOU DO NOT NEED TO CHANGE THE FOLLOWING CODE  --------------------------------//
@@ -242,12 +405,11 @@ public:
     // These weights are all positive
 
     template <class vertex_t, class triangle_t>
-    void buildBarycentricWeightsOfTriangleMesh(const std::vector<vertex_t> &vertices, const std::vector<triangle_t> &triangles)
+    void buildBarycentricWeightsOfTriangleMesh(const std::vector<vertex_t> &vertices, const std::vector<triangle_t> &triangles, ThreadPool *threadPool = 0)
     {
-        resize(vertices.size());
+        std::vector<TriangleWeights> triangleWeights(triangles.size());
 
-        for (unsigned int t = 0; t < triangles.size(); ++t)
-        {
+        forEachIndex(threadPool, triangles.size(), [&](unsigned int t) {
             unsigned int v0 = triangles[t][0];
             unsigned int v1 = triangles[t][1];
             unsigned int v2 = triangles[t][2];
@@ -259,28 +421,21 @@ public:
             double t_area_by_3 = Vec3::cross(p1 - p0, p2 - p0).norm() / 6.0;
 
             // Barycentric weights:
-            edge_weights[v1][v2] += t_area_by_3;
-            edge_weights[v2][v1] += t_area_by_3;
-
-            edge_weights[v0][v2] += t_area_by_3;
-            edge_weights[v2][v0] += t_area_by_3;
+            for (unsigned int c = 0; c < 3; ++c)
+            {
+                triangleWeights[t].hasEdge[c] = true;
+                triangleWeights[t].edge[c] = t_area_by_3;
+                triangleWeights[t].vertex[c] = t_area_by_3;
+            }
+        });
 
-            edge_weights[v1][v0] += t_area_by_3;
-            edge_weights[v0][v1] += t_area_by_3;
+        buildFromTriangleWeights(vertices.size(), triangles, triangleWeights, threadPool);
 
-            vertex_weights[v0] += t_area_by_3;
-            vertex_weights[v1] += t_area_by_3;
-            vertex_weights[v2] += t_area_by_3;
-        }
-        for (unsigned int v = 0; v < n_vertices; ++v)
-        {
+        forEachIndex(threadPool, n_vertices, [&](unsigned int v) {
             double v_area = vertex_weights[v];
-            for (std::map<unsigned int, double>::iterator it = edge_weights[v].begin(); it != edge_weights[v].end(); ++it)
-            {
-                // todo:: make sure it does not mess up the iterator (it should not, they are supposed to be ordered solely based on it->first, but, not sure)
-                edge_weights[v][it->first] = it->second / v_area;
-            }
-        }
+            for (unsigned int e = adjacent_edges_begin[v]; e < adjacent_edges_begin[v + 1]; ++e)
+                edge_weights[e] /= v_area;
+        });
     }
 };
 
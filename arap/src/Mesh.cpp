@@ -2,13 +2,17 @@
 #include <iostream>
 #include <fstream>
 
-void Mesh::loadOFF (const std::string & filename) {
+bool Mesh::loadOFF (const std::string & filename) {
+    V.clear ();
+    T.clear ();
     std::ifstream in (filename.c_str ());
     if (!in)
-        exit (EXIT_FAILURE);
+        return false;
     std::string offString;
     unsigned int sizeV, sizeT, tmp;
     in >> offString >> sizeV >> sizeT >> tmp;
+    if (!in || offString != "OFF" || sizeV == 0)
+        return false;
     V.resize (sizeV);
     T.resize (sizeT);
     for (unsigned int i = 0; i < sizeV; i++) {
@@ -20,10 +24,33 @@ void Mesh::loadOFF (const std::string & filename) {
         in >> s;
         for (unsigned int j = 0; j < 3; j++)
             in >> T[i].v[j];
+        if (s != 3 || T[i].v[0] >= sizeV || T[i].v[1] >= sizeV || T[i].v[2] >= sizeV)
+            in.setstate (std::ios::failbit);   // only triangles
+    }
+    if (!in) {
+        V.clear ();
+        T.clear ();
+        return false;
     }
     in.close ();
     centerAndScaleToUnit ();
     recomputeNormals ();
+    return true;
+}
+
+bool Mesh::saveOFF (const std::string & filename) const {
+    std::ofstream out (filename.c_str ());
+    if (!out)
+        return false;
+    out.precision (9);
+    out << "OFF" << std::endl << V.size () << " " << T.size () << " 0" << std::endl;
+    for (unsigned int i = 0; i < V.size (); i++) {
+        Vec3 p = unitCenter + unitScale * V[i].p;
+        out << p[0] << " " << p[1] << " " << p[2] << std::endl;
+    }
+    for (unsigned int i = 0; i < T.size (); i++)
+        out << "3 " << T[i].v[0] << " " << T[i].v[1] << " " << T[i].v[2] << std::endl;
+    return bool (out);
 }
 
 void Mesh::recomputeNormals () {
@@ -52,6 +79,8 @@ void Mesh::centerAndScaleToUnit () {
         if (m > maxD)
             maxD = m;
     }
+    unitCenter = c;
+    unitScale = maxD;
     for  (unsigned int i = 0; i < V.size (); i++) {
         V[i].p = (V[i].p - c) / maxD;
         V[i].pInit = (V[i].pInit - c) / maxD;
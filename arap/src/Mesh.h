@@ -70,14 +70,22 @@ class Mesh {
 public:
     std::vector<MeshVertex> V;
     std::vector<MeshTriangle> T;
+    // transformation applied by centerAndScaleToUnit : unit position = ( file position - unitCenter ) / unitScale
+    Vec3 unitCenter;
+    double unitScale;
 
-    void loadOFF (const std::string & filename);
+    inline Mesh () : unitCenter (0.0, 0.0, 0.0), unitScale (1.0) {}
+
+    // false (and an empty mesh) if the file cannot be read
+    bool loadOFF (const std::string & filename);
+    // current positions , back in the frame of the file given to loadOFF
+    bool saveOFF (const std::string & filename) const;
     void recomputeNormals ();
     void centerAndScaleToUnit ();
     void scaleUnit ();
 
     void draw() const {
-        // This code is deprecated. We will how to use vertex arrays and vertex buffer objects instead.
+        // Immediate mode, one call per corner: gmini draws with the buffers of MeshRenderer instead.
         glBegin (GL_TRIANGLES);
         for (unsigned int i = 0; i < T.size (); i++)
             for (unsigned int j = 0; j < 3; j++) {
@@ -0,0 +1,65 @@
+#ifndef MeshHash_H
+#define MeshHash_H
+
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "Mesh.h"
+
+
+//-------------------------------------------------------------------------------------//
+//
+// 64 bits FNV-1a hash of the rest state of a mesh (rest positions and triangles), to name the
+// files of precomputations that only depend on it (and on the constrained vertices).
+//
+//-------------------------------------------------------------------------------------//
+namespace MeshHashDetails {
+
+static const unsigned long long FnvOffsetBasis = 14695981039346656037ULL;
+static const unsigned long long FnvPrime = 1099511628211ULL;
+
+inline void hashBytes( unsigned long long & hash , void const * data , unsigned int size ) {
+    unsigned char const * bytes = static_cast< unsigned char const * >( data );
+    for( unsigned int i = 0 ; i < size ; ++i ) {
+        hash ^= bytes[i];
+        hash *= FnvPrime;
+    }
+}
+
+}
+
+inline unsigned long long hashRestMesh( Mesh const & mesh ) {
+    unsigned long long hash = MeshHashDetails::FnvOffsetBasis;
+    unsigned int sizes[2] = { (unsigned int)mesh.V.size() , (unsigned int)mesh.T.size() };
+    MeshHashDetails::hashBytes( hash , sizes , sizeof( sizes ) );
+    for( unsigned int v = 0 ; v < mesh.V.size() ; ++v ) {
+        double p[3] = { mesh.V[v].pInit[0] , mesh.V[v].pInit[1] , mesh.V[v].pInit[2] };
+        MeshHashDetails::hashBytes( hash , p , sizeof( p ) );
+    }
+    for( unsigned int t = 0 ; t < mesh.T.size() ; ++t ) {
+        unsigned int corners[3] = { mesh.T[t][0] , mesh.T[t][1] , mesh.T[t][2] };
+        MeshHashDetails::hashBytes( hash , corners , sizeof( corners ) );
+    }
+    return hash;
+}
+
+// Which vertices are constrained (not the handle they belong to): what a factorization with eliminated handles depends on
+inline unsigned long long hashConstrainedVertices( std::vector< bool > const & isConstrained ) {
+    unsigned long long hash = MeshHashDetails::FnvOffsetBasis;
+    unsigned int size = isConstrained.size();
+    MeshHashDetails::hashBytes( hash , &size , sizeof( size ) );
+    for( unsigned int v = 0 ; v < isConstrained.size() ; ++v )
+        if( isConstrained[v] ) MeshHashDetails::hashBytes( hash , &v , sizeof( v ) );
+    return hash;
+}
+
+// 16 hexadecimal digits, for file names
+inline std::string meshHashString( unsigned long long hash ) {
+    char buffer[17];
+    std::snprintf( buffer , sizeof( buffer ) , "%016llx" , hash );
+    return std::string( buffer );
+}
+
+#endif // MeshHash_H
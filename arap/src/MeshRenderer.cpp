@@ -0,0 +1,133 @@
+// vertex buffer objects (OpenGL 1.5) , declared by glext.h
+#define GL_GLEXT_PROTOTYPES
+
+#include "MeshRenderer.h"
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+
+MeshRenderer::MeshRenderer() :
+    _isInitialized(false) , _buffersAreSupported(false) , _vertexBuffer(0) , _indexBuffer(0) ,
+    _numberOfVertices(0) , _numberOfTriangles(0) , _verticesMayHaveChanged(true) , _lastUploadBytes(0) {}
+
+
+void MeshRenderer::initialize() {
+    _isInitialized = true;
+    int major = 0 , minor = 0;
+    char const * version = (char const *) glGetString( GL_VERSION );
+    if( version == 0  ||  sscanf( version , "%d.%d" , &major , &minor ) != 2  ||  major * 10 + minor < 15 ) return;
+    glGenBuffers( 1 , &_vertexBuffer );
+    glGenBuffers( 1 , &_indexBuffer );
+    _buffersAreSupported = true;
+}
+
+
+void MeshRenderer::uploadAll( Mesh const & mesh ) {
+    _numberOfVertices = mesh.V.size();
+    _uploadedVertices.resize( 6 * _numberOfVertices );
+    for( unsigned int v = 0 ; v < _numberOfVertices ; ++v )
+        for( unsigned int c = 0 ; c < 3 ; ++c ) {
+            _uploadedVertices[ 6 * v + c ] = mesh.V[v].p[c];
+            _uploadedVertices[ 6 * v + 3 + c ] = mesh.V[v].n[c];
+        }
+    glBindBuffer( GL_ARRAY_BUFFER , _vertexBuffer );
+    glBufferData( GL_ARRAY_BUFFER , _uploadedVertices.size() * sizeof(float) , _uploadedVertices.empty() ? 0 : &_uploadedVertices[0] , GL_DYNAMIC_DRAW );
+    glBindBuffer( GL_ARRAY_BUFFER , 0 );
+    _lastUploadBytes += _uploadedVertices.size() * sizeof(float);
+}
+
+
+void MeshRenderer::uploadChangedBlocks( Mesh const & mesh ) {
+    glBindBuffer( GL_ARRAY_BUFFER , _vertexBuffer );
+    unsigned int runBegin = 0 , runEnd = 0;   // vertices of the current run of changed blocks
+    for( unsigned int blockBegin = 0 ; blockBegin < _numberOfVertices ; blockBegin += BlockSize ) {
+        unsigned int blockEnd = std::min( blockBegin + BlockSize , _numberOfVertices );
+        bool blockChanged = false;
+        for( unsigned int v = blockBegin ; v < blockEnd ; ++v ) {
+            float vertex[6];
+            for( unsigned int c = 0 ; c < 3 ; ++c ) {
+                vertex[c] = mesh.V[v].p[c];
+                vertex[ 3 + c ] = mesh.V[v].n[c];
+            }
+            if( std::memcmp( vertex , &_uploadedVertices[ 6 * v ] , sizeof(vertex) ) != 0 ) {
+                std::memcpy( &_uploadedVertices[ 6 * v ] , vertex , sizeof(vertex) );
+                blockChanged = true;
+            }
+        }
+        if( blockChanged ) {
+            if( runEnd != blockBegin ) runBegin = blockBegin;
+            runEnd = blockEnd;
+        }
+        // send the run once it ends
+        if( runEnd > runBegin  &&  ( ! blockChanged  ||  blockEnd == _numberOfVertices ) ) {
+            glBufferSubData( GL_ARRAY_BUFFER , 6 * runBegin * sizeof(float) , 6 * ( runEnd - runBegin ) * sizeof(float) , &_uploadedVertices[ 6 * runBegin ] );
+            _lastUploadBytes += 6 * ( runEnd - runBegin ) * sizeof(float);
+            runBegin = runEnd;
+        }
+    }
+    glBindBuffer( GL_ARRAY_BUFFER , 0 );
+}
+
+
+void MeshRenderer::updateBuffers( Mesh const & mesh ) {
+    _lastUploadBytes = 0;
+    if( _numberOfTriangles != mesh.T.size() ) {
+        _numberOfTriangles = mesh.T.size();
+        std::vector< unsigned int > indices( 3 * _numberOfTriangles );
+        for( unsigned int t = 0 ; t < _numberOfTriangles ; ++t )
+            for( unsigned int c = 0 ; c < 3 ; ++c ) indices[ 3 * t + c ] = mesh.T[t][c];
+        glBindBuffer( GL_ELEMENT_ARRAY_BUFFER , _indexBuffer );
+        glBufferData( GL_ELEMENT_ARRAY_BUFFER , indices.size() * sizeof(unsigned int) , indices.empty() ? 0 : &indices[0] , GL_STATIC_DRAW );
+        glBindBuffer( GL_ELEMENT_ARRAY_BUFFER , 0 );
+        _lastUploadBytes += indices.size() * sizeof(unsigned int);
+    }
+    if( _numberOfVertices != mesh.V.size()  ||  _uploadedVertices.empty() ) uploadAll( mesh );
+    else if( _verticesMayHaveChanged ) uploadChangedBlocks( mesh );
+    _verticesMayHaveChanged = false;
+}
+
+
+void MeshRenderer::draw( Mesh const & mesh ) {
+    if( ! _isInitialized ) initialize();
+    if( ! _buffersAreSupported ) {
+        mesh.draw();
+        return;
+    }
+    updateBuffers( mesh );
+
+    if( _numberOfTriangles == 0 ) return;
+    glPushClientAttrib( GL_CLIENT_VERTEX_ARRAY_BIT );
+    glBindBuffer( GL_ARRAY_BUFFER , _vertexBuffer );
+    glEnableClientState( GL_VERTEX_ARRAY );
+    glEnableClientState( GL_NORMAL_ARRAY );
+    glVertexPointer( 3 , GL_FLOAT , 6 * sizeof(float) , (void const *) 0 );
+    glNormalPointer( GL_FLOAT , 6 * sizeof(float) , (void const *) ( 3 * sizeof(float) ) );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER , _indexBuffer );
+    glDrawElements( GL_TRIANGLES , 3 * _numberOfTriangles , GL_UNSIGNED_INT , (void const *) 0 );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER , 0 );
+    glBindBuffer( GL_ARRAY_BUFFER , 0 );
+    glPopClientAttrib();
+}
+
+
+bool MeshRenderer::drawTriangles( Mesh const & mesh ) {
+    if( ! _isInitialized ) initialize();
+    if( ! _buffersAreSupported ) return false;
+    updateBuffers( mesh );
+
+    if( _numberOfTriangles == 0 ) return true;
+    glPushClientAttrib( GL_CLIENT_VERTEX_ARRAY_BIT );
+    glBindBuffer( GL_ARRAY_BUFFER , _vertexBuffer );
+    glEnableClientState( GL_VERTEX_ARRAY );
+    glVertexPointer( 3 , GL_FLOAT , 6 * sizeof(float) , (void const *) 0 );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER , _indexBuffer );
+    glDrawElements( GL_TRIANGLES , 3 * _numberOfTriangles , GL_UNSIGNED_INT , (void const *) 0 );
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER , 0 );
+    glBindBuffer( GL_ARRAY_BUFFER , 0 );
+    glPopClientAttrib();
+    return true;
+}
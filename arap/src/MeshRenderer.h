@@ -0,0 +1,57 @@
+#ifndef MeshRenderer_H
+#define MeshRenderer_H
+
+#include <vector>
+
+#include "Mesh.h"
+
+
+//-------------------------------------------------------------------------------------//
+//
+// Mesh::draw() with buffers kept on the GPU: the triangles in an index buffer, built once
+// for a set of triangles, and the positions and normals in one interleaved vertex buffer,
+// drawn with a single glDrawElements.
+//
+// After positionsWereChanged(), the next draw compares the mesh with the copy that was
+// uploaded, by blocks of BlockSize vertices, and only sends the blocks that differ
+// (glBufferSubData of each run of consecutive changed blocks): moving the handles, or a solve
+// on a region of interest, uploads the part of the mesh that moved.
+//
+// Not a member of Mesh: meshes are copied (arapMesh), and the buffers belong to one context.
+// Without vertex buffer objects (OpenGL < 1.5) it calls Mesh::draw().
+//
+//-------------------------------------------------------------------------------------//
+class MeshRenderer {
+    static const unsigned int BlockSize = 1024;
+
+    bool _isInitialized , _buffersAreSupported;
+    unsigned int _vertexBuffer , _indexBuffer;
+    unsigned int _numberOfVertices , _numberOfTriangles;   // in the buffers
+    std::vector< float > _uploadedVertices;                // position , normal per vertex , as in _vertexBuffer
+    bool _verticesMayHaveChanged;
+    unsigned int _lastUploadBytes;
+
+    void initialize();
+    void uploadAll( Mesh const & mesh );
+    void uploadChangedBlocks( Mesh const & mesh );
+    void updateBuffers( Mesh const & mesh );
+
+public:
+    MeshRenderer();
+
+    // positions or normals changed (the number of vertices and the triangles did not)
+    void positionsWereChanged() { _verticesMayHaveChanged = true; }
+    // the triangles changed
+    void trianglesWereChanged() { _numberOfTriangles = 0; }
+
+    // needs the context , uses the current color and material
+    void draw( Mesh const & mesh );
+    // the triangles in the order of mesh.T , positions only , with the current program: primitive t is triangle t
+    // (the pick pass , see PickingBuffer). Returns false , and draws nothing , without vertex buffer objects.
+    bool drawTriangles( Mesh const & mesh );
+
+    // bytes sent by the last draw or drawTriangles (0 if the buffers were up to date)
+    unsigned int lastUploadBytes() const { return _lastUploadBytes; }
+};
+
+#endif // MeshRenderer_H
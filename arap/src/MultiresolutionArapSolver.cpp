@@ -0,0 +1,382 @@
+#include "MultiresolutionArapSolver.h"
+#include "ClosestRotation.h"
+#include "Timer.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <utility>
+
+
+MultiresolutionArapSolver::MultiresolutionArapSolver() : _mesh(0) , _fineSolver(0) , _fineIterations(0) , _buildMs(0.0) {
+}
+
+
+// _clusterOfVertex[v] <- cell of the grid of size cellSize containing pInit , cells numbered in the order of their coordinates
+void MultiresolutionArapSolver::clusterVertices( double cellSize ) {
+    Mesh const & mesh = *_mesh;
+    Vec3 bbMin = mesh.V[0].pInit;
+    for( unsigned int v = 1 ; v < mesh.V.size() ; ++v )
+        for( unsigned int coord = 0 ; coord < 3 ; ++coord )
+            bbMin[coord] = std::min( bbMin[coord] , mesh.V[v].pInit[coord] );
+
+    // the coordinates are kept whole: packed in one integer, the cells of a fine grid would be merged
+    std::vector< std::pair< GridCell , unsigned int > > cellOfVertex( mesh.V.size() );
+    for( unsigned int v = 0 ; v < mesh.V.size() ; ++v ) {
+        for( unsigned int coord = 0 ; coord < 3 ; ++coord )
+            cellOfVertex[v].first[coord] = (unsigned long long)( ( mesh.V[v].pInit[coord] - bbMin[coord] ) / cellSize );
+        cellOfVertex[v].second = v;
+    }
+    std::sort( cellOfVertex.begin() , cellOfVertex.end() );
+
+    _clusterOfVertex.resize( mesh.V.size() );
+    _cellOfCluster.clear();
+    for( unsigned int i = 0 ; i < cellOfVertex.size() ; ++i ) {
+        if( i == 0  ||  cellOfVertex[i].first != cellOfVertex[i-1].first ) _cellOfCluster.push_back( cellOfVertex[i].first );
+        _clusterOfVertex[ cellOfVertex[i].second ] = _cellOfCluster.size() - 1;
+    }
+}
+
+// Used cluster whose centroid is the nearest to that of the cluster c , searched in the cells around that of c ,
+// ring after ring: the centroids of the cells of ring r (at r cells from c along some axis) are at least at
+// ( r - 1 ) cellSize. Past as many cells as there are clusters, all the clusters are compared instead.
+static unsigned int nearestUsedCluster( unsigned int c , std::vector< std::array< unsigned long long , 3 > > const & cellOfCluster ,
+                                        std::vector< Vec3 > const & centroids , std::vector< bool > const & clusterIsUsed , double cellSize ) {
+    typedef std::array< unsigned long long , 3 > GridCell;
+    unsigned int nearest = c;
+    double bestDistance = -1.0;
+    unsigned long long visitedCells = 0;
+    GridCell const & center = cellOfCluster[c];
+    for( long long r = 0 ; visitedCells <= cellOfCluster.size() ; ++r ) {
+        double ringDistance = std::max< double >( r - 1 , 0 ) * cellSize;
+        if( bestDistance >= 0.0  &&  ringDistance * ringDistance > bestDistance ) return nearest;
+        for( long long i = -r ; i <= r ; ++i )
+            for( long long j = -r ; j <= r ; ++j ) {
+                // inside the ring along i and j: only its two faces along k
+                bool onSide = ( std::abs( i ) == r  ||  std::abs( j ) == r );
+                for( long long k = -r ; k <= r ; k += onSide ? 1 : 2 * r ) {
+                    long long offset[3] = { i , j , k };
+                    GridCell cell;
+                    bool inGrid = true;
+                    for( unsigned int coord = 0 ; coord < 3 ; ++coord ) {
+                        inGrid = inGrid  &&  ( offset[coord] >= 0  ||  center[coord] >= (unsigned long long)( -offset[coord] ) );
+                        cell[coord] = center[coord] + offset[coord];
+                    }
+                    ++visitedCells;
+                    if( ! inGrid ) continue;
+                    std::vector< GridCell >::const_iterator it = std::lower_bound( cellOfCluster.begin() , cellOfCluster.end() , cell );
+                    if( it == cellOfCluster.end()  ||  *it != cell ) continue;
+                    unsigned int other = it - cellOfCluster.begin();
+                    double distance = ( centroids[other] - centroids[c] ).sqrnorm();
+                    if( clusterIsUsed[other]  &&  ( bestDistance < 0.0  ||  distance < bestDistance ) ) { bestDistance = distance; nearest = other; }
+                }
+            }
+    }
+    for( unsigned int other = 0 ; other < cellOfCluster.size() ; ++other ) {
+        double distance = ( centroids[other] - centroids[c] ).sqrnorm();
+        if( clusterIsUsed[other]  &&  ( bestDistance < 0.0  ||  distance < bestDistance ) ) { bestDistance = distance; nearest = other; }
+    }
+    return nearest;
+}
+
+bool MultiresolutionArapSolver::buildProxy( unsigned int targetNumberOfCoarseVertices ) {
+    Mesh const & mesh = *_mesh;
+
+    // 1. grid size: a cell holds about area / target of the surface, refined on the actual number of clusters
+    double area = 0.0;
+    for( unsigned int t = 0 ; t < mesh.T.size() ; ++t ) {
+        Vec3 const & p0 = mesh.V[ mesh.T[t][0] ].pInit;
+        area += 0.5 * Vec3::cross( mesh.V[ mesh.T[t][1] ].pInit - p0 , mesh.V[ mesh.T[t][2] ].pInit - p0 ).length();
+    }
+    targetNumberOfCoarseVertices = std::max( targetNumberOfCoarseVertices , 1u );
+    double cellSize = std::sqrt( area / targetNumberOfCoarseVertices );
+    for( unsigned int attempt = 0 ; attempt < 8 ; ++attempt ) {
+        clusterVertices( cellSize );
+        double numberOfClusters = _clusterOfVertex.empty() ? 0.0 : 1.0 + *std::max_element( _clusterOfVertex.begin() , _clusterOfVertex.end() );
+        double ratio = numberOfClusters / targetNumberOfCoarseVertices;
+        if( ratio > 0.8  &&  ratio < 1.25 ) break;
+        cellSize *= std::sqrt( ratio );
+    }
+    // 2. triangles between 3 different clusters, once each, without the (almost) flat ones whose cotangents are not defined.
+    //    A target too small for the shape may leave none: the grid is then refined until some remain.
+    unsigned int numberOfClusters = 0;
+    std::vector< Vec3 > centroids;
+    std::vector< bool > clusterIsUsed;
+    std::vector< MeshTriangle > uniqueTriangles;
+    for( unsigned int refinement = 0 ; refinement <= MaxGridRefinements ; ++refinement ) {
+        if( refinement > 0 ) {
+            cellSize *= 0.5;
+            clusterVertices( cellSize );
+        }
+        numberOfClusters = _cellOfCluster.size();
+
+        centroids.assign( numberOfClusters , Vec3(0,0,0) );
+        std::vector< double > clusterSizes( numberOfClusters , 0.0 );
+        for( unsigned int v = 0 ; v < mesh.V.size() ; ++v ) {
+            centroids[ _clusterOfVertex[v] ] += mesh.V[v].pInit;
+            clusterSizes[ _clusterOfVertex[v] ] += 1.0;
+        }
+        for( unsigned int c = 0 ; c < numberOfClusters ; ++c )
+            centroids[c] /= clusterSizes[c];
+
+        std::vector< std::pair< std::array< unsigned int , 3 > , unsigned int > > coarseTriangleKeys;
+        std::vector< MeshTriangle > coarseTriangles;
+        double minimalArea = 1e-6 * cellSize * cellSize;
+        for( unsigned int t = 0 ; t < mesh.T.size() ; ++t ) {
+            unsigned int c0 = _clusterOfVertex[ mesh.T[t][0] ] , c1 = _clusterOfVertex[ mesh.T[t][1] ] , c2 = _clusterOfVertex[ mesh.T[t][2] ];
+            if( c0 == c1  ||  c1 == c2  ||  c0 == c2 ) continue;
+            if( 0.5 * Vec3::cross( centroids[c1] - centroids[c0] , centroids[c2] - centroids[c0] ).length() < minimalArea ) continue;
+            std::array< unsigned int , 3 > sorted = {{ c0 , c1 , c2 }};
+            std::sort( sorted.begin() , sorted.end() );
+            coarseTriangleKeys.push_back( std::make_pair( sorted , coarseTriangles.size() ) );
+            coarseTriangles.push_back( MeshTriangle( c0 , c1 , c2 ) );
+        }
+        std::sort( coarseTriangleKeys.begin() , coarseTriangleKeys.end() );
+
+        clusterIsUsed.assign( numberOfClusters , false );
+        uniqueTriangles.clear();
+        for( unsigned int i = 0 ; i < coarseTriangleKeys.size() ; ++i ) {
+            if( i > 0  &&  coarseTriangleKeys[i].first == coarseTriangleKeys[i-1].first ) continue;
+            MeshTriangle const & triangle = coarseTriangles[ coarseTriangleKeys[i].second ];
+            uniqueTriangles.push_back( triangle );
+            for( unsigned int k = 0 ; k < 3 ; ++k ) clusterIsUsed[ triangle[k] ] = true;
+        }
+        if( ! uniqueTriangles.empty() ) break;
+    }
+    if( uniqueTriangles.empty() ) {   // no triangle with an area in the mesh
+        _clusterOfVertex.clear();
+        _cellOfCluster.clear();
+        return false;
+    }
+
+    // 3. the vertices of clusters in no coarse triangle join the cluster of a neighbor, through the edges of the mesh
+    bool changed = true;
+    while( changed ) {
+        changed = false;
+        for( unsigned int t = 0 ; t < mesh.T.size() ; ++t )
+            for( unsigned int k = 0 ; k < 3 ; ++k ) {
+                unsigned int v = mesh.T[t][k] , vNext = mesh.T[t][(k+1)%3];
+                if( !clusterIsUsed[ _clusterOfVertex[v] ]  &&  clusterIsUsed[ _clusterOfVertex[vNext] ] ) { _clusterOfVertex[v] = _clusterOfVertex[vNext]; changed = true; }
+                else if( clusterIsUsed[ _clusterOfVertex[v] ]  &&  !clusterIsUsed[ _clusterOfVertex[vNext] ] ) { _clusterOfVertex[vNext] = _clusterOfVertex[v]; changed = true; }
+            }
+    }
+    // components of the mesh with no coarse triangle: the used cluster nearest to their cluster
+    std::vector< int > joinedCluster( numberOfClusters , -1 );
+    for( unsigned int v = 0 ; v < mesh.V.size() ; ++v ) {
+        unsigned int c = _clusterOfVertex[v];
+        if( clusterIsUsed[c] ) continue;
+        if( joinedCluster[c] == -1 ) joinedCluster[c] = nearestUsedCluster( c , _cellOfCluster , centroids , clusterIsUsed , cellSize );
+        _clusterOfVertex[v] = joinedCluster[c];
+    }
+    _cellOfCluster.clear();
+
+    // 4. proxy made of the used clusters only
+    std::vector< int > coarseVertexOfCluster( numberOfClusters , -1 );
+    _coarseMesh.V.clear();
+    for( unsigned int c = 0 ; c < numberOfClusters ; ++c ) {
+        if( !clusterIsUsed[c] ) continue;
+        coarseVertexOfCluster[c] = _coarseMesh.V.size();
+        _coarseMesh.V.push_back( MeshVertex( centroids[c] , Vec3(0,0,0) ) );
+    }
+    _coarseMesh.T.resize( uniqueTriangles.size() );
+    for( unsigned int t = 0 ; t < uniqueTriangles.size() ; ++t )
+        for( unsigned int k = 0 ; k < 3 ; ++k )
+            _coarseMesh.T[t][k] = coarseVertexOfCluster[ uniqueTriangles[t][k] ];
+    for( unsigned int v = 0 ; v < mesh.V.size() ; ++v )
+        _clusterOfVertex[v] = coarseVertexOfCluster[ _clusterOfVertex[v] ];
+    _coarseMesh.recomputeNormals();
+    return true;
+}
+
+// Each vertex follows its cluster and the neighbors of its cluster on the proxy, the MaxMappingNodes nearest ones,
+// with the weights (1 - d_k / d_max)^2 of embedded deformation, normalized.
+void MultiresolutionArapSolver::buildMapping() {
+    Mesh const & mesh = *_mesh;
+    LaplacianWeights const & coarseWeights = _coarseSolver.weights();
+
+    _mappingBegin.resize( mesh.V.size() + 1 );
+    _mappingCoarseVertex.clear();
+    _mappingWeight.clear();
+    std::vector< std::pair< double , unsigned int > > candidates;
+    for( unsigned int v = 0 ; v < mesh.V.size() ; ++v ) {
+        _mappingBegin[v] = _mappingCoarseVertex.size();
+        unsigned int c = _clusterOfVertex[v];
+        candidates.clear();
+        candidates.push_back( std::make_pair( ( _coarseMesh.V[c].pInit - mesh.V[v].pInit ).length() , c ) );
+        ConstArraySpan< unsigned int > neighbors = coarseWeights.get_adjacent_vertices(c);
+        for( unsigned int k = 0 ; k < neighbors.size() ; ++k )
+            candidates.push_back( std::make_pair( ( _coarseMesh.V[ neighbors[k] ].pInit - mesh.V[v].pInit ).length() , neighbors[k] ) );
+        std::sort( candidates.begin() , candidates.end() );
+
+        unsigned int numberOfNodes = std::min< unsigned int >( candidates.size() , MaxMappingNodes );
+        double maximalDistance = ( candidates.size() > numberOfNodes ) ? candidates[numberOfNodes].first : 1.01 * candidates.back().first;
+        double sumWeights = 0.0;
+        for( unsigned int k = 0 ; k < numberOfNodes ; ++k ) {
+            double x = ( maximalDistance > 0.0 ) ? 1.0 - candidates[k].first / maximalDistance : 1.0;
+            double weight = std::max( x * x , 0.0 );
+            if( weight <= 0.0 ) continue;
+            _mappingCoarseVertex.push_back( candidates[k].second );
+            _mappingWeight.push_back( weight );
+            sumWeights += weight;
+        }
+        if( sumWeights <= 0.0 ) {   // v on the proxy vertex of its cluster, nothing else
+            _mappingCoarseVertex.push_back( c );
+            _mappingWeight.push_back( 1.0 );
+            sumWeights = 1.0;
+        }
+        for( unsigned int e = _mappingBegin[v] ; e < _mappingCoarseVertex.size() ; ++e )
+            _mappingWeight[e] /= sumWeights;
+    }
+    _mappingBegin[ mesh.V.size() ] = _mappingCoarseVertex.size();
+}
+
+bool MultiresolutionArapSolver::setMesh( Mesh & mesh , unsigned int targetNumberOfCoarseVertices ) {
+    _mesh = &mesh;
+    _coarseMesh.V.clear();
+    _coarseMesh.T.clear();
+    Timer timer;
+    if( mesh.V.empty()  ||  ! buildProxy( targetNumberOfCoarseVertices ) ) {
+        _mesh = 0;
+        return false;
+    }
+    _coarseSolver.setMesh( _coarseMesh );
+    buildMapping();
+    _buildMs = timer.elapsedMs();
+    setHandles( std::vector< int >( mesh.V.size() , -1 ) );
+    return true;
+}
+
+void MultiresolutionArapSolver::setHandles( std::vector< int > const & verticesHandles ) {
+    if( ! _mesh ) return;
+    _verticesHandles = verticesHandles;
+
+    // a cluster takes the handle of its first handle vertex, the vertices of other handles in it are not used for the fit
+    _coarseHandles.assign( _coarseMesh.V.size() , -1 );
+    std::vector< std::vector< unsigned int > > verticesOfCluster( _coarseMesh.V.size() );
+    for( unsigned int v = 0 ; v < _mesh->V.size() ; ++v ) {
+        if( verticesHandles[v] == -1 ) continue;
+        unsigned int c = _clusterOfVertex[v];
+        if( _coarseHandles[c] == -1 ) _coarseHandles[c] = verticesHandles[v];
+        if( _coarseHandles[c] == verticesHandles[v] ) verticesOfCluster[c].push_back( v );
+    }
+    _handleClusters.clear();
+    _handleClusterBegin.clear();
+    _handleClusterVertices.clear();
+    for( unsigned int c = 0 ; c < _coarseMesh.V.size() ; ++c ) {
+        if( verticesOfCluster[c].empty() ) continue;
+        _handleClusters.push_back( c );
+        _handleClusterBegin.push_back( _handleClusterVertices.size() );
+        _handleClusterVertices.insert( _handleClusterVertices.end() , verticesOfCluster[c].begin() , verticesOfCluster[c].end() );
+    }
+    _handleClusterBegin.push_back( _handleClusterVertices.size() );
+
+    _coarseSolver.setHandles( _coarseHandles );
+    if( _fineSolver ) _fineSolver->setHandles( _verticesHandles );
+}
+
+void MultiresolutionArapSolver::setFineLevel( ArapSolver * fineSolver , unsigned int fineIterations ) {
+    _fineSolver = fineSolver;
+    _fineIterations = fineIterations;
+    if( _fineSolver  &&  _mesh ) _fineSolver->setHandles( _verticesHandles );
+}
+
+// Rigid motion of the handle vertices of each handle cluster (rest -> current), applied to the proxy vertex.
+void MultiresolutionArapSolver::updateCoarseHandlePositions() {
+    Mesh const & mesh = *_mesh;
+    for( unsigned int i = 0 ; i < _handleClusters.size() ; ++i ) {
+        unsigned int begin = _handleClusterBegin[i] , end = _handleClusterBegin[i+1];
+        Eigen::Vector3d pMean(0,0,0) , pInitMean(0,0,0);
+        for( unsigned int k = begin ; k < end ; ++k ) {
+            MeshVertex const & vertex = mesh.V[ _handleClusterVertices[k] ];
+            pMean += Eigen::Vector3d( vertex.p[0] , vertex.p[1] , vertex.p[2] );
+            pInitMean += Eigen::Vector3d( vertex.pInit[0] , vertex.pInit[1] , vertex.pInit[2] );
+        }
+        pMean /= double( end - begin );
+        pInitMean /= double( end - begin );
+
+        Eigen::Matrix3d rotation = Eigen::Matrix3d::Identity();
+        if( end - begin >= 3 ) {
+            Eigen::Matrix3d covariance = Eigen::Matrix3d::Zero();
+            for( unsigned int k = begin ; k < end ; ++k ) {
+                MeshVertex const & vertex = mesh.V[ _handleClusterVertices[k] ];
+                Eigen::Vector3d p( vertex.p[0] , vertex.p[1] , vertex.p[2] ) , pInit( vertex.pInit[0] , vertex.pInit[1] , vertex.pInit[2] );
+                covariance += ( p - pMean ) * ( pInit - pInitMean ).transpose();
+            }
+            rotation = computeClosestRotation( covariance );
+        }
+
+        MeshVertex & coarseVertex = _coarseMesh.V[ _handleClusters[i] ];
+        Eigen::Vector3d q = pMean + rotation * ( Eigen::Vector3d( coarseVertex.pInit[0] , coarseVertex.pInit[1] , coarseVertex.pInit[2] ) - pInitMean );
+        coarseVertex.p = Vec3( q[0] , q[1] , q[2] );
+    }
+}
+
+// p = sum_k w_k ( q_k + R_k ( pInit - qInit_k ) ) for the free vertices,
+// and for the fine level the rotations closest to sum_k w_k R_k , by batches as in the local step.
+void MultiresolutionArapSolver::transferToMesh() {
+    Mesh & mesh = *_mesh;
+    std::vector< Eigen::Matrix3d > const & coarseRotations = _coarseSolver.rotations();
+    bool needsRotations = ( fineIterations() > 0 );
+    if( needsRotations ) _fineRotations.resize( mesh.V.size() );
+
+    unsigned int numberOfBatches = ( mesh.V.size() + ClosestRotationBatchSize - 1 ) / ClosestRotationBatchSize;
+    _coarseSolver.threadPool().parallelFor( 0 , numberOfBatches , [this , &mesh , &coarseRotations , needsRotations]( unsigned int batch ) {
+        double blendedRotations[9][ClosestRotationBatchSize] , rotations[9][ClosestRotationBatchSize];
+        unsigned int vBegin = batch * ClosestRotationBatchSize;
+        for( unsigned int l = 0 ; l < ClosestRotationBatchSize ; ++l ) {
+            unsigned int v = vBegin + l;
+            Eigen::Matrix3d rotation = Eigen::Matrix3d::Identity();   // padding of the last batch
+            if( v < mesh.V.size() ) {
+                Eigen::Vector3d pInit( mesh.V[v].pInit[0] , mesh.V[v].pInit[1] , mesh.V[v].pInit[2] );
+                Eigen::Vector3d p(0,0,0);
+                rotation.setZero();
+                for( unsigned int e = _mappingBegin[v] ; e < _mappingBegin[v+1] ; ++e ) {
+                    MeshVertex const & coarseVertex = _coarseMesh.V[ _mappingCoarseVertex[e] ];
+                    Eigen::Vector3d q( coarseVertex.p[0] , coarseVertex.p[1] , coarseVertex.p[2] );
+                    Eigen::Vector3d qInit( coarseVertex.pInit[0] , coarseVertex.pInit[1] , coarseVertex.pInit[2] );
+                    Eigen::Matrix3d const & R = coarseRotations[ _mappingCoarseVertex[e] ];
+                    p += _mappingWeight[e] * ( q + R * ( pInit - qInit ) );
+                    rotation += _mappingWeight[e] * R;
+                }
+                if( _verticesHandles[v] == -1 )
+                    mesh.V[v].p = Vec3( p[0] , p[1] , p[2] );
+            }
+            for( unsigned int i = 0 ; i < 3 ; ++i )
+                for( unsigned int j = 0 ; j < 3 ; ++j )
+                    blendedRotations[3*i+j][l] = rotation(i,j);
+        }
+        if( ! needsRotations ) return;
+
+        computeClosestRotationsBatch< ClosestRotationBatchSize >( blendedRotations , rotations );
+        for( unsigned int l = 0 ; l < ClosestRotationBatchSize  &&  vBegin + l < mesh.V.size() ; ++l )
+            for( unsigned int i = 0 ; i < 3 ; ++i )
+                for( unsigned int j = 0 ; j < 3 ; ++j )
+                    _fineRotations[vBegin + l](i,j) = rotations[3*i+j][l];
+    } );
+}
+
+bool MultiresolutionArapSolver::solve( bool continuePreviousSolve ) {
+    _timings.clear();
+    if( ! _mesh ) return false;
+    Timer timer;
+    updateCoarseHandlePositions();
+    double transferMs = timer.elapsedMs();
+
+    if( ! _coarseSolver.solve( continuePreviousSolve ) ) return false;
+    _timings = _coarseSolver.timings();
+
+    timer.restart();
+    transferToMesh();
+    _timings.transferMs = transferMs + timer.elapsedMs();
+
+    if( fineIterations() > 0 ) {
+        ArapSolver::StoppingCriteria criteria = _fineSolver->stoppingCriteria();
+        _fineSolver->setStoppingCriteria( ArapSolver::StoppingCriteria( _fineIterations ) );
+        _fineSolver->setRotations( _fineRotations );
+        _fineSolver->solve();
+        _fineSolver->setStoppingCriteria( criteria );
+        _timings += _fineSolver->timings();
+    }
+    return true;
+}
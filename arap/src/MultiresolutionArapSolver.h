@@ -0,0 +1,101 @@
+#ifndef MultiresolutionArapSolver_H
+#define MultiresolutionArapSolver_H
+
+#include <array>
+#include <vector>
+
+#include "../extern/eigen3/Eigen/Core"
+
+#include "Mesh.h"
+#include "ArapSolver.h"
+
+
+//-------------------------------------------------------------------------------------//
+//
+// ARAP on a coarse proxy of the mesh, for meshes too large for an interactive solve:
+//   - the proxy is a vertex clustering of the rest mesh on a uniform grid, with about the requested
+//     number of vertices (one per cluster, at the centroid of its vertices);
+//   - a proxy vertex is a handle if its cluster contains vertices of a handle, and follows the rigid
+//     motion fitted to them;
+//   - each vertex of the mesh follows the proxy vertices q_k nearest to it (its cluster and the neighbors
+//     of its cluster on the proxy), with their rotations R_k:
+//         p = sum_k w_k ( q_k + R_k ( pInit - qInit_k ) )
+//     The weights w_k are precomputed with the proxy, so that this transfer is linear in the number of vertices.
+//   - optionally, a few iterations of a full resolution ArapSolver start from the transferred positions.
+//
+// The handle vertices of the mesh keep the positions given by the caller.
+//
+//-------------------------------------------------------------------------------------//
+class MultiresolutionArapSolver {
+public:
+    static const unsigned int MaxMappingNodes = 4;
+    static const unsigned int MaxGridRefinements = 32;   // halvings of the grid when no coarse triangle remains
+
+private:
+    Mesh * _mesh;
+    Mesh _coarseMesh;
+    ArapSolver _coarseSolver;
+
+    std::vector< unsigned int > _clusterOfVertex;
+    // while the proxy is built: the clusters are the cells of a grid , numbered in the order of their coordinates
+    typedef std::array< unsigned long long , 3 > GridCell;
+    std::vector< GridCell > _cellOfCluster;
+
+    // mapping from the proxy to the mesh, in compressed rows: vertex v follows the proxy vertices
+    // _mappingCoarseVertex[ _mappingBegin[v] .. _mappingBegin[v+1] [
+    std::vector< unsigned int > _mappingBegin;
+    std::vector< unsigned int > _mappingCoarseVertex;
+    std::vector< double > _mappingWeight;
+
+    // handles of the proxy: the clusters _handleClusters[i] , whose handle vertices are
+    // _handleClusterVertices[ _handleClusterBegin[i] .. _handleClusterBegin[i+1] [
+    std::vector< int > _verticesHandles;
+    std::vector< int > _coarseHandles;
+    std::vector< unsigned int > _handleClusters;
+    std::vector< unsigned int > _handleClusterBegin;
+    std::vector< unsigned int > _handleClusterVertices;
+
+    ArapSolver * _fineSolver;
+    unsigned int _fineIterations;
+    std::vector< Eigen::Matrix3d > _fineRotations;
+
+    ArapSolver::Timings _timings;
+    double _buildMs;
+
+    void clusterVertices( double cellSize );
+    bool buildProxy( unsigned int targetNumberOfCoarseVertices );
+    void buildMapping();
+    void updateCoarseHandlePositions();
+    void transferToMesh();
+
+public:
+    MultiresolutionArapSolver();
+
+    // Builds the proxy of mesh , which must outlive the solver, and the mapping from the proxy to mesh.
+    // The proxy has at least one triangle, whatever the target: returns false (and the solver is not usable)
+    // only when mesh has no triangle with an area.
+    bool setMesh( Mesh & mesh , unsigned int targetNumberOfCoarseVertices );
+    void setHandles( std::vector< int > const & verticesHandles );
+
+    // fineSolver (set up with the same mesh) runs fineIterations iterations after each solve() , 0 disables it.
+    void setFineLevel( ArapSolver * fineSolver , unsigned int fineIterations );
+    unsigned int fineIterations() const { return _fineSolver ? _fineIterations : 0; }
+
+    ArapSolver::StoppingCriteria const & stoppingCriteria() const { return _coarseSolver.stoppingCriteria(); }
+    void setStoppingCriteria( ArapSolver::StoppingCriteria const & criteria ) { _coarseSolver.setStoppingCriteria( criteria ); }
+    bool stoppedOnBudget() const { return _coarseSolver.stoppedOnBudget(); }
+
+    ThreadPool & threadPool() { return _coarseSolver.threadPool(); }
+    Mesh const & coarseMesh() const { return _coarseMesh; }
+    ArapSolver const & coarseSolver() const { return _coarseSolver; }
+    double buildMs() const { return _buildMs; }   // proxy and mapping, in setMesh()
+
+    // Energies and timings of the coarse level (plus those of the fine iterations, if any).
+    std::vector< double > const & energies() const { return _coarseSolver.energies(); }
+    ArapSolver::Timings const & timings() const { return _timings; }
+
+    // Returns false (and does nothing) when no vertex is constrained. See ArapSolver::solve() for continuePreviousSolve.
+    bool solve( bool continuePreviousSolve = false );
+};
+
+#endif // MultiresolutionArapSolver_H
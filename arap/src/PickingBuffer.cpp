@@ -0,0 +1,228 @@
+// framebuffer objects (OpenGL 3.0 , or ARB_framebuffer_object) , shaders , declared by glext.h
+#define GL_GLEXT_PROTOTYPES
+
+#include "PickingBuffer.h"
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+
+namespace {
+
+const char * vertexShaderSource =
+    "#version 150 compatibility\n"
+    "void main() {\n"
+    "    gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;\n"
+    "}\n";
+
+// id t + 1 of triangle t , on 24 bits: each byte is exact in an 8 bits channel
+const char * fragmentShaderSource =
+    "#version 150 compatibility\n"
+    "void main() {\n"
+    "    uint id = uint( gl_PrimitiveID ) + 1u;\n"
+    "    gl_FragColor = vec4( float( id & 255u ) , float( ( id >> 8 ) & 255u ) , float( ( id >> 16 ) & 255u ) , 0.0 ) / 255.0;\n"
+    "}\n";
+
+GLuint compileShader( GLenum type , char const * source ) {
+    GLuint shader = glCreateShader( type );
+    glShaderSource( shader , 1 , &source , 0 );
+    glCompileShader( shader );
+    GLint isCompiled = GL_FALSE;
+    glGetShaderiv( shader , GL_COMPILE_STATUS , &isCompiled );
+    if( ! isCompiled ) {
+        char log[1024];
+        glGetShaderInfoLog( shader , sizeof(log) , 0 , log );
+        std::cerr << "PickingBuffer: shader not compiled: " << log << std::endl;
+        glDeleteShader( shader );
+        return 0;
+    }
+    return shader;
+}
+
+}
+
+
+PickingBuffer::PickingBuffer() :
+    _framebuffer(0) , _colorRenderbuffer(0) , _depthRenderbuffer(0) , _width(0) , _height(0) , _isUpToDate(false) ,
+    _programIsInitialized(false) , _program(0) , _stamp(0) {
+    for( unsigned int i = 0 ; i < 16 ; ++i ) _modelview[i] = _projection[i] = 0.0;
+    for( unsigned int i = 0 ; i < 4 ; ++i ) _viewport[i] = 0;
+}
+
+// the context may be gone at exit: the renderbuffers are released with it
+PickingBuffer::~PickingBuffer() {}
+
+
+bool PickingBuffer::createFramebuffer( int width , int height ) {
+    if( _framebuffer != 0  &&  width == _width  &&  height == _height ) return true;
+    if( _framebuffer == 0 ) {
+        glGenFramebuffers( 1 , &_framebuffer );
+        glGenRenderbuffers( 1 , &_colorRenderbuffer );
+        glGenRenderbuffers( 1 , &_depthRenderbuffer );
+    }
+    glBindRenderbuffer( GL_RENDERBUFFER , _colorRenderbuffer );
+    glRenderbufferStorage( GL_RENDERBUFFER , GL_RGBA8 , width , height );
+    glBindRenderbuffer( GL_RENDERBUFFER , _depthRenderbuffer );
+    glRenderbufferStorage( GL_RENDERBUFFER , GL_DEPTH_COMPONENT24 , width , height );
+    glBindRenderbuffer( GL_RENDERBUFFER , 0 );
+
+    glBindFramebuffer( GL_FRAMEBUFFER , _framebuffer );
+    glFramebufferRenderbuffer( GL_FRAMEBUFFER , GL_COLOR_ATTACHMENT0 , GL_RENDERBUFFER , _colorRenderbuffer );
+    glFramebufferRenderbuffer( GL_FRAMEBUFFER , GL_DEPTH_ATTACHMENT , GL_RENDERBUFFER , _depthRenderbuffer );
+    bool isComplete = glCheckFramebufferStatus( GL_FRAMEBUFFER ) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer( GL_FRAMEBUFFER , 0 );
+    _width = width;
+    _height = height;
+    return isComplete;
+}
+
+
+void PickingBuffer::initializeProgram() {
+    _programIsInitialized = true;
+    int major = 0 , minor = 0;
+    char const * version = (char const *) glGetString( GL_VERSION );
+    if( version == 0  ||  sscanf( version , "%d.%d" , &major , &minor ) != 2  ||  major * 10 + minor < 32 ) return;
+
+    GLuint vertexShader = compileShader( GL_VERTEX_SHADER , vertexShaderSource );
+    GLuint fragmentShader = compileShader( GL_FRAGMENT_SHADER , fragmentShaderSource );
+    if( vertexShader == 0  ||  fragmentShader == 0 ) return;
+    _program = glCreateProgram();
+    glAttachShader( _program , vertexShader );
+    glAttachShader( _program , fragmentShader );
+    glLinkProgram( _program );
+    glDeleteShader( vertexShader );
+    glDeleteShader( fragmentShader );
+    GLint isLinked = GL_FALSE;
+    glGetProgramiv( _program , GL_LINK_STATUS , &isLinked );
+    if( ! isLinked ) {
+        std::cerr << "PickingBuffer: program not linked, triangles drawn one by one" << std::endl;
+        glDeleteProgram( _program );
+        _program = 0;
+    }
+}
+
+
+void PickingBuffer::render( Mesh const & mesh , MeshRenderer & renderer ) {
+    int width = _viewport[2] , height = _viewport[3];
+    // without framebuffer objects, the pass is drawn in the back buffer, which the next frame clears
+    bool offscreen = createFramebuffer( width , height );
+
+    glPushAttrib( GL_ALL_ATTRIB_BITS );
+    if( offscreen ) {
+        glBindFramebuffer( GL_FRAMEBUFFER , _framebuffer );
+        glViewport( 0 , 0 , width , height );
+    }
+    else glDrawBuffer( GL_BACK );
+
+    // the ids must reach the framebuffer unchanged
+    glDisable( GL_LIGHTING );
+    glDisable( GL_BLEND );
+    glDisable( GL_DITHER );
+    glDisable( GL_TEXTURE_2D );
+    glDisable( GL_MULTISAMPLE );
+    glDisable( GL_CULL_FACE );
+    glEnable( GL_DEPTH_TEST );
+    glDepthFunc( GL_LESS );
+    glDepthMask( GL_TRUE );
+    glPolygonMode( GL_FRONT_AND_BACK , GL_FILL );
+    glShadeModel( GL_FLAT );
+    glClearColor( 0.f , 0.f , 0.f , 0.f );
+    glClearDepth( 1.0 );
+    glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+
+    if( ! _programIsInitialized ) initializeProgram();
+    bool drawn = false;
+    if( _program != 0 ) {
+        glUseProgram( _program );
+        drawn = renderer.drawTriangles( mesh );
+        glUseProgram( 0 );
+    }
+    if( ! drawn ) {
+        glBegin( GL_TRIANGLES );
+        for( unsigned int t = 0 ; t < mesh.T.size() ; ++t ) {
+            uint32_t id = t + 1;
+            glColor3ub( id & 0xff , ( id >> 8 ) & 0xff , ( id >> 16 ) & 0xff );
+            for( unsigned int c = 0 ; c < 3 ; ++c ) {
+                Vec3 const & p = mesh.V[ mesh.T[t][c] ].p;
+                glVertex3f( p[0] , p[1] , p[2] );
+            }
+        }
+        glEnd();
+    }
+
+    // RGB only: the back buffer of the fallback may have no alpha channel
+    std::vector< unsigned char > colors( 3 * width * height );
+    glPixelStorei( GL_PACK_ALIGNMENT , 1 );
+    if( offscreen ) glReadBuffer( GL_COLOR_ATTACHMENT0 );
+    else glReadBuffer( GL_BACK );
+    glReadPixels( offscreen ? 0 : _viewport[0] , offscreen ? 0 : _viewport[1] , width , height , GL_RGB , GL_UNSIGNED_BYTE , &colors[0] );
+
+    if( offscreen ) glBindFramebuffer( GL_FRAMEBUFFER , 0 );
+    glPopAttrib();
+
+    _triangles.resize( width * height );
+    for( int i = 0 ; i < width * height ; ++i ) {
+        unsigned char const * color = &colors[ 3 * i ];
+        uint32_t id = uint32_t( color[0] ) | ( uint32_t( color[1] ) << 8 ) | ( uint32_t( color[2] ) << 16 );
+        _triangles[i] = id <= mesh.T.size() ? id : 0;
+    }
+
+    // vertices of the triangles seen
+    _visibleVertices.resize( mesh.V.size() );
+    unsigned int stamp = nextStamp( mesh );
+    for( int i = 0 ; i < width * height ; ++i ) {
+        uint32_t id = _triangles[i];
+        if( id == 0  ||  _triangleStamps[ id - 1 ] == stamp ) continue;
+        _triangleStamps[ id - 1 ] = stamp;
+        for( unsigned int c = 0 ; c < 3 ; ++c ) _visibleVertices.set( mesh.T[ id - 1 ][c] );
+    }
+}
+
+
+void PickingBuffer::update( Mesh const & mesh , MeshRenderer & renderer ) {
+    double modelview[16] , projection[16];
+    int viewport[4];
+    glGetDoublev( GL_MODELVIEW_MATRIX , modelview );
+    glGetDoublev( GL_PROJECTION_MATRIX , projection );
+    glGetIntegerv( GL_VIEWPORT , viewport );
+    if( _isUpToDate  &&  std::memcmp( modelview , _modelview , sizeof(modelview) ) == 0  &&
+            std::memcmp( projection , _projection , sizeof(projection) ) == 0  &&  std::memcmp( viewport , _viewport , sizeof(viewport) ) == 0 )
+        return;
+
+    std::memcpy( _modelview , modelview , sizeof(modelview) );
+    std::memcpy( _projection , projection , sizeof(projection) );
+    std::memcpy( _viewport , viewport , sizeof(viewport) );
+    if( _viewport[2] <= 0  ||  _viewport[3] <= 0 ) {
+        _triangles.clear();
+        _visibleVertices.resize( mesh.V.size() );
+    }
+    else render( mesh , renderer );
+    _isUpToDate = true;
+}
+
+
+unsigned int PickingBuffer::nextStamp( Mesh const & mesh ) {
+    if( _triangleStamps.size() != mesh.T.size()  ||  _vertexStamps.size() != mesh.V.size()  ||  _stamp == ~0u ) {
+        _triangleStamps.assign( mesh.T.size() , 0 );
+        _vertexStamps.assign( mesh.V.size() , 0 );
+        _stamp = 0;
+    }
+    return ++_stamp;
+}
+
+
+bool PickingBuffer::project( Vec3 const & p , double & x , double & y ) const {
+    double eye[4] , clip[4];
+    for( unsigned int r = 0 ; r < 4 ; ++r )
+        eye[r] = _modelview[r] * p[0] + _modelview[4 + r] * p[1] + _modelview[8 + r] * p[2] + _modelview[12 + r];
+    for( unsigned int r = 0 ; r < 4 ; ++r )
+        clip[r] = _projection[r] * eye[0] + _projection[4 + r] * eye[1] + _projection[8 + r] * eye[2] + _projection[12 + r] * eye[3];
+    if( clip[3] <= 0.0 ) return false;
+    x = ( clip[0] / clip[3] + 1.0 ) * 0.5 * _viewport[2];
+    y = ( clip[1] / clip[3] + 1.0 ) * 0.5 * _viewport[3];
+    return true;
+}
+
@@ -0,0 +1,99 @@
+#ifndef PickingBuffer_H
+#define PickingBuffer_H
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include "Vec3.h"
+#include "Mesh.h"
+#include "MeshRenderer.h"
+#include "ScreenSpaceSelection.h"
+
+
+//-------------------------------------------------------------------------------------//
+//
+// Visible triangle of each pixel of the viewport (the "pick pass"), for the selection tools:
+// the mesh is rendered with the index of each triangle as its RGB color (24 bits, so up to
+// 2^24 - 1 triangles) into an offscreen framebuffer, or the back buffer without framebuffer
+// objects, and the ids are read back once. The triangles are drawn from the buffers of the
+// MeshRenderer of the mesh, by a shader that writes gl_PrimitiveID (OpenGL 3.2), or one by one
+// without it. The pass is redone by
+// update() only when the matrices or the viewport differ from those of the last pass, or after
+// meshWasChanged(): selecting is then a lookup in these arrays, its cost depends on the pixels
+// and triangles seen, not on the number of vertices.
+//
+// A vertex is visible if one of its triangles covers a pixel. Triangles smaller than a pixel
+// may cover none: on very dense meshes, a few visible vertices can be missed.
+//
+// The x , y given to forEachVisibleVertexInRectangle() are window coordinates as given by GLUT (y down).
+// The point under the mouse is found by ray casting instead (TriangleBVH).
+//
+//-------------------------------------------------------------------------------------//
+class PickingBuffer {
+    unsigned int _framebuffer , _colorRenderbuffer , _depthRenderbuffer;   // 0 : not created , or not supported
+    int _width , _height;                                                   // of the renderbuffers
+    bool _isUpToDate;
+    bool _programIsInitialized;
+    unsigned int _program;                                                  // 0 : not supported
+
+    // state of the last pass
+    double _modelview[16] , _projection[16];
+    int _viewport[4];
+    std::vector< uint32_t > _triangles;   // per pixel , row 0 at the bottom: 0 background , t + 1 triangle t
+    VertexBitset _visibleVertices;
+
+    // marks of the triangles and vertices already visited by a query (equal to _stamp)
+    std::vector< unsigned int > _triangleStamps , _vertexStamps;
+    unsigned int _stamp;
+
+    bool createFramebuffer( int width , int height );
+    void initializeProgram();
+    void render( Mesh const & mesh , MeshRenderer & renderer );
+    unsigned int nextStamp( Mesh const & mesh );
+    // coordinates of p in the viewport of the last pass ( [0,width] x [0,height] , y up ) , false if p is behind the eye
+    bool project( Vec3 const & p , double & x , double & y ) const;
+
+public:
+    PickingBuffer();
+    ~PickingBuffer();
+
+    // to call when the positions of the vertices or the triangles changed
+    void meshWasChanged() { _isUpToDate = false; }
+
+    // redoes the pass if needed, with the current OpenGL matrices and viewport (needs the context).
+    // renderer is the one that draws mesh: the pass uses its buffers.
+    void update( Mesh const & mesh , MeshRenderer & renderer );
+
+    VertexBitset const & visibleVertices() const { return _visibleVertices; }
+
+    // f( v ) once for each vertex of a triangle seen in the rectangle whose projection is in the rectangle (bounds included)
+    template< class F >
+    void forEachVisibleVertexInRectangle( Mesh const & mesh , int x0 , int y0 , int x1 , int y1 , F const & f ) {
+        if( _triangles.empty() ) return;
+        int left = std::max( std::min( x0 , x1 ) , 0 ) , right = std::min( std::max( x0 , x1 ) , _viewport[2] - 1 );
+        int top = std::max( std::min( y0 , y1 ) , 0 ) , bottom = std::min( std::max( y0 , y1 ) , _viewport[3] - 1 );
+        unsigned int stamp = nextStamp( mesh );
+        for( int y = top ; y <= bottom ; ++y ) {
+            uint32_t const * row = &_triangles[ ( _viewport[3] - 1 - y ) * _viewport[2] ];
+            for( int x = left ; x <= right ; ++x ) {
+                uint32_t id = row[x];
+                if( id == 0  ||  _triangleStamps[ id - 1 ] == stamp ) continue;
+                _triangleStamps[ id - 1 ] = stamp;
+                MeshTriangle const & triangle = mesh.T[ id - 1 ];
+                for( unsigned int c = 0 ; c < 3 ; ++c ) {
+                    unsigned int v = triangle[c];
+                    if( _vertexStamps[v] == stamp ) continue;
+                    _vertexStamps[v] = stamp;
+                    double windowX , windowY;
+                    if( ! project( mesh.V[v].p , windowX , windowY ) ) continue;
+                    double glutY = _viewport[3] - windowY;
+                    if( windowX >= std::min( x0 , x1 )  &&  windowX <= std::max( x0 , x1 )  &&
+                            glutY >= std::min( y0 , y1 )  &&  glutY <= std::max( y0 , y1 ) ) f( v );
+                }
+            }
+        }
+    }
+};
+
+#endif // PickingBuffer_H
@@ -2,6 +2,8 @@
 #ifndef RectangleSelectionTool_H
 #define RectangleSelectionTool_H
 
+#include "ScreenSpaceSelection.h"
+
 struct RectangleSelectionTool {
     int xStart , yStart;
     int xEnd , yEnd;
@@ -17,26 +19,27 @@ struct RectangleSelectionTool {
         yEnd = y;
     }
 
+    // rectangle in normalized window coordinates ( [0,1] x [0,1] , y up ), given the viewport read with glGetFloatv( GL_VIEWPORT )
+    ScreenRectangle getBounds( float const viewport[4] ) const {
+        float w = viewport[2] , h = viewport[3];
+        return ScreenRectangle( (float)(min<int>(xStart,xEnd)) / w , (float)(max<int>(xStart,xEnd)) / w ,
+                                1.f - (float)(max<int>(yStart,yEnd)) / h , 1.f - (float)(min<int>(yStart,yEnd)) / h );
+    }
+
+    // reads the viewport at each call: see selectVerticesInRectangle() to test many points
     bool contains(float xx , float yy) const {
         float viewport[4]; glGetFloatv( GL_VIEWPORT , viewport );
-        float w = viewport[2] , h = viewport[3];
-        float left = (float)(min<int>(xStart,xEnd)) / w;
-        float right = (float)(max<int>(xStart,xEnd)) / w;
-        float top = 1.f - (float)(min<int>(yStart,yEnd)) / h;
-        float bottom = 1.f - (float)(max<int>(yStart,yEnd)) / h;
+        ScreenRectangle bounds = getBounds( viewport );
 
-        return (left <= xx) && (xx <= right) && (bottom <= yy) && (yy <= top);
+        return (bounds.left <= xx) && (xx <= bounds.right) && (bounds.bottom <= yy) && (yy <= bounds.top);
     }
 
     void draw() {
         if(! isActive) return;
 
         float viewport[4]; glGetFloatv( GL_VIEWPORT , viewport );
-        float w = viewport[2] , h = viewport[3];
-        float left = (float)(min<int>(xStart,xEnd)) / w;
-        float right = (float)(max<int>(xStart,xEnd)) / w;
-        float top = 1.f - (float)(min<int>(yStart,yEnd)) / h;
-        float bottom = 1.f - (float)(max<int>(yStart,yEnd)) / h;
+        ScreenRectangle bounds = getBounds( viewport );
+        float left = bounds.left , right = bounds.right , top = bounds.top , bottom = bounds.bottom;
 
         glDisable(GL_DEPTH_TEST);
         glDisable(GL_LIGHTING);
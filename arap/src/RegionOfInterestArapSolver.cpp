@@ -0,0 +1,204 @@
+#include "RegionOfInterestArapSolver.h"
+#include "Timer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <functional>
+#include <utility>
+
+
+RegionOfInterestArapSolver::RegionOfInterestArapSolver() : _mesh(0) , _meanEdgeLength(0.0) , _numberOfInteriorVertices(0) ,
+    _regionExtent(0.0) , _regionIsUpToDate(false) , _rebuilds(0) , _lastRebuildMs(0.0) {
+}
+
+void RegionOfInterestArapSolver::setMesh( Mesh & mesh ) {
+    _mesh = &mesh;
+    unsigned int nV = mesh.V.size();
+
+    std::vector< std::pair< unsigned int , unsigned int > > edges;
+    edges.reserve( 6 * mesh.T.size() );
+    for( unsigned int t = 0 ; t < mesh.T.size() ; ++t )
+        for( unsigned int k = 0 ; k < 3 ; ++k ) {
+            unsigned int a = mesh.T[t][k] , b = mesh.T[t][(k+1)%3];
+            edges.push_back( std::make_pair( a , b ) );
+            edges.push_back( std::make_pair( b , a ) );
+        }
+    std::sort( edges.begin() , edges.end() );
+    edges.erase( std::unique( edges.begin() , edges.end() ) , edges.end() );
+
+    _neighborsBegin.assign( nV + 1 , 0 );
+    _neighbors.resize( edges.size() );
+    _neighborDistances.resize( edges.size() );
+    double sumLengths = 0.0;
+    for( unsigned int e = 0 ; e < edges.size() ; ++e ) {
+        ++_neighborsBegin[ edges[e].first + 1 ];
+        _neighbors[e] = edges[e].second;
+        _neighborDistances[e] = ( mesh.V[ edges[e].second ].pInit - mesh.V[ edges[e].first ].pInit ).length();
+        sumLengths += _neighborDistances[e];
+    }
+    for( unsigned int v = 0 ; v < nV ; ++v )
+        _neighborsBegin[v+1] += _neighborsBegin[v];
+    _meanEdgeLength = edges.empty() ? 1.0 : sumLengths / edges.size();
+
+    _distances.assign( nV , -1.0 );
+    _regionVertexOfVertex.assign( nV , -1 );
+    _vertexOfRegionVertex.clear();
+    _numberOfInteriorVertices = 0;
+    _regionExtent = 0.0;
+    _verticesHandles.assign( nV , -1 );
+    _handleVertices.clear();
+    _regionIsUpToDate = false;
+}
+
+void RegionOfInterestArapSolver::setHandles( std::vector< int > const & verticesHandles ) {
+    _verticesHandles = verticesHandles;
+    _handleVertices.clear();
+    for( unsigned int v = 0 ; v < verticesHandles.size() ; ++v )
+        if( verticesHandles[v] != -1 ) _handleVertices.push_back( v );
+    _regionIsUpToDate = false;
+}
+
+
+double RegionOfInterestArapSolver::requiredExtent() const {
+    double maximalDisplacement = 0.0;
+    for( unsigned int i = 0 ; i < _handleVertices.size() ; ++i ) {
+        MeshVertex const & vertex = _mesh->V[ _handleVertices[i] ];
+        maximalDisplacement = std::max( maximalDisplacement , ( vertex.p - vertex.pInit ).length() );
+    }
+    double extent = _settings.extentPerDisplacement * maximalDisplacement;
+    if( _settings.growth == Growth_KRing ) extent = std::ceil( extent / _meanEdgeLength );
+    return std::max( _settings.extent , extent );
+}
+
+// Dijkstra from the handle vertices, up to extent (the k-rings are the same with edges of length 1).
+// interior: the vertices reached, in the order of their distance ; boundary: their neighbors outside.
+// _distances is back to -1 everywhere on return.
+void RegionOfInterestArapSolver::growRegion( double extent , std::vector< unsigned int > & interior , std::vector< unsigned int > & boundary ) {
+    typedef std::pair< double , unsigned int > QueueEntry;
+    std::priority_queue< QueueEntry , std::vector< QueueEntry > , std::greater< QueueEntry > > queue;
+    bool kRing = ( _settings.growth == Growth_KRing );
+
+    interior.clear();
+    boundary.clear();
+    for( unsigned int i = 0 ; i < _handleVertices.size() ; ++i ) {
+        _distances[ _handleVertices[i] ] = 0.0;
+        queue.push( QueueEntry( 0.0 , _handleVertices[i] ) );
+    }
+    while( ! queue.empty() ) {
+        QueueEntry entry = queue.top();
+        queue.pop();
+        unsigned int v = entry.second;
+        if( entry.first > _distances[v] ) continue;   // already reached by a shorter path
+        if( _regionVertexOfVertex[v] == -2 ) continue; // already in interior
+        _regionVertexOfVertex[v] = -2;
+        interior.push_back( v );
+        for( unsigned int e = _neighborsBegin[v] ; e < _neighborsBegin[v+1] ; ++e ) {
+            unsigned int n = _neighbors[e];
+            double distance = entry.first + ( kRing ? 1.0 : _neighborDistances[e] );
+            if( distance <= extent  &&  ( _distances[n] < 0.0  ||  distance < _distances[n] ) ) {
+                _distances[n] = distance;
+                queue.push( QueueEntry( distance , n ) );
+            }
+        }
+    }
+    for( unsigned int i = 0 ; i < interior.size() ; ++i ) {
+        unsigned int v = interior[i];
+        for( unsigned int e = _neighborsBegin[v] ; e < _neighborsBegin[v+1] ; ++e ) {
+            unsigned int n = _neighbors[e];
+            if( _distances[n] < 0.0 ) {
+                _distances[n] = 0.0;   // marks n as already in boundary
+                boundary.push_back( n );
+            }
+        }
+    }
+
+    for( unsigned int i = 0 ; i < interior.size() ; ++i ) { _distances[ interior[i] ] = -1.0; _regionVertexOfVertex[ interior[i] ] = -1; }
+    for( unsigned int i = 0 ; i < boundary.size() ; ++i ) _distances[ boundary[i] ] = -1.0;
+}
+
+void RegionOfInterestArapSolver::buildRegion( double extent ) {
+    Mesh const & mesh = *_mesh;
+    Timer timer;
+
+    // the rotations of the vertices that stay in the region are kept, to warm start the solve
+    std::vector< Eigen::Matrix3d > previousRotations = _regionSolver.rotations();
+    std::vector< unsigned int > previousRegion;
+    previousRegion.swap( _vertexOfRegionVertex );
+    std::vector< unsigned int > interior , boundary;
+    for( unsigned int r = 0 ; r < previousRegion.size() ; ++r ) _regionVertexOfVertex[ previousRegion[r] ] = -1;
+    growRegion( extent , interior , boundary );
+
+    _numberOfInteriorVertices = interior.size();
+    _vertexOfRegionVertex = interior;
+    _vertexOfRegionVertex.insert( _vertexOfRegionVertex.end() , boundary.begin() , boundary.end() );
+    for( unsigned int r = 0 ; r < _vertexOfRegionVertex.size() ; ++r )
+        _regionVertexOfVertex[ _vertexOfRegionVertex[r] ] = r;
+
+    std::vector< Eigen::Matrix3d > rotations( _vertexOfRegionVertex.size() , Eigen::Matrix3d::Identity() );
+    for( unsigned int r = 0 ; r < previousRegion.size() ; ++r ) {
+        int newR = _regionVertexOfVertex[ previousRegion[r] ];
+        if( newR >= 0  &&  r < previousRotations.size() ) rotations[newR] = previousRotations[r];
+    }
+
+    // region mesh: rest and current positions of the mesh, triangles with a vertex inside (taken from their first interior corner)
+    _regionMesh.V.resize( _vertexOfRegionVertex.size() );
+    for( unsigned int r = 0 ; r < _vertexOfRegionVertex.size() ; ++r ) {
+        MeshVertex const & vertex = mesh.V[ _vertexOfRegionVertex[r] ];
+        _regionMesh.V[r].pInit = vertex.pInit;
+        _regionMesh.V[r].p = vertex.p;
+        _regionMesh.V[r].n = vertex.n;
+    }
+    _regionMesh.T.clear();
+    for( unsigned int t = 0 ; t < mesh.T.size() ; ++t ) {
+        int r0 = _regionVertexOfVertex[ mesh.T[t][0] ] , r1 = _regionVertexOfVertex[ mesh.T[t][1] ] , r2 = _regionVertexOfVertex[ mesh.T[t][2] ];
+        if( r0 < 0  ||  r1 < 0  ||  r2 < 0 ) continue;
+        if( (unsigned int)std::min( r0 , std::min( r1 , r2 ) ) >= _numberOfInteriorVertices ) continue;   // boundary only
+        _regionMesh.T.push_back( MeshTriangle( r0 , r1 , r2 ) );
+    }
+
+    _regionSolver.setMesh( _regionMesh );   // rest state from pInit: the region may be rebuilt during a drag
+    _regionSolver.setRotations( rotations );
+    std::vector< int > regionHandles( _vertexOfRegionVertex.size() , BoundaryHandle );
+    for( unsigned int r = 0 ; r < _numberOfInteriorVertices ; ++r )
+        regionHandles[r] = _verticesHandles[ _vertexOfRegionVertex[r] ];
+    _regionSolver.setHandles( regionHandles );
+
+    _regionExtent = extent;
+    _regionIsUpToDate = true;
+    ++_rebuilds;
+    _lastRebuildMs = timer.elapsedMs();
+}
+
+
+bool RegionOfInterestArapSolver::solve( bool continuePreviousSolve ) {
+    _timings.clear();
+    if( _handleVertices.empty() ) return false; // nothing holds the mesh in place
+
+    double extent = requiredExtent();
+    if( ! _regionIsUpToDate  ||  extent > _regionExtent ) {
+        // when the handles moved too far, the region grows with some slack
+        buildRegion( _regionIsUpToDate ? 1.5 * extent : extent );
+        _timings = _regionSolver.meshTimings();
+        continuePreviousSolve = false;
+    }
+
+    Mesh & mesh = *_mesh;
+    Timer timer;
+    for( unsigned int r = 0 ; r < _numberOfInteriorVertices ; ++r ) {
+        unsigned int v = _vertexOfRegionVertex[r];
+        if( _verticesHandles[v] != -1 ) _regionMesh.V[r].p = mesh.V[v].p;
+    }
+    double transferMs = timer.elapsedMs();
+
+    if( ! _regionSolver.solve( continuePreviousSolve ) ) return false;
+    _timings += _regionSolver.timings();
+
+    timer.restart();
+    for( unsigned int r = 0 ; r < _numberOfInteriorVertices ; ++r ) {
+        unsigned int v = _vertexOfRegionVertex[r];
+        if( _verticesHandles[v] == -1 ) mesh.V[v].p = _regionMesh.V[r].p;
+    }
+    _timings.transferMs += transferMs + timer.elapsedMs();
+    return true;
+}
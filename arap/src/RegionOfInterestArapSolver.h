@@ -0,0 +1,98 @@
+#ifndef RegionOfInterestArapSolver_H
+#define RegionOfInterestArapSolver_H
+
+#include <vector>
+#include <climits>
+
+#include "Mesh.h"
+#include "ArapSolver.h"
+
+
+//-------------------------------------------------------------------------------------//
+//
+// ARAP restricted to the part of the mesh around the handles, for local edits of large meshes:
+//   - the region grows from the handle vertices, by k-rings or by geodesic distance (Dijkstra on the
+//     rest edge lengths), and the ring of vertices just outside it is fixed, at its current positions;
+//   - the region and its boundary ring are copied into a small mesh, with its own ArapSolver, so that
+//     the weights, the system and the iterations only involve the region;
+//   - the region is rebuilt when the handles change, or when they move further from their rest positions
+//     than the region can absorb (its extent must stay above extentPerDisplacement times the displacement),
+//     with some slack so that a drag does not rebuild it at every step.
+//
+// Solve cost scales with the size of the region, not with the size of the mesh.
+//
+//-------------------------------------------------------------------------------------//
+class RegionOfInterestArapSolver {
+public:
+    enum Growth {
+        Growth_KRing ,     // extent in number of rings (edges)
+        Growth_Geodesic    // extent in distance along the edges of the rest mesh
+    };
+    struct RegionSettings {
+        Growth growth;
+        double extent;                   // rings or distance
+        double extentPerDisplacement;    // minimal extent per unit of handle displacement (in edge lengths for the k-rings)
+
+        RegionSettings( Growth growth_ = Growth_Geodesic , double extent_ = 0.15 , double extentPerDisplacement_ = 2.0 ) :
+            growth(growth_) , extent(extent_) , extentPerDisplacement(extentPerDisplacement_) {}
+    };
+    static const int BoundaryHandle = INT_MAX;   // handle of the fixed boundary ring in the region mesh
+
+private:
+    Mesh * _mesh;
+    std::vector< unsigned int > _neighborsBegin , _neighbors;   // adjacency of the mesh, compressed rows
+    std::vector< double > _neighborDistances;                   // rest lengths of the edges
+    double _meanEdgeLength;
+
+    RegionSettings _settings;
+    std::vector< int > _verticesHandles;
+    std::vector< unsigned int > _handleVertices;
+
+    // region: vertices of the mesh in the region mesh, interior first then boundary
+    Mesh _regionMesh;
+    ArapSolver _regionSolver;
+    std::vector< unsigned int > _vertexOfRegionVertex;
+    std::vector< int > _regionVertexOfVertex;   // -1 outside
+    unsigned int _numberOfInteriorVertices;
+    double _regionExtent;
+    bool _regionIsUpToDate;
+
+    std::vector< double > _distances;   // Dijkstra, -1 outside of growRegion()
+    unsigned int _rebuilds;
+    double _lastRebuildMs;
+    ArapSolver::Timings _timings;
+
+    double requiredExtent() const;
+    void growRegion( double extent , std::vector< unsigned int > & interior , std::vector< unsigned int > & boundary );
+    void buildRegion( double extent );
+
+public:
+    RegionOfInterestArapSolver();
+
+    // mesh must outlive the solver. Nothing is built before the first solve().
+    void setMesh( Mesh & mesh );
+    void setHandles( std::vector< int > const & verticesHandles );
+
+    RegionSettings const & regionSettings() const { return _settings; }
+    void setRegionSettings( RegionSettings const & settings ) { _settings = settings; _regionIsUpToDate = false; }
+
+    ArapSolver::StoppingCriteria const & stoppingCriteria() const { return _regionSolver.stoppingCriteria(); }
+    void setStoppingCriteria( ArapSolver::StoppingCriteria const & criteria ) { _regionSolver.setStoppingCriteria( criteria ); }
+    bool stoppedOnBudget() const { return _regionSolver.stoppedOnBudget(); }
+    void setGlobalStepMode( ArapSolver::GlobalStepMode mode ) { _regionSolver.setGlobalStepMode( mode ); }
+
+    ThreadPool & threadPool() { return _regionSolver.threadPool(); }
+    unsigned int numberOfRegionVertices() const { return _vertexOfRegionVertex.size(); }
+    unsigned int numberOfInteriorVertices() const { return _numberOfInteriorVertices; }
+    double regionExtent() const { return _regionExtent; }
+    unsigned int numberOfRebuilds() const { return _rebuilds; }
+
+    // Energies of the region. The timings of the solve that rebuilt the region count its weights and Laplacian.
+    std::vector< double > const & energies() const { return _regionSolver.energies(); }
+    ArapSolver::Timings const & timings() const { return _timings; }
+
+    // Returns false (and does nothing) when no vertex is constrained. See ArapSolver::solve() for continuePreviousSolve.
+    bool solve( bool continuePreviousSolve = false );
+};
+
+#endif // RegionOfInterestArapSolver_H
@@ -0,0 +1,157 @@
+#ifndef RenderScheduler_H
+#define RenderScheduler_H
+
+#include <vector>
+#include <string>
+#include <cmath>
+#include <fstream>
+#include <ostream>
+#include <algorithm>
+
+#include "Timer.h"
+
+
+//-------------------------------------------------------------------------------------//
+//
+// Histogram of durations in milliseconds, on logarithmic bins: BinsPerOctave bins per power of two
+// from 1/64 ms to 2^14 ms (shorter and longer durations go to the first and the last bin).
+// A percentile is interpolated in its bin, it is within about 5% of the exact one.
+//
+//-------------------------------------------------------------------------------------//
+class FrameTimeHistogram {
+public:
+    static const unsigned int BinsPerOctave = 16;
+    static const unsigned int Octaves = 20;
+
+private:
+    std::vector< unsigned long long > _counts;
+    unsigned long long _numberOfSamples;
+    double _totalMs , _maxMs;
+
+    static double minMs() { return 1.0 / 64.0; }
+
+public:
+    FrameTimeHistogram() : _counts( BinsPerOctave * Octaves , 0 ) , _numberOfSamples(0) , _totalMs(0.0) , _maxMs(0.0) {}
+
+    void clear() {
+        std::fill( _counts.begin() , _counts.end() , 0 );
+        _numberOfSamples = 0;
+        _totalMs = _maxMs = 0.0;
+    }
+
+    void add( double ms ) {
+        int bin = ( ms > minMs() ) ? int( std::floor( BinsPerOctave * std::log2( ms / minMs() ) ) ) : 0;
+        ++_counts[ std::min< int >( bin , _counts.size() - 1 ) ];
+        ++_numberOfSamples;
+        _totalMs += ms;
+        _maxMs = std::max( _maxMs , ms );
+    }
+
+    unsigned long long numberOfSamples() const { return _numberOfSamples; }
+    double meanMs() const { return _numberOfSamples == 0 ? 0.0 : _totalMs / _numberOfSamples; }
+    double maxMs() const { return _maxMs; }
+
+    static double binLowerMs( unsigned int bin ) { return bin == 0 ? 0.0 : minMs() * std::exp2( double(bin) / BinsPerOctave ); }
+    static double binUpperMs( unsigned int bin ) { return minMs() * std::exp2( double(bin + 1) / BinsPerOctave ); }
+
+    // p in [0,1] , 0 without samples
+    double percentileMs( double p ) const {
+        double rank = p * _numberOfSamples;
+        unsigned long long below = 0;
+        for( unsigned int bin = 0 ; bin < _counts.size() ; ++bin ) {
+            if( _counts[bin] > 0  &&  below + _counts[bin] >= rank ) {
+                double lower = binLowerMs( bin ) , upper = binUpperMs( bin );
+                return std::min( lower + ( rank - below ) / _counts[bin] * ( upper - lower ) , _maxMs );
+            }
+            below += _counts[bin];
+        }
+        return _maxMs;
+    }
+
+    // one line per non-empty bin: series , lower_ms , upper_ms , count , fraction of the samples up to this bin
+    void writeCsv( std::ostream & out , std::string const & series ) const {
+        unsigned long long upToBin = 0;
+        for( unsigned int bin = 0 ; bin < _counts.size() ; ++bin ) {
+            if( _counts[bin] == 0 ) continue;
+            upToBin += _counts[bin];
+            out << series << "," << binLowerMs( bin ) << "," << binUpperMs( bin ) << "," << _counts[bin] << ","
+                << double(upToBin) / _numberOfSamples << "\n";
+        }
+    }
+
+    void print( std::ostream & out , std::string const & series ) const {
+        out << series << ": " << _numberOfSamples << " samples , p50 " << percentileMs( 0.5 ) << " ms , p95 " << percentileMs( 0.95 )
+            << " ms , p99 " << percentileMs( 0.99 ) << " ms , max " << _maxMs << " ms" << std::endl;
+    }
+};
+
+
+//-------------------------------------------------------------------------------------//
+//
+// When the viewer draws, instead of a frame at every idle call:
+//   - a frame is drawn after requestRedraw() (the camera moved, the mesh changed, a key was pressed...),
+//     and at every idle call while an animation runs (setAnimating());
+//   - with frame pacing (setMinimumFrameMs() > 0), two frames begin at least that far apart, the requests
+//     in between are drawn by the next frame;
+//   - the durations of the frames (addDrawMs()) and of the solves (addSolveMs()) go to two histograms,
+//     printed with print() and dumped with writeCsv().
+//
+// GLUT stays in the viewer: its idle function draws when frameIsDue(), and stops being called
+// (glutIdleFunc(0)) when there is no pending frame and nothing else to wait for; the input callbacks
+// call requestRedraw() and set the idle function again. The display function calls beginFrame().
+//
+//-------------------------------------------------------------------------------------//
+class RenderScheduler {
+    bool _redrawIsRequested , _isAnimating;
+    double _minimumFrameMs;
+    Timer _sinceFrameBegin;
+    FrameTimeHistogram _drawHistogram , _solveHistogram;
+
+public:
+    RenderScheduler() : _redrawIsRequested(true) , _isAnimating(false) , _minimumFrameMs(0.0) {}
+
+    void requestRedraw() { _redrawIsRequested = true; }
+    void setAnimating( bool isAnimating ) { _isAnimating = isAnimating; }
+    bool isAnimating() const { return _isAnimating; }
+
+    // 0: no pacing
+    void setMinimumFrameMs( double minimumFrameMs ) { _minimumFrameMs = minimumFrameMs; }
+    double minimumFrameMs() const { return _minimumFrameMs; }
+
+    bool hasPendingFrame() const { return _redrawIsRequested || _isAnimating; }
+    // before the next frame may begin, 0 if it may begin now
+    double msUntilNextFrame() const { return std::max( 0.0 , _minimumFrameMs - _sinceFrameBegin.elapsedMs() ); }
+    bool frameIsDue() const { return hasPendingFrame()  &&  msUntilNextFrame() == 0.0; }
+
+    // the requests made until now are drawn by this frame
+    void beginFrame() {
+        _redrawIsRequested = false;
+        _sinceFrameBegin.restart();
+    }
+
+    void addDrawMs( double ms ) { _drawHistogram.add( ms ); }
+    void addSolveMs( double ms ) { _solveHistogram.add( ms ); }
+    FrameTimeHistogram const & drawHistogram() const { return _drawHistogram; }
+    FrameTimeHistogram const & solveHistogram() const { return _solveHistogram; }
+    void clearHistograms() {
+        _drawHistogram.clear();
+        _solveHistogram.clear();
+    }
+
+    void print( std::ostream & out ) const {
+        _drawHistogram.print( out , "draw" );
+        _solveHistogram.print( out , "solve" );
+    }
+
+    // both histograms in one file, see FrameTimeHistogram::writeCsv()
+    bool writeCsv( std::string const & fileName ) const {
+        std::ofstream out( fileName.c_str() );
+        if( ! out ) return false;
+        out << "series,lower_ms,upper_ms,count,cumulative_fraction\n";
+        _drawHistogram.writeCsv( out , "draw" );
+        _solveHistogram.writeCsv( out , "solve" );
+        return bool( out );
+    }
+};
+
+#endif // RenderScheduler_H
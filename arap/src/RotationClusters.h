@@ -0,0 +1,99 @@
+#ifndef RotationClusters_H
+#define RotationClusters_H
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+#include "Vec3.h"
+#include "Mesh.h"
+
+
+//-------------------------------------------------------------------------------------//
+//
+// Partition of the vertices of a mesh in clusters that share one ARAP rotation, from their rest positions:
+//   - farthest point sampling: the first center is vertex 0, each next one is the vertex farthest from
+//     the centers already chosen, and each vertex goes to its nearest center;
+//   - k-means: Lloyd iterations on the rest positions, starting from the farthest point sampling.
+// Both are O(k V) per pass. The clusters are numbered 0 .. returned number - 1, none is empty.
+//
+//-------------------------------------------------------------------------------------//
+enum RotationClustering {
+    RotationClustering_FarthestPoints ,
+    RotationClustering_KMeans
+};
+
+namespace RotationClustersDetails {
+
+// Index of the nearest center, and its squared distance.
+inline unsigned int nearestCenter( Vec3 const & p , std::vector< Vec3 > const & centers , double & squaredDistance ) {
+    unsigned int nearest = 0;
+    squaredDistance = std::numeric_limits< double >::max();
+    for( unsigned int c = 0 ; c < centers.size() ; ++c ) {
+        double d = ( p - centers[c] ).squareLength();
+        if( d < squaredDistance ) { squaredDistance = d; nearest = c; }
+    }
+    return nearest;
+}
+
+}
+
+inline unsigned int clusterVerticesForRotations( Mesh const & mesh , unsigned int numberOfClusters , RotationClustering clustering ,
+                                                 std::vector< unsigned int > & clusterOfVertex , unsigned int kMeansIterations = 10 ) {
+    unsigned int nV = mesh.V.size();
+    numberOfClusters = std::min( numberOfClusters , nV );
+    clusterOfVertex.assign( nV , 0 );
+    if( numberOfClusters == 0 ) return 0;
+
+    // farthest point sampling: squaredDistances[v] is the squared distance of v to its nearest center
+    std::vector< Vec3 > centers;
+    centers.reserve( numberOfClusters );
+    std::vector< double > squaredDistances( nV , std::numeric_limits< double >::max() );
+    unsigned int nextCenter = 0;
+    while( centers.size() < numberOfClusters ) {
+        unsigned int c = centers.size();
+        centers.push_back( mesh.V[nextCenter].pInit );
+        double farthest = -1.0;
+        for( unsigned int v = 0 ; v < nV ; ++v ) {
+            double d = ( mesh.V[v].pInit - centers[c] ).squareLength();
+            if( d < squaredDistances[v] ) { squaredDistances[v] = d; clusterOfVertex[v] = c; }
+            if( squaredDistances[v] > farthest ) { farthest = squaredDistances[v]; nextCenter = v; }
+        }
+        if( farthest <= 0.0 ) break;   // fewer distinct positions than clusters
+    }
+
+    if( clustering == RotationClustering_KMeans ) {
+        std::vector< Vec3 > sums( centers.size() );
+        std::vector< unsigned int > counts( centers.size() );
+        for( unsigned int iteration = 0 ; iteration < kMeansIterations ; ++iteration ) {
+            std::fill( sums.begin() , sums.end() , Vec3(0,0,0) );
+            std::fill( counts.begin() , counts.end() , 0u );
+            for( unsigned int v = 0 ; v < nV ; ++v ) {
+                sums[ clusterOfVertex[v] ] += mesh.V[v].pInit;
+                ++counts[ clusterOfVertex[v] ];
+            }
+            for( unsigned int c = 0 ; c < centers.size() ; ++c )
+                if( counts[c] > 0 ) centers[c] = sums[c] / (double)counts[c];
+
+            bool changed = false;
+            for( unsigned int v = 0 ; v < nV ; ++v ) {
+                double d;
+                unsigned int c = RotationClustersDetails::nearestCenter( mesh.V[v].pInit , centers , d );
+                changed = changed  ||  ( c != clusterOfVertex[v] );
+                clusterOfVertex[v] = c;
+            }
+            if( ! changed ) break;
+        }
+    }
+
+    // numbers of the non empty clusters
+    std::vector< int > newCluster( centers.size() , -1 );
+    unsigned int numberOfNonEmptyClusters = 0;
+    for( unsigned int v = 0 ; v < nV ; ++v ) {
+        if( newCluster[ clusterOfVertex[v] ] < 0 ) newCluster[ clusterOfVertex[v] ] = numberOfNonEmptyClusters++;
+        clusterOfVertex[v] = newCluster[ clusterOfVertex[v] ];
+    }
+    return numberOfNonEmptyClusters;
+}
+
+#endif // RotationClusters_H
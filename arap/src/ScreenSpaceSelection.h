@@ -0,0 +1,131 @@
+#ifndef ScreenSpaceSelection_H
+#define ScreenSpaceSelection_H
+
+#include <vector>
+#include <cstdint>
+
+#include "Mesh.h"
+#include "ThreadPool.h"
+
+
+//-------------------------------------------------------------------------------------//
+//
+// Vertices whose projection falls in a screen rectangle, without OpenGL calls: the caller
+// reads the matrices and the viewport once, the vertices are then projected by batches of
+// 64 (one word of the result), on the threads of a ThreadPool.
+//
+// Each batch is gathered lane by lane ("structure of arrays") and every step is a loop over
+// the lanes with no data-dependent branch, so that the compiler vectorizes it (as in
+// ClosestRotation.h). The rectangle test is done in clip space, without division:
+//   left <= ( x / w + 1 ) / 2  <=>  ( 2 left - 1 ) w <= x     (w > 0)
+// Vertices behind the eye (w <= 0) are never selected.
+//
+//-------------------------------------------------------------------------------------//
+
+// One bit per vertex
+class VertexBitset {
+    std::vector< uint64_t > _words;
+    unsigned int _size;
+
+public:
+    VertexBitset() : _size(0) {}
+
+    void resize( unsigned int size ) {
+        _size = size;
+        _words.assign( ( size + 63 ) / 64 , 0 );
+    }
+    unsigned int size() const { return _size; }
+    unsigned int numberOfWords() const { return _words.size(); }
+    uint64_t word( unsigned int w ) const { return _words[w]; }
+    uint64_t & word( unsigned int w ) { return _words[w]; }
+
+    bool test( unsigned int v ) const { return ( _words[ v >> 6 ] >> ( v & 63 ) ) & 1; }
+    void set( unsigned int v ) { _words[ v >> 6 ] |= uint64_t( 1 ) << ( v & 63 ); }
+
+    unsigned int count() const {
+        unsigned int n = 0;
+        for( unsigned int w = 0 ; w < _words.size() ; ++w ) n += __builtin_popcountll( _words[w] );
+        return n;
+    }
+
+    // f( v ) for each set bit , in increasing order
+    template< class F >
+    void forEachSetBit( F const & f ) const {
+        for( unsigned int w = 0 ; w < _words.size() ; ++w )
+            for( uint64_t bits = _words[w] ; bits != 0 ; bits &= bits - 1 )
+                f( 64 * w + __builtin_ctzll( bits ) );
+    }
+};
+
+
+// Screen rectangle in normalized window coordinates ( [0,1] x [0,1] , y up ), see RectangleSelectionTool::getBounds()
+struct ScreenRectangle {
+    float left , right , bottom , top;
+
+    ScreenRectangle( float left_ = 0.f , float right_ = 0.f , float bottom_ = 0.f , float top_ = 0.f ) :
+        left(left_) , right(right_) , bottom(bottom_) , top(top_) {}
+};
+
+
+namespace ScreenSpaceSelectionDetails {
+
+static const unsigned int BatchSize = 64;
+
+// selection bits of the vertices [ begin , begin + count [ , count <= BatchSize
+inline uint64_t selectBatch( std::vector< MeshVertex > const & V , unsigned int begin , unsigned int count ,
+                             float const (&clip)[4][4] , ScreenRectangle const & bounds ) {
+    float x[ BatchSize ] , y[ BatchSize ] , z[ BatchSize ];
+    for( unsigned int l = 0 ; l < count ; ++l ) {
+        Vec3 const & p = V[ begin + l ].p;
+        x[l] = p[0];  y[l] = p[1];  z[l] = p[2];
+    }
+    for( unsigned int l = count ; l < BatchSize ; ++l )
+        x[l] = y[l] = z[l] = 0.f;
+
+    // ( 2 bound - 1 ) , the bounds of x and y in clip space are these times w
+    float left = 2.f * bounds.left - 1.f , right = 2.f * bounds.right - 1.f;
+    float bottom = 2.f * bounds.bottom - 1.f , top = 2.f * bounds.top - 1.f;
+    uint32_t inside[ BatchSize ];
+    for( unsigned int l = 0 ; l < BatchSize ; ++l ) {
+        float cx = clip[0][0] * x[l] + clip[0][1] * y[l] + clip[0][2] * z[l] + clip[0][3];
+        float cy = clip[1][0] * x[l] + clip[1][1] * y[l] + clip[1][2] * z[l] + clip[1][3];
+        float cw = clip[3][0] * x[l] + clip[3][1] * y[l] + clip[3][2] * z[l] + clip[3][3];
+        inside[l] = ( cw > 0.f ) & ( left * cw <= cx ) & ( cx <= right * cw ) & ( bottom * cw <= cy ) & ( cy <= top * cw );
+    }
+    uint64_t bits = 0;
+    for( unsigned int l = 0 ; l < count ; ++l )
+        bits |= uint64_t( inside[l] ) << l;
+    return bits;
+}
+
+}
+
+
+// selection.size() == V.size() on return , bit v set iff vertex v projects into bounds.
+//   modelview and projection are column major (as given by glGetFloatv), the modelview matrix is affine.
+inline void selectVerticesInRectangle( std::vector< MeshVertex > const & V , float const modelview[16] , float const projection[16] ,
+                                       ScreenRectangle const & bounds , VertexBitset & selection , ThreadPool * threadPool = 0 ) {
+    using namespace ScreenSpaceSelectionDetails;
+    // clip = projection * modelview , row major
+    float clip[4][4];
+    for( unsigned int r = 0 ; r < 4 ; ++r )
+        for( unsigned int c = 0 ; c < 4 ; ++c ) {
+            double sum = 0.0;
+            for( unsigned int k = 0 ; k < 4 ; ++k )
+                sum += double( projection[ 4 * k + r ] ) * double( modelview[ 4 * c + k ] );
+            clip[r][c] = float( sum );
+        }
+
+    selection.resize( V.size() );
+    auto selectWords = [&]( unsigned int wordBegin , unsigned int wordEnd , unsigned int ) {
+        for( unsigned int w = wordBegin ; w < wordEnd ; ++w ) {
+            unsigned int begin = w * BatchSize;
+            unsigned int count = std::min< unsigned int >( BatchSize , V.size() - begin );
+            selection.word( w ) = selectBatch( V , begin , count , clip , bounds );
+        }
+    };
+    if( threadPool  &&  threadPool->numberOfThreads() > 1 ) threadPool->parallelForChunks( 0 , selection.numberOfWords() , selectWords , 256 );
+    else selectWords( 0 , selection.numberOfWords() , 0 );
+}
+
+#endif // ScreenSpaceSelection_H
@@ -0,0 +1,132 @@
+#ifndef SpatialGrid_H
+#define SpatialGrid_H
+
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+#include "Vec3.h"
+#include "Mesh.h"
+
+
+//-------------------------------------------------------------------------------------//
+//
+// Uniform grid over the positions of the vertices of a mesh, for radius queries.
+//   The vertices are sorted by cell (counting sort), and their positions copied in that
+//   order, so that a cell is a contiguous range.
+//   forEachVertexInShell() visits the cells that overlap the bounding box of the outer sphere,
+//   skips those entirely inside the inner sphere or outside the outer one, and takes those
+//   entirely in the shell without testing their vertices: the cost is that of the vertices
+//   found plus the cells crossed by the two spheres.
+//   The grid has at most about 4 cells per vertex, and about 8 vertices per occupied cell on a
+//   surface mesh.
+//
+//-------------------------------------------------------------------------------------//
+class SpatialGrid {
+    Vec3 _origin;
+    double _cellSize;
+    int _resolution[3];
+    std::vector< unsigned int > _cellStart;   // number of cells + 1
+    std::vector< unsigned int > _vertices;    // sorted by cell
+    std::vector< Vec3 > _positions;           // of _vertices , same order
+
+    int cellCoordinate( double x , unsigned int axis ) const {
+        return std::min( std::max( int( std::floor( ( x - _origin[axis] ) / _cellSize ) ) , 0 ) , _resolution[axis] - 1 );
+    }
+    unsigned int cellIndex( int i , int j , int k ) const { return ( k * _resolution[1] + j ) * _resolution[0] + i; }
+
+public:
+    SpatialGrid() : _cellSize(1.0) { _resolution[0] = _resolution[1] = _resolution[2] = 0; }
+
+    bool isEmpty() const { return _vertices.empty(); }
+
+    // positions p of the vertices
+    void build( std::vector< MeshVertex > const & V ) {
+        _vertices.clear();
+        _positions.clear();
+        _cellStart.assign( 1 , 0 );
+        _resolution[0] = _resolution[1] = _resolution[2] = 0;
+        if( V.empty() ) return;
+
+        Vec3 bbMin = V[0].p , bbMax = V[0].p;
+        for( unsigned int v = 1 ; v < V.size() ; ++v )
+            for( unsigned int axis = 0 ; axis < 3 ; ++axis ) {
+                bbMin[axis] = std::min( bbMin[axis] , V[v].p[axis] );
+                bbMax[axis] = std::max( bbMax[axis] , V[v].p[axis] );
+            }
+        Vec3 extent = bbMax - bbMin;
+        double largestExtent = std::max( std::max( extent[0] , extent[1] ) , std::max( extent[2] , 1e-12 ) );
+        // cells per axis on the largest extent: sqrt(V/8) (8 vertices per cell on a surface), at most cbrt(4V)
+        double resolution = std::min( std::sqrt( V.size() / 8.0 ) , std::cbrt( 4.0 * V.size() ) );
+        _cellSize = largestExtent / std::max( resolution , 1.0 );
+        _origin = bbMin;
+        for( unsigned int axis = 0 ; axis < 3 ; ++axis )
+            _resolution[axis] = std::max( 1 , int( std::ceil( extent[axis] / _cellSize ) ) );
+
+        unsigned int numberOfCells = _resolution[0] * _resolution[1] * _resolution[2];
+        std::vector< unsigned int > cellOfVertex( V.size() );
+        _cellStart.assign( numberOfCells + 1 , 0 );
+        for( unsigned int v = 0 ; v < V.size() ; ++v ) {
+            Vec3 const & p = V[v].p;
+            cellOfVertex[v] = cellIndex( cellCoordinate( p[0] , 0 ) , cellCoordinate( p[1] , 1 ) , cellCoordinate( p[2] , 2 ) );
+            ++_cellStart[ cellOfVertex[v] + 1 ];
+        }
+        for( unsigned int c = 0 ; c < numberOfCells ; ++c )
+            _cellStart[c+1] += _cellStart[c];
+        std::vector< unsigned int > next( _cellStart.begin() , _cellStart.end() - 1 );
+        _vertices.resize( V.size() );
+        _positions.resize( V.size() );
+        for( unsigned int v = 0 ; v < V.size() ; ++v ) {
+            unsigned int position = next[ cellOfVertex[v] ]++;
+            _vertices[ position ] = v;
+            _positions[ position ] = V[v].p;
+        }
+    }
+
+    // f( v ) for the vertices with innerRadius < | p_v - center | <= outerRadius (innerRadius < 0 : the whole ball)
+    template< class F >
+    void forEachVertexInShell( Vec3 const & center , double innerRadius , double outerRadius , F const & f ) const {
+        if( _vertices.empty()  ||  outerRadius < 0.0  ||  outerRadius <= innerRadius ) return;
+        double inner2 = innerRadius < 0.0 ? -1.0 : innerRadius * innerRadius , outer2 = outerRadius * outerRadius;
+        int begin[3] , end[3];
+        for( unsigned int axis = 0 ; axis < 3 ; ++axis ) {
+            if( center[axis] + outerRadius < _origin[axis]  ||  center[axis] - outerRadius > _origin[axis] + _resolution[axis] * _cellSize ) return;
+            begin[axis] = cellCoordinate( center[axis] - outerRadius , axis );
+            end[axis] = cellCoordinate( center[axis] + outerRadius , axis ) + 1;
+        }
+        for( int k = begin[2] ; k < end[2] ; ++k )
+            for( int j = begin[1] ; j < end[1] ; ++j )
+                for( int i = begin[0] ; i < end[0] ; ++i ) {
+                    unsigned int cell = cellIndex( i , j , k );
+                    unsigned int cellBegin = _cellStart[cell] , cellEnd = _cellStart[cell+1];
+                    if( cellBegin == cellEnd ) continue;
+                    // nearest and farthest points of the cell
+                    int ijk[3] = { i , j , k };
+                    double nearest2 = 0.0 , farthest2 = 0.0;
+                    for( unsigned int axis = 0 ; axis < 3 ; ++axis ) {
+                        double low = _origin[axis] + ijk[axis] * _cellSize , high = low + _cellSize;
+                        double below = low - center[axis] , above = center[axis] - high;
+                        double nearest = std::max( std::max( below , above ) , 0.0 );
+                        double farthest = std::max( std::fabs( below ) , std::fabs( above ) );
+                        nearest2 += nearest * nearest;
+                        farthest2 += farthest * farthest;
+                    }
+                    if( nearest2 > outer2  ||  farthest2 <= inner2 ) continue;
+                    if( nearest2 > inner2  &&  farthest2 <= outer2 ) {
+                        for( unsigned int position = cellBegin ; position < cellEnd ; ++position ) f( _vertices[ position ] );
+                        continue;
+                    }
+                    for( unsigned int position = cellBegin ; position < cellEnd ; ++position ) {
+                        double distance2 = ( _positions[ position ] - center ).squareLength();
+                        if( distance2 > inner2  &&  distance2 <= outer2 ) f( _vertices[ position ] );
+                    }
+                }
+    }
+
+    template< class F >
+    void forEachVertexInBall( Vec3 const & center , double radius , F const & f ) const {
+        forEachVertexInShell( center , -1.0 , radius , f );
+    }
+};
+
+#endif // SpatialGrid_H
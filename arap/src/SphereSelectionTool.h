@@ -15,24 +15,39 @@ struct SphereSelectionTool
 
 	void initSphere(const Vec3& pCenter, const float &pRadius)
 	{
-		// init sphere with Vec3 center and radius
+		center = pCenter;
+		radius = pRadius;
 	}
 
 	void updateSphere(float pRadius)
 	{
-		// update radius 
+		radius = pRadius;
 	}
 
-	bool contains (const Vec3& p)
+	bool contains (const Vec3& p) const
 	{
-		// is point p in sphere (center_x, center_y, center_z), radius) ?
-		return false;
+		return (p - center).squareLength() <= (double)radius * (double)radius;
 	}
 
 
 	void draw() {
 	    if(!isActive) return;
-	    // draw Sphere
+
+		glDisable(GL_LIGHTING);
+		glEnable(GL_BLEND);
+		glLineWidth(1.0);
+		if(isAdding)
+			glColor4f(0.1, 0.1, 1.f , 0.5f); // adding -> blue
+		else
+			glColor4f(1.0, 0.1, 0.1 , 0.5f); // removing -> red
+
+		glPushMatrix();
+		glTranslatef(center[0], center[1], center[2]);
+		glutWireSphere(radius, 24, 16);
+		glPopMatrix();
+
+		glDisable(GL_BLEND);
+		glEnable(GL_LIGHTING);
 	}
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,21 @@
+#ifndef Timer_H
+#define Timer_H
+
+#include <chrono>
+
+// Wall-clock stopwatch, in milliseconds.
+struct Timer {
+    std::chrono::steady_clock::time_point start;
+
+    Timer() { restart(); }
+
+    void restart() {
+        start = std::chrono::steady_clock::now();
+    }
+
+    double elapsedMs() const {
+        return std::chrono::duration< double , std::milli >( std::chrono::steady_clock::now() - start ).count();
+    }
+};
+
+#endif // Timer_H
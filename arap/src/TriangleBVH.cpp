@@ -0,0 +1,380 @@
+#include "TriangleBVH.h"
+#include "Timer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+
+namespace {
+
+const unsigned int NumberOfBins = 16;
+const unsigned int MaxLeafSize = 4;
+// below this depth the splits are SAH, then median: the depth, and the traversal stack, stay under 64 + 32
+// (the medians halve less than 2^32 triangles)
+const unsigned int MaxSahDepth = 64;
+const unsigned int MaxStackSize = 128;
+static_assert( MaxSahDepth + 32 <= MaxStackSize , "the traversal stack must hold the deepest path of the tree" );
+// cost of visiting a node, relative to the intersection of a triangle
+const float TraversalCost = 1.f;
+
+float lowerFloat( double x ) {
+    float f = float( x );
+    return double( f ) > x ? std::nextafter( f , -std::numeric_limits< float >::infinity() ) : f;
+}
+float upperFloat( double x ) {
+    float f = float( x );
+    return double( f ) < x ? std::nextafter( f , std::numeric_limits< float >::infinity() ) : f;
+}
+
+struct Box {
+    Vec3 boxMin , boxMax;
+
+    Box() : boxMin( 1e300 , 1e300 , 1e300 ) , boxMax( -1e300 , -1e300 , -1e300 ) {}
+    void extend( Vec3 const & p ) {
+        for( unsigned int axis = 0 ; axis < 3 ; ++axis ) {
+            boxMin[axis] = std::min( boxMin[axis] , p[axis] );
+            boxMax[axis] = std::max( boxMax[axis] , p[axis] );
+        }
+    }
+    void extend( Vec3 const & otherMin , Vec3 const & otherMax ) {
+        for( unsigned int axis = 0 ; axis < 3 ; ++axis ) {
+            boxMin[axis] = std::min( boxMin[axis] , otherMin[axis] );
+            boxMax[axis] = std::max( boxMax[axis] , otherMax[axis] );
+        }
+    }
+    bool isEmpty() const { return boxMin[0] > boxMax[0]; }
+    double halfArea() const {
+        if( isEmpty() ) return 0.0;
+        Vec3 e = boxMax - boxMin;
+        return e[0] * e[1] + e[1] * e[2] + e[2] * e[0];
+    }
+};
+
+// box of floats, for the build , empty once cleared (not constructed: most bins of small nodes are not used)
+struct FloatBox {
+    float boxMin[3] , boxMax[3];
+
+    void clear() {
+        for( unsigned int axis = 0 ; axis < 3 ; ++axis ) {
+            boxMin[axis] = std::numeric_limits< float >::max();
+            boxMax[axis] = -std::numeric_limits< float >::max();
+        }
+    }
+    void extend( float const otherMin[3] , float const otherMax[3] ) {
+        for( unsigned int axis = 0 ; axis < 3 ; ++axis ) {
+            boxMin[axis] = std::min( boxMin[axis] , otherMin[axis] );
+            boxMax[axis] = std::max( boxMax[axis] , otherMax[axis] );
+        }
+    }
+    float halfArea() const {
+        if( boxMin[0] > boxMax[0] ) return 0.f;
+        float e0 = boxMax[0] - boxMin[0] , e1 = boxMax[1] - boxMin[1] , e2 = boxMax[2] - boxMin[2];
+        return e0 * e1 + e1 * e2 + e2 * e0;
+    }
+};
+
+}
+
+
+// triangles are moved with their box during the build, instead of being reached through an index
+struct TriangleBVH::BuildTriangle {
+    float boxMin[3] , boxMax[3];
+    unsigned int triangle;
+
+    float centroid( unsigned int axis ) const { return 0.5f * ( boxMin[axis] + boxMax[axis] ); }
+};
+
+
+void TriangleBVH::buildSubtree( std::vector< Node > & nodes , BuildTask root , BuildTriangle * buildTriangles ,
+                                unsigned int stopAtCount , std::vector< BuildTask > * pendingNodes ) {
+    std::vector< BuildTask > tasks( 1 , root );
+    while( ! tasks.empty() ) {
+        BuildTask task = tasks.back();
+        tasks.pop_back();
+        unsigned int first = nodes[ task.node ].first , count = nodes[ task.node ].count;
+        BuildTriangle * triangles = buildTriangles + first;
+
+        FloatBox box , centroidBox;
+        box.clear();
+        centroidBox.clear();
+        for( unsigned int i = 0 ; i < count ; ++i ) {
+            BuildTriangle const triangle = triangles[i];
+            float centroid[3] = { triangle.centroid(0) , triangle.centroid(1) , triangle.centroid(2) };
+            box.extend( triangle.boxMin , triangle.boxMax );
+            centroidBox.extend( centroid , centroid );
+        }
+        Node & node = nodes[ task.node ];
+        for( unsigned int axis = 0 ; axis < 3 ; ++axis ) {
+            node.boxMin[axis] = box.boxMin[axis];
+            node.boxMax[axis] = box.boxMax[axis];
+        }
+        if( pendingNodes  &&  count <= stopAtCount ) {
+            pendingNodes->push_back( task );
+            continue;
+        }
+        if( count <= 1 ) continue;
+
+        // binned SAH on the three axes , in one pass over the triangles , with no more bins than triangles
+        unsigned int splitAxis = 3 , splitBin = 0;
+        float splitCost = std::numeric_limits< float >::infinity();
+        unsigned int numberOfBins = std::min( NumberOfBins , count );
+        float offsets[3] , scales[3];
+        for( unsigned int axis = 0 ; axis < 3 ; ++axis ) {
+            float extent = centroidBox.boxMax[axis] - centroidBox.boxMin[axis];
+            offsets[axis] = centroidBox.boxMin[axis];
+            scales[axis] = extent > 0.f ? numberOfBins / extent : 0.f;
+        }
+        // captured by value: through references, every store to a bin would reload them (all floats may alias)
+        int lastBin = int( numberOfBins ) - 1;
+        auto binOf = [offsets , scales , lastBin]( BuildTriangle const & triangle , unsigned int axis ) {
+            return std::min( int( ( triangle.centroid( axis ) - offsets[axis] ) * scales[axis] ) , lastBin );
+        };
+        if( task.depth < MaxSahDepth ) {
+            FloatBox bins[3][ NumberOfBins ];
+            unsigned int binCounts[3][ NumberOfBins ];
+            for( unsigned int axis = 0 ; axis < 3 ; ++axis )
+                for( unsigned int b = 0 ; b < numberOfBins ; ++b ) {
+                    bins[axis][b].clear();
+                    binCounts[axis][b] = 0;
+                }
+            for( unsigned int i = 0 ; i < count ; ++i ) {
+                BuildTriangle const triangle = triangles[i];
+                for( unsigned int axis = 0 ; axis < 3 ; ++axis ) {
+                    unsigned int bin = binOf( triangle , axis );
+                    bins[axis][bin].extend( triangle.boxMin , triangle.boxMax );
+                    ++binCounts[axis][bin];
+                }
+            }
+            for( unsigned int axis = 0 ; axis < 3 ; ++axis ) {
+                if( scales[axis] == 0.f ) continue;
+                // areas and counts to the right of each plane, then sweep from the left
+                float rightAreas[ NumberOfBins ];
+                unsigned int rightCounts[ NumberOfBins ];
+                FloatBox right;
+                right.clear();
+                unsigned int rightCount = 0;
+                for( unsigned int b = numberOfBins - 1 ; b > 0 ; --b ) {
+                    right.extend( bins[axis][b].boxMin , bins[axis][b].boxMax );
+                    rightCount += binCounts[axis][b];
+                    rightAreas[b] = right.halfArea();
+                    rightCounts[b] = rightCount;
+                }
+                FloatBox left;
+                left.clear();
+                unsigned int leftCount = 0;
+                for( unsigned int b = 1 ; b < numberOfBins ; ++b ) {
+                    left.extend( bins[axis][b-1].boxMin , bins[axis][b-1].boxMax );
+                    leftCount += binCounts[axis][b-1];
+                    if( leftCount == 0  ||  rightCounts[b] == 0 ) continue;
+                    float cost = left.halfArea() * leftCount + rightAreas[b] * rightCounts[b];
+                    if( cost < splitCost ) {
+                        splitCost = cost;
+                        splitAxis = axis;
+                        splitBin = b;
+                    }
+                }
+            }
+        }
+
+        unsigned int leftCount;
+        if( splitAxis < 3 ) {
+            float leafCost = count , cost = TraversalCost + splitCost / box.halfArea();
+            if( count <= MaxLeafSize  &&  !( cost < leafCost ) ) continue;
+            BuildTriangle * middle = std::partition( triangles , triangles + count ,
+                                                     [&]( BuildTriangle const & triangle ) { return binOf( triangle , splitAxis ) < int( splitBin ); } );
+            leftCount = middle - triangles;
+        }
+        else {
+            if( count <= MaxLeafSize ) continue;
+            // too deep, or all the centroids at the same point: median on the largest extent
+            unsigned int axis = 0;
+            for( unsigned int a = 1 ; a < 3 ; ++a )
+                if( centroidBox.boxMax[a] - centroidBox.boxMin[a] > centroidBox.boxMax[axis] - centroidBox.boxMin[axis] ) axis = a;
+            leftCount = count / 2;
+            std::nth_element( triangles , triangles + leftCount , triangles + count ,
+                              [axis]( BuildTriangle const & a , BuildTriangle const & b ) { return a.centroid( axis ) < b.centroid( axis ); } );
+        }
+
+        unsigned int left = nodes.size();
+        Node child;
+        child.first = first;
+        child.count = leftCount;
+        nodes.push_back( child );
+        child.first = first + leftCount;
+        child.count = count - leftCount;
+        nodes.push_back( child );
+        nodes[ task.node ].first = left;
+        nodes[ task.node ].count = 0;
+        tasks.push_back( BuildTask{ left + 1 , task.depth + 1 } );
+        tasks.push_back( BuildTask{ left , task.depth + 1 } );
+    }
+}
+
+
+void TriangleBVH::build( Mesh const & mesh , ThreadPool * threadPool ) {
+    Timer timer;
+    unsigned int numberOfTriangles = mesh.T.size();
+    _numberOfTriangles = numberOfTriangles;
+    _nodes.clear();
+    _triangles.resize( numberOfTriangles );
+    if( numberOfTriangles == 0 ) { _lastBuildMs = timer.elapsedMs(); return; }
+
+    std::vector< BuildTriangle > buildTriangles( numberOfTriangles );
+    auto prepareTriangles = [&]( unsigned int begin , unsigned int end , unsigned int ) {
+        for( unsigned int t = begin ; t < end ; ++t ) {
+            Box box;
+            for( unsigned int c = 0 ; c < 3 ; ++c ) box.extend( mesh.V[ mesh.T[t][c] ].p );
+            for( unsigned int axis = 0 ; axis < 3 ; ++axis ) {
+                buildTriangles[t].boxMin[axis] = lowerFloat( box.boxMin[axis] );
+                buildTriangles[t].boxMax[axis] = upperFloat( box.boxMax[axis] );
+            }
+            buildTriangles[t].triangle = t;
+        }
+    };
+    unsigned int numberOfThreads = threadPool ? threadPool->numberOfThreads() : 1;
+    if( numberOfThreads > 1 ) threadPool->parallelForChunks( 0 , numberOfTriangles , prepareTriangles , 4096 );
+    else prepareTriangles( 0 , numberOfTriangles , 0 );
+
+    Node root;
+    root.first = 0;
+    root.count = numberOfTriangles;
+    _nodes.reserve( 2 * ( numberOfTriangles / MaxLeafSize + 1 ) );
+    _nodes.push_back( root );
+    if( numberOfThreads <= 1 ) buildSubtree( _nodes , BuildTask{ 0 , 0 } , &buildTriangles[0] , 0 , 0 );
+    else {
+        // top of the tree on this thread, down to about 4 subtrees per thread
+        std::vector< BuildTask > pendingNodes;
+        unsigned int stopAtCount = std::max( numberOfTriangles / ( 4 * numberOfThreads ) , 1024u );
+        buildSubtree( _nodes , BuildTask{ 0 , 0 } , &buildTriangles[0] , stopAtCount , &pendingNodes );
+
+        std::vector< std::vector< Node > > subtrees( pendingNodes.size() );
+        threadPool->parallelFor( 0 , pendingNodes.size() , [&]( unsigned int s ) {
+            subtrees[s].assign( 1 , _nodes[ pendingNodes[s].node ] );
+            buildSubtree( subtrees[s] , BuildTask{ 0 , pendingNodes[s].depth } , &buildTriangles[0] , 0 , 0 );
+        } , 1 );
+
+        // the root of a subtree replaces its pending node , the other nodes are appended: node i > 0 goes to base + i - 1
+        for( unsigned int s = 0 ; s < subtrees.size() ; ++s ) {
+            std::vector< Node > & subtree = subtrees[s];
+            unsigned int base = _nodes.size();
+            for( unsigned int i = 0 ; i < subtree.size() ; ++i )
+                if( subtree[i].count == 0 ) subtree[i].first += base - 1;
+            _nodes[ pendingNodes[s].node ] = subtree[0];
+            _nodes.insert( _nodes.end() , subtree.begin() + 1 , subtree.end() );
+        }
+    }
+    for( unsigned int i = 0 ; i < numberOfTriangles ; ++i ) _triangles[i] = buildTriangles[i].triangle;
+    _lastBuildMs = timer.elapsedMs();
+}
+
+
+void TriangleBVH::setLeafBox( Node & node , Mesh const & mesh ) const {
+    Box box;
+    for( unsigned int i = node.first ; i < node.first + node.count ; ++i ) {
+        MeshTriangle const & triangle = mesh.T[ _triangles[i] ];
+        for( unsigned int c = 0 ; c < 3 ; ++c ) box.extend( mesh.V[ triangle[c] ].p );
+    }
+    for( unsigned int axis = 0 ; axis < 3 ; ++axis ) {
+        node.boxMin[axis] = lowerFloat( box.boxMin[axis] );
+        node.boxMax[axis] = upperFloat( box.boxMax[axis] );
+    }
+}
+
+
+void TriangleBVH::refit( Mesh const & mesh , ThreadPool * threadPool ) {
+    Timer timer;
+    auto refitLeaves = [&]( unsigned int begin , unsigned int end , unsigned int ) {
+        for( unsigned int n = begin ; n < end ; ++n )
+            if( _nodes[n].count > 0 ) setLeafBox( _nodes[n] , mesh );
+    };
+    if( threadPool  &&  threadPool->numberOfThreads() > 1 ) threadPool->parallelForChunks( 0 , _nodes.size() , refitLeaves , 4096 );
+    else refitLeaves( 0 , _nodes.size() , 0 );
+
+    // the children of a node are after it
+    for( unsigned int n = _nodes.size() ; n-- > 0 ; ) {
+        Node & node = _nodes[n];
+        if( node.count > 0 ) continue;
+        Node const & left = _nodes[ node.first ];
+        Node const & right = _nodes[ node.first + 1 ];
+        for( unsigned int axis = 0 ; axis < 3 ; ++axis ) {
+            node.boxMin[axis] = std::min( left.boxMin[axis] , right.boxMin[axis] );
+            node.boxMax[axis] = std::max( left.boxMax[axis] , right.boxMax[axis] );
+        }
+    }
+    _lastRefitMs = timer.elapsedMs();
+}
+
+
+TriangleBVH::Hit TriangleBVH::intersect( Mesh const & mesh , Vec3 const & origin , Vec3 const & direction , double maxT ) const {
+    Hit hit;
+    if( _nodes.empty() ) return hit;
+    double inverseDirection[3];
+    for( unsigned int axis = 0 ; axis < 3 ; ++axis ) inverseDirection[axis] = 1.0 / direction[axis];   // +-inf on 0
+
+    // entry distance of the ray in the box of a node , +inf if missed or beyond the nearest hit
+    auto enter = [&]( Node const & node ) {
+        double tMin = 0.0 , tMax = maxT;
+        for( unsigned int axis = 0 ; axis < 3 ; ++axis ) {
+            double t0 = ( node.boxMin[axis] - origin[axis] ) * inverseDirection[axis];
+            double t1 = ( node.boxMax[axis] - origin[axis] ) * inverseDirection[axis];
+            if( t0 > t1 ) std::swap( t0 , t1 );
+            // NaN (0 * inf , the ray in the plane of a face) leaves the bounds as they are
+            tMin = t0 > tMin ? t0 : tMin;
+            tMax = t1 < tMax ? t1 : tMax;
+        }
+        return tMin <= tMax ? tMin : std::numeric_limits< double >::infinity();
+    };
+
+    unsigned int stack[ MaxStackSize ];
+    unsigned int stackSize = 0;
+    if( enter( _nodes[0] ) == std::numeric_limits< double >::infinity() ) return hit;
+    unsigned int current = 0;
+    for( ;; ) {
+        Node const & node = _nodes[ current ];
+        if( node.count > 0 ) {
+            // Moller-Trumbore
+            for( unsigned int i = node.first ; i < node.first + node.count ; ++i ) {
+                MeshTriangle const & triangle = mesh.T[ _triangles[i] ];
+                Vec3 const & p0 = mesh.V[ triangle[0] ].p;
+                Vec3 edge1 = mesh.V[ triangle[1] ].p - p0 , edge2 = mesh.V[ triangle[2] ].p - p0;
+                Vec3 p = Vec3::cross( direction , edge2 );
+                double determinant = Vec3::dot( edge1 , p );
+                if( determinant == 0.0 ) continue;
+                double inverseDeterminant = 1.0 / determinant;
+                Vec3 s = origin - p0;
+                double u = Vec3::dot( s , p ) * inverseDeterminant;
+                if( u < 0.0  ||  u > 1.0 ) continue;
+                Vec3 q = Vec3::cross( s , edge1 );
+                double v = Vec3::dot( direction , q ) * inverseDeterminant;
+                if( v < 0.0  ||  u + v > 1.0 ) continue;
+                double t = Vec3::dot( edge2 , q ) * inverseDeterminant;
+                if( t < 0.0  ||  t > maxT ) continue;
+                maxT = t;
+                hit.triangle = _triangles[i];
+                hit.t = t;
+                hit.u = u;
+                hit.v = v;
+            }
+        }
+        else {
+            // nearest child first , the other one on the stack
+            unsigned int near = node.first , far = node.first + 1;
+            double tNear = enter( _nodes[ near ] ) , tFar = enter( _nodes[ far ] );
+            if( tFar < tNear ) { std::swap( near , far ); std::swap( tNear , tFar ); }
+            if( tNear != std::numeric_limits< double >::infinity() ) {
+                // at most one node per level of the tree: see MaxStackSize
+                if( tFar != std::numeric_limits< double >::infinity() ) stack[ stackSize++ ] = far;
+                current = near;
+                continue;
+            }
+        }
+        // next node on the stack that the ray still reaches before the nearest hit
+        bool found = false;
+        while( stackSize > 0  &&  ! found ) {
+            current = stack[ --stackSize ];
+            found = enter( _nodes[ current ] ) != std::numeric_limits< double >::infinity();
+        }
+        if( ! found ) return hit;
+    }
+}
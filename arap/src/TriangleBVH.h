@@ -0,0 +1,73 @@
+#ifndef TriangleBVH_H
+#define TriangleBVH_H
+
+#include <vector>
+
+#include "Vec3.h"
+#include "Mesh.h"
+#include "ThreadPool.h"
+
+
+//-------------------------------------------------------------------------------------//
+//
+// Bounding volume hierarchy over the triangles of a mesh, for ray casting (picking).
+//   build(): binned SAH (16 bins per axis on the centroids), leaves of at most 4 triangles
+//   unless splitting does not pay. The top of the tree is split on the calling thread until
+//   there are a few subtrees per thread, which are then built in parallel and appended.
+//   refit(): recomputes the boxes for new positions of the vertices, with the same tree, in
+//   O(number of nodes): the children of a node are after it in the array. The tree gets worse
+//   as the mesh deforms far from the positions of the build, not wrong.
+//   intersect(): nearest hit, front to back traversal with a stack.
+//
+// Boxes are stored in float, rounded outwards.
+//
+//-------------------------------------------------------------------------------------//
+class TriangleBVH {
+public:
+    struct Hit {
+        int triangle;    // -1 : no hit
+        double t;        // position = origin + t direction
+        double u , v;    // barycentric coordinates of the corners 1 and 2 of the triangle
+
+        Hit() : triangle(-1) , t(0.0) , u(0.0) , v(0.0) {}
+    };
+
+private:
+    struct Node {
+        float boxMin[3] , boxMax[3];
+        unsigned int first;   // leaf: first of _triangles , inner node: left child (the right one follows)
+        unsigned int count;   // 0 for an inner node
+    };
+
+    std::vector< Node > _nodes;              // root first
+    std::vector< unsigned int > _triangles;  // triangles of the leaves
+    unsigned int _numberOfTriangles;
+    double _lastBuildMs , _lastRefitMs;
+
+    struct BuildTriangle;
+    struct BuildTask {
+        unsigned int node , depth;   // depth in the whole tree , also for the subtrees built apart
+    };
+    // splits nodes[ root.node ] (first , count set) , the nodes with at most stopAtCount triangles are left to pendingNodes if given
+    void buildSubtree( std::vector< Node > & nodes , BuildTask root , BuildTriangle * buildTriangles ,
+                       unsigned int stopAtCount , std::vector< BuildTask > * pendingNodes );
+    void setLeafBox( Node & node , Mesh const & mesh ) const;
+
+public:
+    TriangleBVH() : _numberOfTriangles(0) , _lastBuildMs(0.0) , _lastRefitMs(0.0) {}
+
+    bool isEmpty() const { return _nodes.empty(); }
+    // built for a mesh with this number of triangles (refit() needs the same triangles)
+    unsigned int numberOfTriangles() const { return _numberOfTriangles; }
+    unsigned int numberOfNodes() const { return _nodes.size(); }
+    double lastBuildMs() const { return _lastBuildMs; }
+    double lastRefitMs() const { return _lastRefitMs; }
+
+    void build( Mesh const & mesh , ThreadPool * threadPool = 0 );
+    void refit( Mesh const & mesh , ThreadPool * threadPool = 0 );
+
+    // nearest triangle of mesh hit by the ray , with t in [ 0 , maxT ]
+    Hit intersect( Mesh const & mesh , Vec3 const & origin , Vec3 const & direction , double maxT = 1e30 ) const;
+};
+
+#endif // TriangleBVH_H
@@ -0,0 +1,480 @@
+#ifndef laplacianSystem_H
+#define laplacianSystem_H
+
+
+
+#include "../extern/eigen3/Eigen/SparseCore"
+#include "../extern/eigen3/Eigen/SparseCholesky"
+#include "../extern/eigen3/Eigen/LU"
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <istream>
+#include <ostream>
+
+#include "LaplacianWeights.h"
+#include "ThreadPool.h"
+#include "Timer.h"
+
+
+//-------------------------------------------------------------------------------------//
+//
+// Square symmetric system  L_ff . X_f = B_f - L_fc . X_c  built from a weighted Laplacian,
+// where the constrained vertices (c) are eliminated from the unknowns (f).
+//   X has 3 columns (x,y,z), so that the three coordinates are solved with a single factorization.
+//
+// Compared to linearSystem (least squares on a rectangular 3E x 3V matrix), the factorized
+// matrix is only (nb of free vertices) x (nb of free vertices).
+//
+// Changing the constrained vertices does not require a new factorization: the factorization
+// of a "base" set of unknowns F0 is kept, and the vertices whose status changed since then
+// are added as a border (Schur complement):
+//   - a vertex freed since the base (R) becomes an extra unknown, with its Laplacian row,
+//   - a vertex constrained since the base (A) stays an unknown of the base, with an extra
+//     equation X_a = c_a (Lagrange multiplier).
+//   [ K   B ] [ X_F0 ]   [ r1 ]     K = L_F0F0 (factorized) , B = [ L_F0R  E_A ] , D = [ L_RR 0 ]
+//   [ B^T D ] [ X_2  ] = [ r2 ]                                                      [ 0    0 ]
+// With Z = K^-1 B and S = D - B^T Z (dense, border x border), a solve costs one solve with K
+// plus a small dense solve. Z is kept between updates for the vertices that stay in the border.
+// When the border gets too large, the system is factorized again with the current set as base.
+//
+// The factorization of the base ( P^T L D L^T P ) can be written to a stream and read back for the same
+// Laplacian and the same constrained vertices, instead of factorizing again (see ArapSolver's cache).
+//
+//-------------------------------------------------------------------------------------//
+class laplacianSystem {
+    Eigen::SparseMatrix<double> _L;                   // V x V
+
+    // current partition of the vertices
+    std::vector< int > _unknownOfVertex;              // -1 for constrained vertices
+    std::vector< unsigned int > _vertexOfUnknown;
+    std::vector< unsigned int > _constrainedVertices;
+
+    // partition of the factorization
+    std::vector< int > _baseUnknownOfVertex;
+    std::vector< unsigned int > _baseVertexOfUnknown;
+    Eigen::SparseMatrix<double> _factorL;              // unit lower triangular (the diagonal is not stored)
+    Eigen::VectorXd _inverseD;
+    Eigen::PermutationMatrix< Eigen::Dynamic , Eigen::Dynamic , int > _P , _Pinv;   // fill-reducing ordering
+    bool _baseIsFactorized;
+    double _factorizationMs , _solveMsPerColumn;     // of the base , used to choose between update and new factorization
+    double _lastAssemblyMs , _lastFactorizationMs;   // of the last preprocess() / updateConstrainedVertices()
+
+    // border : vertices freed since the base , then vertices constrained since the base
+    std::vector< unsigned int > _freedVertices , _fixedVertices;
+    std::vector< int > _borderColumnOfVertex;         // column of Z , -1 if not in the border
+    Eigen::SparseMatrix<double> _L_baseFreed , _L_freedBase;
+    Eigen::MatrixXd _Z;
+    Eigen::PartialPivLU< Eigen::MatrixXd > _schurComplement;
+    bool _lastUpdateWasIncremental;
+
+    Eigen::MatrixXd _b , _bConstraints , _fixedPositions;
+    Eigen::MatrixXd _Xc , _LXc , _baseSolution , _permutedSolution , _borderRhs , _borderSolution;   // work buffers
+
+    // x = K^-1 x , with work of the same size as x
+    void solveBase( Eigen::MatrixXd & x , Eigen::MatrixXd & work ) const {
+        work = _P * x;
+        _factorL.triangularView< Eigen::UnitLower >().solveInPlace( work );
+        for( unsigned int c = 0 ; c < work.cols() ; ++c )
+            work.col(c).array() *= _inverseD.array();
+        _factorL.transpose().triangularView< Eigen::UnitUpper >().solveInPlace( work );
+        x = _Pinv * work;
+    }
+
+    void resizeBuffers() {
+        unsigned int nV = _unknownOfVertex.size() , nf = _vertexOfUnknown.size();
+        unsigned int nBorder = _freedVertices.size() + _fixedVertices.size();
+        _b.setZero( nf , 3 );
+        _bConstraints.setZero( nf , 3 );
+        _fixedPositions.setZero( _fixedVertices.size() , 3 );
+        _Xc.setZero( nV , 3 );
+        _LXc.setZero( nV , 3 );
+        _baseSolution.setZero( _baseVertexOfUnknown.size() , 3 );
+        _permutedSolution.setZero( _baseVertexOfUnknown.size() , 3 );
+        _borderRhs.setZero( nBorder , 3 );
+        _borderSolution.setZero( nBorder , 3 );
+    }
+
+    // The current partition becomes the base, without any border.
+    void resetBase() {
+        _baseUnknownOfVertex = _unknownOfVertex;
+        _baseVertexOfUnknown = _vertexOfUnknown;
+        _baseIsFactorized = false;
+        _freedVertices.clear();
+        _fixedVertices.clear();
+        std::fill( _borderColumnOfVertex.begin() , _borderColumnOfVertex.end() , -1 );
+        _Z.resize( _vertexOfUnknown.size() , 0 );
+        _lastUpdateWasIncremental = false;
+        resizeBuffers();
+    }
+
+    // x = K^-1 x for one right-hand side per coordinate, to measure the cost of a column
+    void measureSolve() {
+        Timer timer;
+        solveBase( _baseSolution , _permutedSolution );
+        _solveMsPerColumn = timer.elapsedMs() / 3.0;
+    }
+
+    // The current partition becomes the base, factorized.
+    void factorizeBase() {
+        Timer timer;
+        _lastAssemblyMs = _lastFactorizationMs = 0.0;
+        resetBase();
+        // without any constraint, the Laplacian is singular
+        if( _constrainedVertices.empty() || _vertexOfUnknown.empty() ) return;
+
+        unsigned int nf = _vertexOfUnknown.size();
+        std::vector< Eigen::Triplet< double > > tripletsFF;
+        for( unsigned int r = 0 ; r < nf ; ++r )
+            for( Eigen::SparseMatrix<double>::InnerIterator it( _L , _vertexOfUnknown[r] ) ; it ; ++it )
+                if( _unknownOfVertex[ it.row() ] >= 0 )
+                    tripletsFF.push_back( Eigen::Triplet< double >( _unknownOfVertex[ it.row() ] , r , it.value() ) );
+        Eigen::SparseMatrix<double> Lff( nf , nf );
+        Lff.setFromTriplets( tripletsFF.begin() , tripletsFF.end() );
+        _lastAssemblyMs = timer.elapsedMs();
+
+        Timer factorizationTimer;
+        Eigen::SimplicialLDLT< Eigen::SparseMatrix<double> > choleskyDecomposition;
+        choleskyDecomposition.analyzePattern(Lff);
+        choleskyDecomposition.factorize(Lff);
+        if( choleskyDecomposition.info() != Eigen::Success ) return;
+        _factorL = choleskyDecomposition.matrixL().nestedExpression();
+        _inverseD = choleskyDecomposition.vectorD().cwiseInverse();
+        _P = choleskyDecomposition.permutationP();
+        _Pinv = choleskyDecomposition.permutationPinv();
+        _baseIsFactorized = true;
+        _lastFactorizationMs = factorizationTimer.elapsedMs();
+        _factorizationMs = timer.elapsedMs();
+
+        measureSolve();
+    }
+
+    // Border of the current partition with respect to the base. Z is only computed for the vertices
+    // that were not already in the border, the other columns are copied.
+    void updateBorder( ThreadPool * threadPool ) {
+        std::vector< unsigned int > freedVertices , fixedVertices;
+        for( unsigned int v = 0 ; v < _unknownOfVertex.size() ; ++v ) {
+            if( _baseUnknownOfVertex[v] < 0  &&  _unknownOfVertex[v] >= 0 ) freedVertices.push_back(v);
+            if( _baseUnknownOfVertex[v] >= 0  &&  _unknownOfVertex[v] < 0 ) fixedVertices.push_back(v);
+        }
+        unsigned int nf0 = _baseVertexOfUnknown.size() , nR = freedVertices.size() , nBorder = nR + fixedVertices.size();
+
+        // B = [ L_F0R  E_A ] , and the rows L_RF0
+        std::vector< Eigen::Triplet< double > > tripletsBR , tripletsRB;
+        for( unsigned int k = 0 ; k < nR ; ++k )
+            for( Eigen::SparseMatrix<double>::InnerIterator it( _L , freedVertices[k] ) ; it ; ++it )
+                if( _baseUnknownOfVertex[ it.row() ] >= 0 ) {
+                    tripletsBR.push_back( Eigen::Triplet< double >( _baseUnknownOfVertex[ it.row() ] , k , it.value() ) );
+                    tripletsRB.push_back( Eigen::Triplet< double >( k , _baseUnknownOfVertex[ it.row() ] , it.value() ) );
+                }
+        _L_baseFreed.resize( nf0 , nR );
+        _L_baseFreed.setFromTriplets( tripletsBR.begin() , tripletsBR.end() );
+        _L_freedBase.resize( nR , nf0 );
+        _L_freedBase.setFromTriplets( tripletsRB.begin() , tripletsRB.end() );
+
+        std::vector< unsigned int > borderVertices( freedVertices );
+        borderVertices.insert( borderVertices.end() , fixedVertices.begin() , fixedVertices.end() );
+        Eigen::MatrixXd Z( nf0 , nBorder );
+        std::vector< unsigned int > newColumns;
+        for( unsigned int k = 0 ; k < nBorder ; ++k ) {
+            int oldColumn = _borderColumnOfVertex[ borderVertices[k] ];
+            if( oldColumn >= 0 ) Z.col(k) = _Z.col(oldColumn);
+            else newColumns.push_back(k);
+        }
+        for( unsigned int i = 0 ; i < newColumns.size() ; ++i ) {
+            unsigned int k = newColumns[i];
+            if( k < nR ) Z.col(k) = _L_baseFreed.col(k);
+            else {
+                Z.col(k).setZero();
+                Z( _baseUnknownOfVertex[ borderVertices[k] ] , k ) = 1.0;
+            }
+        }
+        ThreadPool sequential(1);
+        ThreadPool & pool = threadPool ? *threadPool : sequential;
+        pool.parallelForChunks( 0 , newColumns.size() , [&]( unsigned int begin , unsigned int end , unsigned int ) {
+            Eigen::MatrixXd columns( nf0 , end - begin ) , work;
+            for( unsigned int i = begin ; i < end ; ++i ) columns.col(i - begin) = Z.col( newColumns[i] );
+            solveBase( columns , work );
+            for( unsigned int i = begin ; i < end ; ++i ) Z.col( newColumns[i] ) = columns.col(i - begin);
+        } );
+
+        for( unsigned int k = 0 ; k < _freedVertices.size() ; ++k ) _borderColumnOfVertex[ _freedVertices[k] ] = -1;
+        for( unsigned int k = 0 ; k < _fixedVertices.size() ; ++k ) _borderColumnOfVertex[ _fixedVertices[k] ] = -1;
+        for( unsigned int k = 0 ; k < nBorder ; ++k ) _borderColumnOfVertex[ borderVertices[k] ] = k;
+        _freedVertices.swap( freedVertices );
+        _fixedVertices.swap( fixedVertices );
+        _Z.swap( Z );
+
+        // S = D - B^T Z
+        Eigen::MatrixXd S( nBorder , nBorder );
+        S.topRows( nR ) = - ( _L_freedBase * _Z );
+        for( unsigned int k = nR ; k < nBorder ; ++k )
+            S.row(k) = - _Z.row( _baseUnknownOfVertex[ borderVertices[k] ] );
+        for( unsigned int i = 0 ; i < nR ; ++i )
+            for( unsigned int j = 0 ; j < nR ; ++j )
+                S(i,j) += _L.coeff( _freedVertices[i] , _freedVertices[j] );
+        if( nBorder > 0 ) _schurComplement.compute( S );
+
+        resizeBuffers();
+    }
+
+    unsigned int numberOfVerticesChangedSinceBase( std::vector< bool > const & isConstrained , unsigned int & numberOfNewBorderVertices ) const {
+        unsigned int changed = 0;
+        numberOfNewBorderVertices = 0;
+        for( unsigned int v = 0 ; v < isConstrained.size() ; ++v )
+            if( isConstrained[v] != ( _baseUnknownOfVertex[v] < 0 ) ) {
+                ++changed;
+                if( _borderColumnOfVertex[v] < 0 ) ++numberOfNewBorderVertices;
+            }
+        return changed;
+    }
+
+public:
+    laplacianSystem() : _baseIsFactorized(false) , _factorizationMs(0.0) , _solveMsPerColumn(0.0) ,
+        _lastAssemblyMs(0.0) , _lastFactorizationMs(0.0) , _lastUpdateWasIncremental(false) {}
+    ~laplacianSystem() {}
+
+    void setConstrainedVertices( std::vector< bool > const & isConstrained ) {
+        _unknownOfVertex.resize( isConstrained.size() );
+        _vertexOfUnknown.clear();
+        _constrainedVertices.clear();
+        for( unsigned int v = 0 ; v < isConstrained.size() ; ++v ) {
+            if( isConstrained[v] ) {
+                _unknownOfVertex[v] = -1;
+                _constrainedVertices.push_back(v);
+            }
+            else {
+                _unknownOfVertex[v] = _vertexOfUnknown.size();
+                _vertexOfUnknown.push_back(v);
+            }
+        }
+    }
+
+    unsigned int numberOfUnknowns() const { return _vertexOfUnknown.size(); }
+    unsigned int numberOfConstraints() const { return _constrainedVertices.size(); }
+    unsigned int vertexOfUnknown( unsigned int row ) const { return _vertexOfUnknown[row]; }
+    int unknownOfVertex( unsigned int v ) const { return _unknownOfVertex[v]; }
+    Eigen::SparseMatrix<double> const & laplacian() const { return _L; }   // V x V , all the vertices
+
+    // L_ii = sum_j w_ij  ,  L_ij = -w_ij , then factorization for the vertices given to setConstrainedVertices()
+    void preprocess( LaplacianWeights const & weights ) {
+        Timer timer;
+        unsigned int nV = weights.get_n_vertices();
+        std::vector< Eigen::Triplet< double > > triplets;
+        for( unsigned int v = 0 ; v < nV ; ++v ) {
+            ConstArraySpan< unsigned int > neighbors = weights.get_adjacent_vertices(v);
+            ConstArraySpan< double > neighborWeights = weights.get_weight_of_adjacent_edges(v);
+            double diagonal = 0.0;
+            for( unsigned int k = 0 ; k < neighbors.size() ; ++k ) {
+                diagonal += neighborWeights[k];
+                triplets.push_back( Eigen::Triplet< double >( neighbors[k] , v , - neighborWeights[k] ) );
+            }
+            triplets.push_back( Eigen::Triplet< double >( v , v , diagonal ) );
+        }
+        _L.resize( nV , nV );
+        _L.setFromTriplets( triplets.begin() , triplets.end() );
+        _borderColumnOfVertex.assign( nV , -1 );
+        double laplacianAssemblyMs = timer.elapsedMs();
+
+        factorizeBase();
+        _lastAssemblyMs += laplacianAssemblyMs;
+    }
+
+    // Whether updateConstrainedVertices( isConstrained ) would update the border instead of factorizing again:
+    // the solves for the new border columns are compared to the time of the last factorization, and the border
+    // is bounded so that it costs less than the factor at each solve.
+    bool updateWouldBeIncremental( std::vector< bool > const & isConstrained , unsigned int numberOfThreads ) const {
+        if( ! _baseIsFactorized ) return false;
+        unsigned int numberOfConstrained = std::count( isConstrained.begin() , isConstrained.end() , true );
+        if( numberOfConstrained == 0  ||  numberOfConstrained == isConstrained.size() ) return false;
+        unsigned int numberOfNewBorderVertices = 0;
+        unsigned int borderSize = numberOfVerticesChangedSinceBase( isConstrained , numberOfNewBorderVertices );
+        double incrementalMs = numberOfNewBorderVertices * _solveMsPerColumn / std::max( numberOfThreads , 1u );
+        unsigned int maximumBorderSize = 32 + 2 * factorNonZeros() / std::max( 1u , (unsigned int)_baseVertexOfUnknown.size() );
+        return borderSize <= maximumBorderSize  &&  incrementalMs < _factorizationMs;
+    }
+
+    // New constrained vertices, applied to the existing factorization when it is cheaper than a new one
+    // (see updateWouldBeIncremental() , the border columns are solved on threadPool if given).
+    // preprocess() must have been called once before.
+    void updateConstrainedVertices( std::vector< bool > const & isConstrained , ThreadPool * threadPool = 0 ) {
+        bool incremental = updateWouldBeIncremental( isConstrained , threadPool ? threadPool->numberOfThreads() : 1 );
+        setConstrainedVertices( isConstrained );
+        if( incremental ) {
+            Timer timer;
+            updateBorder( threadPool );
+            _lastUpdateWasIncremental = true;
+            _lastAssemblyMs = 0.0;
+            _lastFactorizationMs = timer.elapsedMs();
+        }
+        else
+            factorizeBase();
+    }
+
+    bool isValid() const {
+        return _vertexOfUnknown.size() > 0  &&  _baseIsFactorized;
+    }
+
+    unsigned int factorNonZeros() const {
+        return _baseIsFactorized ? _factorL.nonZeros() : 0;
+    }
+
+    // Factorization of the base: its size , the time it took , P , D^-1 and L (compressed columns), in binary.
+    // Only when the current partition is the base ( borderSize() == 0 ).
+    bool writeBaseFactorization( std::ostream & out ) const {
+        if( ! _baseIsFactorized  ||  borderSize() > 0 ) return false;
+        unsigned int n = _factorL.cols() , nonZeros = _factorL.nonZeros();
+        out.write( reinterpret_cast< char const * >( &n ) , sizeof( n ) );
+        out.write( reinterpret_cast< char const * >( &nonZeros ) , sizeof( nonZeros ) );
+        out.write( reinterpret_cast< char const * >( &_factorizationMs ) , sizeof( _factorizationMs ) );
+        out.write( reinterpret_cast< char const * >( _P.indices().data() ) , sizeof( int ) * n );
+        out.write( reinterpret_cast< char const * >( _inverseD.data() ) , sizeof( double ) * n );
+        out.write( reinterpret_cast< char const * >( _factorL.outerIndexPtr() ) , sizeof( int ) * ( n + 1 ) );
+        out.write( reinterpret_cast< char const * >( _factorL.innerIndexPtr() ) , sizeof( int ) * nonZeros );
+        out.write( reinterpret_cast< char const * >( _factorL.valuePtr() ) , sizeof( double ) * nonZeros );
+        return bool( out );
+    }
+
+    // The current partition (setConstrainedVertices()) becomes the base, with the factorization written by
+    // writeBaseFactorization() for the same Laplacian and the same constrained vertices. false if it does not fit.
+    bool readBaseFactorization( std::istream & in ) {
+        Timer timer;
+        unsigned int n = 0 , nonZeros = 0;
+        double factorizationMs = 0.0;
+        in.read( reinterpret_cast< char * >( &n ) , sizeof( n ) );
+        in.read( reinterpret_cast< char * >( &nonZeros ) , sizeof( nonZeros ) );
+        in.read( reinterpret_cast< char * >( &factorizationMs ) , sizeof( factorizationMs ) );
+        if( !in  ||  n != _vertexOfUnknown.size()  ||  n == 0  ||  _constrainedVertices.empty() ) return false;
+        // the rest of the file is exactly the factorization, before anything is allocated
+        std::streampos contentBegin = in.tellg();
+        in.seekg( 0 , std::ios::end );
+        unsigned long long contentBytes = (unsigned long long)( in.tellg() - contentBegin );
+        in.seekg( contentBegin );
+        if( !in  ||  contentBytes != ( sizeof( int ) + sizeof( double ) ) * (unsigned long long)( n + nonZeros ) + sizeof( int ) * ( n + 1ull ) ) return false;
+
+        Eigen::PermutationMatrix< Eigen::Dynamic , Eigen::Dynamic , int > P( n );
+        Eigen::VectorXd inverseD( n );
+        Eigen::SparseMatrix<double> factorL( n , n );
+        factorL.resizeNonZeros( nonZeros );
+        in.read( reinterpret_cast< char * >( P.indices().data() ) , sizeof( int ) * n );
+        in.read( reinterpret_cast< char * >( inverseD.data() ) , sizeof( double ) * n );
+        in.read( reinterpret_cast< char * >( factorL.outerIndexPtr() ) , sizeof( int ) * ( n + 1 ) );
+        in.read( reinterpret_cast< char * >( factorL.innerIndexPtr() ) , sizeof( int ) * nonZeros );
+        in.read( reinterpret_cast< char * >( factorL.valuePtr() ) , sizeof( double ) * nonZeros );
+        if( !in  ||  ! isValidFactorization( P , inverseD , factorL ) ) return false;
+
+        resetBase();
+        _factorL.swap( factorL );
+        _inverseD.swap( inverseD );
+        _P = P;
+        _Pinv = P.inverse();
+        _baseIsFactorized = true;
+        _factorizationMs = factorizationMs;   // of the factorization that was cached, to choose between update and new factorization
+        _lastAssemblyMs = 0.0;
+        _lastFactorizationMs = timer.elapsedMs();
+        measureSolve();
+        return true;
+    }
+
+    // What readBaseFactorization() checks before using a file: P is a permutation , D^-1 is finite and not 0 ,
+    // the columns of L are sorted, strictly below the diagonal, with finite values.
+    static bool isValidFactorization( Eigen::PermutationMatrix< Eigen::Dynamic , Eigen::Dynamic , int > const & P ,
+                                      Eigen::VectorXd const & inverseD , Eigen::SparseMatrix<double> const & factorL ) {
+        int n = factorL.cols();
+        std::vector< bool > isUsed( n , false );
+        for( int i = 0 ; i < n ; ++i ) {
+            int k = P.indices()[i];
+            if( k < 0  ||  k >= n  ||  isUsed[k] ) return false;
+            isUsed[k] = true;
+            if( ! std::isfinite( inverseD[i] )  ||  inverseD[i] == 0.0 ) return false;
+        }
+        int const * outer = factorL.outerIndexPtr();
+        int const * inner = factorL.innerIndexPtr();
+        double const * values = factorL.valuePtr();
+        if( outer[0] != 0  ||  outer[n] != factorL.nonZeros() ) return false;
+        for( int column = 0 ; column < n ; ++column )
+            if( outer[column+1] < outer[column] ) return false;
+        for( int column = 0 ; column < n ; ++column ) {
+            for( int k = outer[column] ; k < outer[column+1] ; ++k ) {
+                if( inner[k] <= ( k == outer[column] ? column : inner[k-1] )  ||  inner[k] >= n ) return false;
+                if( ! std::isfinite( values[k] ) ) return false;
+            }
+        }
+        return true;
+    }
+
+    // x = L_ff^-1 x , for any number of columns (several poses at once), rows in the order of vertexOfUnknown().
+    // Only for a system without border ( borderSize() == 0 , e.g. after preprocess() ). work is resized to the size of x.
+    void solveFactorized( Eigen::MatrixXd & x , Eigen::MatrixXd & work ) const {
+        work.resize( x.rows() , x.cols() );
+        solveBase( x , work );
+    }
+
+    bool lastUpdateWasIncremental() const { return _lastUpdateWasIncremental; }
+    double lastAssemblyMs() const { return _lastAssemblyMs; }
+    double lastFactorizationMs() const { return _lastFactorizationMs; }     // or of the border update
+    unsigned int borderSize() const { return _freedVertices.size() + _fixedVertices.size(); }
+
+    // Positions of the constrained vertices, to be set each time they move (not at each ARAP iteration).
+    // The vertices constrained in the base are eliminated (b_f - L_fc X_c), the other ones are in the border.
+    template< class vertex_t >
+    void setConstrainedPositions( std::vector< vertex_t > const & vertices ) {
+        _Xc.setZero();
+        for( unsigned int c = 0 ; c < _constrainedVertices.size() ; ++c ) {
+            unsigned int v = _constrainedVertices[c];
+            if( _baseUnknownOfVertex[v] < 0 )
+                for( unsigned int coord = 0 ; coord < 3 ; ++coord )
+                    _Xc(v,coord) = vertices[v][coord];
+        }
+        _LXc.noalias() = _L * _Xc;
+        for( unsigned int r = 0 ; r < _vertexOfUnknown.size() ; ++r )
+            _bConstraints.row(r) = - _LXc.row( _vertexOfUnknown[r] );
+        for( unsigned int k = 0 ; k < _fixedVertices.size() ; ++k )
+            for( unsigned int coord = 0 ; coord < 3 ; ++coord )
+                _fixedPositions(k,coord) = vertices[ _fixedVertices[k] ][coord];
+    }
+
+    // row r of b corresponds to the vertex vertexOfUnknown(r)
+    double & b( unsigned int row , unsigned int coord ) {
+        return _b( row , coord );
+    }
+
+    // P^T L D L^T P is applied by hand rather than with SimplicialLDLT::solve(), whose final in-place
+    // permutation allocates: with X already of the right size, the solve does not allocate.
+    void solve( Eigen::MatrixXd & X ) {
+        X.resize( _b.rows() , 3 );
+        unsigned int nR = _freedVertices.size() , nBorder = nR + _fixedVertices.size();
+
+        // r1 , with 0 on the rows of the vertices constrained since the base (their multiplier takes the residual)
+        for( unsigned int i = 0 ; i < _baseVertexOfUnknown.size() ; ++i ) {
+            int r = _unknownOfVertex[ _baseVertexOfUnknown[i] ];
+            if( r >= 0 ) _baseSolution.row(i) = _b.row(r) + _bConstraints.row(r);
+            else _baseSolution.row(i).setZero();
+        }
+        solveBase( _baseSolution , _permutedSolution );
+
+        if( nBorder > 0 ) {
+            // X_2 = S^-1 ( r2 - B^T K^-1 r1 ) , X_F0 = K^-1 r1 - Z X_2
+            for( unsigned int k = 0 ; k < nR ; ++k ) {
+                int r = _unknownOfVertex[ _freedVertices[k] ];
+                _borderRhs.row(k) = _b.row(r) + _bConstraints.row(r);
+            }
+            _borderRhs.topRows( nR ).noalias() -= _L_freedBase * _baseSolution;
+            for( unsigned int k = nR ; k < nBorder ; ++k )
+                _borderRhs.row(k) = _fixedPositions.row(k - nR) - _baseSolution.row( _baseUnknownOfVertex[ _fixedVertices[k - nR] ] );
+            _borderSolution = _schurComplement.solve( _borderRhs );
+            for( unsigned int k = 0 ; k < nBorder ; ++k )
+                for( unsigned int coord = 0 ; coord < 3 ; ++coord )
+                    _baseSolution.col(coord) -= _borderSolution(k,coord) * _Z.col(k);
+        }
+
+        for( unsigned int r = 0 ; r < _vertexOfUnknown.size() ; ++r ) {
+            unsigned int v = _vertexOfUnknown[r];
+            if( _baseUnknownOfVertex[v] >= 0 ) X.row(r) = _baseSolution.row( _baseUnknownOfVertex[v] );
+            else X.row(r) = _borderSolution.row( _borderColumnOfVertex[v] );
+        }
+    }
+};
+
+#endif // laplacianSystem_H
@@ -5,69 +5,592 @@
 
 #include "../extern/eigen3/Eigen/SparseCore"
 #include "../extern/eigen3/Eigen/SparseCholesky"
+#include "../extern/eigen3/Eigen/SparseLU"
+#include "../extern/eigen3/Eigen/OrderingMethods"
+#include "../extern/eigen3/Eigen/IterativeLinearSolvers"
 
 #include <vector>
-#include <map>
+#include <memory>
+#include <algorithm>
+#include <cmath>
 
+#include "Timer.h"
+#include "ThreadPool.h"
 
+
+// Solvers of the least squares system min | A X - b |^2 (see linearSystem::setSolver()).
+enum LinearSolver {
+    LinearSolver_SimplicialLLT ,       // A^T A = L L^T
+    LinearSolver_SimplicialLDLT ,      // A^T A = L D L^T , the default
+    LinearSolver_SupernodalLU ,        // supernodal LU of A^T A (Eigen::SparseLU): dense kernels on the blocks of columns with the same pattern
+    LinearSolver_ConjugateGradient ,   // conjugate gradient on A^T A , Jacobi preconditioner , started from the previous solution
+    LinearSolver_LeastSquaresCG ,      // conjugate gradient on the rectangular A (CGLS, A^T A is never formed) , Jacobi preconditioner ,
+                                       // started from the previous solution
+    NumberOfLinearSolvers
+};
+
+// Fill-reducing ordering of the columns, for the direct solvers (the iterative ones ignore it).
+enum LinearSolverOrdering {
+    LinearSolverOrdering_AMD ,
+    LinearSolverOrdering_COLAMD ,
+    LinearSolverOrdering_Natural ,
+    NumberOfLinearSolverOrderings
+};
+
+inline char const * linearSolverName( LinearSolver solver ) {
+    static char const * const names[ NumberOfLinearSolvers ] = { "llt" , "ldlt" , "supernodalLU" , "cg" , "lscg" };
+    return names[ solver ];
+}
+
+inline char const * linearSolverOrderingName( LinearSolverOrdering ordering ) {
+    static char const * const names[ NumberOfLinearSolverOrderings ] = { "amd" , "colamd" , "natural" };
+    return names[ ordering ];
+}
+
+inline bool linearSolverIsIterative( LinearSolver solver ) {
+    return solver == LinearSolver_ConjugateGradient  ||  solver == LinearSolver_LeastSquaresCG;
+}
+
+
+// Compressed sparse rows: the storage of A and A^T in linearSystem.
+typedef Eigen::SparseMatrix< double , Eigen::RowMajor > csrMatrix;
+
+// y = M x , the rows of M shared between the threads of threadPool (all in the calling thread when it is null).
+// y must not be x.
+inline void multiplyCSR( csrMatrix const & M , Eigen::VectorXd const & x , Eigen::VectorXd & y , ThreadPool * threadPool = 0 ) {
+    static const unsigned int RowsPerChunk = 2048;
+    y.resize( M.rows() );
+    int const * rowStart = M.outerIndexPtr();
+    int const * columns = M.innerIndexPtr();
+    double const * values = M.valuePtr();
+    auto multiplyRows = [&]( unsigned int begin , unsigned int end , unsigned int ) {
+        for( unsigned int r = begin ; r < end ; ++r ) {
+            double sum = 0.0;
+            for( int k = rowStart[r] ; k < rowStart[r+1] ; ++k )
+                sum += values[k] * x[ columns[k] ];
+            y[r] = sum;
+        }
+    };
+    if( threadPool  &&  threadPool->numberOfThreads() > 1  &&  M.rows() > int( RowsPerChunk ) )
+        threadPool->parallelForChunks( 0 , M.rows() , multiplyRows , RowsPerChunk );
+    else
+        multiplyRows( 0 , M.rows() , 0 );
+}
+
+
+
+// One way of solving A^T A X = A^T b , given A and A^T (kept by the linearSystem until its next preprocess()).
+class linearSystemSolver {
+public:
+    virtual ~linearSystemSolver() {}
+    // patternIsUnchanged : A has the same sparsity pattern as at the previous call, whose symbolic analysis is reused.
+    // false if the factorization failed
+    virtual bool factorize( csrMatrix const & A , csrMatrix const & At , bool patternIsUnchanged ) = 0;
+    virtual void solve( csrMatrix const & A , csrMatrix const & At , Eigen::VectorXd const & b , Eigen::VectorXd & X , ThreadPool * threadPool ) = 0;
+    // held by the solver besides A and A^T: factor , or A^T A and the preconditioner
+    virtual unsigned long long memoryBytes() const = 0;
+    virtual unsigned int lastIterations() const { return 0; }
+};
+
+
+template< class decomposition_t >
+inline unsigned long long factorMemoryBytes( decomposition_t const & decomposition ) {
+    // simplicial factorizations: L , compressed column
+    return decomposition.matrixL().nestedExpression().nonZeros() * ( sizeof( double ) + sizeof( int ) ) +
+           ( decomposition.cols() + 1 ) * sizeof( int ) + decomposition.cols() * sizeof( double );
+}
+
+template< class matrix_t , class ordering_t >
+inline unsigned long long factorMemoryBytes( Eigen::SparseLU< matrix_t , ordering_t > const & decomposition ) {
+    // L stored by supernodes (dense blocks , one row index per row of a block) , U compressed column
+    int columns = decomposition.cols();
+    if( columns == 0 ) return 0;
+    Eigen::SparseLUMatrixUReturnType< typename Eigen::SparseLU< matrix_t , ordering_t >::SCMatrix ,
+                                      Eigen::MappedSparseMatrix< double , Eigen::ColMajor , int > > factors = decomposition.matrixU();
+    return factors.m_mapL.colIndexPtr()[ columns ] * sizeof( double ) + factors.m_mapL.rowIndexPtr()[ columns ] * sizeof( int ) +
+           factors.m_mapU.nonZeros() * ( sizeof( double ) + sizeof( int ) ) + 3 * ( columns + 1 ) * sizeof( int );
+}
+
+// X = decomposition^-1 b , work of the size of b , inverseD: see factorInverseDiagonal()
+template< class decomposition_t >
+inline void solveWithFactor( decomposition_t const & decomposition , Eigen::VectorXd const & , Eigen::VectorXd const & b ,
+                             Eigen::VectorXd & X , Eigen::VectorXd & ) {
+    X = decomposition.solve( b );
+}
+
+// P^T L D L^T P (and P^T L L^T P) applied by hand, as in laplacianSystem.h: the final in-place permutation
+// of SimplicialLDLT::solve() allocates, these out-of-place ones do not when X and work have the right size.
+template< class matrix_t , class ordering_t >
+inline void solveWithFactor( Eigen::SimplicialLDLT< matrix_t , Eigen::Lower , ordering_t > const & decomposition , Eigen::VectorXd const & inverseD ,
+                             Eigen::VectorXd const & b , Eigen::VectorXd & X , Eigen::VectorXd & work ) {
+    if( decomposition.permutationP().size() > 0 ) work = decomposition.permutationP() * b;
+    else work = b;
+    decomposition.matrixL().solveInPlace( work );
+    work.array() *= inverseD.array();
+    decomposition.matrixU().solveInPlace( work );
+    if( decomposition.permutationPinv().size() > 0 ) X = decomposition.permutationPinv() * work;
+    else X = work;
+}
+
+template< class matrix_t , class ordering_t >
+inline void solveWithFactor( Eigen::SimplicialLLT< matrix_t , Eigen::Lower , ordering_t > const & decomposition , Eigen::VectorXd const & ,
+                             Eigen::VectorXd const & b , Eigen::VectorXd & X , Eigen::VectorXd & work ) {
+    if( decomposition.permutationP().size() > 0 ) work = decomposition.permutationP() * b;
+    else work = b;
+    decomposition.matrixL().solveInPlace( work );
+    decomposition.matrixU().solveInPlace( work );
+    if( decomposition.permutationPinv().size() > 0 ) X = decomposition.permutationPinv() * work;
+    else X = work;
+}
+
+// D^-1 of an LDLT factorization (vectorD() returns a copy), empty for the other ones
+template< class decomposition_t >
+inline void factorInverseDiagonal( decomposition_t const & , Eigen::VectorXd & inverseD ) {
+    inverseD.resize( 0 );
+}
+
+template< class matrix_t , class ordering_t >
+inline void factorInverseDiagonal( Eigen::SimplicialLDLT< matrix_t , Eigen::Lower , ordering_t > const & decomposition , Eigen::VectorXd & inverseD ) {
+    inverseD = decomposition.vectorD().cwiseInverse();
+}
+
+template< class decomposition_t >
+class directLinearSystemSolver : public linearSystemSolver {
+    decomposition_t _decomposition;
+    Eigen::VectorXd _Atb , _work , _inverseD;
+
+public:
+    bool factorize( csrMatrix const & A , csrMatrix const & At , bool patternIsUnchanged ) {
+        Eigen::SparseMatrix< double > const & leftMatrix = At * A;
+        if( ! patternIsUnchanged ) _decomposition.analyzePattern( leftMatrix );
+        _decomposition.factorize( leftMatrix );
+        if( _decomposition.info() != Eigen::Success ) return false;
+        factorInverseDiagonal( _decomposition , _inverseD );
+        _Atb.resize( At.rows() );   // the buffers of solve() , so that it does not allocate
+        _work.resize( At.rows() );
+        return true;
+    }
+
+    void solve( csrMatrix const & , csrMatrix const & At , Eigen::VectorXd const & b , Eigen::VectorXd & X , ThreadPool * threadPool ) {
+        multiplyCSR( At , b , _Atb , threadPool );
+        solveWithFactor( _decomposition , _inverseD , _Atb , X , _work );
+    }
+
+    unsigned long long memoryBytes() const { return factorMemoryBytes( _decomposition ); }
+};
+
+
+// Jacobi-preconditioned conjugate gradient on A^T A , from the solution of the previous solve() when there is one
+class conjugateGradientLinearSystemSolver : public linearSystemSolver {
+    double _relativeTolerance;
+    unsigned int _maxIterations , _iterations;
+    csrMatrix _AtA;
+    Eigen::VectorXd _inverseDiagonal , _previousX;
+    Eigen::VectorXd _rhs , _r , _z , _p , _q;   // A^T b , residual A^T b - A^T A X , preconditioned residual , direction , A^T A p
+
+public:
+    conjugateGradientLinearSystemSolver( double relativeTolerance , unsigned int maxIterations ) :
+        _relativeTolerance(relativeTolerance) , _maxIterations(maxIterations) , _iterations(0) {}
+
+    bool factorize( csrMatrix const & A , csrMatrix const & At , bool patternIsUnchanged ) {
+        _AtA = At * A;
+        _inverseDiagonal = _AtA.diagonal();
+        for( int c = 0 ; c < _inverseDiagonal.size() ; ++c )
+            _inverseDiagonal[c] = _inverseDiagonal[c] > 0.0 ? 1.0 / _inverseDiagonal[c] : 1.0;
+        if( ! patternIsUnchanged ) _previousX.resize( 0 );
+        return true;
+    }
+
+    void solve( csrMatrix const & , csrMatrix const & At , Eigen::VectorXd const & b , Eigen::VectorXd & X , ThreadPool * threadPool ) {
+        multiplyCSR( At , b , _rhs , threadPool );
+        if( _previousX.size() == _rhs.size() ) X = _previousX;
+        else X.setZero( _rhs.size() );
+        multiplyCSR( _AtA , X , _q , threadPool );
+        _r = _rhs - _q;
+        double threshold = _relativeTolerance * _rhs.norm();
+        _z = _inverseDiagonal.cwiseProduct( _r );
+        _p = _z;
+        double gamma = _r.dot( _z );
+        for( _iterations = 0 ; _iterations < _maxIterations  &&  _r.norm() > threshold ; ++_iterations ) {
+            multiplyCSR( _AtA , _p , _q , threadPool );
+            double pq = _p.dot( _q );
+            if( pq <= 0.0 ) break;
+            double alpha = gamma / pq;
+            X += alpha * _p;
+            _r -= alpha * _q;
+            _z = _inverseDiagonal.cwiseProduct( _r );
+            double newGamma = _r.dot( _z );
+            _p = _z + ( newGamma / gamma ) * _p;
+            gamma = newGamma;
+        }
+        _previousX = X;
+    }
+
+    unsigned long long memoryBytes() const {
+        return _AtA.nonZeros() * ( sizeof( double ) + sizeof( int ) ) + ( _AtA.rows() + 1 ) * sizeof( int ) +
+               ( _inverseDiagonal.size() + _previousX.size() + _rhs.size() + _r.size() + _z.size() + _p.size() + _q.size() ) * sizeof( double );
+    }
+    unsigned int lastIterations() const { return _iterations; }
+};
+
+
+// CGLS: conjugate gradient on A^T A X = A^T b with products by A and A^T only, preconditioned by the diagonal of A^T A
+// (the squared norms of the columns of A), from the solution of the previous solve() when there is one.
+//   Eigen 3.2 has no LeastSquaresConjugateGradient: this is the same iteration.
+class leastSquaresConjugateGradientLinearSystemSolver : public linearSystemSolver {
+    double _relativeTolerance;
+    unsigned int _maxIterations , _iterations;
+    Eigen::VectorXd _inverseDiagonal , _previousX;
+    Eigen::VectorXd _r , _q , _s , _z , _p;   // residual b - A X , A p , A^T r , preconditioned A^T r , direction
+
+public:
+    leastSquaresConjugateGradientLinearSystemSolver( double relativeTolerance , unsigned int maxIterations ) :
+        _relativeTolerance(relativeTolerance) , _maxIterations(maxIterations) , _iterations(0) {}
+
+    bool factorize( csrMatrix const & , csrMatrix const & At , bool patternIsUnchanged ) {
+        _inverseDiagonal.resize( At.rows() );
+        for( int c = 0 ; c < At.rows() ; ++c ) {
+            double squaredNorm = 0.0;
+            for( csrMatrix::InnerIterator it( At , c ) ; it ; ++it )
+                squaredNorm += it.value() * it.value();
+            _inverseDiagonal[c] = squaredNorm > 0.0 ? 1.0 / squaredNorm : 1.0;
+        }
+        if( ! patternIsUnchanged ) _previousX.resize( 0 );
+        return true;
+    }
+
+    void solve( csrMatrix const & A , csrMatrix const & At , Eigen::VectorXd const & b , Eigen::VectorXd & X , ThreadPool * threadPool ) {
+        if( _previousX.size() == A.cols() ) X = _previousX;
+        else X.setZero( A.cols() );
+        multiplyCSR( A , X , _q , threadPool );
+        _r = b - _q;
+        multiplyCSR( At , b , _s , threadPool );
+        double threshold = _relativeTolerance * _s.norm();
+        multiplyCSR( At , _r , _s , threadPool );
+        _z = _inverseDiagonal.cwiseProduct( _s );
+        _p = _z;
+        double gamma = _s.dot( _z );
+        for( _iterations = 0 ; _iterations < _maxIterations  &&  _s.norm() > threshold ; ++_iterations ) {
+            multiplyCSR( A , _p , _q , threadPool );
+            double qq = _q.squaredNorm();
+            if( qq <= 0.0 ) break;
+            double alpha = gamma / qq;
+            X += alpha * _p;
+            _r -= alpha * _q;
+            multiplyCSR( At , _r , _s , threadPool );
+            _z = _inverseDiagonal.cwiseProduct( _s );
+            double newGamma = _s.dot( _z );
+            _p = _z + ( newGamma / gamma ) * _p;
+            gamma = newGamma;
+        }
+        _previousX = X;
+    }
+
+    unsigned long long memoryBytes() const {
+        return ( _inverseDiagonal.size() + _previousX.size() + _s.size() + _z.size() + _p.size() + _r.size() + _q.size() ) * sizeof( double );
+    }
+    unsigned int lastIterations() const { return _iterations; }
+};
+
+
+
+//-------------------------------------------------------------------------------------//
+//
+// Least squares system min | A X - b |^2 , A sparse.
+//   A(row,column) = value sets an entry (the last value given wins) , A(row,column) += value adds to it.
+//   A is stored as compressed sparse rows. After setDimensions() , the entries given are kept in a list
+//   (24 bytes each) that preprocess() sorts into the rows, applying the writes to each entry in order;
+//   after preprocess() , the pattern is fixed: A(row,column) writes in the stored entry, and resetValues()
+//   sets all of them to 0 so that the same system can be assembled again in place, without allocating.
+//   A(row,column) of an entry out of the pattern goes back to the list. When the pattern did not change, preprocess() reuses the ordering
+//   and symbolic factorization of the previous one.
+//
+//-------------------------------------------------------------------------------------//
 class linearSystem {
-    std::vector< std::map< unsigned int , double > > _ASparse;
+    struct entry {
+        unsigned int row , column;
+        double value;
+        bool isAdded;   // += , otherwise =
+    };
+    std::vector< entry > _entries;     // given since setDimensions() , or since the pattern was left
+
+    csrMatrix _A , _At;
+    std::vector< int > _transposePositions;   // of each entry of _A in _At
+    bool _patternIsFixed;                     // _A holds all the entries, A() writes in it
+    unsigned int _patternVersion , _analyzedPatternVersion;
+    bool _lastPatternWasReused;
 
-    Eigen::SparseMatrix<double> _A , _At;
-    Eigen::SimplicialLDLT< Eigen::SparseMatrix<double> > _AtA_choleskyDecomposition;
+    std::unique_ptr< linearSystemSolver > _solver;
+    ThreadPool * _threadPool;
 
     Eigen::VectorXd _b;
 
     unsigned int _rows , _columns;
 
+    LinearSolver _solverType;
+    LinearSolverOrdering _ordering;
+    double _relativeTolerance;
+    unsigned int _maxIterations;
+    bool _factorizationIsOk;
+    double _lastFactorizationMs , _lastSolveMs;
+
+    template< class ordering_t >
+    linearSystemSolver * newDirectSolver() const {
+        typedef Eigen::SparseMatrix< double > matrix_t;
+        if( _solverType == LinearSolver_SimplicialLLT ) return new directLinearSystemSolver< Eigen::SimplicialLLT< matrix_t , Eigen::Lower , ordering_t > >;
+        if( _solverType == LinearSolver_SupernodalLU ) return new directLinearSystemSolver< Eigen::SparseLU< matrix_t , ordering_t > >;
+        return new directLinearSystemSolver< Eigen::SimplicialLDLT< matrix_t , Eigen::Lower , ordering_t > >;
+    }
+
+    linearSystemSolver * newSolver() const {
+        if( _solverType == LinearSolver_ConjugateGradient ) return new conjugateGradientLinearSystemSolver( _relativeTolerance , _maxIterations );
+        if( _solverType == LinearSolver_LeastSquaresCG ) return new leastSquaresConjugateGradientLinearSystemSolver( _relativeTolerance , _maxIterations );
+        if( _ordering == LinearSolverOrdering_COLAMD ) return newDirectSolver< Eigen::COLAMDOrdering< int > >();
+        if( _ordering == LinearSolverOrdering_Natural ) return newDirectSolver< Eigen::NaturalOrdering< int > >();
+        return newDirectSolver< Eigen::AMDOrdering< int > >();
+    }
+
+    // the entries of _A back into the list, before one out of the pattern is added
+    void leavePattern() {
+        _entries.reserve( _A.nonZeros() + 1 );
+        for( unsigned int r = 0 ; r < _rows ; ++r )
+            for( csrMatrix::InnerIterator it( _A , r ) ; it ; ++it ) {
+                entry e = { r , (unsigned int)it.col() , it.value() , false };
+                _entries.push_back( e );
+            }
+        _patternIsFixed = false;
+    }
+
+    // sorts the list into _A (the writes to an entry given several times are applied in their order) , keeps the
+    // pattern when it is the same: counting sort of the entries by row, then insertion sort of each (short) row
+    // by column, both stable
+    void buildMatrixFromEntries() {
+        std::vector< int > rowStart( _rows + 1 , 0 ) , columns( _entries.size() );
+        std::vector< double > values( _entries.size() );
+        std::vector< char > isAdded( _entries.size() );
+        for( unsigned int i = 0 ; i < _entries.size() ; ++i )
+            ++rowStart[ _entries[i].row + 1 ];
+        for( unsigned int r = 0 ; r < _rows ; ++r )
+            rowStart[r+1] += rowStart[r];
+        {
+            std::vector< int > next( rowStart.begin() , rowStart.end() - 1 );
+            for( unsigned int i = 0 ; i < _entries.size() ; ++i ) {
+                int k = next[ _entries[i].row ]++;
+                columns[k] = _entries[i].column;
+                values[k] = _entries[i].value;
+                isAdded[k] = _entries[i].isAdded;
+            }
+        }
+        std::vector< entry >().swap( _entries );
+
+        int nonZeros = 0;
+        for( unsigned int r = 0 ; r < _rows ; ++r ) {
+            int begin = rowStart[r] , end = rowStart[r+1];
+            for( int i = begin + 1 ; i < end ; ++i ) {
+                int column = columns[i];  double value = values[i];  char added = isAdded[i];
+                int j = i;
+                for( ; j > begin  &&  columns[j-1] > column ; --j ) {
+                    columns[j] = columns[j-1];
+                    values[j] = values[j-1];
+                    isAdded[j] = isAdded[j-1];
+                }
+                columns[j] = column;  values[j] = value;  isAdded[j] = added;
+            }
+            rowStart[r] = nonZeros;
+            for( int i = begin ; i < end ; ++i ) {
+                if( nonZeros > rowStart[r]  &&  columns[ nonZeros - 1 ] == columns[i] ) {
+                    if( isAdded[i] ) values[ nonZeros - 1 ] += values[i];
+                    else values[ nonZeros - 1 ] = values[i];
+                }
+                else {
+                    columns[ nonZeros ] = columns[i];
+                    values[ nonZeros ] = values[i];
+                    ++nonZeros;
+                }
+            }
+        }
+        rowStart[ _rows ] = nonZeros;
+        columns.resize( nonZeros );
+        values.resize( nonZeros );
+
+        bool patternIsUnchanged = _A.rows() == int( _rows )  &&  _A.cols() == int( _columns )  &&  _A.nonZeros() == int( columns.size() )  &&
+                                  std::equal( rowStart.begin() , rowStart.end() , _A.outerIndexPtr() )  &&
+                                  std::equal( columns.begin() , columns.end() , _A.innerIndexPtr() );
+        if( ! patternIsUnchanged ) {
+            _A.resize( _rows , _columns );
+            _A.resizeNonZeros( columns.size() );
+            std::copy( rowStart.begin() , rowStart.end() , _A.outerIndexPtr() );
+            std::copy( columns.begin() , columns.end() , _A.innerIndexPtr() );
+            buildTransposePattern();
+            ++_patternVersion;
+        }
+        std::copy( values.begin() , values.end() , _A.valuePtr() );
+        _patternIsFixed = true;
+    }
+
+    // pattern of _At (rows sorted since the rows of _A are visited in order) , and where each entry of _A goes
+    void buildTransposePattern() {
+        _At.resize( _columns , _rows );
+        _At.resizeNonZeros( _A.nonZeros() );
+        int * transposeRowStart = _At.outerIndexPtr();
+        std::fill( transposeRowStart , transposeRowStart + _columns + 1 , 0 );
+        for( int k = 0 ; k < _A.nonZeros() ; ++k )
+            ++transposeRowStart[ _A.innerIndexPtr()[k] + 1 ];
+        for( unsigned int c = 0 ; c < _columns ; ++c )
+            transposeRowStart[c+1] += transposeRowStart[c];
+        std::vector< int > next( transposeRowStart , transposeRowStart + _columns );
+        _transposePositions.resize( _A.nonZeros() );
+        for( unsigned int r = 0 ; r < _rows ; ++r )
+            for( int k = _A.outerIndexPtr()[r] ; k < _A.outerIndexPtr()[r+1] ; ++k ) {
+                int position = next[ _A.innerIndexPtr()[k] ]++;
+                _At.innerIndexPtr()[ position ] = r;
+                _transposePositions[k] = position;
+            }
+    }
+
+    // A(row,column) = value ( isAdded false ) or += value ( isAdded true )
+    void writeEntry( unsigned int row , unsigned int column , double value , bool isAdded ) {
+        if( _patternIsFixed ) {
+            int const * columns = _A.innerIndexPtr();
+            int const * rowEnd = columns + _A.outerIndexPtr()[row+1];
+            int const * found = std::lower_bound( columns + _A.outerIndexPtr()[row] , rowEnd , int( column ) );
+            if( found != rowEnd  &&  *found == int( column ) ) {
+                double & stored = _A.valuePtr()[ found - columns ];
+                stored = isAdded ? stored + value : value;
+                return;
+            }
+            leavePattern();
+        }
+        entry e = { row , column , value , isAdded };
+        _entries.push_back( e );
+    }
+
 public:
     linearSystem() {
         _rows = _columns = 0;
+        setDefaults();
     }
     linearSystem( int rows , int columns ) {
+        setDefaults();
         setDimensions(rows , columns);
     }
     ~linearSystem() {
     }
 
+    void setDefaults() {
+        _patternIsFixed = false;
+        _patternVersion = 1;
+        _analyzedPatternVersion = 0;
+        _lastPatternWasReused = false;
+        _threadPool = 0;
+        _solverType = LinearSolver_SimplicialLDLT;
+        _ordering = LinearSolverOrdering_AMD;
+        _relativeTolerance = 1e-10;
+        _maxIterations = 5000;
+        _factorizationIsOk = false;
+        _lastFactorizationMs = _lastSolveMs = 0.0;
+    }
+
     void setDimensions( int rows , int columns ) {
         _rows = rows; _columns = columns;
-        _ASparse.clear();
-        _ASparse.resize(_rows);
+        _entries.clear();
+        _patternIsFixed = false;
         _b.resize(_rows);
     }
+    unsigned int rows() const { return _rows; }
+    unsigned int columns() const { return _columns; }
 
-    double & A(unsigned int row , unsigned int column) {
-        return _ASparse[row][column];
+    // What A(row,column) returns, write only: the entries given before preprocess() are not looked up.
+    class entryWriter {
+        linearSystem & _system;
+        unsigned int _row , _column;
+    public:
+        entryWriter( linearSystem & system , unsigned int row , unsigned int column ) : _system(system) , _row(row) , _column(column) {}
+        entryWriter & operator = ( double value ) { _system.writeEntry( _row , _column , value , false ); return *this; }
+        entryWriter & operator += ( double value ) { _system.writeEntry( _row , _column , value , true ); return *this; }
+        entryWriter & operator -= ( double value ) { _system.writeEntry( _row , _column , - value , true ); return *this; }
+    };
+
+    // A(row,column) = value sets the entry , A(row,column) += value adds to it (both from 0 for a new entry).
+    entryWriter A(unsigned int row , unsigned int column) {
+        return entryWriter( *this , row , column );
     }
 
     double & b(unsigned int row) {
         return _b[ row ];
     }
 
+    // Keeps the pattern of the last preprocess() , with all its entries set to 0 (see A()).
+    void resetValues() {
+        if( _patternIsFixed ) std::fill( _A.valuePtr() , _A.valuePtr() + _A.nonZeros() , 0.0 );
+        else _entries.clear();
+    }
+
+    // Threads of the products by A and A^T (none by default)
+    void setThreadPool( ThreadPool * threadPool ) { _threadPool = threadPool; }
+
+    // Taken into account by the next preprocess().
+    void setSolver( LinearSolver solver , LinearSolverOrdering ordering = LinearSolverOrdering_AMD ) {
+        if( solver == _solverType  &&  ordering == _ordering ) return;
+        _solverType = solver;
+        _ordering = ordering;
+        _solver.reset();
+    }
+    LinearSolver solverType() const { return _solverType; }
+    LinearSolverOrdering ordering() const { return _ordering; }
+    // Iterative solvers: stop when | A^T ( b - A X ) | <= relativeTolerance | A^T b | , or after maxIterations.
+    void setIterativeSettings( double relativeTolerance , unsigned int maxIterations ) {
+        _relativeTolerance = relativeTolerance;
+        _maxIterations = maxIterations;
+        _solver.reset();
+    }
+
     void preprocess() {
-        // convert ad-hoc matrix to Eigen sparse format:
-        {
-            _A.resize(_rows , _columns);
-            std::vector< Eigen::Triplet< double > > triplets;
-            for( unsigned int r = 0 ; r < _rows ; ++r ) {
-                for( std::map< unsigned int , double >::const_iterator it = _ASparse[r].begin() ; it != _ASparse[r].end() ; ++it ) {
-                    unsigned int c = it->first;
-                    double val = it->second;
-                    triplets.push_back( Eigen::Triplet< double >(r,c,val) );
-                }
-            }
-            _A.setFromTriplets( triplets.begin() , triplets.end() );
-        }
-        _At = _A.transpose();
-        Eigen::SparseMatrix<double> const & leftMatrix = _At * _A;
-        _AtA_choleskyDecomposition.analyzePattern(leftMatrix);
-        _AtA_choleskyDecomposition.compute(leftMatrix);
+        if( ! _patternIsFixed ) buildMatrixFromEntries();
+        for( int k = 0 ; k < _A.nonZeros() ; ++k )
+            _At.valuePtr()[ _transposePositions[k] ] = _A.valuePtr()[k];
+
+        Timer timer;
+        bool patternIsUnchanged = ( _solver  &&  _analyzedPatternVersion == _patternVersion );
+        if( ! _solver ) _solver.reset( newSolver() );
+        _factorizationIsOk = _solver->factorize( _A , _At , patternIsUnchanged );
+        _lastPatternWasReused = patternIsUnchanged;
+        _analyzedPatternVersion = _patternVersion;
+        _lastFactorizationMs = timer.elapsedMs();
     }
 
     void solve( Eigen::VectorXd & X ) {
-        X = _AtA_choleskyDecomposition.solve( _At * _b );
+        Timer timer;
+        _solver->solve( _A , _At , _b , X , _threadPool );
+        _lastSolveMs = timer.elapsedMs();
     }
+
+    // AX = A X , with the matrix of the last preprocess()
+    void multiplyA( Eigen::VectorXd const & X , Eigen::VectorXd & AX ) const {
+        multiplyCSR( _A , X , AX , _threadPool );
+    }
+
+    // Sparse matrix and right-hand side of the last preprocess()
+    csrMatrix const & matrix() const { return _A; }
+    Eigen::VectorXd const & rhs() const { return _b; }
+
+    // | A^T ( A X - b ) | / | A^T b | : 0 at the least squares solution
+    double relativeResidual( Eigen::VectorXd const & X ) const {
+        Eigen::VectorXd AX , Atb , AtResidual;
+        multiplyCSR( _A , X , AX , _threadPool );
+        multiplyCSR( _At , _b , Atb , _threadPool );
+        multiplyCSR( _At , Eigen::VectorXd( AX - _b ) , AtResidual , _threadPool );
+        double norm = Atb.norm();
+        return norm > 0.0 ? AtResidual.norm() / norm : AtResidual.norm();
+    }
+
+    // Of the last preprocess() and solve()
+    bool factorizationIsOk() const { return _factorizationIsOk; }
+    bool lastPatternWasReused() const { return _lastPatternWasReused; }   // symbolic analysis of the previous preprocess()
+    double lastFactorizationMs() const { return _lastFactorizationMs; }
+    double lastSolveMs() const { return _lastSolveMs; }
+    unsigned int lastIterations() const { return _solver ? _solver->lastIterations() : 0; }
+    unsigned long long solverMemoryBytes() const { return _solver ? _solver->memoryBytes() : 0; }
 };
 
 #endif // linearSystem_H